@@ -0,0 +1,230 @@
+/** @file
+
+MODULE                : BitrateBudget
+
+FILE NAME             : BitrateBudget.h
+
+DESCRIPTION           : Tracks the payload bytes of the kept frames in a sliding window so that the output stays
+                        under a bit rate limit. Protected frames are always kept and disposable frames only if
+                        they fit next to the recent peak of the protected frames.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "FrameTime.h"
+
+// the window remembers at most this many kept frames: older frames leave it early
+const unsigned FSKIP_BUDGET_MAX_FRAMES = 4096;
+// the headroom for protected frames is their peak over the last one or two periods of this many windows
+const unsigned FSKIP_BUDGET_PEAK_WINDOWS = 4;
+
+/**
+ * @brief The bytes of the frames kept within a sliding window of time against the budget of a bit rate limit.
+ *
+ * Protected frames, i.e. sync points and reference frames, are always kept and count against the budget. Disposable
+ * frames are the cheapest to drop and are only kept if they fit into the budget: near the limit the larger ones are
+ * dropped first. Disposable frames leave room for the highest protected bytes seen in a window recently, so that the
+ * protected frames that arrive after them do not take the window over the limit unless they outgrow that peak, e.g.
+ * a key frame further apart than the window. Until the first window is complete the protected bytes so far are
+ * extrapolated to a whole window. The kept frames are stored in a ring buffer that is allocated once:
+ * each frame costs O(1) amortised.
+ */
+class BitrateBudget
+{
+public:
+
+  BitrateBudget()
+    :m_uiMaxBitrate(0),
+    m_iWindow(TIMESTAMP_TICKS_PER_SECOND),
+    m_uiBudgetBytes(0)
+  {
+    reset();
+  }
+
+  /**
+   * @brief sets the limit and the length of the window. The ring buffer is allocated on the first limit.
+   * @param uiMaxBitrate in bits per second. 0 = no limit
+   * @param iWindow in 100 ns units
+   */
+  void setLimit(uint64_t uiMaxBitrate, int64_t iWindow)
+  {
+    m_uiMaxBitrate = uiMaxBitrate;
+    m_iWindow = std::max<int64_t>(iWindow, 1);
+    // split so that neither product overflows for long windows
+    uint64_t uiBytesPerSecond = uiMaxBitrate / 8;
+    uint64_t uiSeconds = static_cast<uint64_t>(m_iWindow / TIMESTAMP_TICKS_PER_SECOND);
+    uint64_t uiTicks = static_cast<uint64_t>(m_iWindow % TIMESTAMP_TICKS_PER_SECOND);
+    m_uiBudgetBytes = uiBytesPerSecond * uiSeconds + uiBytesPerSecond * uiTicks / TIMESTAMP_TICKS_PER_SECOND;
+    if (uiMaxBitrate > 0 && m_vFrames.empty())
+      m_vFrames.resize(FSKIP_BUDGET_MAX_FRAMES);
+  }
+
+  bool isLimited() const
+  {
+    return m_uiMaxBitrate > 0;
+  }
+
+  uint64_t getMaxBitrate() const
+  {
+    return m_uiMaxBitrate;
+  }
+
+  int64_t getWindow() const
+  {
+    return m_iWindow;
+  }
+
+  /// the bytes of the kept frames in the window as of the last frame
+  uint64_t getWindowBytes() const
+  {
+    return m_uiWindowBytes;
+  }
+
+  /// forgets the kept frames, e.g. when streaming restarts
+  void reset()
+  {
+    m_uiFirst = 0;
+    m_uiCount = 0;
+    m_uiWindowBytes = 0;
+    m_uiProtectedBytes = 0;
+    m_auiPeakProtectedBytes[0] = m_auiPeakProtectedBytes[1] = 0;
+    m_bPeriodStarted = false;
+    m_tPeriod = 0;
+    m_bStarted = false;
+    m_tFirst = 0;
+  }
+
+  /**
+   * @brief decides whether a frame fits into the budget. The frame only counts once it is added.
+   * @param bProtected sync points and reference frames are always kept
+   */
+  bool fits(int64_t tStart, uint32_t uiBytes, bool bProtected)
+  {
+    if (!isLimited())
+      return true;
+
+    evict(tStart);
+    if (!m_bStarted)
+    {
+      m_bStarted = true;
+      m_tFirst = tStart;
+    }
+    if (bProtected)
+      return true;
+    uint64_t uiDisposableBytes = m_uiWindowBytes - m_uiProtectedBytes;
+    uint64_t uiReserve = std::max(m_uiProtectedBytes, std::max(m_auiPeakProtectedBytes[0], m_auiPeakProtectedBytes[1]));
+    int64_t iElapsed = tStart - m_tFirst;
+    if (iElapsed < m_iWindow && m_uiProtectedBytes > 0)
+    {
+      if (iElapsed <= 0)
+        return false;
+      uiReserve = std::max(uiReserve, m_uiProtectedBytes * static_cast<uint64_t>(m_iWindow) / static_cast<uint64_t>(iElapsed));
+    }
+    return uiDisposableBytes + uiBytes + uiReserve <= m_uiBudgetBytes;
+  }
+
+  /// adds a kept frame to the window
+  void add(int64_t tStart, uint32_t uiBytes, bool bProtected)
+  {
+    if (!isLimited())
+      return;
+
+    if (m_uiCount == m_vFrames.size())
+      removeFirst();
+    KeptFrame& frame = m_vFrames[(m_uiFirst + m_uiCount) % m_vFrames.size()];
+    frame.Start = tStart;
+    frame.Bytes = uiBytes;
+    frame.Protected = bProtected;
+    ++m_uiCount;
+    m_uiWindowBytes += uiBytes;
+    if (bProtected)
+    {
+      m_uiProtectedBytes += uiBytes;
+      // the protected bytes of a window peak just after a protected frame
+      updatePeak(tStart);
+    }
+  }
+
+private:
+
+  struct KeptFrame
+  {
+    int64_t Start;
+    uint32_t Bytes;
+    bool Protected;
+  };
+
+  /// removes the frames that left the window (tStart - window, tStart]
+  void evict(int64_t tStart)
+  {
+    while (m_uiCount > 0 && m_vFrames[m_uiFirst].Start <= tStart - m_iWindow)
+      removeFirst();
+  }
+
+  void removeFirst()
+  {
+    const KeptFrame& frame = m_vFrames[m_uiFirst];
+    m_uiWindowBytes -= frame.Bytes;
+    if (frame.Protected)
+      m_uiProtectedBytes -= frame.Bytes;
+    m_uiFirst = (m_uiFirst + 1) % m_vFrames.size();
+    --m_uiCount;
+  }
+
+  /// keeps the peaks of the current and the previous period. A peak older than that is forgotten.
+  void updatePeak(int64_t tStart)
+  {
+    const int64_t iPeriod = m_iWindow * FSKIP_BUDGET_PEAK_WINDOWS;
+    if (!m_bPeriodStarted || tStart - m_tPeriod >= iPeriod)
+    {
+      m_auiPeakProtectedBytes[1] = (m_bPeriodStarted && tStart - m_tPeriod < 2 * iPeriod) ? m_auiPeakProtectedBytes[0] : 0;
+      m_auiPeakProtectedBytes[0] = 0;
+      m_bPeriodStarted = true;
+      m_tPeriod = tStart;
+    }
+    m_auiPeakProtectedBytes[0] = std::max(m_auiPeakProtectedBytes[0], m_uiProtectedBytes);
+  }
+
+  uint64_t m_uiMaxBitrate;
+  int64_t m_iWindow;
+  uint64_t m_uiBudgetBytes;
+  // ring buffer of the kept frames in the window, oldest first
+  std::vector<KeptFrame> m_vFrames;
+  size_t m_uiFirst;
+  size_t m_uiCount;
+  uint64_t m_uiWindowBytes;
+  uint64_t m_uiProtectedBytes;
+  // the highest protected bytes in the window in the current and the previous period
+  uint64_t m_auiPeakProtectedBytes[2];
+  bool m_bPeriodStarted;
+  int64_t m_tPeriod;
+  // the start of the first frame since the last reset
+  bool m_bStarted;
+  int64_t m_tFirst;
+};
@@ -0,0 +1,129 @@
+/** @file
+
+MODULE                : ConfigSnapshot
+
+FILE NAME             : ConfigSnapshot.h
+
+DESCRIPTION           : Publishes configuration snapshots from control threads to the streaming thread.
+                        Reading never takes a lock and costs one atomic load while nothing changes.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Double buffered, read-copy-update style configuration snapshot.
+ *
+ * Writers fill the slot that readers are not directed to, wait until no reader is still copying
+ * it and then flip the generation counter. Writers are serialized by a mutex. Readers count
+ * themselves into the current slot, confirm that the generation did not change meanwhile and copy
+ * the snapshot: they never block and only retry if a writer published concurrently.
+ * T must be copy assignable.
+ */
+template <typename T>
+class ConfigSnapshot
+{
+public:
+
+  ConfigSnapshot()
+    :m_uiGeneration(0)
+  {
+    m_aReaders[0].store(0);
+    m_aReaders[1].store(0);
+  }
+
+  explicit ConfigSnapshot(const T& config)
+    :m_uiGeneration(0)
+  {
+    m_aReaders[0].store(0);
+    m_aReaders[1].store(0);
+    m_aSlots[0] = config;
+  }
+
+  /// the number of snapshots published so far
+  uint64_t getGeneration() const
+  {
+    return m_uiGeneration.load(std::memory_order_acquire);
+  }
+
+  /// publishes a new snapshot. May be called from any thread.
+  void publish(const T& config)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t uiGeneration = m_uiGeneration.load(std::memory_order_relaxed);
+    unsigned uiSlot = static_cast<unsigned>((uiGeneration + 1) & 1);
+    // readers that picked up this slot before the last flip may still be copying it
+    while (m_aReaders[uiSlot].load() != 0)
+      std::this_thread::yield();
+    m_aSlots[uiSlot] = config;
+    m_uiGeneration.fetch_add(1);
+  }
+
+  /**
+   * @brief copies the current snapshot if it is newer than ruiGeneration.
+   * @param ruiGeneration the generation of rConfig, updated on return. UINT64_MAX forces a copy.
+   * @return true if rConfig was updated
+   */
+  bool update(T& rConfig, uint64_t& ruiGeneration) const
+  {
+    // fast path while nothing changes
+    if (m_uiGeneration.load(std::memory_order_acquire) == ruiGeneration)
+      return false;
+
+    while (true)
+    {
+      uint64_t uiGeneration = m_uiGeneration.load();
+      unsigned uiSlot = static_cast<unsigned>(uiGeneration & 1);
+      m_aReaders[uiSlot].fetch_add(1);
+      // a writer that flipped after the load above may be overwriting the slot
+      if (m_uiGeneration.load() == uiGeneration)
+      {
+        rConfig = m_aSlots[uiSlot];
+        m_aReaders[uiSlot].fetch_sub(1);
+        ruiGeneration = uiGeneration;
+        return true;
+      }
+      m_aReaders[uiSlot].fetch_sub(1);
+    }
+  }
+
+private:
+
+  ConfigSnapshot(const ConfigSnapshot&);
+  ConfigSnapshot& operator=(const ConfigSnapshot&);
+
+  // serializes writers
+  std::mutex m_mutex;
+  // the current snapshot is in slot generation % 2
+  std::atomic<uint64_t> m_uiGeneration;
+  // readers that are copying each slot
+  mutable std::atomic<unsigned> m_aReaders[2];
+  T m_aSlots[2];
+};
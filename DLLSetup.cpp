@@ -33,10 +33,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "stdafx.h"
 #include "FrameSkippingFilter.h"
+#include "FrameSkippingFanOutFilter.h"
 #include "FrameSkippingProperties.h"
 //////////////////////////////////////////////////////////////////////////
 //###############################  Standard Filter DLL Code ###############################
 static const WCHAR g_wszName[] = L"CSIR VPP Frame Skipping Filter";   /// A name for the filter 
+static const WCHAR g_wszFanOutName[] = L"CSIR VPP Frame Skipping Fan-out Filter";
 
 // The next bunch of structures define information for the class factory.
 AMOVIESETUP_FILTER FilterInfo =
@@ -48,6 +50,15 @@ AMOVIESETUP_FILTER FilterInfo =
   NULL                            // Pin registration information.
 };
 
+AMOVIESETUP_FILTER FanOutFilterInfo =
+{
+  &CLSID_VPP_FrameSkippingFanOutFilter, // CLSID
+  g_wszFanOutName,                      // Name
+  MERIT_DO_NOT_USE,                     // Merit
+  0,                                    // Number of AMOVIESETUP_PIN structs
+  NULL                                  // Pin registration information.
+};
+
 CFactoryTemplate g_Templates[] =
 {
   {
@@ -57,6 +68,13 @@ CFactoryTemplate g_Templates[] =
     NULL,                                 // Initialization function
     &FilterInfo                           // Set-up information (for filters)
   },
+  {
+    g_wszFanOutName,
+    &CLSID_VPP_FrameSkippingFanOutFilter,
+    FrameSkippingFanOutFilter::CreateInstance,
+    NULL,
+    &FanOutFilterInfo
+  },
   // This entry is for the property page.
   {
     L"Frame Skipping Properties",
@@ -0,0 +1,393 @@
+/** @file
+
+MODULE                : FrameAnalysisPool
+
+FILE NAME             : FrameAnalysisPool.h
+
+DESCRIPTION           : Worker threads that compute the signature and statistics of frames stripe by stripe off the
+                        streaming thread. Results are handed back lock-free and may be skipped if they miss a deadline.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FrameSignature.h"
+
+// the most worker threads of a FrameAnalysisPool
+const unsigned FSKIP_ANALYSIS_MAX_THREADS = 16;
+// frames in analysis at the same time, including frames whose result came too late and is still being finished
+const unsigned FSKIP_ANALYSIS_SLOTS = 4;
+// signature block rows per stripe: 32 pixel rows
+const int FSKIP_ANALYSIS_STRIPE_BLOCK_ROWS = 4;
+// in 100 ns units: the longest the caller waits for an analysis if it has no deadline of its own
+const int64_t FSKIP_ANALYSIS_MAX_WAIT = 10000000;
+
+/// the results of analysing the pixels of a frame
+struct FrameAnalysis
+{
+  FrameAnalysis()
+    :Gradient(0)
+  {
+    std::memset(Histogram, 0, sizeof(Histogram));
+  }
+
+  /// compared between frames to measure their difference
+  FrameSignature Signature;
+  /// luma histogram. Only filled if the pool computes statistics.
+  uint32_t Histogram[256];
+  /// the sum of absolute differences of horizontally adjacent luma values: larger for sharper frames
+  uint64_t Gradient;
+};
+
+/**
+ * @brief Worker threads that analyse frames stripe by stripe off the streaming thread.
+ *
+ * The streaming thread submits a frame to one of FSKIP_ANALYSIS_SLOTS slots and later reads the finished result of
+ * that slot, typically one frame later while the previous frame is being delivered, and then releases the slot.
+ * Submitting and reading only use atomics: the slot state is published with release and read with acquire semantics,
+ * and the workers claim stripes with an atomic counter. Idle workers sleep on a condition variable, and a caller
+ * waiting for a result sleeps on a second one that the workers signal when they finish a frame. If a result
+ * is not ready by its deadline the caller decides without it and releases the slot anyway: the workers free it once
+ * they are done with the pixel data, which must stay valid until isIdle returns true for the slot.
+ */
+class FrameAnalysisPool
+{
+public:
+
+  FrameAnalysisPool()
+    :m_bStatistics(false),
+    m_bStop(false),
+    m_uiGeneration(0),
+    m_uiSubmitted(0)
+  {
+    for (unsigned i = 0; i < FSKIP_ANALYSIS_SLOTS; ++i)
+    {
+      m_aSlots[i].State.store(SLOT_FREE, std::memory_order_relaxed);
+      m_aSlots[i].Ticket.store(0, std::memory_order_relaxed);
+      m_aSlots[i].Stripes.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  ~FrameAnalysisPool()
+  {
+    stop();
+  }
+
+  /**
+   * @brief starts uiThreads workers after stopping the current ones. 0 stops the pool.
+   * @param bStatistics also computes the luma histogram and gradient of each frame
+   */
+  void start(unsigned uiThreads, bool bStatistics = false)
+  {
+    stop();
+    m_bStatistics = bStatistics;
+    m_bStop = false;
+    uiThreads = std::min(uiThreads, FSKIP_ANALYSIS_MAX_THREADS);
+    for (unsigned i = 0; i < uiThreads; ++i)
+      m_vWorkers.push_back(std::thread(&FrameAnalysisPool::work, this));
+  }
+
+  /// finishes the frames in analysis and stops the workers
+  void stop()
+  {
+    if (m_vWorkers.empty())
+      return;
+    drain();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_bStop = true;
+    }
+    m_wakeUp.notify_all();
+    for (size_t i = 0; i < m_vWorkers.size(); ++i)
+      m_vWorkers[i].join();
+    m_vWorkers.clear();
+  }
+
+  bool isRunning() const
+  {
+    return !m_vWorkers.empty();
+  }
+
+  unsigned getThreads() const
+  {
+    return static_cast<unsigned>(m_vWorkers.size());
+  }
+
+  /**
+   * @brief starts the analysis of a frame. Memory is only allocated if the frame size changes.
+   * @return the slot of the frame, -1 if the pool is stopped, no slot is idle or the picture cannot be analysed
+   */
+  int submit(const FramePicture& picture)
+  {
+    if (!isRunning())
+      return -1;
+    int iSlot = -1;
+    for (unsigned i = 0; i < FSKIP_ANALYSIS_SLOTS; ++i)
+    {
+      if (m_aSlots[i].State.load(std::memory_order_acquire) == SLOT_FREE)
+      {
+        iSlot = static_cast<int>(i);
+        break;
+      }
+    }
+    if (iSlot < 0)
+      return -1;
+
+    Slot& slot = m_aSlots[iSlot];
+    if (!slot.Analysis.Signature.resize(picture))
+      return -1;
+    slot.Picture = picture;
+    const int iBlockRows = slot.Analysis.Signature.getHeight();
+    const int iStripes = (iBlockRows + FSKIP_ANALYSIS_STRIPE_BLOCK_ROWS - 1) / FSKIP_ANALYSIS_STRIPE_BLOCK_ROWS;
+    if (m_bStatistics)
+    {
+      slot.StripeHistograms.resize(static_cast<size_t>(iStripes) * 256);
+      slot.StripeGradients.resize(iStripes);
+    }
+    ++m_uiSubmitted;
+    slot.Stripes.store(iStripes, std::memory_order_relaxed);
+    slot.DoneStripes.store(0, std::memory_order_relaxed);
+    // publishes the frame to the workers that claim its stripes
+    slot.Ticket.store(m_uiSubmitted << 32, std::memory_order_release);
+    slot.State.store(SLOT_BUSY, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_uiGeneration = m_uiSubmitted;
+    }
+    m_wakeUp.notify_all();
+    return iSlot;
+  }
+
+  /// true once the analysis of the frame in the slot is complete
+  bool isDone(int iSlot) const
+  {
+    return m_aSlots[iSlot].State.load(std::memory_order_acquire) == SLOT_DONE;
+  }
+
+  /// true if no worker reads the picture of the slot anymore
+  bool isIdle(int iSlot) const
+  {
+    unsigned uiState = m_aSlots[iSlot].State.load(std::memory_order_acquire);
+    return uiState == SLOT_FREE || uiState == SLOT_DONE;
+  }
+
+  /// the result of the slot is not read anymore: a slot still in analysis is freed by the workers once they are done
+  void release(int iSlot)
+  {
+    std::atomic<unsigned>& state = m_aSlots[iSlot].State;
+    unsigned uiState = state.load(std::memory_order_relaxed);
+    while (true)
+    {
+      if (uiState == SLOT_DONE && state.compare_exchange_weak(uiState, SLOT_FREE, std::memory_order_relaxed))
+        return;
+      if (uiState == SLOT_BUSY && state.compare_exchange_weak(uiState, SLOT_ABANDONED, std::memory_order_relaxed))
+        return;
+      if (uiState != SLOT_DONE && uiState != SLOT_BUSY)
+        return;
+    }
+  }
+
+  /**
+   * @brief waits for the analysis of the frame in the slot until the deadline.
+   * @return NULL if the analysis missed the deadline. The result stays valid until the slot is released.
+   */
+  const FrameAnalysis* waitFor(int iSlot, std::chrono::steady_clock::time_point tDeadline) const
+  {
+    if (!isDone(iSlot))
+    {
+      std::unique_lock<std::mutex> lock(m_finishedMutex);
+      if (!m_finished.wait_until(lock, tDeadline, [this, iSlot]() { return isDone(iSlot); }))
+        return NULL;
+    }
+    return &m_aSlots[iSlot].Analysis;
+  }
+
+  /// waits until the workers are done with the pixel data of every submitted frame
+  void drain() const
+  {
+    std::unique_lock<std::mutex> lock(m_finishedMutex);
+    for (unsigned i = 0; i < FSKIP_ANALYSIS_SLOTS; ++i)
+    {
+      while (!isIdle(i))
+        m_finished.wait(lock);
+    }
+  }
+
+private:
+
+  enum SlotState
+  {
+    SLOT_FREE = 0,
+    // in analysis
+    SLOT_BUSY = 1,
+    // the result is ready and not released yet
+    SLOT_DONE = 2,
+    // released while in analysis
+    SLOT_ABANDONED = 3
+  };
+
+  struct Slot
+  {
+    FramePicture Picture;
+    FrameAnalysis Analysis;
+    // the number of the frame in the upper 32 bits and the next stripe to be analysed in the lower 32 bits: a
+    // worker can only claim a stripe of the frame whose stripe count it read
+    std::atomic<uint64_t> Ticket;
+    std::atomic<int> Stripes;
+    std::atomic<int> DoneStripes;
+    std::atomic<unsigned> State;
+    // the statistics of each stripe are added up by the worker that finishes the last stripe
+    std::vector<uint32_t> StripeHistograms;
+    std::vector<uint64_t> StripeGradients;
+  };
+
+  void work()
+  {
+    // scratch buffers of this worker: reallocated only if the frame width grows
+    std::vector<uint16_t> vSums;
+    std::vector<uint8_t> vLuma;
+    uint64_t uiSeen = 0;
+    while (true)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_bStop && m_uiGeneration == uiSeen)
+          m_wakeUp.wait(lock);
+        if (m_bStop)
+          return;
+        uiSeen = m_uiGeneration;
+      }
+      Slot* pSlot = NULL;
+      int iStripe = 0;
+      while (claimStripe(pSlot, iStripe))
+      {
+        analyseStripe(*pSlot, iStripe, vSums, vLuma);
+        if (pSlot->DoneStripes.fetch_add(1, std::memory_order_acq_rel) + 1 == pSlot->Stripes.load(std::memory_order_relaxed))
+          finish(*pSlot);
+      }
+    }
+  }
+
+  /// claims the next stripe of the oldest frame with stripes left. Returns false if there is none.
+  bool claimStripe(Slot*& rpSlot, int& riStripe)
+  {
+    while (true)
+    {
+      Slot* pOldest = NULL;
+      uint64_t uiOldest = 0;
+      for (unsigned i = 0; i < FSKIP_ANALYSIS_SLOTS; ++i)
+      {
+        Slot& slot = m_aSlots[i];
+        uint64_t uiTicket = slot.Ticket.load(std::memory_order_acquire);
+        if (isIdle(i) || static_cast<int>(uiTicket & 0xFFFFFFFF) >= slot.Stripes.load(std::memory_order_relaxed))
+          continue;
+        if (pOldest == NULL || uiTicket < uiOldest)
+        {
+          pOldest = &slot;
+          uiOldest = uiTicket;
+        }
+      }
+      if (pOldest == NULL)
+        return false;
+      // fails if another worker claimed the stripe first or the slot was submitted to again
+      if (pOldest->Ticket.compare_exchange_strong(uiOldest, uiOldest + 1, std::memory_order_acq_rel))
+      {
+        rpSlot = pOldest;
+        riStripe = static_cast<int>(uiOldest & 0xFFFFFFFF);
+        return true;
+      }
+    }
+  }
+
+  void analyseStripe(Slot& slot, int iStripe, std::vector<uint16_t>& vSums, std::vector<uint8_t>& vLuma)
+  {
+    FrameSignature& signature = slot.Analysis.Signature;
+    vSums.resize(std::max(vSums.size(), static_cast<size_t>(signature.getWidth())));
+    vLuma.resize(std::max(vLuma.size(), static_cast<size_t>(signature.getWidth()) * FSKIP_SIGNATURE_BLOCK_SIZE));
+    int iFirst = iStripe * FSKIP_ANALYSIS_STRIPE_BLOCK_ROWS;
+    int iRows = std::min(FSKIP_ANALYSIS_STRIPE_BLOCK_ROWS, signature.getHeight() - iFirst);
+    if (!m_bStatistics)
+    {
+      signature.computeBlockRows(slot.Picture, iFirst, iRows, &vSums[0], &vLuma[0]);
+      return;
+    }
+    uint32_t* pHistogram = &slot.StripeHistograms[static_cast<size_t>(iStripe) * 256];
+    std::fill(pHistogram, pHistogram + 256, 0u);
+    slot.StripeGradients[iStripe] = 0;
+    signature.computeBlockRows(slot.Picture, iFirst, iRows, &vSums[0], &vLuma[0], pHistogram, &slot.StripeGradients[iStripe]);
+  }
+
+  /// adds up the statistics of the stripes and publishes the result
+  void finish(Slot& slot)
+  {
+    if (m_bStatistics)
+    {
+      FrameAnalysis& analysis = slot.Analysis;
+      std::fill(analysis.Histogram, analysis.Histogram + 256, 0u);
+      analysis.Gradient = 0;
+      const int iStripes = slot.Stripes.load(std::memory_order_relaxed);
+      for (int iStripe = 0; iStripe < iStripes; ++iStripe)
+      {
+        const uint32_t* pHistogram = &slot.StripeHistograms[static_cast<size_t>(iStripe) * 256];
+        for (int iBin = 0; iBin < 256; ++iBin)
+          analysis.Histogram[iBin] += pHistogram[iBin];
+        analysis.Gradient += slot.StripeGradients[iStripe];
+      }
+    }
+    // the result of an abandoned slot is not read
+    unsigned uiState = SLOT_BUSY;
+    if (!slot.State.compare_exchange_strong(uiState, SLOT_DONE, std::memory_order_release, std::memory_order_relaxed))
+      slot.State.store(SLOT_FREE, std::memory_order_release);
+    // a waiter that has just seen the slot busy is already waiting once the lock is free
+    {
+      std::lock_guard<std::mutex> lock(m_finishedMutex);
+    }
+    m_finished.notify_all();
+  }
+
+  bool m_bStatistics;
+  Slot m_aSlots[FSKIP_ANALYSIS_SLOTS];
+  std::vector<std::thread> m_vWorkers;
+  // wakes idle workers when a frame is submitted
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  bool m_bStop;
+  // wakes the caller waiting for a result or for the workers to drain when a frame is finished
+  mutable std::mutex m_finishedMutex;
+  mutable std::condition_variable m_finished;
+  // the last frame submitted as seen by the workers
+  uint64_t m_uiGeneration;
+  // streaming thread: the number of submitted frames
+  uint64_t m_uiSubmitted;
+};
@@ -0,0 +1,221 @@
+/** @file
+
+MODULE                : FrameKernels
+
+FILE NAME             : FrameKernels.cpp
+
+DESCRIPTION           : Scalar reference kernels and the CPUID based selection of the fastest kernels.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameKernels.h"
+#include "FrameKernelsImpl.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(FSKIP_HAVE_SSE2) || defined(FSKIP_HAVE_AVX2)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+void scalarRgb24ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  for (int i = 0; i < iWidth; ++i, pSrc += 3)
+  {
+    pDst[i] = static_cast<uint8_t>((29 * pSrc[0] + 150 * pSrc[1] + 77 * pSrc[2] + 128) >> 8);
+  }
+}
+
+void scalarRgb32ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  for (int i = 0; i < iWidth; ++i, pSrc += 4)
+  {
+    pDst[i] = static_cast<uint8_t>((29 * pSrc[0] + 150 * pSrc[1] + 77 * pSrc[2] + 128) >> 8);
+  }
+}
+
+void scalarYuy2ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  for (int i = 0; i < iWidth; ++i, pSrc += 2)
+  {
+    pDst[i] = *pSrc;
+  }
+}
+
+void scalarSumBlocks(const uint8_t* pRow, int iBlocks, uint16_t* pSums)
+{
+  for (int iBlock = 0; iBlock < iBlocks; ++iBlock, pRow += FSKIP_KERNEL_BLOCK_WIDTH)
+  {
+    unsigned uiSum = 0;
+    for (int i = 0; i < FSKIP_KERNEL_BLOCK_WIDTH; ++i)
+      uiSum += pRow[i];
+    pSums[iBlock] = static_cast<uint16_t>(pSums[iBlock] + uiSum);
+  }
+}
+
+uint64_t scalarSad(const uint8_t* pA, const uint8_t* pB, size_t uiLength)
+{
+  uint64_t uiSad = 0;
+  for (size_t i = 0; i < uiLength; ++i)
+  {
+    uiSad += static_cast<unsigned>(std::abs(static_cast<int>(pA[i]) - static_cast<int>(pB[i])));
+  }
+  return uiSad;
+}
+
+void scalarHistogram(const uint8_t* pData, size_t uiLength, uint32_t* pHistogram)
+{
+  // four partial histograms so that runs of equal values do not serialise on one counter
+  uint32_t aPartial[4][256];
+  std::memset(aPartial, 0, sizeof(aPartial));
+  size_t i = 0;
+  for (; i + 4 <= uiLength; i += 4)
+  {
+    ++aPartial[0][pData[i]];
+    ++aPartial[1][pData[i + 1]];
+    ++aPartial[2][pData[i + 2]];
+    ++aPartial[3][pData[i + 3]];
+  }
+  for (; i < uiLength; ++i)
+    ++aPartial[0][pData[i]];
+  for (int iBin = 0; iBin < 256; ++iBin)
+    pHistogram[iBin] += aPartial[0][iBin] + aPartial[1][iBin] + aPartial[2][iBin] + aPartial[3][iBin];
+}
+
+namespace
+{
+
+const FrameKernels g_scalarKernels =
+{
+  "scalar",
+  scalarRgb24ToLuma,
+  scalarRgb32ToLuma,
+  scalarYuy2ToLuma,
+  scalarSumBlocks,
+  scalarSad,
+  scalarHistogram
+};
+
+#if defined(FSKIP_HAVE_SSE2) || defined(FSKIP_HAVE_AVX2)
+void cpuid(int iLeaf, int iSubLeaf, unsigned aRegs[4])
+{
+#if defined(_MSC_VER)
+  int aInfo[4];
+  __cpuidex(aInfo, iLeaf, iSubLeaf);
+  for (int i = 0; i < 4; ++i)
+    aRegs[i] = static_cast<unsigned>(aInfo[i]);
+#else
+  __cpuid_count(iLeaf, iSubLeaf, aRegs[0], aRegs[1], aRegs[2], aRegs[3]);
+#endif
+}
+
+bool cpuSupportsSse2()
+{
+  unsigned aRegs[4];
+  cpuid(1, 0, aRegs);
+  return (aRegs[3] & (1u << 26)) != 0;
+}
+
+bool cpuSupportsAvx2()
+{
+  unsigned aRegs[4];
+  cpuid(0, 0, aRegs);
+  if (aRegs[0] < 7)
+    return false;
+  cpuid(1, 0, aRegs);
+  // the OS must save the YMM registers: OSXSAVE and AVX, then XCR0 bits 1 and 2
+  const unsigned OSXSAVE_AVX = (1u << 27) | (1u << 28);
+  if ((aRegs[2] & OSXSAVE_AVX) != OSXSAVE_AVX)
+    return false;
+#if defined(_MSC_VER)
+  unsigned long long uiXcr0 = _xgetbv(0);
+#else
+  unsigned uiEax = 0, uiEdx = 0;
+  __asm__ volatile("xgetbv" : "=a"(uiEax), "=d"(uiEdx) : "c"(0));
+  unsigned long long uiXcr0 = (static_cast<unsigned long long>(uiEdx) << 32) | uiEax;
+#endif
+  if ((uiXcr0 & 0x6) != 0x6)
+    return false;
+  cpuid(7, 0, aRegs);
+  return (aRegs[1] & (1u << 5)) != 0;
+}
+#endif
+
+const FrameKernels* selectSse2Kernels()
+{
+#if defined(FSKIP_HAVE_SSE2)
+  if (cpuSupportsSse2())
+    return &g_sse2FrameKernels;
+#endif
+  return NULL;
+}
+
+const FrameKernels* selectAvx2Kernels()
+{
+#if defined(FSKIP_HAVE_AVX2)
+  if (cpuSupportsAvx2())
+    return &g_avx2FrameKernels;
+#endif
+  return NULL;
+}
+
+const FrameKernels* selectKernels()
+{
+  const FrameKernels* pKernels = getAvx2FrameKernels();
+  if (pKernels == NULL)
+    pKernels = getSse2FrameKernels();
+  return pKernels != NULL ? pKernels : &g_scalarKernels;
+}
+
+}
+
+// the kernels are selected on first use so that objects with static storage in other translation units, which are
+// constructed in no defined order, can use them
+const FrameKernels& getFrameKernels()
+{
+  static const FrameKernels* const s_pKernels = selectKernels();
+  return *s_pKernels;
+}
+
+const FrameKernels& getScalarFrameKernels()
+{
+  return g_scalarKernels;
+}
+
+const FrameKernels* getSse2FrameKernels()
+{
+  static const FrameKernels* const s_pKernels = selectSse2Kernels();
+  return s_pKernels;
+}
+
+const FrameKernels* getAvx2FrameKernels()
+{
+  static const FrameKernels* const s_pKernels = selectAvx2Kernels();
+  return s_pKernels;
+}
@@ -0,0 +1,87 @@
+/** @file
+
+MODULE                : FrameKernels
+
+FILE NAME             : FrameKernels.h
+
+DESCRIPTION           : Pixel kernels used to compute frame statistics: luma extraction, 8x8 block sums,
+                        sum of absolute differences and histograms. Scalar, SSE2 and AVX2 versions
+                        produce bit-exact results and the fastest supported version is selected on first use.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// number of pixels summed per block by FrameKernels::SumBlocks
+const int FSKIP_KERNEL_BLOCK_WIDTH = 8;
+
+/**
+ * @brief A table of pixel kernels for one instruction set.
+ * Every implementation must produce exactly the same output as the scalar reference.
+ */
+struct FrameKernels
+{
+  /// name of the instruction set e.g. "scalar", "sse2" or "avx2"
+  const char* Name;
+
+  /**
+   * @brief converts a row of pixels with blue, green, red byte order to BT.601 luma:
+   * (29 * B + 150 * G + 77 * R + 128) >> 8
+   */
+  void (*Rgb24ToLuma)(const uint8_t* pSrc, int iWidth, uint8_t* pDst);
+  void (*Rgb32ToLuma)(const uint8_t* pSrc, int iWidth, uint8_t* pDst);
+
+  /**
+   * @brief copies every second byte of a row: the luma of YUY2 pixels, or from the second byte on the luma of UYVY
+   * pixels and the 8 most significant bits of P010 luma. Reads at most 2 * iWidth - 1 bytes.
+   */
+  void (*Yuy2ToLuma)(const uint8_t* pSrc, int iWidth, uint8_t* pDst);
+
+  /**
+   * @brief adds the sum of each group of 8 consecutive pixels of a row to pSums.
+   * Summing up to 8 rows fits into 16 bits.
+   */
+  void (*SumBlocks)(const uint8_t* pRow, int iBlocks, uint16_t* pSums);
+
+  /// sum of absolute differences of two byte arrays
+  uint64_t (*Sad)(const uint8_t* pA, const uint8_t* pB, size_t uiLength);
+
+  /// adds the byte values of an array to a 256 bin histogram. There is no byte scatter in SSE2 or AVX2, so every kernel
+  /// set uses the scalar version.
+  void (*Histogram)(const uint8_t* pData, size_t uiLength, uint32_t* pHistogram);
+};
+
+/// the kernels selected on first use for the instruction sets supported by the CPU
+const FrameKernels& getFrameKernels();
+
+/// the portable reference implementation
+const FrameKernels& getScalarFrameKernels();
+
+/// returns NULL if the kernels were not compiled in or the CPU does not support them
+const FrameKernels* getSse2FrameKernels();
+const FrameKernels* getAvx2FrameKernels();
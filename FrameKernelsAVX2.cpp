@@ -0,0 +1,158 @@
+/** @file
+
+MODULE                : FrameKernels
+
+FILE NAME             : FrameKernelsAVX2.cpp
+
+DESCRIPTION           : AVX2 kernels. This file is compiled with AVX2 code generation and only called if CPUID reports AVX2.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameKernels.h"
+#include "FrameKernelsImpl.h"
+#include <immintrin.h>
+
+namespace
+{
+
+/**
+ * @brief converts 16 pixels with 32-bit blue, green, red, x lanes to 16-bit luma.
+ * The pack leaves the pixels in the order 0-3, 8-11 | 4-7, 12-15.
+ */
+inline __m256i lumaFromPixels(__m256i x0, __m256i x1)
+{
+  const __m256i mask = _mm256_set1_epi32(0xFF);
+  __m256i b = _mm256_packs_epi32(_mm256_and_si256(x0, mask), _mm256_and_si256(x1, mask));
+  __m256i g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(x0, 8), mask), _mm256_and_si256(_mm256_srli_epi32(x1, 8), mask));
+  __m256i r = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(x0, 16), mask), _mm256_and_si256(_mm256_srli_epi32(x1, 16), mask));
+  // the weighted sum is at most 65408 so that unsigned 16-bit arithmetic is exact
+  __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(29)), _mm256_mullo_epi16(g, _mm256_set1_epi16(150)));
+  y = _mm256_add_epi16(y, _mm256_mullo_epi16(r, _mm256_set1_epi16(77)));
+  y = _mm256_add_epi16(y, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(y, 8);
+}
+
+/// packs the luma of 32 pixels returned by two calls to lumaFromPixels into bytes in pixel order
+inline __m256i packLuma(__m256i y0, __m256i y1)
+{
+  return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(y0, y1), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+/// expands 8 packed 24-bit pixels to 32-bit lanes: reads 28 bytes
+inline __m256i loadRgb24(const uint8_t* pSrc)
+{
+  const __m256i shuffle = _mm256_setr_epi8(
+    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)pSrc)), _mm_loadu_si128((const __m128i*)(pSrc + 12)), 1);
+  return _mm256_shuffle_epi8(x, shuffle);
+}
+
+void avx2Rgb24ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  int i = 0;
+  // the last load of an iteration reads 4 bytes beyond the 96 bytes that are converted
+  for (; (iWidth - i) * 3 >= 32 * 3 + 4; i += 32, pSrc += 96)
+  {
+    __m256i y0 = lumaFromPixels(loadRgb24(pSrc), loadRgb24(pSrc + 24));
+    __m256i y1 = lumaFromPixels(loadRgb24(pSrc + 48), loadRgb24(pSrc + 72));
+    _mm256_storeu_si256((__m256i*)(pDst + i), packLuma(y0, y1));
+  }
+  scalarRgb24ToLuma(pSrc, iWidth - i, pDst + i);
+}
+
+void avx2Rgb32ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  int i = 0;
+  for (; i + 32 <= iWidth; i += 32, pSrc += 128)
+  {
+    __m256i y0 = lumaFromPixels(_mm256_loadu_si256((const __m256i*)pSrc), _mm256_loadu_si256((const __m256i*)(pSrc + 32)));
+    __m256i y1 = lumaFromPixels(_mm256_loadu_si256((const __m256i*)(pSrc + 64)), _mm256_loadu_si256((const __m256i*)(pSrc + 96)));
+    _mm256_storeu_si256((__m256i*)(pDst + i), packLuma(y0, y1));
+  }
+  scalarRgb32ToLuma(pSrc, iWidth - i, pDst + i);
+}
+
+void avx2Yuy2ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  const __m256i mask = _mm256_set1_epi16(0xFF);
+  int i = 0;
+  // the loads stop one byte short of the row so that UYVY rows can be read from their second byte
+  for (; i + 32 < iWidth; i += 32, pSrc += 64)
+  {
+    __m256i x0 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)pSrc), mask);
+    __m256i x1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pSrc + 32)), mask);
+    // the pack works per 128-bit lane
+    _mm256_storeu_si256((__m256i*)(pDst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(x0, x1), 0xD8));
+  }
+  scalarYuy2ToLuma(pSrc, iWidth - i, pDst + i);
+}
+
+void avx2SumBlocks(const uint8_t* pRow, int iBlocks, uint16_t* pSums)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int iBlock = 0;
+  for (; iBlock + 16 <= iBlocks; iBlock += 16, pRow += 128)
+  {
+    // vpsadbw against zero sums each group of 8 bytes into the low word of a 64-bit lane
+    __m256i s0 = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)pRow), zero);
+    __m256i s1 = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(pRow + 32)), zero);
+    __m256i s2 = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(pRow + 64)), zero);
+    __m256i s3 = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(pRow + 96)), zero);
+    __m256i sums = _mm256_packs_epi32(_mm256_packs_epi32(s0, s1), _mm256_packs_epi32(s2, s3));
+    sums = _mm256_permutevar8x32_epi32(sums, order);
+    __m256i acc = _mm256_loadu_si256((const __m256i*)(pSums + iBlock));
+    _mm256_storeu_si256((__m256i*)(pSums + iBlock), _mm256_add_epi16(acc, sums));
+  }
+  scalarSumBlocks(pRow, iBlocks - iBlock, pSums + iBlock);
+}
+
+uint64_t avx2Sad(const uint8_t* pA, const uint8_t* pB, size_t uiLength)
+{
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= uiLength; i += 32)
+  {
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(pA + i)), _mm256_loadu_si256((const __m256i*)(pB + i))));
+  }
+  uint64_t aSums[4];
+  _mm256_storeu_si256((__m256i*)aSums, acc);
+  return aSums[0] + aSums[1] + aSums[2] + aSums[3] + scalarSad(pA + i, pB + i, uiLength - i);
+}
+
+}
+
+extern const FrameKernels g_avx2FrameKernels =
+{
+  "avx2",
+  avx2Rgb24ToLuma,
+  avx2Rgb32ToLuma,
+  avx2Yuy2ToLuma,
+  avx2SumBlocks,
+  avx2Sad,
+  scalarHistogram
+};
@@ -0,0 +1,52 @@
+/** @file
+
+MODULE                : FrameKernelsImpl
+
+FILE NAME             : FrameKernelsImpl.h
+
+DESCRIPTION           : Internal declarations shared by the kernel implementations of each instruction set.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameKernels.h"
+#pragma once
+#include "FrameKernels.h"
+
+// scalar reference kernels: the SIMD kernels use them for the pixels that do not fill a vector
+void scalarRgb24ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst);
+void scalarRgb32ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst);
+void scalarYuy2ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst);
+void scalarSumBlocks(const uint8_t* pRow, int iBlocks, uint16_t* pSums);
+uint64_t scalarSad(const uint8_t* pA, const uint8_t* pB, size_t uiLength);
+void scalarHistogram(const uint8_t* pData, size_t uiLength, uint32_t* pHistogram);
+
+#if defined(FSKIP_HAVE_SSE2)
+extern const FrameKernels g_sse2FrameKernels;
+#endif
+
+#if defined(FSKIP_HAVE_AVX2)
+extern const FrameKernels g_avx2FrameKernels;
+#endif
@@ -0,0 +1,123 @@
+/** @file
+
+MODULE                : FrameKernels
+
+FILE NAME             : FrameKernelsSSE2.cpp
+
+DESCRIPTION           : SSE2 kernels. SSE2 has no byte shuffle, so RGB24 luma conversion uses the scalar kernel.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameKernels.h"
+#include "FrameKernelsImpl.h"
+#include <emmintrin.h>
+
+namespace
+{
+
+/// converts 8 pixels with 32-bit blue, green, red, x lanes to 16-bit luma
+inline __m128i lumaFromPixels(__m128i x0, __m128i x1)
+{
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  __m128i b = _mm_packs_epi32(_mm_and_si128(x0, mask), _mm_and_si128(x1, mask));
+  __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(x0, 8), mask), _mm_and_si128(_mm_srli_epi32(x1, 8), mask));
+  __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(x0, 16), mask), _mm_and_si128(_mm_srli_epi32(x1, 16), mask));
+  // the weighted sum is at most 65408 so that unsigned 16-bit arithmetic is exact
+  __m128i y = _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(29)), _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+  y = _mm_add_epi16(y, _mm_mullo_epi16(r, _mm_set1_epi16(77)));
+  y = _mm_add_epi16(y, _mm_set1_epi16(128));
+  return _mm_srli_epi16(y, 8);
+}
+
+void sse2Rgb32ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  int i = 0;
+  for (; i + 16 <= iWidth; i += 16, pSrc += 64)
+  {
+    __m128i y0 = lumaFromPixels(_mm_loadu_si128((const __m128i*)pSrc), _mm_loadu_si128((const __m128i*)(pSrc + 16)));
+    __m128i y1 = lumaFromPixels(_mm_loadu_si128((const __m128i*)(pSrc + 32)), _mm_loadu_si128((const __m128i*)(pSrc + 48)));
+    _mm_storeu_si128((__m128i*)(pDst + i), _mm_packus_epi16(y0, y1));
+  }
+  scalarRgb32ToLuma(pSrc, iWidth - i, pDst + i);
+}
+
+void sse2Yuy2ToLuma(const uint8_t* pSrc, int iWidth, uint8_t* pDst)
+{
+  const __m128i mask = _mm_set1_epi16(0xFF);
+  int i = 0;
+  // the loads stop one byte short of the row so that UYVY rows can be read from their second byte
+  for (; i + 16 < iWidth; i += 16, pSrc += 32)
+  {
+    __m128i x0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)pSrc), mask);
+    __m128i x1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pSrc + 16)), mask);
+    _mm_storeu_si128((__m128i*)(pDst + i), _mm_packus_epi16(x0, x1));
+  }
+  scalarYuy2ToLuma(pSrc, iWidth - i, pDst + i);
+}
+
+void sse2SumBlocks(const uint8_t* pRow, int iBlocks, uint16_t* pSums)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int iBlock = 0;
+  for (; iBlock + 8 <= iBlocks; iBlock += 8, pRow += 64)
+  {
+    // psadbw against zero sums each group of 8 bytes into the low word of a 64-bit lane
+    __m128i s0 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)pRow), zero);
+    __m128i s1 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pRow + 16)), zero);
+    __m128i s2 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pRow + 32)), zero);
+    __m128i s3 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pRow + 48)), zero);
+    __m128i sums = _mm_packs_epi32(_mm_packs_epi32(s0, s1), _mm_packs_epi32(s2, s3));
+    __m128i acc = _mm_loadu_si128((const __m128i*)(pSums + iBlock));
+    _mm_storeu_si128((__m128i*)(pSums + iBlock), _mm_add_epi16(acc, sums));
+  }
+  scalarSumBlocks(pRow, iBlocks - iBlock, pSums + iBlock);
+}
+
+uint64_t sse2Sad(const uint8_t* pA, const uint8_t* pB, size_t uiLength)
+{
+  __m128i acc = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= uiLength; i += 16)
+  {
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pA + i)), _mm_loadu_si128((const __m128i*)(pB + i))));
+  }
+  uint64_t aSums[2];
+  _mm_storeu_si128((__m128i*)aSums, acc);
+  return aSums[0] + aSums[1] + scalarSad(pA + i, pB + i, uiLength - i);
+}
+
+}
+
+extern const FrameKernels g_sse2FrameKernels =
+{
+  "sse2",
+  scalarRgb24ToLuma,
+  sse2Rgb32ToLuma,
+  sse2Yuy2ToLuma,
+  sse2SumBlocks,
+  sse2Sad,
+  scalarHistogram
+};
@@ -0,0 +1,271 @@
+/** @file
+
+MODULE                : FrameRateEstimator
+
+FILE NAME             : FrameRateEstimator.h
+
+DESCRIPTION           : Estimates the source frame rate from the start times of the samples: the median of
+                        recent frame intervals, refined by the long run mean of the intervals close to it and
+                        snapped to a standard rate.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "FrameTime.h"
+
+// number of recent frame intervals the estimate is taken from
+const unsigned FSKIP_RATE_WINDOW = 32;
+// the first estimate is made once this many intervals were seen
+const unsigned FSKIP_RATE_MIN_INTERVALS = 16;
+// a different estimate must persist for this many frames before it replaces the current one
+const unsigned FSKIP_RATE_CONFIRM_FRAMES = 8;
+// intervals above this are discontinuities, e.g. a seek or a paused source, and are ignored
+const int64_t FSKIP_RATE_MAX_INTERVAL = TIMESTAMP_TICKS_PER_SECOND;
+// intervals spanning more frame periods than this are gaps rather than dropped frames and are ignored
+const unsigned FSKIP_RATE_MAX_PERIODS = 8;
+// an estimate within this relative distance of a standard rate is snapped onto it
+const double FSKIP_RATE_SNAP_TOLERANCE = 0.005;
+// the current estimate is kept while the mean is at least this close to it
+const double FSKIP_RATE_MIN_UNCERTAINTY = 0.0002;
+// the long run mean restarts if the rate of the window moves further away from it than this, e.g. from 25 to 24 fps
+const double FSKIP_RATE_CHANGE_TOLERANCE = 0.03;
+
+/**
+ * @brief Online estimate of the frame rate of a stream with possibly variable frame rate.
+ *
+ * Each interval is counted as the number of frame periods it spans, so dropped frames do not bias the estimate:
+ * the period of the last FSKIP_RATE_WINDOW intervals is first taken from their lower quartile, which is robust
+ * against drops and bursts, and then refined by their mean. The estimate is the mean period since the rate last
+ * changed: the sum of the intervals only depends on the jitter of the first and the last timestamp, so its error
+ * falls with the length of the stream until e.g. 30 and 30000/1001 fps can be told apart. The result is snapped
+ * to the nearest standard rate or else rounded to 0.1 fps. The current estimate is kept while it is within the
+ * uncertainty of the mean and a different one must persist for FSKIP_RATE_CONFIRM_FRAMES frames to replace it.
+ * No memory is allocated.
+ */
+class FrameRateEstimator
+{
+public:
+
+  FrameRateEstimator()
+  {
+    reset();
+  }
+
+  /// forgets all intervals and the estimate, e.g. when streaming restarts
+  void reset()
+  {
+    m_bHasLast = false;
+    m_tLast = 0;
+    m_uiCount = 0;
+    m_uiNext = 0;
+    m_iSpan = 0;
+    m_uiPeriods = 0;
+    m_estimate = RationalFrameRate();
+    m_candidate = RationalFrameRate();
+    m_uiCandidateFrames = 0;
+  }
+
+  bool hasEstimate() const
+  {
+    return m_estimate.isSet();
+  }
+
+  /// the current estimate: unset until enough intervals were seen
+  const RationalFrameRate& getFrameRate() const
+  {
+    return m_estimate;
+  }
+
+  /**
+   * @brief adds the start time of the next frame.
+   * @return true if the estimate changed
+   */
+  bool addTimestamp(int64_t tStart)
+  {
+    int64_t iInterval = tStart - m_tLast;
+    bool bHadLast = m_bHasLast;
+    m_tLast = tStart;
+    m_bHasLast = true;
+    if (!bHadLast || iInterval <= 0 || iInterval > FSKIP_RATE_MAX_INTERVAL)
+      return false;
+
+    m_aiIntervals[m_uiNext] = iInterval;
+    m_uiNext = (m_uiNext + 1) % FSKIP_RATE_WINDOW;
+    if (m_uiCount < FSKIP_RATE_WINDOW)
+      ++m_uiCount;
+    if (m_uiCount < FSKIP_RATE_MIN_INTERVALS)
+      return false;
+
+    // the period of the window: the lower quartile is a single frame unless most frames are dropped
+    int64_t aiSorted[FSKIP_RATE_WINDOW];
+    std::copy(m_aiIntervals, m_aiIntervals + m_uiCount, aiSorted);
+    int64_t* pQuartile = aiSorted + m_uiCount / 4;
+    std::nth_element(aiSorted, pQuartile, aiSorted + m_uiCount);
+    int64_t iSpan = 0;
+    uint64_t uiPeriods = 0;
+    sumWindow(static_cast<double>(*pQuartile), iSpan, uiPeriods);
+    if (uiPeriods == 0)
+      return false;
+    double dPeriod = static_cast<double>(iSpan) / uiPeriods;
+    sumWindow(dPeriod, iSpan, uiPeriods);
+    if (uiPeriods == 0)
+      return false;
+    dPeriod = static_cast<double>(iSpan) / uiPeriods;
+
+    if (m_uiPeriods == 0)
+    {
+      // the window already holds the new interval
+      m_iSpan = iSpan;
+      m_uiPeriods = uiPeriods;
+    }
+    else if (std::fabs(m_iSpan / (dPeriod * m_uiPeriods) - 1.0) > FSKIP_RATE_CHANGE_TOLERANCE)
+    {
+      // the source changed its rate: the window mixes both rates, so the estimate is held until the window
+      // was refilled with intervals of the new rate
+      m_uiCount = 0;
+      m_uiNext = 0;
+      m_iSpan = 0;
+      m_uiPeriods = 0;
+      return false;
+    }
+    else
+    {
+      unsigned uiIntervalPeriods = getPeriods(iInterval, dPeriod);
+      if (uiIntervalPeriods > 0)
+      {
+        m_iSpan += iInterval;
+        m_uiPeriods += uiIntervalPeriods;
+      }
+    }
+
+    // the jitter of the window bounds the error of the first and the last timestamp of the mean
+    double dDeviation = 0.0;
+    for (unsigned i = 0; i < m_uiCount; ++i)
+      dDeviation += std::fabs(m_aiIntervals[i] - getPeriods(m_aiIntervals[i], dPeriod) * dPeriod);
+    double dUncertainty = 3.0 * dDeviation / m_uiCount / m_iSpan;
+
+    double dFrameRate = TIMESTAMP_FACTOR * m_uiPeriods / m_iSpan;
+    bool bConsistent = m_estimate.isSet() && std::fabs(dFrameRate / m_estimate.toDouble() - 1.0) <= std::max(dUncertainty, FSKIP_RATE_MIN_UNCERTAINTY);
+    RationalFrameRate frameRate = bConsistent ? m_estimate : snap(dFrameRate);
+    if (frameRate == m_estimate)
+    {
+      m_uiCandidateFrames = 0;
+      return false;
+    }
+    if (!m_estimate.isSet())
+    {
+      m_estimate = frameRate;
+      return true;
+    }
+    if (frameRate != m_candidate)
+    {
+      m_candidate = frameRate;
+      m_uiCandidateFrames = 0;
+    }
+    if (++m_uiCandidateFrames < FSKIP_RATE_CONFIRM_FRAMES)
+      return false;
+    m_estimate = frameRate;
+    m_uiCandidateFrames = 0;
+    return true;
+  }
+
+  /**
+   * @brief the nearest standard rate if it is within FSKIP_RATE_SNAP_TOLERANCE, else the rate rounded to 0.1 fps.
+   */
+  static RationalFrameRate snap(double dFrameRate)
+  {
+    static const RationalFrameRate STANDARD_RATES[] =
+    {
+      RationalFrameRate(5), RationalFrameRate(15, 2), RationalFrameRate(10), RationalFrameRate(12), RationalFrameRate(25, 2),
+      RationalFrameRate(15000, 1001), RationalFrameRate(15), RationalFrameRate(20), RationalFrameRate(24000, 1001),
+      RationalFrameRate(24), RationalFrameRate(25), RationalFrameRate(30000, 1001), RationalFrameRate(30),
+      RationalFrameRate(48000, 1001), RationalFrameRate(48), RationalFrameRate(50), RationalFrameRate(60000, 1001),
+      RationalFrameRate(60), RationalFrameRate(72), RationalFrameRate(90), RationalFrameRate(100),
+      RationalFrameRate(120000, 1001), RationalFrameRate(120), RationalFrameRate(144), RationalFrameRate(240)
+    };
+    if (!(dFrameRate > 0.0))
+      return RationalFrameRate();
+
+    const RationalFrameRate* pNearest = NULL;
+    double dNearest = FSKIP_RATE_SNAP_TOLERANCE;
+    for (const RationalFrameRate& standardRate : STANDARD_RATES)
+    {
+      double dDistance = std::fabs(dFrameRate / standardRate.toDouble() - 1.0);
+      if (dDistance <= dNearest)
+      {
+        dNearest = dDistance;
+        pNearest = &standardRate;
+      }
+    }
+    if (pNearest != NULL)
+      return *pNearest;
+    return RationalFrameRate(static_cast<uint32_t>(std::floor(dFrameRate * 10.0 + 0.5)), 10).reduced();
+  }
+
+private:
+
+  /// the number of frame periods an interval spans: 0 if it is shorter than half a period or a gap
+  static unsigned getPeriods(int64_t iInterval, double dPeriod)
+  {
+    double dPeriods = std::floor(iInterval / dPeriod + 0.5);
+    if (dPeriods < 1.0 || dPeriods > FSKIP_RATE_MAX_PERIODS)
+      return 0;
+    return static_cast<unsigned>(dPeriods);
+  }
+
+  /// sums the intervals of the window and the frame periods they span
+  void sumWindow(double dPeriod, int64_t& riSpan, uint64_t& ruiPeriods) const
+  {
+    riSpan = 0;
+    ruiPeriods = 0;
+    for (unsigned i = 0; i < m_uiCount; ++i)
+    {
+      unsigned uiPeriods = getPeriods(m_aiIntervals[i], dPeriod);
+      if (uiPeriods > 0)
+      {
+        riSpan += m_aiIntervals[i];
+        ruiPeriods += uiPeriods;
+      }
+    }
+  }
+
+  bool m_bHasLast;
+  int64_t m_tLast;
+  // ring buffer of the last intervals
+  int64_t m_aiIntervals[FSKIP_RATE_WINDOW];
+  unsigned m_uiCount;
+  unsigned m_uiNext;
+  // the counted intervals and the frame periods they span since the rate last changed
+  int64_t m_iSpan;
+  uint64_t m_uiPeriods;
+  RationalFrameRate m_estimate;
+  // a different estimate and the number of frames it persisted for
+  RationalFrameRate m_candidate;
+  unsigned m_uiCandidateFrames;
+};
@@ -0,0 +1,266 @@
+/** @file
+
+MODULE                : FrameSignature
+
+FILE NAME             : FrameSignature.h
+
+DESCRIPTION           : Downscaled luma signatures of video frames. Two signatures are compared with the
+                        sum of absolute differences to detect duplicate or near-identical frames.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "FrameKernels.h"
+
+enum FramePixelFormat
+{
+  FSKIP_PIXEL_FORMAT_UNKNOWN = 0,
+  FSKIP_PIXEL_FORMAT_I420 = 1,
+  FSKIP_PIXEL_FORMAT_RGB24 = 2,
+  FSKIP_PIXEL_FORMAT_RGB32 = 3,
+  /// 8-bit luma plane followed by interleaved chroma
+  FSKIP_PIXEL_FORMAT_NV12 = 4,
+  /// packed 4:2:2 in the byte order Y0 U Y1 V
+  FSKIP_PIXEL_FORMAT_YUY2 = 5,
+  /// packed 4:2:2 in the byte order U Y0 V Y1
+  FSKIP_PIXEL_FORMAT_UYVY = 6,
+  /// 16-bit little endian luma plane with 10 significant bits at the top followed by interleaved chroma
+  FSKIP_PIXEL_FORMAT_P010 = 7
+};
+
+/**
+ * @brief Describes the pixel data of a frame. Only the luma (or the first) plane is read.
+ * RGB rows may be stored bottom-up: the signature does not depend on the row order as long as it
+ * is the same for every frame. 10-bit luma is reduced to its 8 most significant bits.
+ */
+struct FramePicture
+{
+  FramePicture()
+    :Data(NULL),
+    Width(0),
+    Height(0),
+    Stride(0),
+    Format(FSKIP_PIXEL_FORMAT_UNKNOWN)
+  {
+
+  }
+
+  const uint8_t* Data;
+  int Width;
+  int Height;
+  /// bytes per row of the first plane: may be larger than the row, e.g. for padded decoder surfaces
+  int Stride;
+  /// see FramePixelFormat
+  unsigned Format;
+};
+
+// the signature stores the mean luma of each block of this many pixels squared
+const int FSKIP_SIGNATURE_BLOCK_SIZE = FSKIP_KERNEL_BLOCK_WIDTH;
+
+/**
+ * @brief A downscaled luma image with one byte per 8x8 block of the frame.
+ * Partial blocks at the right and bottom edges are ignored.
+ */
+class FrameSignature
+{
+public:
+
+  FrameSignature()
+    :m_pKernels(&getFrameKernels()),
+    m_iWidth(0),
+    m_iHeight(0)
+  {
+
+  }
+
+  /// selects the kernels used to compute and compare signatures
+  void setKernels(const FrameKernels& kernels)
+  {
+    m_pKernels = &kernels;
+  }
+
+  int getWidth() const { return m_iWidth; }
+  int getHeight() const { return m_iHeight; }
+  bool isEmpty() const { return m_vBlocks.empty(); }
+  const std::vector<uint8_t>& getBlocks() const { return m_vBlocks; }
+
+  void clear()
+  {
+    m_iWidth = m_iHeight = 0;
+    m_vBlocks.clear();
+  }
+
+  /// copies the blocks of another signature but keeps the kernels
+  void assign(const FrameSignature& other)
+  {
+    m_iWidth = other.m_iWidth;
+    m_iHeight = other.m_iHeight;
+    m_vBlocks.assign(other.m_vBlocks.begin(), other.m_vBlocks.end());
+  }
+
+  void swap(FrameSignature& rOther)
+  {
+    std::swap(m_iWidth, rOther.m_iWidth);
+    std::swap(m_iHeight, rOther.m_iHeight);
+    m_vBlocks.swap(rOther.m_vBlocks);
+  }
+
+  /**
+   * @brief computes the signature of the picture. Memory is only allocated if the frame size changes.
+   * @return false if the format is not supported or the frame is smaller than one block
+   */
+  bool compute(const FramePicture& picture)
+  {
+    if (!resize(picture))
+      return false;
+    m_vSums.resize(m_iWidth);
+    if (!hasLumaPlane(picture.Format))
+      m_vLuma.resize(static_cast<size_t>(m_iWidth) * FSKIP_SIGNATURE_BLOCK_SIZE);
+    computeBlockRows(picture, 0, m_iHeight, &m_vSums[0], m_vLuma.empty() ? NULL : &m_vLuma[0]);
+    return true;
+  }
+
+  /**
+   * @brief sets the size of the signature for the picture without computing the blocks, e.g. before several threads
+   * compute its block rows with computeBlockRows.
+   * @return false if the format is not supported or the frame is smaller than one block
+   */
+  bool resize(const FramePicture& picture)
+  {
+    if (picture.Data == NULL || picture.Width <= 0 || picture.Height <= 0)
+    {
+      clear();
+      return false;
+    }
+    int iWidth = picture.Width / FSKIP_SIGNATURE_BLOCK_SIZE;
+    int iHeight = picture.Height / FSKIP_SIGNATURE_BLOCK_SIZE;
+    if (iWidth == 0 || iHeight == 0)
+    {
+      clear();
+      return false;
+    }
+    if (picture.Format == FSKIP_PIXEL_FORMAT_UNKNOWN || picture.Format > FSKIP_PIXEL_FORMAT_P010)
+    {
+      clear();
+      return false;
+    }
+    m_iWidth = iWidth;
+    m_iHeight = iHeight;
+    m_vBlocks.resize(static_cast<size_t>(iWidth) * iHeight);
+    return true;
+  }
+
+  /**
+   * @brief computes the block rows iFirstRow to iFirstRow + iRows - 1 of a signature sized by resize. Different
+   * block rows may be computed concurrently as the scratch buffers belong to the caller.
+   * @param pSums getWidth() sums
+   * @param pLuma getWidth() * FSKIP_SIGNATURE_BLOCK_SIZE bytes for the luma of a row, NULL for formats with a luma plane
+   * @param pHistogram if not NULL the luma values of the rows are added to these 256 bins
+   * @param pGradient if not NULL the absolute differences of horizontally adjacent luma values are added to it
+   */
+  void computeBlockRows(const FramePicture& picture, int iFirstRow, int iRows, uint16_t* pSums, uint8_t* pLuma,
+    uint32_t* pHistogram = NULL, uint64_t* pGradient = NULL)
+  {
+    const int iWidth = m_iWidth;
+    const int iLumaWidth = iWidth * FSKIP_SIGNATURE_BLOCK_SIZE;
+    for (int iBlockRow = iFirstRow; iBlockRow < iFirstRow + iRows; ++iBlockRow)
+    {
+      std::fill(pSums, pSums + iWidth, static_cast<uint16_t>(0));
+      for (int iRow = 0; iRow < FSKIP_SIGNATURE_BLOCK_SIZE; ++iRow)
+      {
+        const uint8_t* pRow = picture.Data + static_cast<ptrdiff_t>(iBlockRow * FSKIP_SIGNATURE_BLOCK_SIZE + iRow) * picture.Stride;
+        switch (picture.Format)
+        {
+        case FSKIP_PIXEL_FORMAT_RGB24:
+          m_pKernels->Rgb24ToLuma(pRow, iLumaWidth, pLuma);
+          pRow = pLuma;
+          break;
+        case FSKIP_PIXEL_FORMAT_RGB32:
+          m_pKernels->Rgb32ToLuma(pRow, iLumaWidth, pLuma);
+          pRow = pLuma;
+          break;
+        case FSKIP_PIXEL_FORMAT_YUY2:
+          m_pKernels->Yuy2ToLuma(pRow, iLumaWidth, pLuma);
+          pRow = pLuma;
+          break;
+        case FSKIP_PIXEL_FORMAT_UYVY:
+        case FSKIP_PIXEL_FORMAT_P010:
+          // the luma byte and the most significant byte of a 16-bit sample are the second of each pair
+          m_pKernels->Yuy2ToLuma(pRow + 1, iLumaWidth, pLuma);
+          pRow = pLuma;
+          break;
+        }
+        m_pKernels->SumBlocks(pRow, iWidth, pSums);
+        if (pHistogram != NULL)
+          m_pKernels->Histogram(pRow, iLumaWidth, pHistogram);
+        if (pGradient != NULL)
+          *pGradient += m_pKernels->Sad(pRow, pRow + 1, iLumaWidth - 1);
+      }
+      uint8_t* pBlocks = &m_vBlocks[static_cast<size_t>(iBlockRow) * iWidth];
+      const unsigned uiArea = FSKIP_SIGNATURE_BLOCK_SIZE * FSKIP_SIGNATURE_BLOCK_SIZE;
+      for (int iBlock = 0; iBlock < iWidth; ++iBlock)
+      {
+        pBlocks[iBlock] = static_cast<uint8_t>((pSums[iBlock] + uiArea / 2) / uiArea);
+      }
+    }
+  }
+
+  /// true if the rows of the format are 8-bit luma that is read in place
+  static bool hasLumaPlane(unsigned uiFormat)
+  {
+    return uiFormat == FSKIP_PIXEL_FORMAT_I420 || uiFormat == FSKIP_PIXEL_FORMAT_NV12;
+  }
+
+  /**
+   * @brief the mean absolute difference per block between two signatures of the same size.
+   * @return a negative value if the signatures cannot be compared
+   */
+  double meanAbsoluteDifference(const FrameSignature& other) const
+  {
+    if (isEmpty() || m_iWidth != other.m_iWidth || m_iHeight != other.m_iHeight)
+      return -1.0;
+
+    uint64_t uiSad = m_pKernels->Sad(&m_vBlocks[0], &other.m_vBlocks[0], m_vBlocks.size());
+    return uiSad / static_cast<double>(m_vBlocks.size());
+  }
+
+private:
+
+  const FrameKernels* m_pKernels;
+  int m_iWidth;
+  int m_iHeight;
+  // the mean luma per block
+  std::vector<uint8_t> m_vBlocks;
+  // luma sums of the block row being computed
+  std::vector<uint16_t> m_vSums;
+  // luma of one RGB row
+  std::vector<uint8_t> m_vLuma;
+};
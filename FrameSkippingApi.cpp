@@ -0,0 +1,239 @@
+/** @file
+
+MODULE                : FrameSkippingApi
+
+FILE NAME             : FrameSkippingApi.cpp
+
+DESCRIPTION           : C interface of the frame skipping engine: each handle owns an engine, its statistics and
+                        a configuration snapshot so that streams are decided independently of each other.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingApi.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include "ConfigSnapshot.h"
+#include "FrameSkippingEngine.h"
+#include "FrameSkippingStatistics.h"
+#include "VersionInfo.h"
+
+static_assert(FSKIP_MODE_SKIP_X_FRAMES_EVERY_Y == FSKIP_SKIP_X_FRAMES_EVERY_Y && FSKIP_MODE_ACHIEVE_TARGET_RATE == FSKIP_ACHIEVE_TARGET_RATE
+  && FSKIP_MODE_RATIONAL_DECIMATION == FSKIP_RATIONAL_DECIMATION && FSKIP_MODE_DROP_DUPLICATES == FSKIP_DROP_DUPLICATES
+  && FSKIP_MODE_TEMPORAL_LAYERS == FSKIP_TEMPORAL_LAYERS && FSKIP_MODE_TOKEN_BUCKET == FSKIP_TOKEN_BUCKET
+  && FSKIP_MODE_BITRATE_BUDGET == FSKIP_BITRATE_BUDGET, "the C modes must match FrameSkippingMode");
+static_assert(FSKIP_FORMAT_I420 == FSKIP_PIXEL_FORMAT_I420 && FSKIP_FORMAT_RGB24 == FSKIP_PIXEL_FORMAT_RGB24
+  && FSKIP_FORMAT_RGB32 == FSKIP_PIXEL_FORMAT_RGB32 && FSKIP_FORMAT_NV12 == FSKIP_PIXEL_FORMAT_NV12
+  && FSKIP_FORMAT_YUY2 == FSKIP_PIXEL_FORMAT_YUY2 && FSKIP_FORMAT_UYVY == FSKIP_PIXEL_FORMAT_UYVY
+  && FSKIP_FORMAT_P010 == FSKIP_PIXEL_FORMAT_P010, "the C formats must match FramePixelFormat");
+
+/**
+ * @brief The decision state of one stream: the engine and its statistics as in the DirectShow filter.
+ * The settings are published as snapshots that the deciding thread picks up without a lock.
+ */
+struct FrameSkipper
+{
+  FrameSkipper()
+    :m_uiConfigGeneration(UINT64_MAX)
+  {
+    m_config.publish(FrameSkippingConfig());
+  }
+
+  void configure(const FrameSkippingConfig& config)
+  {
+    m_config.publish(config);
+  }
+
+  bool decide(int64_t tStart, const FrameSkippingPicture* pPicture, uint32_t uiBytes, uint32_t uiFlags)
+  {
+    if (m_config.update(m_activeConfig, m_uiConfigGeneration))
+    {
+      m_engine.applyConfig(m_activeConfig);
+    }
+
+    bool bTimed = m_statistics.isDecisionTimed();
+    uint64_t uiCycles = bTimed ? FrameSkippingStatistics::readCycleCounter() : 0;
+    FramePicture picture;
+    if (pPicture != NULL && m_engine.requiresPicture())
+    {
+      picture.Data = pPicture->Data;
+      picture.Width = pPicture->Width;
+      picture.Height = pPicture->Height;
+      picture.Stride = pPicture->Stride;
+      picture.Format = pPicture->Format;
+    }
+    bool bKeep = m_engine.keepFrame(tStart, picture.Data != NULL ? &picture : NULL, (uiFlags & FSKIP_FRAME_REFERENCE) == 0, uiBytes);
+    if (bTimed)
+    {
+      m_statistics.recordDecisionLatency(FrameSkippingStatistics::readCycleCounter() - uiCycles);
+    }
+    m_statistics.recordFrame(bKeep, tStart, (uiFlags & FSKIP_FRAME_NO_TIME) == 0);
+    return bKeep;
+  }
+
+  unsigned getTemporalLayer() const
+  {
+    return m_engine.getLastTemporalLayer();
+  }
+
+  void reset()
+  {
+    m_engine.reset();
+    m_statistics.reset();
+  }
+
+  void getStatistics(FrameSkippingStatsSnapshot& stats) const
+  {
+    m_statistics.getSnapshot(stats);
+  }
+
+private:
+
+  // the settings as published by fskip_configure
+  ConfigSnapshot<FrameSkippingConfig> m_config;
+  // deciding thread: the snapshot applied to the engine and its generation
+  FrameSkippingConfig m_activeConfig;
+  uint64_t m_uiConfigGeneration;
+  FrameSkippingEngine m_engine;
+  FrameSkippingStatistics m_statistics;
+};
+
+namespace
+{
+
+/// converts the settings of the C interface. Returns false if they are not valid.
+bool toConfig(const FrameSkippingSettings& settings, FrameSkippingConfig& config)
+{
+  // written so that NaN is rejected as well
+  if (settings.Mode > FSKIP_MODE_BITRATE_BUDGET || !(settings.SourceFrameRate >= 0.0) || !(settings.TargetFrameRate >= 0.0)
+    || !(settings.DuplicateThreshold >= 0.0) || settings.MaxDuplicateInterval < 0 || settings.BurstDuration < 0
+    || settings.BitrateWindow < 0
+    || (settings.SourceFrameRateNum > 0 && settings.SourceFrameRateDen == 0)
+    || (settings.TargetFrameRateNum > 0 && settings.TargetFrameRateDen == 0)
+    || settings.TemporalLayers == 0 || settings.TemporalLayers > FSKIP_MAX_TEMPORAL_LAYERS)
+  {
+    return false;
+  }
+  config.Mode = settings.Mode;
+  config.SourceFrameRate = settings.SourceFrameRate;
+  config.TargetFrameRate = settings.TargetFrameRate;
+  config.RationalSourceFrameRate = FrameSkippingEngine::toRationalFrameRate(settings.SourceFrameRateNum, settings.SourceFrameRateDen, settings.SourceFrameRate);
+  config.RationalTargetFrameRate = FrameSkippingEngine::toRationalFrameRate(settings.TargetFrameRateNum, settings.TargetFrameRateDen, settings.TargetFrameRate);
+  config.DuplicateThreshold = settings.DuplicateThreshold;
+  config.MaxDuplicateInterval = settings.MaxDuplicateInterval;
+  config.TemporalLayers = settings.TemporalLayers;
+  config.MaxTemporalLayer = settings.MaxTemporalLayer;
+  config.BurstDuration = settings.BurstDuration;
+  config.MaxBitrate = settings.MaxBitrate;
+  config.BitrateWindow = settings.BitrateWindow;
+  config.EstimateSourceRate = settings.EstimateSourceRate != 0;
+  // looked up here so that the deciding thread only takes the cache lock to follow a new estimate of the source rate
+  if (config.Mode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+    config.Pattern = SkipPatternCache::getInstance().getPattern(config.SourceFrameRate, config.TargetFrameRate);
+  return true;
+}
+
+}
+
+void fskip_get_version(uint32_t* pMajor, uint32_t* pMinor, uint32_t* pBuild)
+{
+  if (pMajor != NULL)
+    *pMajor = MAJOR_VERSION;
+  if (pMinor != NULL)
+    *pMinor = MINOR_VERSION;
+  if (pBuild != NULL)
+    *pBuild = BUILD_VERSION;
+}
+
+void fskip_init_settings(FrameSkippingSettings* pSettings)
+{
+  if (pSettings == NULL)
+    return;
+  FrameSkippingConfig config;
+  std::memset(pSettings, 0, sizeof(FrameSkippingSettings));
+  pSettings->Size = sizeof(FrameSkippingSettings);
+  pSettings->Mode = config.Mode;
+  pSettings->SourceFrameRateDen = 1;
+  pSettings->TargetFrameRateDen = 1;
+  pSettings->DuplicateThreshold = config.DuplicateThreshold;
+  pSettings->TemporalLayers = config.TemporalLayers;
+  pSettings->MaxTemporalLayer = config.MaxTemporalLayer;
+  pSettings->BitrateWindow = config.BitrateWindow;
+}
+
+FrameSkipper* fskip_create(void)
+{
+  return new (std::nothrow) FrameSkipper();
+}
+
+void fskip_destroy(FrameSkipper* pSkipper)
+{
+  delete pSkipper;
+}
+
+int fskip_configure(FrameSkipper* pSkipper, const FrameSkippingSettings* pSettings)
+{
+  if (pSkipper == NULL || pSettings == NULL || pSettings->Size < offsetof(FrameSkippingSettings, SourceFrameRate))
+    return FSKIP_E_INVALID_ARGUMENT;
+
+  // the fields that an older caller does not know keep their defaults
+  FrameSkippingSettings settings;
+  fskip_init_settings(&settings);
+  std::memcpy(&settings, pSettings, std::min<size_t>(pSettings->Size, sizeof(settings)));
+  settings.Size = sizeof(settings);
+  FrameSkippingConfig config;
+  if (!toConfig(settings, config))
+    return FSKIP_E_INVALID_ARGUMENT;
+  pSkipper->configure(config);
+  return FSKIP_OK;
+}
+
+int fskip_decide(FrameSkipper* pSkipper, int64_t tStart, const FrameSkippingPicture* pPicture, uint32_t uiBytes, uint32_t uiFlags)
+{
+  if (pSkipper == NULL)
+    return FSKIP_E_INVALID_ARGUMENT;
+  return pSkipper->decide(tStart, pPicture, uiBytes, uiFlags) ? 1 : 0;
+}
+
+uint32_t fskip_get_temporal_layer(const FrameSkipper* pSkipper)
+{
+  return pSkipper != NULL ? pSkipper->getTemporalLayer() : 0;
+}
+
+void fskip_reset(FrameSkipper* pSkipper)
+{
+  if (pSkipper != NULL)
+    pSkipper->reset();
+}
+
+int fskip_get_stats(const FrameSkipper* pSkipper, FrameSkippingStatsSnapshot* pStats)
+{
+  if (pSkipper == NULL || pStats == NULL)
+    return FSKIP_E_INVALID_ARGUMENT;
+  pSkipper->getStatistics(*pStats);
+  return FSKIP_OK;
+}
@@ -0,0 +1,179 @@
+/** @file
+
+MODULE                : FrameSkippingApi
+
+FILE NAME             : FrameSkippingApi.h
+
+DESCRIPTION           : C interface of the frame skipping engine for hosts other than DirectShow: one handle per
+                        stream with the skip modes, frame decisions and statistics.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <stdint.h>
+#include "FrameSkippingStats.h"
+
+#if defined(_WIN32)
+#define FSKIP_API
+#elif defined(__GNUC__)
+#define FSKIP_API __attribute__((visibility("default")))
+#else
+#define FSKIP_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* skip modes: see the FrameSkippingMode of the engine */
+#define FSKIP_MODE_SKIP_X_FRAMES_EVERY_Y 0
+#define FSKIP_MODE_ACHIEVE_TARGET_RATE 1
+#define FSKIP_MODE_RATIONAL_DECIMATION 2
+#define FSKIP_MODE_DROP_DUPLICATES 3
+#define FSKIP_MODE_TEMPORAL_LAYERS 4
+#define FSKIP_MODE_TOKEN_BUCKET 5
+#define FSKIP_MODE_BITRATE_BUDGET 6
+
+/* layouts of the pixel data passed to fskip_decide: only the luma plane is read */
+#define FSKIP_FORMAT_I420 1
+#define FSKIP_FORMAT_RGB24 2
+#define FSKIP_FORMAT_RGB32 3
+#define FSKIP_FORMAT_NV12 4
+#define FSKIP_FORMAT_YUY2 5
+#define FSKIP_FORMAT_UYVY 6
+#define FSKIP_FORMAT_P010 7
+
+/* flags of fskip_decide */
+/* other frames depend on this one, e.g. a compressed reference frame: it is never dropped */
+#define FSKIP_FRAME_REFERENCE 0x1
+/* the start time of the frame is not known: it is left out of the statistics. Only the skip x frames every y mode
+   decides without start times. */
+#define FSKIP_FRAME_NO_TIME 0x2
+
+/* results */
+#define FSKIP_OK 0
+#define FSKIP_E_INVALID_ARGUMENT (-1)
+
+/* the decision state of one stream */
+typedef struct FrameSkipper FrameSkipper;
+
+/**
+ * @brief The settings of a stream. Times are in 100 ns units.
+ * Initialise with fskip_init_settings: Size lets later versions add fields that keep their defaults for older callers.
+ */
+typedef struct FrameSkippingSettings
+{
+  /* sizeof(FrameSkippingSettings) */
+  uint32_t Size;
+  /* one of FSKIP_MODE_* */
+  uint32_t Mode;
+  /* floating point rates of the skip x frames every y and target rate modes */
+  double SourceFrameRate;
+  double TargetFrameRate;
+  /* exact rates: take precedence over the floating point rates if the numerator is set */
+  uint32_t SourceFrameRateNum;
+  uint32_t SourceFrameRateDen;
+  uint32_t TargetFrameRateNum;
+  uint32_t TargetFrameRateDen;
+  /* duplicate elimination: mean absolute luma difference per 8x8 block at or below which a frame is a duplicate */
+  double DuplicateThreshold;
+  /* duplicate elimination: keep a duplicate if no frame was kept for this long. 0 = never */
+  int64_t MaxDuplicateInterval;
+  /* temporal layer mode: the number of dyadic layers and the highest layer that is kept */
+  uint32_t TemporalLayers;
+  uint32_t MaxTemporalLayer;
+  /* token bucket mode: how far the mode may catch up with the target rate after a stall */
+  int64_t BurstDuration;
+  /* bitrate budget mode: cap in bits per second on the payload of the kept frames and the window it applies to */
+  uint64_t MaxBitrate;
+  int64_t BitrateWindow;
+  /* 1 = estimate the source frame rate from the timestamps instead of using the configured source rate */
+  uint32_t EstimateSourceRate;
+} FrameSkippingSettings;
+
+/* the pixel data of a frame */
+typedef struct FrameSkippingPicture
+{
+  const uint8_t* Data;
+  int32_t Width;
+  int32_t Height;
+  /* bytes per row of the luma plane */
+  int32_t Stride;
+  /* one of FSKIP_FORMAT_* */
+  uint32_t Format;
+} FrameSkippingPicture;
+
+/* the version of the library */
+FSKIP_API void fskip_get_version(uint32_t* pMajor, uint32_t* pMinor, uint32_t* pBuild);
+
+/* fills the settings with the defaults */
+FSKIP_API void fskip_init_settings(FrameSkippingSettings* pSettings);
+
+/**
+ * @brief creates the decision state of a stream with the default settings.
+ * @return NULL if out of memory
+ */
+FSKIP_API FrameSkipper* fskip_create(void);
+
+FSKIP_API void fskip_destroy(FrameSkipper* pSkipper);
+
+/**
+ * @brief applies new settings from the next decision on. May be called from any thread while frames are decided.
+ * @return FSKIP_OK or FSKIP_E_INVALID_ARGUMENT
+ */
+FSKIP_API int fskip_configure(FrameSkipper* pSkipper, const FrameSkippingSettings* pSettings);
+
+/**
+ * @brief decides whether a frame is kept. Frames of one stream must be decided on one thread at a time;
+ * different streams may be decided concurrently. Does not allocate memory or take a lock after the first two frames
+ * of a size, except when the skip x frames every y mode follows a new estimate of the source rate: the skip pattern
+ * for the new rate is then looked up in a cache shared by all streams.
+ * @param tStart the start time of the frame. Required by all modes except skip x frames every y.
+ * @param pPicture the pixels of the frame. Only read by the duplicate elimination mode: NULL treats the frame
+ * as different from the previous one.
+ * @param uiBytes the payload size of the frame. Only read by the bitrate budget mode.
+ * @param uiFlags FSKIP_FRAME_* flags
+ * @return 1 to keep the frame, 0 to drop it, FSKIP_E_INVALID_ARGUMENT
+ */
+FSKIP_API int fskip_decide(FrameSkipper* pSkipper, int64_t tStart, const FrameSkippingPicture* pPicture, uint32_t uiBytes, uint32_t uiFlags);
+
+/* the temporal layer of the frame last passed to fskip_decide in the temporal layer mode, whether it was kept or not.
+   Call on the deciding thread. */
+FSKIP_API uint32_t fskip_get_temporal_layer(const FrameSkipper* pSkipper);
+
+/* restarts the stream e.g. after a seek: the pattern position, the target time line and the statistics are reset.
+   Call on the deciding thread: the statistics are only written there. */
+FSKIP_API void fskip_reset(FrameSkipper* pSkipper);
+
+/**
+ * @brief copies the statistics of the stream. May be called from any thread.
+ * @return FSKIP_OK or FSKIP_E_INVALID_ARGUMENT
+ */
+FSKIP_API int fskip_get_stats(const FrameSkipper* pSkipper, FrameSkippingStatsSnapshot* pStats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,363 @@
+/** @file
+
+MODULE                : FrameSkippingBatchEngine
+
+FILE NAME             : FrameSkippingBatchEngine.h
+
+DESCRIPTION           : Makes skipping decisions for many streams at once. The state of all streams is kept
+                        in a structure-of-arrays layout so that a batch touches only the arrays it needs.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+#include "FrameSkippingEngine.h"
+
+/// one frame of a batch
+struct FrameBatchEntry
+{
+  uint32_t StreamId;
+  /// start time of the frame in 100 ns units
+  int64_t Start;
+};
+
+/**
+ * @brief The FrameSkippingBatchEngine decides which frames of many streams are kept.
+ *
+ * Every stream behaves exactly like a FrameSkippingEngine in the skip x frames every y, target rate or
+ * rational decimation mode. Duplicate detection, the lateness check and quality control need per stream
+ * resources and are not supported: such streams keep every frame.
+ *
+ * The state is stored per field rather than per stream. The rational decimation step is branch free and runs
+ * over all streams in one loop that the compiler vectorizes, the other modes are only visited for the streams
+ * that use them.
+ */
+class FrameSkippingBatchEngine
+{
+public:
+
+  explicit FrameSkippingBatchEngine(size_t uiStreams = 0)
+    :m_uiPatternBits(0)
+  {
+    resize(uiStreams);
+  }
+
+  /// sets the number of streams. New streams keep every frame until they are configured.
+  void resize(size_t uiStreams)
+  {
+    size_t uiOld = m_vMode.size();
+    if (uiStreams < uiOld)
+    {
+      for (size_t i = uiStreams; i < uiOld; ++i)
+        setMode(static_cast<uint32_t>(i), FSKIP_RATIONAL_DECIMATION);
+    }
+    m_vMode.resize(uiStreams, FSKIP_RATIONAL_DECIMATION);
+    m_vAccumulator.resize(uiStreams, 0);
+    m_vStep.resize(uiStreams, 0);
+    m_vModulus.resize(uiStreams, 0);
+    m_vPatternOffset.resize(uiStreams, 0);
+    m_vPatternLength.resize(uiStreams, 0);
+    m_vPatternPosition.resize(uiStreams, 0);
+    m_vSlot.resize(uiStreams, 0);
+    m_vIsTimeSet.resize(uiStreams, 0);
+    m_vTimeWhole.resize(uiStreams, 0);
+    m_vTimeFraction.resize(uiStreams, 0);
+    m_vDuration.resize(uiStreams);
+  }
+
+  size_t getStreamCount() const
+  {
+    return m_vMode.size();
+  }
+
+  /**
+   * @brief configures a stream and resets its streaming state.
+   * The skip x frames every y pattern is built from the floating point rates like SkipPattern::build.
+   * @return false if the stream id is out of range or the mode is not supported. The stream then keeps every frame.
+   */
+  bool configureStream(uint32_t uiStreamId, unsigned uiMode, const RationalFrameRate& sourceFrameRate, const RationalFrameRate& targetFrameRate)
+  {
+    if (uiStreamId >= m_vMode.size())
+      return false;
+
+    m_vStep[uiStreamId] = 0;
+    m_vModulus[uiStreamId] = 0;
+    m_vPatternLength[uiStreamId] = 0;
+    m_vDuration[uiStreamId] = FrameDuration();
+    bool bSupported = true;
+    switch (uiMode)
+    {
+    case FSKIP_SKIP_X_FRAMES_EVERY_Y:
+    {
+      unsigned uiSkip = 0, uiTotal = 0;
+      std::vector<int> vFramesToBeSkipped;
+      if (SkipPattern::build(sourceFrameRate.toDouble(), targetFrameRate.toDouble(), uiSkip, uiTotal, vFramesToBeSkipped) && !vFramesToBeSkipped.empty())
+      {
+        m_vPatternOffset[uiStreamId] = addPattern(uiSkip, uiTotal, vFramesToBeSkipped);
+        m_vPatternLength[uiStreamId] = static_cast<uint32_t>(vFramesToBeSkipped.size());
+      }
+      break;
+    }
+    case FSKIP_ACHIEVE_TARGET_RATE:
+    {
+      m_vDuration[uiStreamId] = FrameDuration(targetFrameRate);
+      break;
+    }
+    case FSKIP_RATIONAL_DECIMATION:
+    {
+      if (sourceFrameRate.isSet() && targetFrameRate.isSet())
+      {
+        uint64_t uiStep = static_cast<uint64_t>(targetFrameRate.Numerator) * sourceFrameRate.Denominator;
+        uint64_t uiModulus = static_cast<uint64_t>(sourceFrameRate.Numerator) * targetFrameRate.Denominator;
+        uint64_t uiGcd = RationalFrameRate::gcd(uiStep, uiModulus);
+        if (uiStep / uiGcd < uiModulus / uiGcd)
+        {
+          m_vStep[uiStreamId] = uiStep / uiGcd;
+          m_vModulus[uiStreamId] = uiModulus / uiGcd;
+        }
+      }
+      break;
+    }
+    default:
+    {
+      uiMode = FSKIP_RATIONAL_DECIMATION;
+      bSupported = false;
+      break;
+    }
+    }
+    setMode(uiStreamId, uiMode);
+    resetStream(uiStreamId);
+    return bSupported;
+  }
+
+  /// resets the streaming state of one stream
+  void resetStream(uint32_t uiStreamId)
+  {
+    // primes the accumulator so that the first frame is kept
+    m_vAccumulator[uiStreamId] = m_vModulus[uiStreamId] - m_vStep[uiStreamId];
+    m_vPatternPosition[uiStreamId] = 0;
+    m_vIsTimeSet[uiStreamId] = 0;
+  }
+
+  /// resets the streaming state of all streams
+  void reset()
+  {
+    for (size_t i = 0; i < m_vMode.size(); ++i)
+      resetStream(static_cast<uint32_t>(i));
+  }
+
+  /**
+   * @brief decides one frame of every stream.
+   * @param pStarts the start time of the frame of stream i at index i. May be NULL if no stream uses the target rate mode.
+   * @param pKeep receives 1 at index i if the frame of stream i is kept, 0 otherwise
+   */
+  void decideAll(const int64_t* pStarts, uint8_t* pKeep)
+  {
+    const size_t uiStreams = m_vMode.size();
+    uint64_t* pAccumulator = m_vAccumulator.data();
+    const uint64_t* pStep = m_vStep.data();
+    const uint64_t* pModulus = m_vModulus.data();
+    // streams that are not in the rational mode have a zero step and modulus and come out as kept
+    for (size_t i = 0; i < uiStreams; ++i)
+    {
+      uint64_t uiAccumulator = pAccumulator[i] + pStep[i];
+      uint64_t uiWrap = uiAccumulator >= pModulus[i] ? 1 : 0;
+      pAccumulator[i] = uiAccumulator - (pModulus[i] & (0 - uiWrap));
+      pKeep[i] = static_cast<uint8_t>(uiWrap);
+    }
+
+    for (size_t i = 0; i < m_vPatternStreams.size(); ++i)
+    {
+      uint32_t uiStreamId = m_vPatternStreams[i];
+      pKeep[uiStreamId] = keepPattern(uiStreamId) ? 1 : 0;
+    }
+    for (size_t i = 0; i < m_vTargetStreams.size(); ++i)
+    {
+      uint32_t uiStreamId = m_vTargetStreams[i];
+      pKeep[uiStreamId] = keepTargetRate(uiStreamId, pStarts[uiStreamId]) ? 1 : 0;
+    }
+  }
+
+  /**
+   * @brief decides a batch of frames in order. A stream may appear more than once.
+   * @param pKeep receives 1 at index i if the frame of pEntries[i] is kept, 0 otherwise
+   */
+  void decide(const FrameBatchEntry* pEntries, size_t uiEntries, uint8_t* pKeep)
+  {
+    for (size_t i = 0; i < uiEntries; ++i)
+    {
+      uint32_t uiStreamId = pEntries[i].StreamId;
+      bool bKeep = true;
+      switch (m_vMode[uiStreamId])
+      {
+      case FSKIP_SKIP_X_FRAMES_EVERY_Y:
+        bKeep = keepPattern(uiStreamId);
+        break;
+      case FSKIP_ACHIEVE_TARGET_RATE:
+        bKeep = keepTargetRate(uiStreamId, pEntries[i].Start);
+        break;
+      default:
+      {
+        uint64_t uiAccumulator = m_vAccumulator[uiStreamId] + m_vStep[uiStreamId];
+        bKeep = uiAccumulator >= m_vModulus[uiStreamId];
+        m_vAccumulator[uiStreamId] = bKeep ? uiAccumulator - m_vModulus[uiStreamId] : uiAccumulator;
+        break;
+      }
+      }
+      pKeep[i] = bKeep ? 1 : 0;
+    }
+  }
+
+private:
+
+  /// moves a stream into the index list of its mode
+  void setMode(uint32_t uiStreamId, unsigned uiMode)
+  {
+    removeFromList(uiStreamId);
+    m_vMode[uiStreamId] = static_cast<uint8_t>(uiMode);
+    std::vector<uint32_t>* pList = getList(uiMode);
+    if (pList != NULL)
+    {
+      m_vSlot[uiStreamId] = static_cast<uint32_t>(pList->size());
+      pList->push_back(uiStreamId);
+    }
+  }
+
+  void removeFromList(uint32_t uiStreamId)
+  {
+    std::vector<uint32_t>* pList = getList(m_vMode[uiStreamId]);
+    if (pList == NULL)
+      return;
+    // swap with the last entry
+    uint32_t uiSlot = m_vSlot[uiStreamId];
+    uint32_t uiLast = pList->back();
+    (*pList)[uiSlot] = uiLast;
+    m_vSlot[uiLast] = uiSlot;
+    pList->pop_back();
+  }
+
+  std::vector<uint32_t>* getList(unsigned uiMode)
+  {
+    switch (uiMode)
+    {
+    case FSKIP_SKIP_X_FRAMES_EVERY_Y:
+      return &m_vPatternStreams;
+    case FSKIP_ACHIEVE_TARGET_RATE:
+      return &m_vTargetStreams;
+    default:
+      return NULL;
+    }
+  }
+
+  /// stores a pattern once for all streams that use it and returns its offset in bits
+  uint32_t addPattern(unsigned uiSkip, unsigned uiTotal, const std::vector<int>& vFramesToBeSkipped)
+  {
+    std::pair<unsigned, unsigned> key(uiSkip, uiTotal);
+    std::map<std::pair<unsigned, unsigned>, uint32_t>::const_iterator it = m_mPatternOffsets.find(key);
+    if (it != m_mPatternOffsets.end())
+      return it->second;
+
+    uint32_t uiOffset = m_uiPatternBits;
+    m_uiPatternBits += static_cast<uint32_t>(vFramesToBeSkipped.size());
+    m_vPatternBits.resize((m_uiPatternBits + 63) / 64, 0);
+    for (size_t i = 0; i < vFramesToBeSkipped.size(); ++i)
+    {
+      if (vFramesToBeSkipped[i] != 0)
+      {
+        size_t uiBit = uiOffset + i;
+        m_vPatternBits[uiBit / 64] |= static_cast<uint64_t>(1) << (uiBit % 64);
+      }
+    }
+    m_mPatternOffsets[key] = uiOffset;
+    return uiOffset;
+  }
+
+  bool keepPattern(uint32_t uiStreamId)
+  {
+    uint32_t uiLength = m_vPatternLength[uiStreamId];
+    if (uiLength == 0)
+      return true;
+
+    uint32_t uiPosition = m_vPatternPosition[uiStreamId];
+    size_t uiBit = m_vPatternOffset[uiStreamId] + uiPosition;
+    bool bSkip = ((m_vPatternBits[uiBit / 64] >> (uiBit % 64)) & 1) != 0;
+    m_vPatternPosition[uiStreamId] = (uiPosition + 1 == uiLength) ? 0 : uiPosition + 1;
+    return !bSkip;
+  }
+
+  /// the target rate mode of FrameSkippingEngine on the split time line
+  bool keepTargetRate(uint32_t uiStreamId, int64_t tStart)
+  {
+    const FrameDuration& duration = m_vDuration[uiStreamId];
+    if (!duration.isSet())
+      return true;
+
+    FrameTimeline timeFrame;
+    if (!m_vIsTimeSet[uiStreamId])
+    {
+      timeFrame.set(tStart);
+      timeFrame.advance(duration, 1);
+      m_vIsTimeSet[uiStreamId] = 1;
+    }
+    else
+    {
+      if (tStart <= m_vTimeWhole[uiStreamId])
+        return false;
+      timeFrame.set(m_vTimeWhole[uiStreamId], m_vTimeFraction[uiStreamId]);
+      timeFrame.advance(duration, timeFrame.framesUntil(duration, tStart));
+    }
+    m_vTimeWhole[uiStreamId] = timeFrame.getTime();
+    m_vTimeFraction[uiStreamId] = timeFrame.getFraction();
+    return true;
+  }
+
+  // FrameSkippingMode of each stream
+  std::vector<uint8_t> m_vMode;
+  // rational decimation: zero step and modulus keep every frame
+  std::vector<uint64_t> m_vAccumulator;
+  std::vector<uint64_t> m_vStep;
+  std::vector<uint64_t> m_vModulus;
+  // skip x frames every y: position in the bit-packed pattern shared by all streams with the same ratio
+  std::vector<uint32_t> m_vPatternOffset;
+  std::vector<uint32_t> m_vPatternLength;
+  std::vector<uint32_t> m_vPatternPosition;
+  std::vector<uint64_t> m_vPatternBits;
+  uint32_t m_uiPatternBits;
+  std::map<std::pair<unsigned, unsigned>, uint32_t> m_mPatternOffsets;
+  // target rate: the end of the current time frame
+  std::vector<uint8_t> m_vIsTimeSet;
+  std::vector<int64_t> m_vTimeWhole;
+  std::vector<int64_t> m_vTimeFraction;
+  std::vector<FrameDuration> m_vDuration;
+  // the streams in the pattern and target rate modes and the position of each stream in its list
+  std::vector<uint32_t> m_vPatternStreams;
+  std::vector<uint32_t> m_vTargetStreams;
+  std::vector<uint32_t> m_vSlot;
+};
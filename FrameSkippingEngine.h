@@ -0,0 +1,1107 @@
+/** @file
+
+MODULE                : FrameSkippingEngine
+
+FILE NAME             : FrameSkippingEngine.h
+
+DESCRIPTION           : Platform-neutral frame skipping decisions. The engine takes plain 64-bit
+                        timestamps in 100 ns units and decides whether each frame is kept or dropped.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "BitrateBudget.h"
+#include "FrameRateEstimator.h"
+#include "FrameSignature.h"
+#include "FrameTime.h"
+#include "QualityController.h"
+#include "SkipPatternCache.h"
+
+// reference frames kept against the cadence are made up for by dropping up to this many later disposable frames
+const unsigned FSKIP_MAX_REFERENCE_DEBT = 8;
+
+enum FrameSkippingMode
+{
+  FSKIP_SKIP_X_FRAMES_EVERY_Y = 0,
+  FSKIP_ACHIEVE_TARGET_RATE = 1,
+  FSKIP_RATIONAL_DECIMATION = 2,
+  FSKIP_DROP_DUPLICATES = 3,
+  FSKIP_TEMPORAL_LAYERS = 4,
+  FSKIP_TOKEN_BUCKET = 5,
+  FSKIP_BITRATE_BUDGET = 6
+};
+
+// the temporal layer mode supports layers 0 to FSKIP_MAX_TEMPORAL_LAYERS - 1
+const unsigned FSKIP_MAX_TEMPORAL_LAYERS = 8;
+/**
+ * Samples kept by the temporal layer mode carry their layer in bits 24 to 27 of the type specific flags of
+ * the sample. Bit 28 marks the layer as valid. The low bits are left to the AM_VIDEO_FLAG values.
+ */
+const uint32_t FSKIP_TEMPORAL_LAYER_VALID = 0x10000000;
+const uint32_t FSKIP_TEMPORAL_LAYER_MASK = 0x0F000000;
+const unsigned FSKIP_TEMPORAL_LAYER_SHIFT = 24;
+
+/**
+ * @brief All settings of the FrameSkippingEngine.
+ * The settings are applied as one snapshot so that the engine never sees a mix of old and new values.
+ */
+struct FrameSkippingConfig
+{
+  FrameSkippingConfig()
+    :Mode(FSKIP_SKIP_X_FRAMES_EVERY_Y),
+    SourceFrameRate(0.0),
+    TargetFrameRate(0.0),
+    DuplicateThreshold(1.0),
+    MaxDuplicateInterval(0),
+    MaxLateness(0),
+    QualityControl(false),
+    MinOutputRate(0.0),
+    MaxOutputRate(0.0),
+    Repace(false),
+    MaxRepaceOffset(0),
+    TemporalLayers(4),
+    MaxTemporalLayer(3),
+    EstimateSourceRate(false),
+    BurstDuration(0),
+    MaxBitrate(0),
+    BitrateWindow(TIMESTAMP_TICKS_PER_SECOND),
+    Lookahead(0),
+    AnalysisThreads(0),
+    AnalysisDeadline(0)
+  {
+
+  }
+
+  /// see FrameSkippingMode
+  unsigned Mode;
+  /// floating point rates used by the skip x frames every y and target rate modes
+  double SourceFrameRate;
+  double TargetFrameRate;
+  /// exact rates used by the rational decimation and target rate modes
+  RationalFrameRate RationalSourceFrameRate;
+  RationalFrameRate RationalTargetFrameRate;
+  double DuplicateThreshold;
+  /// in 100 ns units
+  int64_t MaxDuplicateInterval;
+  /// in 100 ns units
+  int64_t MaxLateness;
+  bool QualityControl;
+  double MinOutputRate;
+  double MaxOutputRate;
+  /// the skip pattern for the floating point rates. If NULL the engine looks it up in the SkipPatternCache.
+  std::shared_ptr<const SkipPattern> Pattern;
+  /// moves kept frames onto an exact grid at the output frame rate, see OutputPacer
+  bool Repace;
+  /// in 100 ns units: 0 = one output frame
+  int64_t MaxRepaceOffset;
+  /// the number of dyadic layers of the temporal layer mode e.g. 4 for 60/30/15/7.5 fps out of 60 fps
+  unsigned TemporalLayers;
+  /// the temporal layer mode keeps the layers up to and including this one
+  unsigned MaxTemporalLayer;
+  /// replaces the source frame rates with the rate estimated from the timestamps, see FrameRateEstimator
+  bool EstimateSourceRate;
+  /// in 100 ns units: how far the token bucket mode may catch up with the target rate after a stall
+  int64_t BurstDuration;
+  /// the bitrate budget mode keeps the payload of the kept frames under this many bits per second. 0 = no limit
+  uint64_t MaxBitrate;
+  /// in 100 ns units: the sliding window over which the bitrate budget mode measures the bit rate
+  int64_t BitrateWindow;
+  /// the filter holds back this many frames and chooses which of them are kept at the rate of the mode, see LookaheadSelector.
+  /// Fewer than FSKIP_MIN_LOOKAHEAD frames keep the cadence.
+  unsigned Lookahead;
+  /// the filter analyses the pictures of the duplicate elimination mode on this many worker threads, see FrameAnalysisPool.
+  /// 0 = on the streaming thread
+  unsigned AnalysisThreads;
+  /// in 100 ns units after a picture was submitted to the workers: a later analysis is not waited for. 0 = no deadline
+  int64_t AnalysisDeadline;
+};
+
+/**
+ * @brief The clock that frame start times are compared with to detect late frames.
+ * The DirectShow filter uses the stream time of the filter graph, tests can drive a fake clock.
+ */
+class FrameSkippingClock
+{
+public:
+
+  virtual ~FrameSkippingClock()
+  {
+
+  }
+
+  /**
+   * @brief returns the current stream time in 100 ns units.
+   * @return false if the clock is not available e.g. when the graph is not running
+   */
+  virtual bool getStreamTime(int64_t& tNow) = 0;
+};
+
+/**
+ * @brief The FrameSkippingEngine decides which frames are kept.
+ *
+ * The engine has no dependencies on DirectShow so that the skipping logic can be
+ * measured and tuned outside a filter graph. The caller feeds it the start time of
+ * every media sample and forwards the sample only if keepFrame returns true.
+ */
+class FrameSkippingEngine
+{
+public:
+
+  /// Constructor
+  FrameSkippingEngine()
+    :m_uiMode(FSKIP_SKIP_X_FRAMES_EVERY_Y),
+    m_uiSkipFrameNumber(0),
+    m_uiTotalFrames(0),
+    m_uiCurrentFrame(0),
+    m_dSourceFrameRate(0.0),
+    m_dTargetFrameRate(0.0),
+    m_pPatternBits(NULL),
+    m_uiPatternLength(0),
+    m_bIsTimeSet(false),
+    m_uiAccumulator(0),
+    m_uiAccumulatorStep(0),
+    m_uiAccumulatorModulus(0),
+    m_dDuplicateThreshold(1.0),
+    m_iMaxDuplicateTicks(0),
+    m_bHasKeptSignature(false),
+    m_tLastKept(0),
+    m_pClock(NULL),
+    m_iMaxLatenessTicks(0),
+    m_uiDroppedSinceKept(0),
+    m_uiReferenceDebt(0),
+    m_uiTemporalLayers(4),
+    m_uiMaxTemporalLayer(3),
+    m_uiLayerFrame(0),
+    m_uiLastTemporalLayer(0),
+    m_bEstimateSourceRate(false),
+    m_uiSourceRateChanges(0),
+    m_iBurstTicks(0)
+  {
+
+  }
+
+  /// sets the mode of operation, see FrameSkippingMode
+  void setMode(unsigned uiMode)
+  {
+    m_uiMode = uiMode;
+  }
+
+  unsigned getMode() const
+  {
+    return m_uiMode;
+  }
+
+  /// sets the source frame rate: only used to build the skip pattern
+  void setSourceFrameRate(double dSourceFrameRate)
+  {
+    m_dSourceFrameRate = dSourceFrameRate;
+  }
+
+  /// sets the target frame rate: the target rate mode picks this up on the next frame
+  void setTargetFrameRate(double dTargetFrameRate)
+  {
+    m_dTargetFrameRate = dTargetFrameRate;
+  }
+
+  /**
+   * @brief sets the exact source and target frame rates used by the rational decimation mode.
+   * The new ratio takes effect on the next frame and the phase of the accumulator is preserved.
+   */
+  void setRationalFrameRates(const RationalFrameRate& sourceFrameRate, const RationalFrameRate& targetFrameRate)
+  {
+    m_sourceFrameRate = sourceFrameRate;
+    m_targetFrameRate = targetFrameRate;
+    FrameDuration targetFrameDuration(targetFrameRate);
+    m_timeFrame.rescale(m_targetFrameDuration, targetFrameDuration);
+    m_targetFrameDuration = targetFrameDuration;
+
+    uint64_t uiStep = 0, uiModulus = 0;
+    // keep every frame if either rate is unset or if the target rate is not lower than the source rate
+    if (sourceFrameRate.isSet() && targetFrameRate.isSet())
+    {
+      uiStep = static_cast<uint64_t>(targetFrameRate.Numerator) * sourceFrameRate.Denominator;
+      uiModulus = static_cast<uint64_t>(sourceFrameRate.Numerator) * targetFrameRate.Denominator;
+      uint64_t uiGcd = RationalFrameRate::gcd(uiStep, uiModulus);
+      uiStep /= uiGcd;
+      uiModulus /= uiGcd;
+      if (uiStep >= uiModulus)
+        uiStep = uiModulus = 0;
+    }
+    uint64_t uiOldModulus = m_uiAccumulatorModulus;
+    m_uiAccumulatorStep = uiStep;
+    m_uiAccumulatorModulus = uiModulus;
+    if (uiOldModulus == 0)
+    {
+      resetAccumulator();
+    }
+    else if (m_uiAccumulatorModulus != 0 && uiModulus != uiOldModulus)
+    {
+      // keep the progress towards the next kept frame
+      double dPhase = m_uiAccumulator / static_cast<double>(uiOldModulus);
+      m_uiAccumulator = std::min(static_cast<uint64_t>(dPhase * m_uiAccumulatorModulus), m_uiAccumulatorModulus - 1);
+    }
+  }
+
+  /**
+   * @brief sets the dyadic layers of the temporal layer mode. Frame n of the stream is in layer 0 if n is a multiple of
+   * 2^(layers - 1), otherwise in layer (layers - 1 - number of trailing zero bits of n). Lowering the highest kept layer
+   * keeps a subset of the frames so that it can change at any time without disturbing the cadence.
+   */
+  void setTemporalLayers(unsigned uiLayers, unsigned uiMaxLayer)
+  {
+    uiLayers = std::max(1u, std::min(uiLayers, FSKIP_MAX_TEMPORAL_LAYERS));
+    // a different number of layers assigns different layers: start again with a layer 0 frame
+    if (uiLayers != m_uiTemporalLayers)
+      m_uiLayerFrame = 0;
+    m_uiTemporalLayers = uiLayers;
+    m_uiMaxTemporalLayer = std::min(uiMaxLayer, uiLayers - 1);
+  }
+
+  unsigned getTemporalLayers() const
+  {
+    return m_uiTemporalLayers;
+  }
+
+  unsigned getMaxTemporalLayer() const
+  {
+    return m_uiMaxTemporalLayer;
+  }
+
+  /// the layer of the last frame passed to keepFrame in the temporal layer mode
+  unsigned getLastTemporalLayer() const
+  {
+    return m_uiLastTemporalLayer;
+  }
+
+  /// the temporal layer of frame uiFrame of a stream with uiLayers dyadic layers
+  static unsigned getTemporalLayer(uint64_t uiFrame, unsigned uiLayers)
+  {
+    unsigned uiLayer = 0;
+    for (unsigned uiPeriod = 1u << (uiLayers - 1); uiPeriod > 1 && uiFrame % uiPeriod != 0; uiPeriod >>= 1)
+      ++uiLayer;
+    return uiLayer;
+  }
+
+  /// the type specific sample flags with the temporal layer set
+  static uint32_t setTemporalLayerFlags(uint32_t uiFlags, unsigned uiLayer)
+  {
+    return (uiFlags & ~(FSKIP_TEMPORAL_LAYER_MASK | FSKIP_TEMPORAL_LAYER_VALID)) | FSKIP_TEMPORAL_LAYER_VALID
+      | ((uiLayer << FSKIP_TEMPORAL_LAYER_SHIFT) & FSKIP_TEMPORAL_LAYER_MASK);
+  }
+
+  /// @return false if the type specific sample flags carry no temporal layer
+  static bool getTemporalLayerFlags(uint32_t uiFlags, unsigned& ruiLayer)
+  {
+    if ((uiFlags & FSKIP_TEMPORAL_LAYER_VALID) == 0)
+      return false;
+    ruiLayer = (uiFlags & FSKIP_TEMPORAL_LAYER_MASK) >> FSKIP_TEMPORAL_LAYER_SHIFT;
+    return true;
+  }
+
+  /**
+   * @brief sets the largest mean absolute luma difference per 8x8 block at which a frame is
+   * considered a duplicate of the last frame that was kept.
+   */
+  void setDuplicateThreshold(double dThreshold)
+  {
+    m_dDuplicateThreshold = dThreshold;
+  }
+
+  /// duplicates are kept anyway once the last kept frame is older than this. 0 never keeps duplicates.
+  void setMaxDuplicateInterval(int64_t iTicks)
+  {
+    m_iMaxDuplicateTicks = iTicks;
+  }
+
+  /**
+   * @brief the token bucket mode saves the credit of frames that did not arrive for up to this many ticks, e.g. during
+   * an upstream stall, and spends it on the frames that follow. 0 limits the output like the target rate mode.
+   */
+  void setBurstDuration(int64_t iTicks)
+  {
+    m_iBurstTicks = std::max<int64_t>(iTicks, 0);
+  }
+
+  int64_t getBurstDuration() const
+  {
+    return m_iBurstTicks;
+  }
+
+  /**
+   * @brief the bitrate budget mode drops disposable frames whose payload would take the kept bits within any window
+   * of iWindowTicks above uiMaxBitrate bits per second. Sync points and reference frames are always kept.
+   */
+  void setBitrateBudget(uint64_t uiMaxBitrate, int64_t iWindowTicks)
+  {
+    m_budget.setLimit(uiMaxBitrate, iWindowTicks);
+  }
+
+  const BitrateBudget& getBitrateBudget() const
+  {
+    return m_budget;
+  }
+
+  /// sets the clock used to detect late frames. The clock must outlive the engine.
+  void setClock(FrameSkippingClock* pClock)
+  {
+    m_pClock = pClock;
+  }
+
+  /**
+   * @brief frames that start more than this many ticks before the current stream time are dropped
+   * in every mode before the mode makes its decision. 0 disables the check.
+   */
+  void setMaxLateness(int64_t iTicks)
+  {
+    m_iMaxLatenessTicks = iTicks;
+  }
+
+  /// enables adapting the output rate to quality messages from downstream in every mode
+  void setQualityControl(bool bEnabled)
+  {
+    m_quality.setEnabled(bEnabled);
+  }
+
+  /// bounds of the output rate chosen by quality control in fps. 0 means no bound.
+  void setQualityLimits(double dMinOutputRate, double dMaxOutputRate)
+  {
+    m_quality.setLimits(dMinOutputRate, dMaxOutputRate);
+  }
+
+  /**
+   * @brief passes a quality message from downstream to quality control. May be called from any thread:
+   * the streaming thread picks up the new output rate on its next frame.
+   * @param iLate how late downstream renders in 100 ns units
+   * @param lProportion the rate downstream can handle in parts per thousand of the current rate
+   * @return true if the output rate limit changed
+   */
+  bool notifyQuality(int64_t iLate, long lProportion)
+  {
+    return m_quality.notify(iLate, lProportion);
+  }
+
+  bool isQualityControlEnabled() const
+  {
+    return m_quality.isEnabled();
+  }
+
+  /// the output rate limit set by quality control in fps. 0 if the output is not limited.
+  double getQualityOutputRate() const
+  {
+    return m_quality.getOutputRateLimit();
+  }
+
+  /// the end of the current target time frame of the target rate mode
+  FrameTimeline getTimeFrame() const
+  {
+    return m_timeFrame;
+  }
+
+  RationalFrameRate getRationalSourceFrameRate() const
+  {
+    return m_sourceFrameRate;
+  }
+
+  RationalFrameRate getRationalTargetFrameRate() const
+  {
+    return m_targetFrameRate;
+  }
+
+  /**
+   * @brief derives the source frame rate from the timestamps. Each new estimate replaces the source rates
+   * and rebuilds the cadence of the current mode, continuing its phase.
+   */
+  void setSourceRateEstimation(bool bEstimate)
+  {
+    if (!bEstimate)
+      m_rateEstimator.reset();
+    m_bEstimateSourceRate = bEstimate;
+  }
+
+  bool isSourceRateEstimated() const
+  {
+    return m_bEstimateSourceRate;
+  }
+
+  /// the estimated source frame rate: unset until enough frames were seen
+  const RationalFrameRate& getEstimatedSourceFrameRate() const
+  {
+    return m_rateEstimator.getFrameRate();
+  }
+
+  /// counts the changes of the estimated source frame rate so that callers can follow them
+  uint64_t getSourceRateChanges() const
+  {
+    return m_uiSourceRateChanges;
+  }
+
+  /// replaces the source frame rates of a config and looks up the skip pattern for them
+  static void setConfigSourceFrameRate(FrameSkippingConfig& config, const RationalFrameRate& sourceFrameRate)
+  {
+    config.SourceFrameRate = sourceFrameRate.toDouble();
+    config.RationalSourceFrameRate = sourceFrameRate;
+    if (config.Mode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+      config.Pattern = SkipPatternCache::getInstance().getPattern(config.SourceFrameRate, config.TargetFrameRate);
+  }
+
+  /// returns the exact frame rate if the numerator is set, otherwise the rational approximation of the floating point rate
+  static RationalFrameRate toRationalFrameRate(uint32_t uiNum, uint32_t uiDen, double dFrameRate)
+  {
+    if (uiNum > 0)
+      return RationalFrameRate(uiNum, uiDen).reduced();
+    return RationalFrameRate::fromDouble(dFrameRate);
+  }
+
+  /// the number of frames skipped per pattern after the last call to buildPattern
+  unsigned getSkipFrameNumber() const
+  {
+    return m_uiSkipFrameNumber;
+  }
+
+  /// the length of the pattern after the last call to buildPattern
+  unsigned getTotalFrames() const
+  {
+    return m_uiTotalFrames;
+  }
+
+  /// returns true if the current mode needs the start time of each sample
+  bool requiresTimestamps() const
+  {
+    if (isLatenessCheckEnabled() || m_quality.isEnabled() || m_bEstimateSourceRate)
+      return true;
+
+    switch (m_uiMode)
+    {
+    case FSKIP_ACHIEVE_TARGET_RATE:
+    case FSKIP_TOKEN_BUCKET:
+      return m_targetFrameDuration.isSet();
+    case FSKIP_DROP_DUPLICATES:
+      return m_targetFrameDuration.isSet() || m_iMaxDuplicateTicks > 0;
+    case FSKIP_BITRATE_BUDGET:
+      return m_budget.isLimited();
+    default:
+      return false;
+    }
+  }
+
+  /**
+   * @brief the nominal rate of the kept frames in the current mode before quality control.
+   * The drop duplicates mode reports its target rate, the actual rate depends on the content.
+   * @return an unset rate if it cannot be determined
+   */
+  RationalFrameRate getOutputFrameRate() const
+  {
+    switch (m_uiMode)
+    {
+    case FSKIP_SKIP_X_FRAMES_EVERY_Y:
+    {
+      RationalFrameRate sourceFrameRate = RationalFrameRate::fromDouble(m_dSourceFrameRate);
+      if (!sourceFrameRate.isSet() || m_uiTotalFrames == 0)
+        return sourceFrameRate;
+      if (m_uiSkipFrameNumber >= m_uiTotalFrames)
+        return RationalFrameRate();
+      uint64_t uiNum = static_cast<uint64_t>(sourceFrameRate.Numerator) * (m_uiTotalFrames - m_uiSkipFrameNumber);
+      uint64_t uiDen = static_cast<uint64_t>(sourceFrameRate.Denominator) * m_uiTotalFrames;
+      uint64_t uiGcd = RationalFrameRate::gcd(uiNum, uiDen);
+      uiNum /= uiGcd;
+      uiDen /= uiGcd;
+      if (uiNum > UINT32_MAX || uiDen > UINT32_MAX)
+        return RationalFrameRate::fromDouble(uiNum / static_cast<double>(uiDen));
+      return RationalFrameRate(static_cast<uint32_t>(uiNum), static_cast<uint32_t>(uiDen));
+    }
+    case FSKIP_RATIONAL_DECIMATION:
+      return (m_uiAccumulatorModulus != 0) ? m_targetFrameRate : m_sourceFrameRate;
+    case FSKIP_ACHIEVE_TARGET_RATE:
+    case FSKIP_DROP_DUPLICATES:
+    case FSKIP_TOKEN_BUCKET:
+      return m_targetFrameRate.isSet() ? m_targetFrameRate : m_sourceFrameRate;
+    case FSKIP_TEMPORAL_LAYERS:
+    {
+      // each layer above the kept ones halves the rate
+      unsigned uiDivisor = 1u << (m_uiTemporalLayers - 1 - m_uiMaxTemporalLayer);
+      return RationalFrameRate(m_sourceFrameRate.Numerator, m_sourceFrameRate.Denominator * uiDivisor).reduced();
+    }
+    case FSKIP_BITRATE_BUDGET:
+      // the number of kept frames depends on their sizes
+      return m_sourceFrameRate;
+    default:
+      return RationalFrameRate();
+    }
+  }
+
+  /**
+   * @brief the average duration of an output frame for the given settings as announced in the output media type.
+   * Quality control is not included: it only lowers the rate for as long as downstream falls behind.
+   * @param iSourceDuration the average duration of a source frame in 100 ns units. 0 = unknown
+   * @return 0 if the duration cannot be determined
+   */
+  static int64_t getOutputFrameDuration(const FrameSkippingConfig& config, int64_t iSourceDuration)
+  {
+    switch (config.Mode)
+    {
+    case FSKIP_SKIP_X_FRAMES_EVERY_Y:
+    {
+      if (iSourceDuration <= 0 && config.SourceFrameRate > 0.0)
+        iSourceDuration = static_cast<int64_t>(TIMESTAMP_FACTOR / config.SourceFrameRate + 0.5);
+      if (!config.Pattern || config.Pattern->getTotalFrames() == 0)
+        return iSourceDuration;
+      unsigned uiKept = config.Pattern->getTotalFrames() - config.Pattern->getSkipFrameNumber();
+      if (uiKept == 0)
+        return 0;
+      return static_cast<int64_t>(std::llround(static_cast<double>(iSourceDuration) * config.Pattern->getTotalFrames() / uiKept));
+    }
+    case FSKIP_RATIONAL_DECIMATION:
+    {
+      const RationalFrameRate& source = config.RationalSourceFrameRate;
+      const RationalFrameRate& target = config.RationalTargetFrameRate;
+      // every frame is kept unless the target rate is below the source rate
+      if (!source.isSet() || !target.isSet() || !(target.toDouble() < source.toDouble()))
+        return iSourceDuration;
+      if (iSourceDuration <= 0)
+        return roundedDuration(target);
+      return static_cast<int64_t>(std::llround(iSourceDuration * source.toDouble() / target.toDouble()));
+    }
+    case FSKIP_ACHIEVE_TARGET_RATE:
+    case FSKIP_DROP_DUPLICATES:
+    case FSKIP_TOKEN_BUCKET:
+    {
+      if (!config.RationalTargetFrameRate.isSet())
+        return iSourceDuration;
+      return std::max(iSourceDuration, roundedDuration(config.RationalTargetFrameRate));
+    }
+    case FSKIP_TEMPORAL_LAYERS:
+    {
+      unsigned uiLayers = std::max(1u, std::min(config.TemporalLayers, FSKIP_MAX_TEMPORAL_LAYERS));
+      unsigned uiMaxLayer = std::min(config.MaxTemporalLayer, uiLayers - 1);
+      if (iSourceDuration <= 0 && config.RationalSourceFrameRate.isSet())
+        iSourceDuration = roundedDuration(config.RationalSourceFrameRate);
+      return iSourceDuration << (uiLayers - 1 - uiMaxLayer);
+    }
+    default:
+      return iSourceDuration;
+    }
+  }
+
+  /// returns true if the current mode inspects the pixel data of each frame
+  bool requiresPicture() const
+  {
+    return m_uiMode == FSKIP_DROP_DUPLICATES;
+  }
+
+  /**
+   * @brief looks up the skip x frames every y pattern for the source and target frame rates in the SkipPatternCache.
+   * This should be called before streaming starts.
+   * @return true if a new skip and total frame number was calculated
+   */
+  bool buildPattern()
+  {
+    if (m_uiMode != FSKIP_SKIP_X_FRAMES_EVERY_Y)
+    {
+      setPattern(std::shared_ptr<const SkipPattern>());
+      return false;
+    }
+    std::shared_ptr<const SkipPattern> pPattern = SkipPatternCache::getInstance().getPattern(m_dSourceFrameRate, m_dTargetFrameRate);
+    setPattern(pPattern);
+    return pPattern != NULL;
+  }
+
+  /**
+   * @brief uses a pattern that was already looked up and restarts it. NULL keeps every frame.
+   * The skip and total frame numbers are only updated if a pattern is passed.
+   */
+  void setPattern(const std::shared_ptr<const SkipPattern>& pPattern)
+  {
+    m_uiCurrentFrame = 0;
+    m_pPattern.reset();
+    m_pPatternBits = NULL;
+    m_uiPatternLength = 0;
+    if (!pPattern)
+      return;
+    m_uiSkipFrameNumber = pPattern->getSkipFrameNumber();
+    m_uiTotalFrames = pPattern->getTotalFrames();
+    if (pPattern->getLength() > 0)
+    {
+      m_pPattern = pPattern;
+      m_pPatternBits = pPattern->getBits();
+      m_uiPatternLength = pPattern->getLength();
+    }
+  }
+
+  /**
+   * @brief rebuilds the skip x frames every y pattern while streaming.
+   * The position within the new pattern continues the cadence of the frames dropped since the last kept frame.
+   */
+  bool rebuildPattern()
+  {
+    bool res = buildPattern();
+    alignPattern();
+    return res;
+  }
+
+  /**
+   * @brief applies a complete set of settings while streaming.
+   * A new mode or frame rate takes effect on the next frame. The pattern position, the accumulator and the
+   * target time line keep their phase.
+   */
+  void applyConfig(const FrameSkippingConfig& config)
+  {
+    setSourceRateEstimation(config.EstimateSourceRate);
+    // the estimate takes the place of the configured source rates
+    if (config.EstimateSourceRate && m_rateEstimator.hasEstimate() && config.RationalSourceFrameRate != m_rateEstimator.getFrameRate())
+    {
+      FrameSkippingConfig estimated(config);
+      setConfigSourceFrameRate(estimated, m_rateEstimator.getFrameRate());
+      applySettings(estimated);
+      return;
+    }
+    applySettings(config);
+  }
+
+  /// resets the streaming state: the pattern position and the target rate time line
+  void reset()
+  {
+    m_uiCurrentFrame = 0;
+    m_bIsTimeSet = false;
+    resetAccumulator();
+    m_bHasKeptSignature = false;
+    m_quality.reset();
+    m_uiDroppedSinceKept = 0;
+    m_uiReferenceDebt = 0;
+    m_uiLayerFrame = 0;
+    m_rateEstimator.reset();
+    m_budget.reset();
+  }
+
+  /// clears the pattern and the streaming state
+  void clear()
+  {
+    reset();
+    setPattern(std::shared_ptr<const SkipPattern>());
+  }
+
+  /**
+   * @brief decides whether the frame starting at tStart is kept.
+   * @param tStart The start time of the frame in 100 ns units. Only needed if requiresTimestamps returns true.
+   * @param pPicture The pixel data of the frame. Only needed if requiresPicture returns true.
+   * If it is NULL the frame is treated as different from the previous one.
+   * @param bDisposable false if other frames depend on this one, e.g. a compressed reference frame: it is never dropped.
+   * The next disposable frames that the mode would keep are dropped in its place so that the rate is kept.
+   * @param uiBytes The payload size of the frame. Only needed in the bitrate budget mode.
+   * @return true if the frame should be delivered, false if it should be dropped
+   */
+  bool keepFrame(int64_t tStart, const FramePicture* pPicture = NULL, bool bDisposable = true, uint32_t uiBytes = 0)
+  {
+    return decide(tStart, pPicture, NULL, bDisposable, uiBytes);
+  }
+
+  /**
+   * @brief as keepFrame for a frame whose signature was computed by the caller, e.g. once for several engines.
+   * @param pSignature The signature of the frame or NULL if the frame is different from the previous one.
+   */
+  bool keepFrameWithSignature(int64_t tStart, const FrameSignature* pSignature, bool bDisposable = true, uint32_t uiBytes = 0)
+  {
+    return decide(tStart, NULL, pSignature, bDisposable, uiBytes);
+  }
+
+  /**
+   * @brief calculates the lowest ratio of frames to be skipped per total frames.
+   * Frame rates are limited to 1 decimal.
+   * @return false if the target frame rate exceeds the source frame rate
+   */
+  static bool lowestRatio(double SourceFrameRate, double targetFrameRate, int& iSkipFrame, int& tTotalFrames)
+  {
+    return SkipPattern::lowestRatio(SourceFrameRate, targetFrameRate, iSkipFrame, tTotalFrames);
+  }
+
+  /// the duration of a frame rounded to whole ticks
+  static int64_t roundedDuration(const RationalFrameRate& frameRate)
+  {
+    FrameDuration duration(frameRate);
+    return (duration.getTicks() + duration.getDivisor() / 2) / duration.getDivisor();
+  }
+
+private:
+
+  /// applies a config in which the source rates are final
+  void applySettings(const FrameSkippingConfig& config)
+  {
+    bool bModeChanged = config.Mode != m_uiMode;
+    bool bRebuild = bModeChanged || config.SourceFrameRate != m_dSourceFrameRate || config.TargetFrameRate != m_dTargetFrameRate;
+    setMode(config.Mode);
+    setSourceFrameRate(config.SourceFrameRate);
+    setTargetFrameRate(config.TargetFrameRate);
+    if (config.RationalSourceFrameRate != m_sourceFrameRate || config.RationalTargetFrameRate != m_targetFrameRate)
+      setRationalFrameRates(config.RationalSourceFrameRate, config.RationalTargetFrameRate);
+    setDuplicateThreshold(config.DuplicateThreshold);
+    setMaxDuplicateInterval(config.MaxDuplicateInterval);
+    setMaxLateness(config.MaxLateness);
+    setBurstDuration(config.BurstDuration);
+    setBitrateBudget(config.MaxBitrate, config.BitrateWindow);
+    if (config.QualityControl != m_quality.isEnabled())
+      setQualityControl(config.QualityControl);
+    setQualityLimits(config.MinOutputRate, config.MaxOutputRate);
+    setTemporalLayers(config.TemporalLayers, config.MaxTemporalLayer);
+    if (bRebuild)
+    {
+      if (config.Pattern && m_uiMode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+        setPattern(config.Pattern);
+      else
+        buildPattern();
+      alignPattern();
+    }
+    if (bModeChanged)
+      alignPhase();
+  }
+
+  /// the decision of keepFrame: the signature is computed from the picture if it is not passed
+  bool decide(int64_t tStart, const FramePicture* pPicture, const FrameSignature* pSignature, bool bDisposable, uint32_t uiBytes)
+  {
+    // every frame counts towards the estimate, including the late ones
+    if (m_bEstimateSourceRate && m_rateEstimator.addTimestamp(tStart))
+      changeSourceFrameRate(m_rateEstimator.getFrameRate());
+
+    // a late frame is dropped without advancing the mode so that the next frame takes its place
+    if (bDisposable && isLatenessCheckEnabled())
+    {
+      int64_t tNow = 0;
+      if (m_pClock->getStreamTime(tNow) && tNow - tStart > m_iMaxLatenessTicks)
+        return false;
+    }
+
+    if (!decideMode(tStart, pPicture, pSignature, bDisposable, uiBytes))
+    {
+      if (bDisposable)
+      {
+        ++m_uiDroppedSinceKept;
+        return false;
+      }
+      if (m_uiReferenceDebt < FSKIP_MAX_REFERENCE_DEBT)
+        ++m_uiReferenceDebt;
+    }
+    else if (bDisposable && m_uiReferenceDebt > 0)
+    {
+      --m_uiReferenceDebt;
+      ++m_uiDroppedSinceKept;
+      return false;
+    }
+    m_uiDroppedSinceKept = 0;
+
+    // quality control thins out the frames that the mode kept
+    if (m_quality.isEnabled() && !m_quality.keepFrame(tStart) && bDisposable)
+      return false;
+    if (m_uiMode == FSKIP_BITRATE_BUDGET)
+      m_budget.add(tStart, uiBytes, !bDisposable);
+    return true;
+  }
+
+  /// follows a new estimate of the source frame rate in every mode that depends on it
+  void changeSourceFrameRate(const RationalFrameRate& sourceFrameRate)
+  {
+    m_dSourceFrameRate = sourceFrameRate.toDouble();
+    setRationalFrameRates(sourceFrameRate, m_targetFrameRate);
+    if (m_uiMode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+      rebuildPattern();
+    ++m_uiSourceRateChanges;
+  }
+
+  bool isLatenessCheckEnabled() const
+  {
+    return m_pClock != NULL && m_iMaxLatenessTicks > 0;
+  }
+
+  /// the decision of the current mode
+  bool decideMode(int64_t tStart, const FramePicture* pPicture, const FrameSignature* pSignature, bool bDisposable, uint32_t uiBytes)
+  {
+    switch (m_uiMode)
+    {
+    case FSKIP_ACHIEVE_TARGET_RATE:
+    {
+      return keepTargetRate(tStart);
+    }
+    case FSKIP_TOKEN_BUCKET:
+    {
+      return keepTokenBucket(tStart);
+    }
+    case FSKIP_BITRATE_BUDGET:
+    {
+      // disposable frames cost nothing but their own payload to drop: they are kept while they fit
+      return m_budget.fits(tStart, uiBytes, !bDisposable);
+    }
+    case FSKIP_DROP_DUPLICATES:
+    {
+      if (pSignature == NULL && pPicture != NULL && m_currentSignature.compute(*pPicture))
+        pSignature = &m_currentSignature;
+      return keepNonDuplicate(tStart, pSignature);
+    }
+    case FSKIP_SKIP_X_FRAMES_EVERY_Y:
+    {
+      if (m_uiPatternLength == 0)
+        return true;
+
+      bool bSkip = ((m_pPatternBits[m_uiCurrentFrame / 64] >> (m_uiCurrentFrame % 64)) & 1) != 0;
+      if (++m_uiCurrentFrame >= m_uiPatternLength)
+      {
+        m_uiCurrentFrame = 0;
+      }
+      return !bSkip;
+    }
+    case FSKIP_TEMPORAL_LAYERS:
+    {
+      m_uiLastTemporalLayer = getTemporalLayer(m_uiLayerFrame++, m_uiTemporalLayers);
+      return m_uiLastTemporalLayer <= m_uiMaxTemporalLayer;
+    }
+    case FSKIP_RATIONAL_DECIMATION:
+    {
+      // Bresenham style decimation: keeps exactly step out of every modulus frames
+      if (m_uiAccumulatorModulus == 0)
+        return true;
+
+      m_uiAccumulator += m_uiAccumulatorStep;
+      if (m_uiAccumulator >= m_uiAccumulatorModulus)
+      {
+        m_uiAccumulator -= m_uiAccumulatorModulus;
+        return true;
+      }
+      return false;
+    }
+    default:
+    {
+      assert(false);
+      return true;
+    }
+    }
+  }
+
+  /// enforces the minimum spacing of the target frame rate
+  bool keepTargetRate(int64_t tStart)
+  {
+    if (!m_targetFrameDuration.isSet())
+      return true;
+
+    // runs only once per streaming session to initialize the first target time frame
+    if (!m_bIsTimeSet)
+    {
+      m_timeFrame.set(tStart);
+      m_timeFrame.advance(m_targetFrameDuration, 1);
+      m_bIsTimeSet = true;
+      return true;
+    }
+    if (m_timeFrame.isBefore(tStart))
+    {
+      // move the time frame to the first frame boundary at or after the current frame
+      m_timeFrame.advance(m_targetFrameDuration, m_timeFrame.framesUntil(m_targetFrameDuration, tStart));
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief the token bucket mode in its virtual scheduling form: a frame is kept once its start time passes the time
+   * line, which then advances by one target frame. The time line may lag behind the start times by up to the burst
+   * duration, so the frames that follow a stall catch up on the frames that did not arrive. Any interval of length T
+   * keeps fewer than (T + burst duration) * target rate + 2 frames. Without a burst this is the target rate mode.
+   */
+  bool keepTokenBucket(int64_t tStart)
+  {
+    if (!m_targetFrameDuration.isSet())
+      return true;
+
+    if (!m_bIsTimeSet)
+    {
+      m_timeFrame.set(tStart);
+      m_timeFrame.advance(m_targetFrameDuration, 1);
+      m_bIsTimeSet = true;
+      return true;
+    }
+    if (!m_timeFrame.isBefore(tStart))
+      return false;
+    m_timeFrame.advance(m_targetFrameDuration, 1);
+    // the credit of a longer stall is lost: move to the first frame boundary at or after the oldest time it may lag
+    int64_t tOldest = tStart - m_iBurstTicks;
+    if (m_timeFrame.isBefore(tOldest))
+      m_timeFrame.advance(m_targetFrameDuration, m_timeFrame.framesUntil(m_targetFrameDuration, tOldest));
+    return true;
+  }
+
+  /// drops frames that are nearly identical to the last kept frame and limits the rest to the target rate
+  bool keepNonDuplicate(int64_t tStart, const FrameSignature* pSignature)
+  {
+    if (pSignature != NULL && m_bHasKeptSignature)
+    {
+      double dDifference = pSignature->meanAbsoluteDifference(m_lastKeptSignature);
+      bool bRefresh = m_iMaxDuplicateTicks > 0 && tStart - m_tLastKept >= m_iMaxDuplicateTicks;
+      if (dDifference >= 0.0 && dDifference <= m_dDuplicateThreshold && !bRefresh)
+        return false;
+    }
+    if (!keepTargetRate(tStart))
+      return false;
+
+    m_tLastKept = tStart;
+    m_bHasKeptSignature = pSignature != NULL;
+    // a signature of the caller is copied: the blocks are reused if the frame size does not change
+    if (pSignature == &m_currentSignature)
+      m_lastKeptSignature.swap(m_currentSignature);
+    else if (pSignature != NULL)
+      m_lastKeptSignature.assign(*pSignature);
+    return true;
+  }
+
+  /**
+   * @brief continues the cadence of the previous mode in a newly selected mode: the next frame is kept
+   * where the new mode would have kept it had it kept the last frame the previous mode kept.
+   */
+  void alignPhase()
+  {
+    switch (m_uiMode)
+    {
+    case FSKIP_RATIONAL_DECIMATION:
+    {
+      if (m_uiAccumulatorModulus == 0)
+        break;
+      // just after a kept frame the accumulator is 0 and grows by step per dropped frame
+      uint64_t uiLimit = m_uiAccumulatorModulus - m_uiAccumulatorStep;
+      m_uiAccumulator = (m_uiDroppedSinceKept >= uiLimit / m_uiAccumulatorStep) ? uiLimit : m_uiDroppedSinceKept * m_uiAccumulatorStep;
+      break;
+    }
+    case FSKIP_SKIP_X_FRAMES_EVERY_Y:
+    {
+      alignPattern();
+      break;
+    }
+    case FSKIP_TEMPORAL_LAYERS:
+    {
+      // the next frame is a layer 0 frame and is kept
+      m_uiLayerFrame = 0;
+      break;
+    }
+    case FSKIP_BITRATE_BUDGET:
+    {
+      // the window only holds the frames kept in this mode
+      m_budget.reset();
+      break;
+    }
+    default:
+    {
+      // the time line of the previous mode is unknown: the next frame starts a new one
+      m_bIsTimeSet = false;
+      break;
+    }
+    }
+  }
+
+  /// moves the pattern position to the frame after the first kept frame plus the frames dropped since then
+  void alignPattern()
+  {
+    const unsigned uiLength = m_uiPatternLength;
+    if (uiLength == 0)
+      return;
+    unsigned uiPosition = 0;
+    while (uiPosition < uiLength && m_pPattern->isSkipped(uiPosition))
+      ++uiPosition;
+    uiPosition = (uiPosition + 1) % uiLength;
+    // never skip past a kept frame: if more frames were dropped than the pattern drops the next one is kept
+    for (unsigned uiDropped = 0; uiDropped < m_uiDroppedSinceKept && m_pPattern->isSkipped(uiPosition); ++uiDropped)
+      uiPosition = (uiPosition + 1) % uiLength;
+    m_uiCurrentFrame = uiPosition;
+  }
+
+  /// primes the accumulator so that the first frame is kept
+  void resetAccumulator()
+  {
+    m_uiAccumulator = m_uiAccumulatorModulus - m_uiAccumulatorStep;
+  }
+
+  // current mode
+  unsigned m_uiMode;
+  // the total number of frames to be skipped per pattern
+  unsigned m_uiSkipFrameNumber;
+  // the length of the pattern
+  unsigned m_uiTotalFrames;
+  // current frame
+  unsigned m_uiCurrentFrame;
+  // source fps
+  double m_dSourceFrameRate;
+  // target frame rate
+  double m_dTargetFrameRate;
+  // the shared skip pattern: a set bit marks a frame that is skipped
+  std::shared_ptr<const SkipPattern> m_pPattern;
+  const uint64_t* m_pPatternBits;
+  unsigned m_uiPatternLength;
+  // check if the time is initialized
+  bool m_bIsTimeSet;
+  // the end of the current target time frame: frames are kept once their start time passes it
+  FrameTimeline m_timeFrame;
+  // exact duration of a target frame in ticks
+  FrameDuration m_targetFrameDuration;
+  // exact frame rates for the rational decimation mode
+  RationalFrameRate m_sourceFrameRate;
+  RationalFrameRate m_targetFrameRate;
+  // error accumulator of the rational decimation mode: always less than the modulus
+  uint64_t m_uiAccumulator;
+  // the reduced target/source ratio: step frames are kept out of every modulus frames
+  uint64_t m_uiAccumulatorStep;
+  uint64_t m_uiAccumulatorModulus;
+  // duplicates differ by at most this mean absolute luma difference per block
+  double m_dDuplicateThreshold;
+  // duplicates are kept if the last kept frame is older than this
+  int64_t m_iMaxDuplicateTicks;
+  // signatures of the current frame and of the last frame that was kept
+  FrameSignature m_currentSignature;
+  FrameSignature m_lastKeptSignature;
+  bool m_bHasKeptSignature;
+  // start time of the last frame that was kept
+  int64_t m_tLastKept;
+  // clock used to detect late frames
+  FrameSkippingClock* m_pClock;
+  // frames later than this are dropped
+  int64_t m_iMaxLatenessTicks;
+  // limits the output rate according to quality messages from downstream
+  QualityController m_quality;
+  // frames dropped by the mode since it last kept a frame: carries the cadence over to a new mode
+  unsigned m_uiDroppedSinceKept;
+  // reference frames kept although the mode dropped them that later disposable frames have not made up for
+  unsigned m_uiReferenceDebt;
+  // dyadic temporal layers
+  unsigned m_uiTemporalLayers;
+  unsigned m_uiMaxTemporalLayer;
+  // position of the next frame in the layer hierarchy
+  uint64_t m_uiLayerFrame;
+  unsigned m_uiLastTemporalLayer;
+  // source frame rate estimation
+  bool m_bEstimateSourceRate;
+  FrameRateEstimator m_rateEstimator;
+  uint64_t m_uiSourceRateChanges;
+  // how far the time line of the token bucket mode may lag behind the start times
+  int64_t m_iBurstTicks;
+  // the kept payload of the bitrate budget mode
+  BitrateBudget m_budget;
+};
@@ -0,0 +1,163 @@
+/** @file
+
+MODULE                : FrameSkippingFanOut
+
+FILE NAME             : FrameSkippingFanOut.h
+
+DESCRIPTION           : Skipping decisions for several outputs of one stream, e.g. the renditions of an
+                        adaptive bit rate ladder. All outputs decide in one pass per frame and share the
+                        signature of the frame.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <cstdint>
+#include "FrameSkippingEngine.h"
+
+// the maximum number of outputs: the decisions are returned as a bit mask
+const unsigned FSKIP_MAX_OUTPUTS = 8;
+
+/**
+ * @brief The settings of every output. Only the first OutputCount configs are used.
+ */
+struct FrameSkippingFanOutConfig
+{
+  FrameSkippingFanOutConfig()
+    :OutputCount(1)
+  {
+
+  }
+
+  unsigned OutputCount;
+  FrameSkippingConfig Outputs[FSKIP_MAX_OUTPUTS];
+};
+
+/**
+ * @brief One FrameSkippingEngine per output. The work that does not depend on the output, the signature
+ * of the frame for the outputs that drop duplicates, is done once per frame.
+ */
+class FrameSkippingFanOut
+{
+public:
+
+  FrameSkippingFanOut()
+    :m_uiOutputCount(1)
+  {
+
+  }
+
+  unsigned getOutputCount() const
+  {
+    return m_uiOutputCount;
+  }
+
+  /// the engine of an output e.g. to query its output frame rate
+  FrameSkippingEngine& getEngine(unsigned uiOutput)
+  {
+    return m_aEngines[uiOutput];
+  }
+
+  const FrameSkippingEngine& getEngine(unsigned uiOutput) const
+  {
+    return m_aEngines[uiOutput];
+  }
+
+  /// sets the clock of every output for the lateness check
+  void setClock(FrameSkippingClock* pClock)
+  {
+    for (unsigned i = 0; i < FSKIP_MAX_OUTPUTS; ++i)
+      m_aEngines[i].setClock(pClock);
+  }
+
+  /**
+   * @brief applies the settings of every output. Outputs that are added start from a reset state.
+   */
+  void applyConfig(const FrameSkippingFanOutConfig& config)
+  {
+    unsigned uiOutputCount = config.OutputCount < 1 ? 1 : (config.OutputCount > FSKIP_MAX_OUTPUTS ? FSKIP_MAX_OUTPUTS : config.OutputCount);
+    for (unsigned i = m_uiOutputCount; i < uiOutputCount; ++i)
+      m_aEngines[i].reset();
+    m_uiOutputCount = uiOutputCount;
+    for (unsigned i = 0; i < m_uiOutputCount; ++i)
+      m_aEngines[i].applyConfig(config.Outputs[i]);
+  }
+
+  /// resets the streaming state of every output
+  void reset()
+  {
+    for (unsigned i = 0; i < FSKIP_MAX_OUTPUTS; ++i)
+      m_aEngines[i].reset();
+  }
+
+  /// returns true if any output needs the start time of each sample
+  bool requiresTimestamps() const
+  {
+    for (unsigned i = 0; i < m_uiOutputCount; ++i)
+    {
+      if (m_aEngines[i].requiresTimestamps())
+        return true;
+    }
+    return false;
+  }
+
+  /// returns true if any output inspects the pixel data of each frame
+  bool requiresPicture() const
+  {
+    for (unsigned i = 0; i < m_uiOutputCount; ++i)
+    {
+      if (m_aEngines[i].requiresPicture())
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief decides for every output whether the frame starting at tStart is kept. The parameters are those
+   * of FrameSkippingEngine::keepFrame.
+   * @return bit i is set if output i keeps the frame
+   */
+  uint32_t keepFrame(int64_t tStart, const FramePicture* pPicture = NULL, bool bDisposable = true, uint32_t uiBytes = 0)
+  {
+    const FrameSignature* pSignature = NULL;
+    if (pPicture != NULL && requiresPicture() && m_signature.compute(*pPicture))
+      pSignature = &m_signature;
+
+    uint32_t uiKept = 0;
+    for (unsigned i = 0; i < m_uiOutputCount; ++i)
+    {
+      if (m_aEngines[i].keepFrameWithSignature(tStart, pSignature, bDisposable, uiBytes))
+        uiKept |= 1u << i;
+    }
+    return uiKept;
+  }
+
+private:
+
+  unsigned m_uiOutputCount;
+  FrameSkippingEngine m_aEngines[FSKIP_MAX_OUTPUTS];
+  // the signature of the current frame shared by the outputs
+  FrameSignature m_signature;
+};
@@ -0,0 +1,518 @@
+/** @file
+
+MODULE                : FrameSkippingFanOutFilter
+
+FILE NAME             : FrameSkippingFanOutFilter.cpp
+
+DESCRIPTION           : Skips frames for several output pins with their own modes and rates. Kept samples
+                        are delivered to every output that keeps them without being copied.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "stdafx.h"
+#include "FrameSkippingFanOutFilter.h"
+
+namespace
+{
+
+// the per output parameter names: the single output name with the index of the output appended
+#define FSKIP_OUTPUT_PARAMS(name) { name "0", name "1", name "2", name "3", name "4", name "5", name "6", name "7" }
+const char* const g_aszModeParams[FSKIP_MAX_OUTPUTS] = FSKIP_OUTPUT_PARAMS("mode");
+const char* const g_aszTargetFrameRateParams[FSKIP_MAX_OUTPUTS] = FSKIP_OUTPUT_PARAMS("targetframerate");
+const char* const g_aszTargetFrameRateNumParams[FSKIP_MAX_OUTPUTS] = FSKIP_OUTPUT_PARAMS("targetframeratenum");
+const char* const g_aszTargetFrameRateDenParams[FSKIP_MAX_OUTPUTS] = FSKIP_OUTPUT_PARAMS("targetframerateden");
+const char* const g_aszMaxTemporalLayerParams[FSKIP_MAX_OUTPUTS] = FSKIP_OUTPUT_PARAMS("maxtemporallayer");
+const char* const g_aszBurstDurationParams[FSKIP_MAX_OUTPUTS] = FSKIP_OUTPUT_PARAMS("burstduration");
+const char* const g_aszMaxBitrateParams[FSKIP_MAX_OUTPUTS] = FSKIP_OUTPUT_PARAMS("maxbitrate");
+#undef FSKIP_OUTPUT_PARAMS
+
+const LPCWSTR g_awszOutputNames[FSKIP_MAX_OUTPUTS] =
+{
+  L"Output 0", L"Output 1", L"Output 2", L"Output 3", L"Output 4", L"Output 5", L"Output 6", L"Output 7"
+};
+
+}
+
+FrameSkippingFanOutFilter::FrameSkippingFanOutFilter(LPUNKNOWN pUnk, HRESULT *pHr)
+  : CBaseFilter(NAME("CSIR VPP Frame Skipping Fan-out Filter"), pUnk, &m_csFilter, CLSID_VPP_FrameSkippingFanOutFilter, pHr),
+  m_pInput(NULL),
+  m_uiOutputs(1),
+  m_dSourceFrameRate(0.0),
+  m_uiSourceFrameRateNum(0),
+  m_uiSourceFrameRateDen(1),
+  m_dDuplicateThreshold(1.0),
+  m_uiMaxDuplicateIntervalMs(0),
+  m_uiTemporalLayers(4),
+  m_uiBitrateWindowMs(1000),
+  m_tSourceTimePerFrame(0)
+{
+  for (unsigned i = 0; i < FSKIP_MAX_OUTPUTS; ++i)
+  {
+    m_apOutputs[i] = NULL;
+    m_auiMode[i] = FSKIP_SKIP_X_FRAMES_EVERY_Y;
+    m_adTargetFrameRate[i] = 0.0;
+    m_auiTargetFrameRateNum[i] = 0;
+    m_auiTargetFrameRateDen[i] = 1;
+    m_auiMaxTemporalLayer[i] = 3;
+    m_auiBurstDurationMs[i] = 0;
+    m_auiMaxBitrateKbps[i] = 0;
+  }
+  // Init parameters
+  initParameters();
+
+  // all pins are created up front: GetPinCount decides how many are exposed
+  m_pInput = new FrameSkippingFanOutInputPin(this, pHr);
+  for (unsigned i = 0; i < FSKIP_MAX_OUTPUTS; ++i)
+  {
+    m_apOutputs[i] = new FrameSkippingFanOutOutputPin(this, i, pHr, g_awszOutputNames[i]);
+  }
+}
+
+FrameSkippingFanOutFilter::~FrameSkippingFanOutFilter()
+{
+  delete m_pInput;
+  for (unsigned i = 0; i < FSKIP_MAX_OUTPUTS; ++i)
+  {
+    delete m_apOutputs[i];
+  }
+}
+
+CUnknown * WINAPI FrameSkippingFanOutFilter::CreateInstance(LPUNKNOWN pUnk, HRESULT *pHr)
+{
+  FrameSkippingFanOutFilter *pFilter = new FrameSkippingFanOutFilter(pUnk, pHr);
+  if (pFilter == NULL)
+  {
+    *pHr = E_OUTOFMEMORY;
+  }
+  return pFilter;
+}
+
+STDMETHODIMP FrameSkippingFanOutFilter::NonDelegatingQueryInterface(REFIID riid, void **ppv)
+{
+  if (riid == (IID_ISettingsInterface))
+  {
+    return GetInterface((ISettingsInterface*) this, ppv);
+  }
+  return CBaseFilter::NonDelegatingQueryInterface(riid, ppv);
+}
+
+void FrameSkippingFanOutFilter::initParameters()
+{
+  addParameter(FILTER_PARAM_OUTPUTS, &m_uiOutputs, 1);
+  addParameter(FILTER_PARAM_SOURCE_FRAMERATE, &m_dSourceFrameRate, 0.0);
+  addParameter(FILTER_PARAM_SOURCE_FRAMERATE_NUM, &m_uiSourceFrameRateNum, 0);
+  addParameter(FILTER_PARAM_SOURCE_FRAMERATE_DEN, &m_uiSourceFrameRateDen, 1);
+  addParameter(FILTER_PARAM_DUPLICATE_THRESHOLD, &m_dDuplicateThreshold, 1.0);
+  addParameter(FILTER_PARAM_MAX_DUPLICATE_INTERVAL, &m_uiMaxDuplicateIntervalMs, 0);
+  addParameter(FILTER_PARAM_TEMPORAL_LAYERS, &m_uiTemporalLayers, 4);
+  addParameter(FILTER_PARAM_BITRATE_WINDOW, &m_uiBitrateWindowMs, 1000);
+  for (unsigned i = 0; i < FSKIP_MAX_OUTPUTS; ++i)
+  {
+    addParameter(g_aszModeParams[i], &m_auiMode[i], 0);
+    addParameter(g_aszTargetFrameRateParams[i], &m_adTargetFrameRate[i], 0.0);
+    addParameter(g_aszTargetFrameRateNumParams[i], &m_auiTargetFrameRateNum[i], 0);
+    addParameter(g_aszTargetFrameRateDenParams[i], &m_auiTargetFrameRateDen[i], 1);
+    addParameter(g_aszMaxTemporalLayerParams[i], &m_auiMaxTemporalLayer[i], 3);
+    addParameter(g_aszBurstDurationParams[i], &m_auiBurstDurationMs[i], 0);
+    addParameter(g_aszMaxBitrateParams[i], &m_auiMaxBitrateKbps[i], 0);
+  }
+}
+
+int FrameSkippingFanOutFilter::GetPinCount()
+{
+  return 1 + static_cast<int>(m_uiOutputs);
+}
+
+CBasePin* FrameSkippingFanOutFilter::GetPin(int n)
+{
+  if (n == 0)
+  {
+    return m_pInput;
+  }
+  if (n > 0 && n <= static_cast<int>(m_uiOutputs))
+  {
+    return m_apOutputs[n - 1];
+  }
+  return NULL;
+}
+
+STDMETHODIMP FrameSkippingFanOutFilter::Pause()
+{
+  CAutoLock lock(&m_csFilter);
+  if (m_State == State_Stopped)
+  {
+    CAutoLock receiveLock(&m_csReceive);
+    m_fanOut.applyConfig(makeConfig());
+  }
+  return CBaseFilter::Pause();
+}
+
+STDMETHODIMP FrameSkippingFanOutFilter::Stop()
+{
+  CAutoLock lock(&m_csFilter);
+  if (m_State == State_Stopped)
+  {
+    return NOERROR;
+  }
+  // as in CTransformFilter the input is decommitted first so that no further sample arrives
+  m_pInput->Inactive();
+  CAutoLock receiveLock(&m_csReceive);
+  HRESULT hr = CBaseFilter::Stop();
+  m_fanOut.reset();
+  for (unsigned i = 0; i < FSKIP_MAX_OUTPUTS; ++i)
+  {
+    m_aStatistics[i].reset();
+  }
+  return hr;
+}
+
+STDMETHODIMP FrameSkippingFanOutFilter::SetParameter(const char* type, const char* value)
+{
+  CAutoLock lock(&m_csFilter);
+  // the outputs announce their rates in their connection types
+  if (m_State != State_Stopped)
+  {
+    return VFW_E_NOT_STOPPED;
+  }
+
+  unsigned uiOutputs = m_uiOutputs;
+  HRESULT hr = CSettingsInterface::SetParameter(type, value);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  if (m_uiOutputs < 1)
+    m_uiOutputs = 1;
+  else if (m_uiOutputs > FSKIP_MAX_OUTPUTS)
+    m_uiOutputs = FSKIP_MAX_OUTPUTS;
+  for (unsigned i = m_uiOutputs; i < uiOutputs; ++i)
+  {
+    if (m_apOutputs[i]->IsConnected())
+    {
+      m_uiOutputs = uiOutputs;
+      return VFW_E_ALREADY_CONNECTED;
+    }
+  }
+  if (m_uiOutputs != uiOutputs)
+  {
+    IncrementPinVersion();
+  }
+  reconnectOutputs(false);
+  return hr;
+}
+
+void FrameSkippingFanOutFilter::getStatistics(unsigned uiOutput, FrameSkippingStatsSnapshot& stats) const
+{
+  if (uiOutput < FSKIP_MAX_OUTPUTS)
+  {
+    m_aStatistics[uiOutput].getSnapshot(stats);
+  }
+}
+
+HRESULT FrameSkippingFanOutFilter::receive(IMediaSample *pSample)
+{
+  const unsigned uiOutputs = m_fanOut.getOutputCount();
+  // control data is passed on to every output
+  uint32_t uiKept = (1u << uiOutputs) - 1;
+  AM_SAMPLE2_PROPERTIES * const pProps = m_pInput->SampleProps();
+  if (pProps->dwStreamId == AM_STREAM_MEDIA)
+  {
+    REFERENCE_TIME tStart = 0, tStop = 0;
+    HRESULT hrTime = pSample->GetTime(&tStart, &tStop);
+    if (FAILED(hrTime) && m_fanOut.requiresTimestamps())
+    {
+      return hrTime;
+    }
+
+    FramePicture picture = m_picture;
+    if (m_fanOut.requiresPicture())
+    {
+      BYTE* pBuffer = NULL;
+      // a sample that is too short is treated as different from the previous frame
+      if (SUCCEEDED(pSample->GetPointer(&pBuffer)) && pSample->GetActualDataLength() >= picture.Stride * picture.Height)
+      {
+        picture.Data = pBuffer;
+      }
+    }
+    // compressed frames may only be dropped if no other frame refers to them
+    bool bDisposable = true;
+    if (m_nalParser.getCodec() != FSKIP_CODEC_NONE)
+    {
+      BYTE* pBuffer = NULL;
+      bDisposable = SUCCEEDED(pSample->GetPointer(&pBuffer)) && m_nalParser.isDisposable(pBuffer, pSample->GetActualDataLength());
+      bDisposable = bDisposable && pSample->IsSyncPoint() != S_OK;
+    }
+    uiKept = m_fanOut.keepFrame(tStart, picture.Data != NULL ? &picture : NULL, bDisposable, static_cast<uint32_t>(pSample->GetActualDataLength()));
+    for (unsigned i = 0; i < uiOutputs; ++i)
+    {
+      m_aStatistics[i].recordFrame(((uiKept >> i) & 1) != 0, tStart, SUCCEEDED(hrTime));
+    }
+  }
+
+  // downstream adds a reference to the sample if it holds on to it: the buffer is never copied
+  for (unsigned i = 0; i < uiOutputs; ++i)
+  {
+    if (((uiKept >> i) & 1) != 0 && m_apOutputs[i]->IsConnected())
+    {
+      // an output that stops accepting samples does not stop the others
+      m_apOutputs[i]->Deliver(pSample);
+    }
+  }
+  return S_OK;
+}
+
+FrameSkippingFanOutConfig FrameSkippingFanOutFilter::makeConfig() const
+{
+  FrameSkippingFanOutConfig config;
+  config.OutputCount = m_uiOutputs;
+  RationalFrameRate sourceFrameRate = FrameSkippingFilter::toRationalFrameRate(m_uiSourceFrameRateNum, m_uiSourceFrameRateDen, m_dSourceFrameRate);
+  for (unsigned i = 0; i < m_uiOutputs; ++i)
+  {
+    FrameSkippingConfig& output = config.Outputs[i];
+    output.Mode = m_auiMode[i];
+    output.SourceFrameRate = m_dSourceFrameRate;
+    output.TargetFrameRate = m_adTargetFrameRate[i];
+    output.RationalSourceFrameRate = sourceFrameRate;
+    output.RationalTargetFrameRate = FrameSkippingFilter::toRationalFrameRate(m_auiTargetFrameRateNum[i], m_auiTargetFrameRateDen[i], m_adTargetFrameRate[i]);
+    output.DuplicateThreshold = m_dDuplicateThreshold;
+    output.MaxDuplicateInterval = static_cast<int64_t>(m_uiMaxDuplicateIntervalMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+    output.TemporalLayers = m_uiTemporalLayers;
+    output.MaxTemporalLayer = m_auiMaxTemporalLayer[i];
+    output.BurstDuration = static_cast<int64_t>(m_auiBurstDurationMs[i]) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+    output.MaxBitrate = static_cast<uint64_t>(m_auiMaxBitrateKbps[i]) * 1000;
+    output.BitrateWindow = static_cast<int64_t>(m_uiBitrateWindowMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+    if (output.Mode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+      output.Pattern = SkipPatternCache::getInstance().getPattern(m_dSourceFrameRate, m_adTargetFrameRate[i]);
+  }
+  return config;
+}
+
+REFERENCE_TIME FrameSkippingFanOutFilter::getOutputTimePerFrame(unsigned uiOutput) const
+{
+  return FrameSkippingEngine::getOutputFrameDuration(makeConfig().Outputs[uiOutput], m_tSourceTimePerFrame);
+}
+
+void FrameSkippingFanOutFilter::reconnectOutputs(bool bAll)
+{
+  if (m_pGraph == NULL)
+  {
+    return;
+  }
+  for (unsigned i = 0; i < m_uiOutputs; ++i)
+  {
+    FrameSkippingFanOutOutputPin* pOutput = m_apOutputs[i];
+    if (!pOutput->IsConnected())
+      continue;
+    CMediaType mtOut;
+    if (FAILED(pOutput->GetMediaType(0, &mtOut)))
+      continue;
+    if (bAll || mtOut != pOutput->CurrentMediaType())
+    {
+      ReconnectPin(pOutput, &mtOut);
+    }
+  }
+}
+
+FrameSkippingFanOutInputPin::FrameSkippingFanOutInputPin(__inout FrameSkippingFanOutFilter *pFilter, __inout HRESULT *phr)
+  : CBaseInputPin(NAME("Fan-out input pin"), pFilter, &pFilter->m_csFilter, phr, L"Input"),
+  m_pFanOutFilter(pFilter)
+{
+
+}
+
+HRESULT FrameSkippingFanOutInputPin::CheckMediaType(const CMediaType* pmt)
+{
+  HRESULT hr = FrameSkippingFilter::checkVideoType(pmt);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  // each output announces its own rate in its type, so a sample that carries a new type cannot be delivered to all
+  // of them: upstream learns this through QueryAccept before it changes the format
+  if (IsConnected() && !IsStopped() && *pmt != m_mt)
+  {
+    return VFW_E_TYPE_NOT_ACCEPTED;
+  }
+  return S_OK;
+}
+
+HRESULT FrameSkippingFanOutInputPin::SetMediaType(const CMediaType* pmt)
+{
+  HRESULT hr = CBaseInputPin::SetMediaType(pmt);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  m_pFanOutFilter->m_tSourceTimePerFrame = FrameSkippingFilter::getAverageTimePerFrame(pmt);
+  FrameSkippingFilter::describeInput(pmt, m_pFanOutFilter->m_picture, m_pFanOutFilter->m_nalParser);
+  // the outputs offer the input type at their rates
+  m_pFanOutFilter->reconnectOutputs(false);
+  return S_OK;
+}
+
+STDMETHODIMP FrameSkippingFanOutInputPin::NotifyAllocator(IMemAllocator *pAllocator, BOOL bReadOnly)
+{
+  CAutoLock lock(m_pLock);
+  bool bChanged = pAllocator != m_pAllocator;
+  HRESULT hr = CBaseInputPin::NotifyAllocator(pAllocator, bReadOnly);
+  if (SUCCEEDED(hr) && bChanged)
+  {
+    // the outputs pass the new allocator downstream
+    m_pFanOutFilter->reconnectOutputs(true);
+  }
+  return hr;
+}
+
+STDMETHODIMP FrameSkippingFanOutInputPin::Receive(IMediaSample *pSample)
+{
+  CAutoLock lock(&m_pFanOutFilter->m_csReceive);
+  // checks the streaming state and applies format changes from upstream
+  HRESULT hr = CBaseInputPin::Receive(pSample);
+  if (hr != S_OK)
+  {
+    return hr;
+  }
+  return m_pFanOutFilter->receive(pSample);
+}
+
+STDMETHODIMP FrameSkippingFanOutInputPin::EndOfStream()
+{
+  CAutoLock lock(&m_pFanOutFilter->m_csReceive);
+  HRESULT hr = CheckStreaming();
+  if (hr != S_OK)
+  {
+    return hr;
+  }
+  for (unsigned i = 0; i < m_pFanOutFilter->m_uiOutputs; ++i)
+  {
+    if (m_pFanOutFilter->m_apOutputs[i]->IsConnected())
+      m_pFanOutFilter->m_apOutputs[i]->DeliverEndOfStream();
+  }
+  return S_OK;
+}
+
+STDMETHODIMP FrameSkippingFanOutInputPin::BeginFlush()
+{
+  CAutoLock lock(m_pLock);
+  HRESULT hr = CBaseInputPin::BeginFlush();
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  for (unsigned i = 0; i < m_pFanOutFilter->m_uiOutputs; ++i)
+  {
+    if (m_pFanOutFilter->m_apOutputs[i]->IsConnected())
+      m_pFanOutFilter->m_apOutputs[i]->DeliverBeginFlush();
+  }
+  return S_OK;
+}
+
+STDMETHODIMP FrameSkippingFanOutInputPin::EndFlush()
+{
+  CAutoLock lock(m_pLock);
+  for (unsigned i = 0; i < m_pFanOutFilter->m_uiOutputs; ++i)
+  {
+    if (m_pFanOutFilter->m_apOutputs[i]->IsConnected())
+      m_pFanOutFilter->m_apOutputs[i]->DeliverEndFlush();
+  }
+  return CBaseInputPin::EndFlush();
+}
+
+STDMETHODIMP FrameSkippingFanOutInputPin::NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate)
+{
+  CBasePin::NewSegment(tStart, tStop, dRate);
+  for (unsigned i = 0; i < m_pFanOutFilter->m_uiOutputs; ++i)
+  {
+    if (m_pFanOutFilter->m_apOutputs[i]->IsConnected())
+      m_pFanOutFilter->m_apOutputs[i]->DeliverNewSegment(tStart, tStop, dRate);
+  }
+  return S_OK;
+}
+
+FrameSkippingFanOutOutputPin::FrameSkippingFanOutOutputPin(__inout FrameSkippingFanOutFilter *pFilter, unsigned uiOutput,
+  __inout HRESULT *phr, __in_opt LPCWSTR pName)
+  : CBaseOutputPin(NAME("Fan-out output pin"), pFilter, &pFilter->m_csFilter, phr, pName),
+  m_pFanOutFilter(pFilter),
+  m_uiOutput(uiOutput)
+{
+
+}
+
+HRESULT FrameSkippingFanOutOutputPin::GetMediaType(int iPosition, __inout CMediaType *pMediaType)
+{
+  if (iPosition < 0)
+  {
+    return E_INVALIDARG;
+  }
+  if (!m_pFanOutFilter->m_pInput->IsConnected())
+  {
+    return VFW_E_NOT_CONNECTED;
+  }
+  if (iPosition > 0)
+  {
+    return VFW_S_NO_MORE_ITEMS;
+  }
+  *pMediaType = m_pFanOutFilter->m_pInput->CurrentMediaType();
+  FrameSkippingFilter::setAverageTimePerFrame(pMediaType, m_pFanOutFilter->getOutputTimePerFrame(m_uiOutput));
+  return S_OK;
+}
+
+HRESULT FrameSkippingFanOutOutputPin::CheckMediaType(const CMediaType* pmtOut)
+{
+  // the samples are passed on as they are: only the frame rate of the input type may differ
+  CMediaType mtOut;
+  HRESULT hr = GetMediaType(0, &mtOut);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  return (*pmtOut == mtOut) ? S_OK : VFW_E_TYPE_NOT_ACCEPTED;
+}
+
+HRESULT FrameSkippingFanOutOutputPin::DecideAllocator(IMemInputPin *pPin, __deref_out IMemAllocator **ppAlloc)
+{
+  IMemAllocator* pAllocator = m_pFanOutFilter->m_pInput->peekAllocator();
+  if (pAllocator == NULL)
+  {
+    return VFW_E_NO_ALLOCATOR;
+  }
+  // read-only: the other outputs receive the same sample
+  HRESULT hr = pPin->NotifyAllocator(pAllocator, TRUE);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  pAllocator->AddRef();
+  *ppAlloc = pAllocator;
+  return S_OK;
+}
+
+HRESULT FrameSkippingFanOutOutputPin::DecideBufferSize(IMemAllocator *pAlloc, __inout ALLOCATOR_PROPERTIES *pProps)
+{
+  UNREFERENCED_PARAMETER(pAlloc);
+  UNREFERENCED_PARAMETER(pProps);
+  return S_OK;
+}
@@ -0,0 +1,203 @@
+/** @file
+
+MODULE                : FrameSkippingFanOutFilter
+
+FILE NAME             : FrameSkippingFanOutFilter.h
+
+DESCRIPTION           : Skips frames for several output pins with their own modes and rates. Kept samples
+                        are delivered to every output that keeps them without being copied.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <DirectShowExt/CSettingsInterface.h>
+#include <DirectShowExt/FilterParameterStringConstants.h>
+
+#include "FrameSkippingFanOut.h"
+#include "FrameSkippingFilter.h"
+#include "VersionInfo.h"
+
+// Fan-out: number of output pins from 1 to FSKIP_MAX_OUTPUTS. Connected pins cannot be removed
+#define FILTER_PARAM_OUTPUTS "outputs"
+// Fan-out: the settings of each output are the parameters of the single output filter with the index of the pin
+// appended: "mode<i>", "targetframerate<i>", "targetframeratenum<i>", "targetframerateden<i>", "maxtemporallayer<i>"
+// "burstduration<i>" and "maxbitrate<i>".
+// The source rate and the duplicate, temporal layer and bitrate window settings are shared
+
+// {0B6F6652-3BDF-4BD4-BC55-40E923575107}
+static const GUID CLSID_VPP_FrameSkippingFanOutFilter =
+{ 0xb6f6652, 0x3bdf, 0x4bd4, { 0xbc, 0x55, 0x40, 0xe9, 0x23, 0x57, 0x51, 0x7 } };
+
+class FrameSkippingFanOutInputPin;
+class FrameSkippingFanOutOutputPin;
+
+/**
+ * @brief The FrameSkippingFanOutFilter feeds several renditions of one source, e.g. an adaptive bit rate ladder,
+ * without a chain of FrameSkippingFilters. Each output pin has its own mode and target rate and announces its
+ * own frame rate. The decisions for all outputs are made in one pass per input sample and a kept sample is
+ * delivered to each output that keeps it as it is: the outputs use the allocator of the input read-only.
+ * As the outputs share the samples, kept frames are not re-paced and the settings only change while the filter
+ * is stopped: connected outputs are then reconnected at their new rate. For the same reason a format change from
+ * upstream is only accepted while the filter is stopped, and the connected outputs are reconnected with it.
+ */
+class FrameSkippingFanOutFilter : public CBaseFilter,
+  public CSettingsInterface
+{
+  friend class FrameSkippingFanOutInputPin;
+  friend class FrameSkippingFanOutOutputPin;
+
+public:
+  DECLARE_IUNKNOWN
+
+  /// Constructor
+  FrameSkippingFanOutFilter(LPUNKNOWN pUnk, HRESULT *pHr);
+  /// Destructor
+  ~FrameSkippingFanOutFilter();
+
+  /// Static object-creation method (for the class factory)
+  static CUnknown * WINAPI CreateInstance(LPUNKNOWN pUnk, HRESULT *pHr);
+
+  /// override this to publicize our interfaces
+  STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void **ppv);
+
+  /// the input and the configured number of outputs
+  int GetPinCount();
+  CBasePin *GetPin(int n);
+
+  /// applies the settings when streaming starts
+  STDMETHODIMP Pause();
+  /// waits for the sample being delivered and resets the streaming state
+  STDMETHODIMP Stop();
+
+  virtual void doGetVersion(std::string& sVersion)
+  {
+    sVersion = VersionInfo::toString();
+  }
+  /// Overridden from CSettingsInterface
+  virtual void initParameters();
+  /// the settings cannot change while streaming
+  STDMETHODIMP SetParameter(const char* type, const char* value);
+
+  /// copies the statistics of one output
+  void getStatistics(unsigned uiOutput, FrameSkippingStatsSnapshot& stats) const;
+
+private:
+
+  /// decides for every output and delivers the sample to the outputs that keep it
+  HRESULT receive(IMediaSample *pSample);
+  /// the current parameters as a snapshot for the fan-out
+  FrameSkippingFanOutConfig makeConfig() const;
+  /// the average duration of an output frame for the source frame duration of the input type
+  REFERENCE_TIME getOutputTimePerFrame(unsigned uiOutput) const;
+  /// reconnects the connected outputs whose rate changed or all of them, e.g. for a new allocator
+  void reconnectOutputs(bool bAll);
+
+  // serializes the filter state
+  CCritSec m_csFilter;
+  // held while a sample is received
+  CCritSec m_csReceive;
+  FrameSkippingFanOutInputPin* m_pInput;
+  FrameSkippingFanOutOutputPin* m_apOutputs[FSKIP_MAX_OUTPUTS];
+
+  // number of output pins
+  unsigned m_uiOutputs;
+  // source fps
+  double m_dSourceFrameRate;
+  unsigned m_uiSourceFrameRateNum;
+  unsigned m_uiSourceFrameRateDen;
+  // duplicate frame elimination
+  double m_dDuplicateThreshold;
+  unsigned m_uiMaxDuplicateIntervalMs;
+  // temporal layers
+  unsigned m_uiTemporalLayers;
+  // bitrate budget
+  unsigned m_uiBitrateWindowMs;
+  // per output settings
+  unsigned m_auiMode[FSKIP_MAX_OUTPUTS];
+  double m_adTargetFrameRate[FSKIP_MAX_OUTPUTS];
+  unsigned m_auiTargetFrameRateNum[FSKIP_MAX_OUTPUTS];
+  unsigned m_auiTargetFrameRateDen[FSKIP_MAX_OUTPUTS];
+  unsigned m_auiMaxTemporalLayer[FSKIP_MAX_OUTPUTS];
+  unsigned m_auiBurstDurationMs[FSKIP_MAX_OUTPUTS];
+  unsigned m_auiMaxBitrateKbps[FSKIP_MAX_OUTPUTS];
+  // average frame duration of the input type
+  REFERENCE_TIME m_tSourceTimePerFrame;
+  // layout of the input pixel data: the data pointer is set per sample
+  FramePicture m_picture;
+  // finds the disposable frames of compressed input
+  NalParser m_nalParser;
+  // makes the skipping decisions of all outputs
+  FrameSkippingFanOut m_fanOut;
+  // recorded on the streaming thread
+  FrameSkippingStatistics m_aStatistics[FSKIP_MAX_OUTPUTS];
+};
+
+class FrameSkippingFanOutInputPin : public CBaseInputPin
+{
+public:
+  FrameSkippingFanOutInputPin(__inout FrameSkippingFanOutFilter *pFilter, __inout HRESULT *phr);
+
+  /// refuses a different type while streaming: the outputs cannot be renegotiated for a shared sample
+  HRESULT CheckMediaType(const CMediaType* pmt);
+  /// reconnects the connected outputs with the new type
+  HRESULT SetMediaType(const CMediaType* pmt);
+  /// the outputs are reconnected to share the new allocator
+  STDMETHODIMP NotifyAllocator(IMemAllocator *pAllocator, BOOL bReadOnly);
+  STDMETHODIMP Receive(IMediaSample *pSample);
+  STDMETHODIMP EndOfStream();
+  STDMETHODIMP BeginFlush();
+  STDMETHODIMP EndFlush();
+  STDMETHODIMP NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate);
+
+  /// the allocator of the samples passed on to the outputs. NULL if none was agreed yet
+  IMemAllocator* peekAllocator() const
+  {
+    return m_pAllocator;
+  }
+
+private:
+  FrameSkippingFanOutFilter* m_pFanOutFilter;
+};
+
+class FrameSkippingFanOutOutputPin : public CBaseOutputPin
+{
+public:
+  FrameSkippingFanOutOutputPin(__inout FrameSkippingFanOutFilter *pFilter, unsigned uiOutput, __inout HRESULT *phr,
+    __in_opt LPCWSTR pName);
+
+  /// offers the input type at the rate of this output
+  HRESULT GetMediaType(int iPosition, __inout CMediaType *pMediaType);
+  /// only accepts the type offered by GetMediaType
+  HRESULT CheckMediaType(const CMediaType* pmtOut);
+  /// uses the allocator of the input read-only so that samples are not copied
+  HRESULT DecideAllocator(IMemInputPin *pPin, __deref_out IMemAllocator **ppAlloc);
+  /// not used: the buffers belong to the allocator of the input
+  HRESULT DecideBufferSize(IMemAllocator *pAlloc, __inout ALLOCATOR_PROPERTIES *pProps);
+
+private:
+  FrameSkippingFanOutFilter* m_pFanOutFilter;
+  unsigned m_uiOutput;
+};
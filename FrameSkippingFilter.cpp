@@ -33,29 +33,61 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "stdafx.h"
 #include "FrameSkippingFilter.h"
-#include <cassert>
-#include <set>
+#include <cstring>
+#include <string>
 #include <dvdmedia.h>
 
-// timestamp unit is in 10^-7
-const double TIMESTAMP_FACTOR = 10000000.0;
-
 FrameSkippingFilter::FrameSkippingFilter(LPUNKNOWN pUnk, HRESULT *pHr)
   : CTransInPlaceFilter(NAME("CSIR VPP Frame Skipping Filter"), pUnk, CLSID_VPP_FrameSkippingFilter, pHr, false),
   m_uiSkipFrameNumber(0),
   m_uiTotalFrames(1),
-  m_uiCurrentFrame(0),
-  m_dSkipRatio(1.0),
   m_dTargetFrameRate(0.0),
-  m_bIsTimeSet(false),
-  m_dTimeFrame(0.0),
-  m_dTimeCurrent(0.0),
-  m_dTargetTimeFrame(0.0),
-  m_tStart(0),
-  m_tStop(0)
+  m_uiSourceFrameRateNum(0),
+  m_uiSourceFrameRateDen(1),
+  m_uiTargetFrameRateNum(0),
+  m_uiTargetFrameRateDen(1),
+  m_dDuplicateThreshold(1.0),
+  m_uiMaxDuplicateIntervalMs(0),
+  m_uiMaxLatenessMs(0),
+  m_streamClock(this),
+  m_uiQualityControl(0),
+  m_dMinOutputRate(0.0),
+  m_dMaxOutputRate(0.0),
+  m_uiRepace(0),
+  m_uiMaxRepaceOffsetMs(0),
+  m_uiTemporalLayers(4),
+  m_uiMaxTemporalLayer(3),
+  m_uiBurstDurationMs(0),
+  m_uiMaxBitrateKbps(0),
+  m_uiBitrateWindowMs(1000),
+  m_uiLookahead(0),
+  m_uiAnalysisThreads(0),
+  m_uiAnalysisDeadlineMs(0),
+  m_uiEstimateSourceRate(0),
+  m_tSourceTimePerFrame(0),
+  m_tOutputTimePerFrame(0),
+  m_bUpstreamTypeChanged(false),
+  m_uiConfigGeneration(UINT64_MAX),
+  m_uiSourceRateChanges(0),
+  m_sFramesIn("0"),
+  m_sFramesOut("0"),
+  m_sFramesDropped("0"),
+  m_dAchievedFps(0.0),
+  m_sAnalysisMisses("0"),
+  m_uiHeld(0),
+  m_pPending(NULL),
+  m_iPendingSlot(-1),
+  m_dwPendingTypeSpecificFlags(0),
+  m_uiMaxAnalysing(0)
 {
+  for (unsigned i = 0; i < FSKIP_ANALYSIS_SLOTS; ++i)
+  {
+    m_apAnalysing[i] = NULL;
+  }
   // Init parameters
   initParameters();
+  m_engine.setClock(&m_streamClock);
+  publishConfig();
 }
 
 FrameSkippingFilter::~FrameSkippingFilter()
@@ -89,104 +121,678 @@ STDMETHODIMP FrameSkippingFilter::NonDelegatingQueryInterface(REFIID riid, void
   }
 }
 
-HRESULT FrameSkippingFilter::Transform(IMediaSample *pSample)
+HRESULT FrameSkippingFilter::Receive(IMediaSample *pSample)
 {
+  // the pending sample was received before the mode, the lookahead or the number of workers changed
+  if (m_pPending != NULL && (m_lookahead.getLookahead() > 1 || !isAnalysedByWorkers()))
+  {
+    HRESULT hr = deliverPending(true);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+  }
+
+  if (m_lookahead.getLookahead() > 1)
+  {
+    return holdSample(pSample);
+  }
+
+  if (isAnalysedByWorkers())
+  {
+    return analyseSample(pSample);
+  }
+
+  // without a copy the base class calls Transform on the sample itself
+  if (!UsingDifferentAllocators())
+  {
+    return CTransInPlaceFilter::Receive(pSample);
+  }
+
   /*  Check for other streams and pass them on */
   // don't skip control info
-  AM_SAMPLE2_PROPERTIES * const pProps = m_pInput->SampleProps();
-  if (pProps->dwStreamId != AM_STREAM_MEDIA) {
-    return S_OK;
+  if (m_pInput->SampleProps()->dwStreamId != AM_STREAM_MEDIA)
+  {
+    return deliverControl(pSample);
+  }
+
+  // the decision only reads the input sample: dropped frames are released without a copy or an output buffer
+  bool bTagLayer = false;
+  HRESULT hr = decideSample(pSample, bTagLayer);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  if (hr == S_FALSE)
+  {
+    notifySampleSkipped();
+    return NOERROR;
+  }
+
+  return deliverKept(pSample, bTagLayer);
+}
+
+HRESULT FrameSkippingFilter::deliverControl(IMediaSample *pSample)
+{
+  if (!UsingDifferentAllocators())
+  {
+    return m_pOutput->Deliver(pSample);
   }
-  // select mode
-  if (m_uiFrameSkippingMode == FSKIP_ACHIEVE_TARGET_RATE)
+  // the sample belongs to the upstream allocator: downstream only receives buffers of the output allocator
+  IMediaSample* pOutSample = Copy(pSample);
+  if (pOutSample == NULL)
   {
-    if (m_dTargetFrameRate != 0.0)
+    return E_UNEXPECTED;
+  }
+  HRESULT hr = m_pOutput->Deliver(pOutSample);
+  pOutSample->Release();
+  return hr;
+}
+
+void FrameSkippingFilter::notifySampleSkipped()
+{
+  // as in CTransInPlaceFilter::Receive
+  m_bSampleSkipped = TRUE;
+  if (!m_bQualityChanged)
+  {
+    NotifyEvent(EC_QUALITY_CHANGE, 0, 0);
+    m_bQualityChanged = TRUE;
+  }
+}
+
+HRESULT FrameSkippingFilter::EndOfStream()
+{
+  // called with the receive lock held
+  deliverHeld(true);
+  deliverPending(true);
+  return CTransInPlaceFilter::EndOfStream();
+}
+
+HRESULT FrameSkippingFilter::EndFlush()
+{
+  {
+    CAutoLock lck(&m_csReceive);
+    deliverHeld(false);
+    deliverPending(false);
+    releaseAnalysed(true);
+  }
+  return CTransInPlaceFilter::EndFlush();
+}
+
+HRESULT FrameSkippingFilter::NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate)
+{
+  {
+    // the input pin does not hold the receive lock: upstream calls NewSegment between samples
+    CAutoLock lck(&m_csReceive);
+    deliverHeld(true);
+    deliverPending(true);
+  }
+  return CTransInPlaceFilter::NewSegment(tStart, tStop, dRate);
+}
+
+HRESULT FrameSkippingFilter::holdSample(IMediaSample *pSample)
+{
+  /*  Check for other streams and pass them on */
+  // don't skip control info: it follows the media samples received before it
+  if (m_pInput->SampleProps()->dwStreamId != AM_STREAM_MEDIA)
+  {
+    HRESULT hr = deliverHeld(true);
+    if (FAILED(hr))
     {
-      assert(m_dTargetFrameRate > 0.0);
-      //set initial time frame
-      m_dTargetTimeFrame = (1 / m_dTargetFrameRate); // timestamp unit is in 10^-7
-      HRESULT hr = pSample->GetTime(&m_tStart, &m_tStop);
-      if (SUCCEEDED(hr))
-      {
-        //m_bIsTimeSet runs only once with each rendering to initialize the 1st targetTimeFrame
-        if (!m_bIsTimeSet)
-        {
-          m_dTimeCurrent = m_tStart / TIMESTAMP_FACTOR;
-          m_dTimeFrame = m_dTimeCurrent + m_dTargetTimeFrame;
-          m_bIsTimeSet = true;
-          return S_OK;
-        }
-        else
-        {
-          m_dTimeCurrent = m_tStart / TIMESTAMP_FACTOR;
-          if (m_dTimeCurrent > m_dTimeFrame)
-          {
-            int multiplier = static_cast<int>(ceil((m_dTimeCurrent - m_dTimeFrame) / m_dTargetTimeFrame));
-            if (multiplier == 0) { multiplier = 1; }
-            m_dTimeFrame += (m_dTargetTimeFrame *multiplier);
-            return S_OK;
-          }
-          else
-          {
-            return S_FALSE;
-          }
-        }
+      return hr;
+    }
+    return deliverControl(pSample);
+  }
 
+  bool bTagLayer = false;
+  HRESULT hr = decideSample(pSample, bTagLayer, true);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+  // the window may also have been shortened by a new config
+  if (!m_lookahead.isFull())
+  {
+    return NOERROR;
+  }
+  return deliverHeld(true);
+}
+
+HRESULT FrameSkippingFilter::deliverHeld(bool bDeliver)
+{
+  if (m_uiHeld == 0)
+  {
+    return NOERROR;
+  }
+  uint32_t uiKept = m_lookahead.select();
+  HRESULT hr = NOERROR;
+  for (unsigned i = 0; i < m_uiHeld; ++i)
+  {
+    bool bKeep = ((uiKept >> i) & 1) != 0;
+    if (bDeliver)
+    {
+      m_statistics.recordFrame(bKeep, m_atHeldStart[i], m_abHeldTimed[i]);
+      // the remaining samples are released once downstream fails
+      if (bKeep && SUCCEEDED(hr))
+      {
+        hr = deliverKept(m_apHeld[i], m_abHeldTagLayer[i]);
       }
-      else
+      else if (!bKeep)
       {
-        return hr;
+        notifySampleSkipped();
       }
     }
-    else
+    m_apHeld[i]->Release();
+    m_apHeld[i] = NULL;
+  }
+  m_uiHeld = 0;
+  return hr;
+}
+
+HRESULT FrameSkippingFilter::deliverKept(IMediaSample *pSample, bool bTagLayer)
+{
+  if (!UsingDifferentAllocators())
+  {
+    prepareKeptSample(pSample, bTagLayer);
+    return m_pOutput->Deliver(pSample);
+  }
+
+  IMediaSample* pOutSample = copySample(pSample);
+  if (pOutSample == NULL)
+  {
+    return E_UNEXPECTED;
+  }
+  prepareKeptSample(pOutSample, bTagLayer);
+  HRESULT hr = m_pOutput->Deliver(pOutSample);
+  pOutSample->Release();
+  return hr;
+}
+
+IMediaSample* FrameSkippingFilter::copySample(IMediaSample *pSource)
+{
+  // as CTransInPlaceFilter::Copy, which takes the properties from m_pInput->SampleProps(): those of the sample
+  // received last and not of a held or pending sample
+  REFERENCE_TIME tStart = 0, tStop = 0;
+  const BOOL bTime = S_OK == pSource->GetTime(&tStart, &tStop);
+  IMediaSample* pDest = NULL;
+  HRESULT hr = OutputPin()->PeekAllocator()->GetBuffer(&pDest, bTime ? &tStart : NULL, bTime ? &tStop : NULL,
+    m_bSampleSkipped ? AM_GBF_PREVFRAMESKIPPED : 0);
+  if (FAILED(hr))
+  {
+    return NULL;
+  }
+
+  IMediaSample2* pSource2 = NULL;
+  IMediaSample2* pDest2 = NULL;
+  if (SUCCEEDED(pSource->QueryInterface(IID_IMediaSample2, (void **)&pSource2))
+    && SUCCEEDED(pDest->QueryInterface(IID_IMediaSample2, (void **)&pDest2)))
+  {
+    // the media type of the properties is owned by the source sample, which is alive until it is delivered
+    AM_SAMPLE2_PROPERTIES props;
+    hr = pSource2->GetProperties(FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, pbBuffer), (PBYTE)&props);
+    if (SUCCEEDED(hr))
+    {
+      hr = pDest2->SetProperties(FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, pbBuffer), (PBYTE)&props);
+    }
+  }
+  else
+  {
+    if (bTime)
     {
-      return S_OK;
+      pDest->SetTime(&tStart, &tStop);
     }
+    pDest->SetSyncPoint(S_OK == pSource->IsSyncPoint());
+    pDest->SetDiscontinuity(S_OK == pSource->IsDiscontinuity() || m_bSampleSkipped);
+    pDest->SetPreroll(S_OK == pSource->IsPreroll());
+    AM_MEDIA_TYPE* pMediaType = NULL;
+    if (S_OK == pSource->GetMediaType(&pMediaType))
+    {
+      pDest->SetMediaType(pMediaType);
+      DeleteMediaType(pMediaType);
+    }
+  }
+  if (pSource2 != NULL)
+  {
+    pSource2->Release();
+  }
+  if (pDest2 != NULL)
+  {
+    pDest2->Release();
   }
+  m_bSampleSkipped = FALSE;
 
-  else if (m_uiFrameSkippingMode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+  REFERENCE_TIME tMediaStart = 0, tMediaStop = 0;
+  if (SUCCEEDED(hr) && pSource->GetMediaTime(&tMediaStart, &tMediaStop) == NOERROR)
   {
-    if (m_vFramesToBeSkipped.empty())
-      return S_OK;
+    pDest->SetMediaTime(&tMediaStart, &tMediaStop);
+  }
+
+  const long lDataLength = pSource->GetActualDataLength();
+  BYTE* pSourceBuffer = NULL;
+  BYTE* pDestBuffer = NULL;
+  if (FAILED(hr) || lDataLength < 0 || pDest->GetSize() < lDataLength || FAILED(pDest->SetActualDataLength(lDataLength))
+    || FAILED(pSource->GetPointer(&pSourceBuffer)) || FAILED(pDest->GetPointer(&pDestBuffer)))
+  {
+    pDest->Release();
+    return NULL;
+  }
+  CopyMemory(pDestBuffer, pSourceBuffer, lDataLength);
+  return pDest;
+}
+
+void FrameSkippingFilter::updateLookahead()
+{
+  unsigned uiLookahead = getLookahead(m_activeConfig);
+  if (uiLookahead == m_lookahead.getLookahead())
+  {
+    return;
+  }
+  // the frames held so far are selected with the previous window
+  deliverHeld(true);
+  m_lookahead.setLookahead(uiLookahead);
+}
+
+HRESULT FrameSkippingFilter::analyseSample(IMediaSample *pSample)
+{
+  /*  Check for other streams and pass them on */
+  // don't skip control info: it follows the media sample received before it
+  if (m_pInput->SampleProps()->dwStreamId != AM_STREAM_MEDIA)
+  {
+    HRESULT hr = deliverPending(true);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+    return deliverControl(pSample);
+  }
+
+  // upstream blocks once every buffer of its allocator is held: a sample that would take the last free buffer
+  // is decided on the streaming thread after the pending sample
+  releaseAnalysed(false);
+  HRESULT hr = NOERROR;
+  if (getAnalysingSamples() >= m_uiMaxAnalysing)
+  {
+    hr = deliverPending(true);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+    bool bTagLayer = false;
+    hr = decideSample(pSample, bTagLayer);
+    if (hr == S_OK)
+    {
+      return deliverKept(pSample, bTagLayer);
+    }
+    if (hr == S_FALSE)
+    {
+      notifySampleSkipped();
+      return NOERROR;
+    }
+    return hr;
+  }
+
+  // a format change applies from this sample on: the pending sample is delivered with the previous format
+  AM_SAMPLE2_PROPERTIES * const pProps = m_pInput->SampleProps();
+  if ((pProps->dwSampleFlags & AM_SAMPLE_TYPECHANGED) && pProps->pMediaType != NULL)
+  {
+    hr = deliverPending(true);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+  }
+  checkUpstreamType(pProps);
+  DWORD dwTypeSpecificFlags = pProps->dwTypeSpecificFlags;
+
+  // a sample that is too short or finds no free slot is decided by the target rate alone
+  int iSlot = -1;
+  FramePicture picture = m_picture;
+  BYTE* pBuffer = NULL;
+  if (SUCCEEDED(pSample->GetPointer(&pBuffer)) && pSample->GetActualDataLength() >= picture.Stride * picture.Height)
+  {
+    picture.Data = pBuffer;
+    iSlot = m_analysisPool.submit(picture);
+  }
+  // without a configured deadline a stalled analysis still cannot hold up the stream
+  int64_t iDeadline = m_activeConfig.AnalysisDeadline > 0 ? m_activeConfig.AnalysisDeadline : FSKIP_ANALYSIS_MAX_WAIT;
+  std::chrono::steady_clock::time_point tDeadline = std::chrono::steady_clock::now()
+    + std::chrono::duration<int64_t, std::ratio<1, TIMESTAMP_TICKS_PER_SECOND> >(iDeadline);
+  if (iSlot >= 0)
+  {
+    // a slot freed by the workers since releaseAnalysed may still hold its sample
+    if (m_apAnalysing[iSlot] != NULL)
+    {
+      m_apAnalysing[iSlot]->Release();
+    }
+    pSample->AddRef();
+    m_apAnalysing[iSlot] = pSample;
+  }
+
+  // the previous frame is decided and delivered while the workers analyse this one
+  hr = deliverPending(true);
+  pSample->AddRef();
+  m_pPending = pSample;
+  m_iPendingSlot = iSlot;
+  m_tPendingDeadline = tDeadline;
+  m_dwPendingTypeSpecificFlags = dwTypeSpecificFlags;
+  return hr;
+}
+
+HRESULT FrameSkippingFilter::deliverPending(bool bDeliver)
+{
+  if (m_pPending == NULL)
+  {
+    return NOERROR;
+  }
+  IMediaSample* pSample = m_pPending;
+  m_pPending = NULL;
+  HRESULT hr = NOERROR;
+  if (bDeliver)
+  {
+    bool bTagLayer = false;
+    hr = decideSample(pSample, bTagLayer, false, true);
+    if (hr == S_OK)
+    {
+      hr = deliverKept(pSample, bTagLayer);
+    }
+    else if (hr == S_FALSE)
+    {
+      notifySampleSkipped();
+      hr = NOERROR;
+    }
+  }
+  pSample->Release();
+  // the workers may still read the pixels of an analysis that missed its deadline
+  if (m_iPendingSlot >= 0)
+  {
+    m_analysisPool.release(m_iPendingSlot);
+    m_iPendingSlot = -1;
+  }
+  releaseAnalysed(false);
+  return hr;
+}
 
-    int iSkip = m_vFramesToBeSkipped[m_uiCurrentFrame++];
-    if (m_uiCurrentFrame >= m_vFramesToBeSkipped.size())
+void FrameSkippingFilter::releaseAnalysed(bool bWait)
+{
+  if (bWait)
+  {
+    m_analysisPool.drain();
+  }
+  for (unsigned i = 0; i < FSKIP_ANALYSIS_SLOTS; ++i)
+  {
+    if (m_apAnalysing[i] != NULL && m_analysisPool.isIdle(i))
     {
-      m_uiCurrentFrame = 0;
+      m_apAnalysing[i]->Release();
+      m_apAnalysing[i] = NULL;
     }
+  }
+}
+
+bool FrameSkippingFilter::isAnalysedByWorkers() const
+{
+  // the pending sample and the next one must fit into the buffers that may be held
+  return m_analysisPool.isRunning() && m_uiMaxAnalysing >= 2 && m_engine.requiresPicture() && m_picture.Format != FSKIP_PIXEL_FORMAT_UNKNOWN;
+}
 
-    if (iSkip == 1)
+unsigned FrameSkippingFilter::getAnalysingSamples() const
+{
+  unsigned uiSamples = m_pPending != NULL && m_iPendingSlot < 0 ? 1 : 0;
+  for (unsigned i = 0; i < FSKIP_ANALYSIS_SLOTS; ++i)
+  {
+    if (m_apAnalysing[i] != NULL)
     {
-      return S_FALSE;
+      ++uiSamples;
     }
+  }
+  return uiSamples;
+}
+
+void FrameSkippingFilter::updateAnalysisThreads()
+{
+  // the result of a frame in analysis survives the restart
+  unsigned uiThreads = std::min(m_activeConfig.AnalysisThreads, FSKIP_ANALYSIS_MAX_THREADS);
+  m_uiMaxAnalysing = uiThreads > 0 ? getHoldableSamples() : 0;
+  if (uiThreads != m_analysisPool.getThreads())
+  {
+    m_analysisPool.start(uiThreads);
+  }
+}
+
+unsigned FrameSkippingFilter::getHoldableSamples()
+{
+  // upstream blocks once every buffer of its allocator is held: one must remain free
+  ALLOCATOR_PROPERTIES props;
+  IMemAllocator* pAllocator = InputPin()->PeekAllocator();
+  if (pAllocator == NULL || FAILED(pAllocator->GetProperties(&props)) || props.cBuffers < 3)
+  {
+    return 0;
+  }
+  return static_cast<unsigned>(props.cBuffers - 1);
+}
+
+unsigned FrameSkippingFilter::getLookahead(const FrameSkippingConfig& config)
+{
+  // the temporal layer and bitrate budget modes decide by position and size: their frames are not interchangeable
+  if (config.Lookahead < FSKIP_MIN_LOOKAHEAD || config.Mode == FSKIP_TEMPORAL_LAYERS || config.Mode == FSKIP_BITRATE_BUDGET)
+  {
+    return 0;
+  }
+  unsigned uiLookahead = std::min(std::min(config.Lookahead, FSKIP_MAX_LOOKAHEAD), getHoldableSamples());
+  // a window shortened by the allocator keeps the cadence as well
+  return uiLookahead >= FSKIP_MIN_LOOKAHEAD ? uiLookahead : 0;
+}
+
+HRESULT FrameSkippingFilter::Transform(IMediaSample *pSample)
+{
+  /*  Check for other streams and pass them on */
+  // don't skip control info
+  if (m_pInput->SampleProps()->dwStreamId != AM_STREAM_MEDIA) {
     return S_OK;
   }
+
+  bool bTagLayer = false;
+  HRESULT hr = decideSample(pSample, bTagLayer);
+  if (hr == S_OK)
+  {
+    prepareKeptSample(pSample, bTagLayer);
+  }
+  return hr;
+}
+
+HRESULT FrameSkippingFilter::decideSample(IMediaSample *pSample, bool& rbTagLayer, bool bHold, bool bPending)
+{
+  // the properties belong to the last received sample
+  AM_SAMPLE2_PROPERTIES * const pProps = m_pInput->SampleProps();
+  if (!bPending)
+  {
+    checkUpstreamType(pProps);
+  }
+
+  // pick up parameter changes without a lock
+  if (m_config.update(m_activeConfig, m_uiConfigGeneration))
+  {
+    m_engine.applyConfig(m_activeConfig);
+    m_pacer.setFrameRate(m_engine.getOutputFrameRate(), m_activeConfig.MaxRepaceOffset);
+    if (m_engine.isSourceRateEstimated())
+    {
+      followSourceFrameRate();
+    }
+    updateLookahead();
+    updateAnalysisThreads();
+  }
+
+  // the start time is also used for the output interval statistics
+  REFERENCE_TIME tStart = 0, tStop = 0;
+  HRESULT hrTime = pSample->GetTime(&tStart, &tStop);
+  if (FAILED(hrTime) && m_engine.requiresTimestamps())
+  {
+    return hrTime;
+  }
+
+  bool bTimed = m_statistics.isDecisionTimed();
+  uint64_t uiCycles = bTimed ? FrameSkippingStatistics::readCycleCounter() : 0;
+  bool bKeep = false;
+  FramePicture picture = m_picture;
+  if ((m_engine.requiresPicture() || bHold) && !bPending)
+  {
+    BYTE* pBuffer = NULL;
+    HRESULT hr = pSample->GetPointer(&pBuffer);
+    // a sample that is too short is treated as different from the previous frame
+    if (SUCCEEDED(hr) && pSample->GetActualDataLength() >= picture.Stride * picture.Height)
+    {
+      picture.Data = pBuffer;
+    }
+  }
+  // compressed frames may only be dropped if no other frame refers to them
+  bool bDisposable = true;
+  if (m_nalParser.getCodec() != FSKIP_CODEC_NONE)
+  {
+    // sync points are parsed too so that in-band parameter sets are picked up
+    BYTE* pBuffer = NULL;
+    bDisposable = SUCCEEDED(pSample->GetPointer(&pBuffer)) && m_nalParser.isDisposable(pBuffer, pSample->GetActualDataLength());
+    bDisposable = bDisposable && pSample->IsSyncPoint() != S_OK;
+  }
+  // a relay after another filter in the temporal layer mode only compares the layer of the sample
+  unsigned uiLayer = 0;
+  bool bLayerTagged = m_engine.getMode() == FSKIP_TEMPORAL_LAYERS
+    && FrameSkippingEngine::getTemporalLayerFlags(bPending ? m_dwPendingTypeSpecificFlags : pProps->dwTypeSpecificFlags, uiLayer);
+  if (bLayerTagged)
+  {
+    bKeep = uiLayer <= m_engine.getMaxTemporalLayer();
+  }
+  else if (bPending)
+  {
+    // a frame whose analysis misses the deadline is treated as different from the last kept frame
+    const FrameAnalysis* pAnalysis = NULL;
+    if (m_engine.requiresPicture())
+    {
+      pAnalysis = m_iPendingSlot >= 0 ? m_analysisPool.waitFor(m_iPendingSlot, m_tPendingDeadline) : NULL;
+      if (pAnalysis == NULL)
+      {
+        m_statistics.recordAnalysisMiss();
+      }
+    }
+    bKeep = m_engine.keepFrameWithSignature(tStart, pAnalysis != NULL ? &pAnalysis->Signature : NULL, bDisposable, static_cast<uint32_t>(pSample->GetActualDataLength()));
+  }
   else
   {
-    assert(false);
-    return S_OK;
+    bKeep = m_engine.keepFrame(tStart, picture.Data != NULL ? &picture : NULL, bDisposable, static_cast<uint32_t>(pSample->GetActualDataLength()));
+  }
+  if (bTimed)
+  {
+    m_statistics.recordDecisionLatency(FrameSkippingStatistics::readCycleCounter() - uiCycles);
   }
-  
-#if 0
-  // adjust frame duration here?
+  if (m_engine.getSourceRateChanges() != m_uiSourceRateChanges)
+  {
+    followSourceFrameRate();
+  }
+  rbTagLayer = bKeep && m_engine.getMode() == FSKIP_TEMPORAL_LAYERS && !bLayerTagged;
+  if (bHold)
+  {
+    // recorded once the window is selected
+    pSample->AddRef();
+    m_apHeld[m_uiHeld] = pSample;
+    m_atHeldStart[m_uiHeld] = tStart;
+    m_abHeldTimed[m_uiHeld] = SUCCEEDED(hrTime);
+    m_abHeldTagLayer[m_uiHeld] = rbTagLayer;
+    ++m_uiHeld;
+    m_lookahead.add(picture.Data != NULL ? &picture : NULL, !bDisposable, bKeep);
+    return bKeep ? S_OK : S_FALSE;
+  }
+  m_statistics.recordFrame(bKeep, tStart, SUCCEEDED(hrTime));
+  return bKeep ? S_OK : S_FALSE;
+}
 
-  BYTE *pBufferIn, *pBufferOut;
-  HRESULT hr = pSample->GetPointer(&pBufferIn);
-  if (FAILED(hr))
+void FrameSkippingFilter::checkUpstreamType(const AM_SAMPLE2_PROPERTIES* pProps)
+{
+  // an upstream format change is passed on with the next kept sample
+  if ((pProps->dwSampleFlags & AM_SAMPLE_TYPECHANGED) && pProps->pMediaType != NULL)
   {
-    return hr;
+    m_mtUpstream = *pProps->pMediaType;
+    m_tSourceTimePerFrame = getAverageTimePerFrame(pProps->pMediaType);
+    m_bUpstreamTypeChanged = true;
   }
+}
 
-  VIDEOINFOHEADER *pVih1 = (VIDEOINFOHEADER*)mtIn->pbFormat;
+void FrameSkippingFilter::followSourceFrameRate()
+{
+  m_uiSourceRateChanges = m_engine.getSourceRateChanges();
+  const RationalFrameRate& sourceFrameRate = m_engine.getEstimatedSourceFrameRate();
+  if (!sourceFrameRate.isSet())
+  {
+    return;
+  }
+  // the next kept sample announces the output rate for the estimated source rate
+  FrameSkippingEngine::setConfigSourceFrameRate(m_activeConfig, sourceFrameRate);
+  m_tSourceTimePerFrame = FrameSkippingEngine::roundedDuration(sourceFrameRate);
+  m_pacer.setFrameRate(m_engine.getOutputFrameRate(), m_activeConfig.MaxRepaceOffset);
+}
 
-  m_dSkipRatio
-#endif
+void FrameSkippingFilter::prepareKeptSample(IMediaSample *pSample, bool bTagLayer)
+{
+  updateOutputMediaType(pSample);
+  if (bTagLayer)
+  {
+    setTemporalLayer(pSample, m_engine.getLastTemporalLayer());
+  }
+  REFERENCE_TIME tStart = 0, tStop = 0;
+  if (m_activeConfig.Repace && SUCCEEDED(pSample->GetTime(&tStart, &tStop)))
+  {
+    REFERENCE_TIME tMediaStart = 0, tMediaStop = 0;
+    if (m_pacer.pace(tStart, tStart, tStop, tMediaStart, tMediaStop))
+    {
+      pSample->SetTime(&tStart, &tStop);
+      pSample->SetMediaTime(&tMediaStart, &tMediaStop);
+    }
+  }
 }
 
 DEFINE_GUID(MEDIASUBTYPE_I420, 0x30323449, 0x0000, 0x0010, 0x80, 0x00,
   0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+// the output of hardware decoders: not declared by older SDKs
+DEFINE_GUID(FSKIP_MEDIASUBTYPE_NV12, 0x3231564E, 0x0000, 0x0010, 0x80, 0x00,
+  0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+DEFINE_GUID(FSKIP_MEDIASUBTYPE_P010, 0x30313050, 0x0000, 0x0010, 0x80, 0x00,
+  0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+// compressed subtypes: H264 and HEVC use start codes, AVC1 and HVC1 NAL unit length prefixes
+DEFINE_GUID(FSKIP_MEDIASUBTYPE_H264, 0x34363248, 0x0000, 0x0010, 0x80, 0x00,
+  0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+DEFINE_GUID(FSKIP_MEDIASUBTYPE_AVC1, 0x31435641, 0x0000, 0x0010, 0x80, 0x00,
+  0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+DEFINE_GUID(FSKIP_MEDIASUBTYPE_HEVC, 0x43564548, 0x0000, 0x0010, 0x80, 0x00,
+  0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+DEFINE_GUID(FSKIP_MEDIASUBTYPE_HVC1, 0x31435648, 0x0000, 0x0010, 0x80, 0x00,
+  0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
 
-HRESULT FrameSkippingFilter::CheckInputType(const CMediaType* mtIn)
+unsigned FrameSkippingFilter::getPixelFormat(const GUID& subtype)
+{
+  if (subtype == MEDIASUBTYPE_I420)
+    return FSKIP_PIXEL_FORMAT_I420;
+  if (subtype == MEDIASUBTYPE_RGB24)
+    return FSKIP_PIXEL_FORMAT_RGB24;
+  if (subtype == MEDIASUBTYPE_RGB32)
+    return FSKIP_PIXEL_FORMAT_RGB32;
+  if (subtype == FSKIP_MEDIASUBTYPE_NV12)
+    return FSKIP_PIXEL_FORMAT_NV12;
+  if (subtype == MEDIASUBTYPE_YUY2)
+    return FSKIP_PIXEL_FORMAT_YUY2;
+  if (subtype == MEDIASUBTYPE_UYVY)
+    return FSKIP_PIXEL_FORMAT_UYVY;
+  if (subtype == FSKIP_MEDIASUBTYPE_P010)
+    return FSKIP_PIXEL_FORMAT_P010;
+  return FSKIP_PIXEL_FORMAT_UNKNOWN;
+}
+
+unsigned FrameSkippingFilter::getCodec(const GUID& subtype)
+{
+  if (subtype == FSKIP_MEDIASUBTYPE_H264 || subtype == FSKIP_MEDIASUBTYPE_AVC1)
+    return FSKIP_CODEC_H264;
+  if (subtype == FSKIP_MEDIASUBTYPE_HEVC || subtype == FSKIP_MEDIASUBTYPE_HVC1)
+    return FSKIP_CODEC_HEVC;
+  return FSKIP_CODEC_NONE;
+}
+
+HRESULT FrameSkippingFilter::checkVideoType(const CMediaType* mtIn)
 {
   // Check the major type.
   if (mtIn->majortype != MEDIATYPE_Video)
@@ -194,80 +800,177 @@ HRESULT FrameSkippingFilter::CheckInputType(const CMediaType* mtIn)
     return VFW_E_TYPE_NOT_ACCEPTED;
   }
 
-  if (
-    (mtIn->subtype != MEDIASUBTYPE_RGB24) && (mtIn->subtype != MEDIASUBTYPE_RGB32) && (mtIn->subtype != MEDIASUBTYPE_I420)
-    )
+  // compressed video is skipped ahead of the decoder
+  if (getCodec(mtIn->subtype) != FSKIP_CODEC_NONE)
+  {
+    if (mtIn->formattype != FORMAT_VideoInfo && mtIn->formattype != FORMAT_VideoInfo2 && mtIn->formattype != FORMAT_MPEG2Video)
+    {
+      return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+    return S_OK;
+  }
+
+  if (getPixelFormat(mtIn->subtype) == FSKIP_PIXEL_FORMAT_UNKNOWN)
   {
     return VFW_E_TYPE_NOT_ACCEPTED;
   }
 
-  if (mtIn->formattype != FORMAT_VideoInfo)
+  if (mtIn->formattype != FORMAT_VideoInfo && mtIn->formattype != FORMAT_VideoInfo2)
   {
     return VFW_E_TYPE_NOT_ACCEPTED;
   }
   return S_OK;
 }
 
-HRESULT FrameSkippingFilter::Run(REFERENCE_TIME tStart)
+HRESULT FrameSkippingFilter::CheckInputType(const CMediaType* mtIn)
 {
-  if (m_uiFrameSkippingMode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+  return checkVideoType(mtIn);
+}
+
+HRESULT FrameSkippingFilter::SetMediaType(PIN_DIRECTION direction, const CMediaType *pmt)
+{
+  if (direction == PINDIR_INPUT)
   {
-    m_vFramesToBeSkipped.clear();
+    m_tSourceTimePerFrame = getAverageTimePerFrame(pmt);
+    describeInput(pmt, m_picture, m_nalParser);
+  }
+  return CTransInPlaceFilter::SetMediaType(direction, pmt);
+}
 
-    int iSkip = 0, iTotal = 0;
-    bool res = lowestRatio(m_dSourceFrameRate, m_dTargetFrameRate, iSkip, iTotal);
-    if (res)
+void FrameSkippingFilter::describeInput(const CMediaType* pmt, FramePicture& picture, NalParser& nalParser)
+{
+  picture = FramePicture();
+  nalParser.setFormat(FSKIP_CODEC_NONE, 0);
+  unsigned uiCodec = getCodec(pmt->subtype);
+  if (uiCodec != FSKIP_CODEC_NONE)
+  {
+    // MPEG2VIDEOINFO holds the NAL unit length size of AVC1 and HVC1 and the parameter sets
+    bool bLengthPrefixed = pmt->subtype == FSKIP_MEDIASUBTYPE_AVC1 || pmt->subtype == FSKIP_MEDIASUBTYPE_HVC1;
+    const MPEG2VIDEOINFO* pMpeg2 = NULL;
+    if (pmt->formattype == FORMAT_MPEG2Video && pmt->cbFormat >= sizeof(MPEG2VIDEOINFO))
+      pMpeg2 = (const MPEG2VIDEOINFO*)pmt->pbFormat;
+    unsigned uiLengthSize = (bLengthPrefixed && pMpeg2 != NULL) ? pMpeg2->dwFlags : (bLengthPrefixed ? 4 : 0);
+    nalParser.setFormat(uiCodec, uiLengthSize);
+    if (pMpeg2 != NULL && pMpeg2->cbSequenceHeader > 0
+      && pmt->cbFormat >= FIELD_OFFSET(MPEG2VIDEOINFO, dwSequenceHeader) + pMpeg2->cbSequenceHeader)
     {
-      m_uiSkipFrameNumber = iSkip;
-      m_uiTotalFrames = iTotal;
-      // calculate which frames should be dropped
-      if (m_uiSkipFrameNumber < m_uiTotalFrames && m_uiSkipFrameNumber > 0)
-      {
-        double dRatio = m_uiTotalFrames / static_cast<double>(m_uiSkipFrameNumber);
-        std::set<int> toBeSkipped;
-        std::set<int> toBePlayed;
-        // populate to be skipped: note that this index is 1-indexed
-        for (size_t iCount = 1; iCount <= m_uiSkipFrameNumber; ++iCount)
-        {
-#if _MSC_VER > 1600
-          int iToBeSkipped = static_cast<int>(round(iCount * dRatio));
-#else
-          int iToBeSkipped = static_cast<int>(floor(iCount * dRatio + 0.5));
-#endif
-          toBeSkipped.insert(iToBeSkipped);
-        }
-
-        // populate to be played
-        for (size_t iCount = 1; iCount <= m_uiTotalFrames; ++iCount)
-        {
-          auto found = toBeSkipped.find(iCount);
-          if (found == toBeSkipped.end())
-          {
-            toBePlayed.insert(iCount);
-            m_vFramesToBeSkipped.push_back(0);
-          }
-          else
-          {
-            m_vFramesToBeSkipped.push_back(1);
-          }
-        }
-      }
-      else
-      {
-        // invalid input
-        m_vFramesToBeSkipped.clear();
-      }
+      nalParser.parseParameterSets((const uint8_t*)pMpeg2->dwSequenceHeader, pMpeg2->cbSequenceHeader, bLengthPrefixed ? 2 : 0);
     }
   }
+  const BITMAPINFOHEADER* pBmi = NULL;
+  const RECT* pSource = NULL;
+  if (pmt->formattype == FORMAT_VideoInfo && pmt->cbFormat >= sizeof(VIDEOINFOHEADER))
+  {
+    pBmi = &((const VIDEOINFOHEADER*)pmt->pbFormat)->bmiHeader;
+    pSource = &((const VIDEOINFOHEADER*)pmt->pbFormat)->rcSource;
+  }
+  else if (pmt->formattype == FORMAT_VideoInfo2 && pmt->cbFormat >= sizeof(VIDEOINFOHEADER2))
+  {
+    pBmi = &((const VIDEOINFOHEADER2*)pmt->pbFormat)->bmiHeader;
+    pSource = &((const VIDEOINFOHEADER2*)pmt->pbFormat)->rcSource;
+  }
+  unsigned uiFormat = getPixelFormat(pmt->subtype);
+  if (pBmi == NULL || uiFormat == FSKIP_PIXEL_FORMAT_UNKNOWN)
+  {
+    return;
+  }
+
+  // biWidth is the stride in pixels: decoders with padded surfaces describe the visible pixels with the source rectangle
+  picture.Format = uiFormat;
+  picture.Width = pBmi->biWidth;
+  picture.Height = abs(pBmi->biHeight);
+  if (pSource->left == 0 && pSource->top == 0 && pSource->right > 0 && pSource->bottom > 0)
+  {
+    picture.Width = std::min(picture.Width, static_cast<int>(pSource->right));
+    picture.Height = std::min(picture.Height, static_cast<int>(pSource->bottom));
+  }
+  switch (uiFormat)
+  {
+  case FSKIP_PIXEL_FORMAT_I420:
+  case FSKIP_PIXEL_FORMAT_NV12:
+    picture.Stride = pBmi->biWidth;
+    break;
+  case FSKIP_PIXEL_FORMAT_P010:
+    picture.Stride = pBmi->biWidth * 2;
+    break;
+  default:
+    // packed DIB rows are DWORD aligned
+    picture.Stride = ((pBmi->biWidth * pBmi->biBitCount + 31) & ~31) >> 3;
+    break;
+  }
+}
+
+HRESULT FrameSkippingFilter::CompleteConnect(PIN_DIRECTION direction, IPin *pReceivePin)
+{
+  UNREFERENCED_PARAMETER(pReceivePin);
+  if (m_pGraph == NULL)
+  {
+    return VFW_E_NOT_IN_GRAPH;
+  }
+
+  // as in CTransInPlaceFilter the input is always reconnected to account for buffering changes,
+  // but the types of the two pins differ in their frame rate
+  if (direction == PINDIR_OUTPUT)
+  {
+    if (m_pInput->IsConnected())
+    {
+      CMediaType mtIn(m_pOutput->CurrentMediaType());
+      setAverageTimePerFrame(&mtIn, m_tSourceTimePerFrame);
+      return ReconnectPin(m_pInput, &mtIn);
+    }
+    return NOERROR;
+  }
+
+  if (m_pOutput->IsConnected())
+  {
+    CMediaType mtOut(m_pInput->CurrentMediaType());
+    setAverageTimePerFrame(&mtOut, getOutputTimePerFrame(makeConfig()));
+    if (mtOut != m_pOutput->CurrentMediaType())
+    {
+      return ReconnectPin(m_pOutput, &mtOut);
+    }
+  }
+  return NOERROR;
+}
+
+HRESULT FrameSkippingFilter::AlterQuality(Quality q)
+{
+  // S_FALSE lets the output pin pass the message on to the upstream filter
+  if (!m_engine.isQualityControlEnabled())
+    return S_FALSE;
+
+  m_engine.notifyQuality(q.Late, q.Proportion);
+  return S_OK;
+}
+
+HRESULT FrameSkippingFilter::Run(REFERENCE_TIME tStart)
+{
+  // the pattern is shared with all filters that skip with the same rates
+  FrameSkippingConfig config = makeConfig();
+  if (config.Pattern)
+  {
+    m_uiSkipFrameNumber = config.Pattern->getSkipFrameNumber();
+    m_uiTotalFrames = config.Pattern->getTotalFrames();
+  }
+  m_config.publish(config);
   return CTransInPlaceFilter::Run(tStart);
 }
 
-HRESULT FrameSkippingFilter::Stop(void)
+HRESULT FrameSkippingFilter::StopStreaming()
 {
-  m_uiCurrentFrame = 0;
-  m_vFramesToBeSkipped.clear();
-  m_bIsTimeSet = false;
-  return CTransInPlaceFilter::Stop();
+  // called with the receive lock held
+  deliverHeld(false);
+  deliverPending(false);
+  m_analysisPool.stop();
+  releaseAnalysed(false);
+  m_lookahead.reset();
+  m_engine.reset();
+  m_statistics.reset();
+  m_pacer.reset();
+  // an estimated source rate only applies to the stream it was measured on
+  m_tSourceTimePerFrame = getAverageTimePerFrame(&m_pInput->CurrentMediaType());
+  m_uiSourceRateChanges = m_engine.getSourceRateChanges();
+  return CTransInPlaceFilter::StopStreaming();
 }
 
 CBasePin* FrameSkippingFilter::GetPin(int n)
@@ -321,131 +1024,284 @@ CBasePin* FrameSkippingFilter::GetPin(int n)
   }
 } // GetPin
 
+STDMETHODIMP FrameSkippingFilter::GetParameter(const char* szParamName, int nBufferSize, char* szValue, int* pLength)
+{
+  // refresh the read-only statistics parameters
+  FrameSkippingStatsSnapshot stats;
+  m_statistics.getSnapshot(stats);
+  m_sFramesIn = std::to_string(static_cast<unsigned long long>(stats.FramesIn));
+  m_sFramesOut = std::to_string(static_cast<unsigned long long>(stats.FramesOut));
+  m_sFramesDropped = std::to_string(static_cast<unsigned long long>(stats.FramesDropped));
+  m_dAchievedFps = stats.AchievedFps;
+  m_sAnalysisMisses = std::to_string(static_cast<unsigned long long>(m_statistics.getAnalysisMisses()));
+  return CSettingsInterface::GetParameter(szParamName, nBufferSize, szValue, pLength);
+}
+
 STDMETHODIMP FrameSkippingFilter::SetParameter(const char* type, const char* value)
 {
-  HRESULT hr = CSettingsInterface::SetParameter(type, value);
-  if (SUCCEEDED(hr))
-  { 
-    if (m_uiTotalFrames > 0)
-      m_dSkipRatio = m_uiSkipFrameNumber / static_cast<double>(m_uiTotalFrames);
-    else
-      m_dSkipRatio = 0.0;
+  if (isStatisticsParameter(type))
+    return E_ACCESSDENIED;
+
+  // the previous value is restored if the new one is out of range
+  char szPrevious[256] = {};
+  int iLength = 0;
+  HRESULT hr = CSettingsInterface::GetParameter(type, sizeof(szPrevious) - 1, szPrevious, &iLength);
+  if (FAILED(hr))
+    return hr;
+  hr = CSettingsInterface::SetParameter(type, value);
+  if (FAILED(hr))
+    return hr;
+  if (!hasValidParameters())
+  {
+    CSettingsInterface::SetParameter(type, szPrevious);
+    return E_INVALIDARG;
   }
+  publishConfig();
   return hr;
 }
 
-FrameSkippingOutputPin::FrameSkippingOutputPin
-(__in_opt LPCTSTR             pObjectName
-, __inout CTransInPlaceFilter *pFilter
-, __inout HRESULT             *phr
-, __in_opt LPCWSTR             pName
-)
-: CTransInPlaceOutputPin(pObjectName, pFilter, phr, pName)
+bool FrameSkippingFilter::hasValidParameters() const
 {
+  // as toConfig of the C library: a mode out of range would reach the assertion of FrameSkippingEngine::decideMode
+  return m_uiFrameSkippingMode <= FSKIP_BITRATE_BUDGET && m_dSourceFrameRate >= 0.0 && m_dTargetFrameRate >= 0.0
+    && (m_uiSourceFrameRateNum == 0 || m_uiSourceFrameRateDen != 0)
+    && (m_uiTargetFrameRateNum == 0 || m_uiTargetFrameRateDen != 0)
+    && m_uiTemporalLayers > 0 && m_uiTemporalLayers <= FSKIP_MAX_TEMPORAL_LAYERS
+    && m_dDuplicateThreshold >= 0.0 && m_dMinOutputRate >= 0.0 && m_dMaxOutputRate >= 0.0;
+}
 
+void FrameSkippingFilter::publishConfig()
+{
+  m_config.publish(makeConfig());
 }
 
-// EnumMediaTypes
-// - pass through to our downstream filter
-STDMETHODIMP FrameSkippingOutputPin::EnumMediaTypes(__deref_out IEnumMediaTypes **ppEnum)
+FrameSkippingConfig FrameSkippingFilter::makeConfig() const
 {
-  HRESULT hr = CTransInPlaceOutputPin::EnumMediaTypes(ppEnum);
- 
+  FrameSkippingConfig config;
+  config.Mode = m_uiFrameSkippingMode;
+  config.SourceFrameRate = m_dSourceFrameRate;
+  config.TargetFrameRate = m_dTargetFrameRate;
+  config.RationalSourceFrameRate = toRationalFrameRate(m_uiSourceFrameRateNum, m_uiSourceFrameRateDen, m_dSourceFrameRate);
+  config.RationalTargetFrameRate = toRationalFrameRate(m_uiTargetFrameRateNum, m_uiTargetFrameRateDen, m_dTargetFrameRate);
+  config.DuplicateThreshold = m_dDuplicateThreshold;
+  config.MaxDuplicateInterval = static_cast<int64_t>(m_uiMaxDuplicateIntervalMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+  config.MaxLateness = static_cast<int64_t>(m_uiMaxLatenessMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+  config.QualityControl = m_uiQualityControl != 0;
+  config.MinOutputRate = m_dMinOutputRate;
+  config.MaxOutputRate = m_dMaxOutputRate;
+  config.Repace = m_uiRepace != 0;
+  config.MaxRepaceOffset = static_cast<int64_t>(m_uiMaxRepaceOffsetMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+  config.TemporalLayers = m_uiTemporalLayers;
+  config.MaxTemporalLayer = m_uiMaxTemporalLayer;
+  config.BurstDuration = static_cast<int64_t>(m_uiBurstDurationMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+  config.MaxBitrate = static_cast<uint64_t>(m_uiMaxBitrateKbps) * 1000;
+  config.BitrateWindow = static_cast<int64_t>(m_uiBitrateWindowMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+  config.Lookahead = m_uiLookahead;
+  config.AnalysisThreads = m_uiAnalysisThreads;
+  config.AnalysisDeadline = static_cast<int64_t>(m_uiAnalysisDeadlineMs) * (TIMESTAMP_TICKS_PER_SECOND / 1000);
+  config.EstimateSourceRate = m_uiEstimateSourceRate != 0;
+  // looked up here so that the streaming thread does not take the cache lock
+  if (m_uiFrameSkippingMode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+    config.Pattern = SkipPatternCache::getInstance().getPattern(m_dSourceFrameRate, m_dTargetFrameRate);
+  return config;
+}
+
+REFERENCE_TIME FrameSkippingFilter::getOutputTimePerFrame(const FrameSkippingConfig& config) const
+{
+  return FrameSkippingEngine::getOutputFrameDuration(config, m_tSourceTimePerFrame);
+}
+
+void FrameSkippingFilter::updateOutputMediaType(IMediaSample *pSample)
+{
+  REFERENCE_TIME tOutputTimePerFrame = getOutputTimePerFrame(m_activeConfig);
+  if (!m_bUpstreamTypeChanged && (tOutputTimePerFrame == m_tOutputTimePerFrame || tOutputTimePerFrame == 0))
+    return;
+
+  CMediaType mt(m_bUpstreamTypeChanged ? m_mtUpstream : m_pOutput->CurrentMediaType());
+  m_bUpstreamTypeChanged = false;
+  // only asked once per change: after a refusal downstream keeps the current output type
+  m_tOutputTimePerFrame = tOutputTimePerFrame;
+  setAverageTimePerFrame(&mt, tOutputTimePerFrame);
+  IPin* pPeer = m_pOutput->GetConnected();
+  if (pPeer == NULL || pPeer->QueryAccept(&mt) != S_OK)
+  {
+    // the sample may still carry the type of an upstream format change that downstream did not accept
+    pSample->SetMediaType(NULL);
+    return;
+  }
+
+  // downstream switches to the new type when it receives this sample
+  if (SUCCEEDED(pSample->SetMediaType(&mt)))
+  {
+    static_cast<FrameSkippingOutputPin*>(m_pOutput)->setStreamingMediaType(mt);
+  }
+}
+
+HRESULT FrameSkippingFilter::setTemporalLayer(IMediaSample *pSample, unsigned uiLayer)
+{
+  IMediaSample2* pSample2 = NULL;
+  HRESULT hr = pSample->QueryInterface(IID_IMediaSample2, (void**)&pSample2);
+  if (FAILED(hr))
+    return hr;
+
+  AM_SAMPLE2_PROPERTIES props;
+  hr = pSample2->GetProperties(sizeof(props), (BYTE*)&props);
   if (SUCCEEDED(hr))
   {
-    // modify frame duration
-    AM_MEDIA_TYPE *pmt = NULL;
-    while (hr = (*ppEnum)->Next(1, &pmt, NULL), hr == S_OK)
-    {
-      adjustAverageTimePerFrameInVideoInfoHeader(pmt);
-    }
+    // only the size and the type specific flags are written back
+    props.cbData = FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, dwSampleFlags);
+    props.dwTypeSpecificFlags = FrameSkippingEngine::setTemporalLayerFlags(props.dwTypeSpecificFlags, uiLayer);
+    hr = pSample2->SetProperties(props.cbData, (const BYTE*)&props);
   }
+  pSample2->Release();
   return hr;
-} // EnumMediaTypes
+}
 
-HRESULT
-FrameSkippingOutputPin::SetMediaType(const CMediaType* pmtOut)
+REFERENCE_TIME FrameSkippingFilter::getAverageTimePerFrame(const AM_MEDIA_TYPE *pmt)
 {
-  const AM_MEDIA_TYPE* pMediaType = pmtOut;
-  adjustAverageTimePerFrameInVideoInfoHeader(const_cast<AM_MEDIA_TYPE*>(pMediaType));
-  return CTransInPlaceOutputPin::SetMediaType(pmtOut);
+  if (pmt->formattype == FORMAT_VideoInfo && pmt->cbFormat >= sizeof(VIDEOINFOHEADER))
+    return ((const VIDEOINFOHEADER*)pmt->pbFormat)->AvgTimePerFrame;
+  if (pmt->formattype == FORMAT_VideoInfo2 && pmt->cbFormat >= sizeof(VIDEOINFOHEADER2))
+    return ((const VIDEOINFOHEADER2*)pmt->pbFormat)->AvgTimePerFrame;
+  if (pmt->formattype == FORMAT_MPEG2Video && pmt->cbFormat >= sizeof(MPEG2VIDEOINFO))
+    return ((const MPEG2VIDEOINFO*)pmt->pbFormat)->hdr.AvgTimePerFrame;
+  return 0;
 }
 
-inline void FrameSkippingOutputPin::adjustAverageTimePerFrameInVideoInfoHeader(AM_MEDIA_TYPE * pmt)
+void FrameSkippingFilter::setAverageTimePerFrame(AM_MEDIA_TYPE *pmt, REFERENCE_TIME tAvgTimePerFrame)
 {
-  if (((FrameSkippingFilter*)m_pFilter)->m_dSkipRatio > 0.0)
+  if (tAvgTimePerFrame < 0)
+    return;
+
+  REFERENCE_TIME* pAvgTimePerFrame = NULL;
+  DWORD* pBitRate = NULL;
+  if (pmt->formattype == FORMAT_VideoInfo && pmt->cbFormat >= sizeof(VIDEOINFOHEADER))
   {
-    if ((FORMAT_VideoInfo == pmt->formattype))
-    {
-      VIDEOINFOHEADER* pV = (VIDEOINFOHEADER*)pmt->pbFormat;
-      REFERENCE_TIME duration = static_cast<REFERENCE_TIME>(pV->AvgTimePerFrame / ((FrameSkippingFilter*)m_pFilter)->m_dSkipRatio);
-      pV->AvgTimePerFrame = duration;
-    }
-    else if ((FORMAT_VideoInfo2 == pmt->formattype))
-    {
-      VIDEOINFOHEADER2* pV = (VIDEOINFOHEADER2*)pmt->pbFormat;
-      REFERENCE_TIME duration = static_cast<REFERENCE_TIME>(pV->AvgTimePerFrame / ((FrameSkippingFilter*)m_pFilter)->m_dSkipRatio);
-      pV->AvgTimePerFrame = duration;
-    }
+    VIDEOINFOHEADER* pV = (VIDEOINFOHEADER*)pmt->pbFormat;
+    pAvgTimePerFrame = &pV->AvgTimePerFrame;
+    pBitRate = &pV->dwBitRate;
   }
+  else if (pmt->formattype == FORMAT_VideoInfo2 && pmt->cbFormat >= sizeof(VIDEOINFOHEADER2))
+  {
+    VIDEOINFOHEADER2* pV = (VIDEOINFOHEADER2*)pmt->pbFormat;
+    pAvgTimePerFrame = &pV->AvgTimePerFrame;
+    pBitRate = &pV->dwBitRate;
+  }
+  else if (pmt->formattype == FORMAT_MPEG2Video && pmt->cbFormat >= sizeof(MPEG2VIDEOINFO))
+  {
+    VIDEOINFOHEADER2* pV = &((MPEG2VIDEOINFO*)pmt->pbFormat)->hdr;
+    pAvgTimePerFrame = &pV->AvgTimePerFrame;
+    pBitRate = &pV->dwBitRate;
+  }
+  if (pAvgTimePerFrame == NULL)
+    return;
+
+  // the bit rate is proportional to the frame rate: for compressed video this is an estimate
+  if (*pAvgTimePerFrame > 0 && tAvgTimePerFrame > 0 && *pBitRate > 0)
+    *pBitRate = static_cast<DWORD>(*pBitRate * (*pAvgTimePerFrame / static_cast<double>(tAvgTimePerFrame)) + 0.5);
+  *pAvgTimePerFrame = tAvgTimePerFrame;
 }
 
-bool FrameSkippingFilter::lowestRatio(double SourceFrameRate, double targetFrameRate, int& iSkipFrame, int& tTotalFrames)
+bool FrameSkippingFilter::StreamClock::getStreamTime(int64_t& tNow)
 {
+  // the stream time is only meaningful while the graph is running
+  if (m_pFilter->m_State != State_Running)
+    return false;
 
-  if (targetFrameRate > SourceFrameRate)
-  {
+  CRefTime tStream;
+  if (m_pFilter->StreamTime(tStream) != S_OK)
     return false;
-  }
-  const double EPSILON = 0.0001;
-  if (SourceFrameRate - targetFrameRate < EPSILON)
+
+  tNow = tStream;
+  return true;
+}
+
+void FrameSkippingFilter::getStatistics(FrameSkippingStatsSnapshot& stats) const
+{
+  m_statistics.getSnapshot(stats);
+}
+
+bool FrameSkippingFilter::isStatisticsParameter(const char* szParamName)
+{
+  const char* aNames[] = { FILTER_PARAM_FRAMES_IN, FILTER_PARAM_FRAMES_OUT, FILTER_PARAM_FRAMES_DROPPED, FILTER_PARAM_ACHIEVED_FPS,
+    FILTER_PARAM_ANALYSIS_MISSES };
+  for (size_t i = 0; i < sizeof(aNames) / sizeof(aNames[0]); ++i)
   {
-    iSkipFrame = 0;
-    tTotalFrames = 0;
-    return true;
+    if (strcmp(szParamName, aNames[i]) == 0)
+      return true;
   }
+  return false;
+}
 
-  //get rid of the floating point
-  //limited to 1 decimal for now
-  if (fmod(targetFrameRate, 1) != 0 || fmod(SourceFrameRate, 1) != 0)
+RationalFrameRate FrameSkippingFilter::toRationalFrameRate(unsigned uiNum, unsigned uiDen, double dFrameRate)
+{
+  return FrameSkippingEngine::toRationalFrameRate(uiNum, uiDen, dFrameRate);
+}
+
+FrameSkippingOutputPin::FrameSkippingOutputPin
+(__in_opt LPCTSTR             pObjectName
+, __inout CTransInPlaceFilter *pFilter
+, __inout HRESULT             *phr
+, __in_opt LPCWSTR             pName
+)
+: CTransInPlaceOutputPin(pObjectName, pFilter, phr, pName)
+{
+
+}
+
+STDMETHODIMP FrameSkippingOutputPin::EnumMediaTypes(__deref_out IEnumMediaTypes **ppEnum)
+{
+  CheckPointer(ppEnum, E_POINTER);
+  FrameSkippingFilter* pFilter = (FrameSkippingFilter*)m_pFilter;
+  if (!pFilter->m_pInput->IsConnected())
   {
-    targetFrameRate = targetFrameRate * 10;
-    SourceFrameRate = SourceFrameRate * 10;
+    return VFW_E_NOT_CONNECTED;
   }
+  // enumerates GetMediaType
+  return CBasePin::EnumMediaTypes(ppEnum);
+} // EnumMediaTypes
 
-  double targetFrameRateTemp(round(targetFrameRate)), SourceFrameRateTemp(round(SourceFrameRate));
-  //Logic to find the greatest common factor
-  while (true)
+HRESULT FrameSkippingOutputPin::GetMediaType(int iPosition, __inout CMediaType *pMediaType)
+{
+  FrameSkippingFilter* pFilter = (FrameSkippingFilter*)m_pFilter;
+  if (iPosition < 0)
   {
-    (targetFrameRateTemp > SourceFrameRateTemp) ? targetFrameRateTemp = remainder(targetFrameRateTemp, SourceFrameRateTemp) :
-      SourceFrameRateTemp = remainder(SourceFrameRateTemp, targetFrameRateTemp);
-    if (targetFrameRateTemp < 0)
-    {
-      targetFrameRateTemp += SourceFrameRateTemp;
-    }
-    else if (SourceFrameRateTemp < 0)
-    {
-      SourceFrameRateTemp += targetFrameRateTemp;
-    }
-    if (targetFrameRateTemp <= 0 || SourceFrameRateTemp <= 0)
-    {
-      break;
-    }
+    return E_INVALIDARG;
   }
-  // Divide by the GCF to get the lowest ratio
-  if (targetFrameRateTemp == 0)
+  if (!pFilter->m_pInput->IsConnected())
   {
-    iSkipFrame = (unsigned int)((SourceFrameRate - targetFrameRate) / SourceFrameRateTemp);
-    tTotalFrames = (unsigned int)(SourceFrameRate / SourceFrameRateTemp);
+    return VFW_E_NOT_CONNECTED;
   }
-  else if (SourceFrameRateTemp == 0)
+  if (iPosition > 0)
   {
-    iSkipFrame = (unsigned int)((SourceFrameRate - targetFrameRate) / targetFrameRateTemp);
-    tTotalFrames = (unsigned int)(SourceFrameRate / targetFrameRateTemp);
+    return VFW_S_NO_MORE_ITEMS;
   }
-  else
+  *pMediaType = pFilter->m_pInput->CurrentMediaType();
+  FrameSkippingFilter::setAverageTimePerFrame(pMediaType, pFilter->getOutputTimePerFrame(pFilter->makeConfig()));
+  return S_OK;
+}
+
+HRESULT FrameSkippingOutputPin::CheckMediaType(const CMediaType* pmtOut)
+{
+  // the connection type while streaming: the base class would compare it at the input rate
+  if (!m_pFilter->IsStopped() && *pmtOut == m_mt)
   {
-    //The previous loop prevent this from happening
+    return S_OK;
   }
-  return true;
+  FrameSkippingFilter* pFilter = (FrameSkippingFilter*)m_pFilter;
+  CMediaType mtIn(*pmtOut);
+  if (pFilter->m_pInput->IsConnected())
+  {
+    FrameSkippingFilter::setAverageTimePerFrame(&mtIn, pFilter->m_tSourceTimePerFrame);
+  }
+  return CTransInPlaceOutputPin::CheckMediaType(&mtIn);
+}
+
+HRESULT FrameSkippingOutputPin::SetMediaType(const CMediaType* pmtOut)
+{
+  FrameSkippingFilter* pFilter = (FrameSkippingFilter*)m_pFilter;
+  CMediaType mtOut(*pmtOut);
+  pFilter->m_tOutputTimePerFrame = pFilter->getOutputTimePerFrame(pFilter->makeConfig());
+  FrameSkippingFilter::setAverageTimePerFrame(&mtOut, pFilter->m_tOutputTimePerFrame);
+  return CTransInPlaceOutputPin::SetMediaType(&mtOut);
 }
@@ -33,11 +33,65 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
 #include <streams.h>
-#include <vector>
 #include <DirectShowExt/CSettingsInterface.h>
 #include <DirectShowExt/FilterParameterStringConstants.h>
 
+#include <chrono>
+#include "ConfigSnapshot.h"
+#include "FrameAnalysisPool.h"
+#include "FrameSkippingEngine.h"
+#include "FrameSkippingStatistics.h"
+#include "LookaheadSelector.h"
+#include "NalParser.h"
+#include "OutputPacer.h"
 #include "VersionInfo.h"
+
+// Exact frame rates: these take precedence over the floating point frame rates if the numerator is set
+#define FILTER_PARAM_SOURCE_FRAMERATE_NUM "sourceframeratenum"
+#define FILTER_PARAM_SOURCE_FRAMERATE_DEN "sourceframerateden"
+#define FILTER_PARAM_TARGET_FRAMERATE_NUM "targetframeratenum"
+#define FILTER_PARAM_TARGET_FRAMERATE_DEN "targetframerateden"
+// Duplicate frame elimination: mean absolute luma difference per 8x8 block at or below which a frame is a duplicate
+#define FILTER_PARAM_DUPLICATE_THRESHOLD "duplicatethreshold"
+// Duplicate frame elimination: keep a duplicate if no frame was kept for this many milliseconds. 0 = never
+#define FILTER_PARAM_MAX_DUPLICATE_INTERVAL "maxduplicateinterval"
+// Frames that are later than this many milliseconds against the stream clock are dropped in every mode. 0 = disabled
+#define FILTER_PARAM_MAX_LATENESS "maxlateness"
+// Quality control: 1 = lower the output rate when downstream reports that it cannot keep up
+#define FILTER_PARAM_QUALITY_CONTROL "qualitycontrol"
+// Quality control: bounds of the adapted output rate in fps. 0 = no bound
+#define FILTER_PARAM_MIN_OUTPUT_RATE "minoutputrate"
+#define FILTER_PARAM_MAX_OUTPUT_RATE "maxoutputrate"
+// Output re-pacing: 1 = move the start, stop and media times of kept frames onto an exact grid at the output rate
+#define FILTER_PARAM_REPACE "repace"
+// Output re-pacing: the grid is restarted if a frame would move by more than this many milliseconds. 0 = one output frame
+#define FILTER_PARAM_MAX_REPACE_OFFSET "maxrepaceoffset"
+// Temporal layer mode: number of dyadic layers and the highest layer that is kept. Kept samples are tagged with their layer
+#define FILTER_PARAM_TEMPORAL_LAYERS "temporallayers"
+#define FILTER_PARAM_MAX_TEMPORAL_LAYER "maxtemporallayer"
+// Token bucket mode: milliseconds of missing frames whose share of the target rate may be caught up on after a stall
+#define FILTER_PARAM_BURST_DURATION "burstduration"
+// Bitrate budget mode: cap in kbit/s on the payload of the kept samples. Sync points and reference frames are always kept
+#define FILTER_PARAM_MAX_BITRATE "maxbitrate"
+// Bitrate budget mode: the sliding window in milliseconds over which the cap is enforced
+#define FILTER_PARAM_BITRATE_WINDOW "bitratewindow"
+// Lookahead: hold back up to this many frames and keep those whose loss would be most visible, at the same output rate.
+// Adds this many frames of latency. Not used in the temporal layer and bitrate budget modes. 0 = off, below 4 keeps the cadence
+#define FILTER_PARAM_LOOKAHEAD "lookahead"
+// Duplicate frame elimination: analyse each frame on this many worker threads while the previous frame is delivered.
+// 0 = on the streaming thread
+#define FILTER_PARAM_ANALYSIS_THREADS "analysisthreads"
+// Duplicate frame elimination: milliseconds after a frame arrives by which its analysis must be done. A later frame
+// is decided by the target rate alone. 0 = wait for the analysis for up to a second
+#define FILTER_PARAM_ANALYSIS_DEADLINE "analysisdeadline"
+// 1 = estimate the source frame rate from the timestamps instead of using the configured source rate
+#define FILTER_PARAM_ESTIMATE_SOURCE_RATE "estimatesourcerate"
+// Read-only statistics since the graph was last started. The frame counts are decimal strings of 64 bit counters.
+#define FILTER_PARAM_FRAMES_IN "framesin"
+#define FILTER_PARAM_FRAMES_OUT "framesout"
+#define FILTER_PARAM_FRAMES_DROPPED "framesdropped"
+#define FILTER_PARAM_ACHIEVED_FPS "achievedfps"
+#define FILTER_PARAM_ANALYSIS_MISSES "analysismisses"
 // {8E974B99-BC09-4041-98F4-1103BAA1B0EA}
 static const GUID CLSID_VPP_FrameSkippingFilter =
 { 0xbbf2f0af, 0x9f7f, 0x4406, { 0xae, 0x9c, 0xe5, 0xf, 0x92, 0xc4, 0x63, 0xbb } };
@@ -46,18 +100,10 @@ static const GUID CLSID_VPP_FrameSkippingFilter =
 static const GUID CLSID_FrameSkippingProperties =
 { 0xf0a41b88, 0x2311, 0x42f9, { 0x8e, 0x26, 0x67, 0x9b, 0xe4, 0xff, 0xc1, 0x76 } };
 
-
-enum FrameSkippingMode
-{
-  FSKIP_SKIP_X_FRAMES_EVERY_Y = 0,
-  FSKIP_ACHIEVE_TARGET_RATE = 1
-};
-
-
-
 /**
  * @brief The FrameSkippingFilter allows x frames out of every y frames to be skipped.
- * TODO: Do input validation by overriding SetParameter
+ * Raw video is accepted as well as H.264 and HEVC ahead of the decoder: compressed reference frames are never dropped.
+ * The skipping decisions are made by the FrameSkippingEngine: the filter only adapts media samples to it.
  */
 class FrameSkippingFilter : public CTransInPlaceFilter,
   public CSettingsInterface,
@@ -83,10 +129,23 @@ public:
   virtual CBasePin *GetPin(int n);
 
   //Overriding various CTransInPlace methods
+  /// decides before the base class copies a sample between different allocators: dropped samples are never copied
+  HRESULT Receive(IMediaSample *pSample);
+  /// delivers the frames held back by the lookahead or in analysis
+  HRESULT EndOfStream();
+  /// releases the frames held back by the lookahead or in analysis without delivering them
+  HRESULT EndFlush();
+  /// delivers the frames held back by the lookahead or in analysis with the times of the previous segment
+  HRESULT NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate);
   HRESULT Transform(IMediaSample *pSample);/* Overrriding the receive method.
                                            This method receives a media sample, processes it, and delivers it to the downstream filter.*/
 
   HRESULT CheckInputType(const CMediaType* mtIn);
+  HRESULT SetMediaType(PIN_DIRECTION direction, const CMediaType *pmt);
+  /// reconnects the other pin with the same type at the input or output frame rate
+  HRESULT CompleteConnect(PIN_DIRECTION direction, IPin *pReceivePin);
+  /// handles quality messages from downstream if quality control is enabled, otherwise passes them upstream
+  HRESULT AlterQuality(Quality q);
 
   STDMETHODIMP GetPages(CAUUID *pPages) // For the Skipping Property Page
   {
@@ -102,7 +161,8 @@ public:
   }
 
   STDMETHODIMP Run(REFERENCE_TIME tStart);
-  STDMETHODIMP Stop(void);
+  /// resets the streaming state: called with the receive lock held
+  HRESULT StopStreaming();
 
   virtual void doGetVersion(std::string& sVersion)
   {
@@ -116,37 +176,231 @@ public:
     addParameter(FILTER_PARAM_SOURCE_FRAMERATE, &m_dSourceFrameRate, 0.0);
     addParameter(FILTER_PARAM_TARGET_FRAMERATE, &m_dTargetFrameRate, 0.0);
     addParameter(FILTER_PARAM_MODE, &m_uiFrameSkippingMode, 0);
-
+    addParameter(FILTER_PARAM_SOURCE_FRAMERATE_NUM, &m_uiSourceFrameRateNum, 0);
+    addParameter(FILTER_PARAM_SOURCE_FRAMERATE_DEN, &m_uiSourceFrameRateDen, 1);
+    addParameter(FILTER_PARAM_TARGET_FRAMERATE_NUM, &m_uiTargetFrameRateNum, 0);
+    addParameter(FILTER_PARAM_TARGET_FRAMERATE_DEN, &m_uiTargetFrameRateDen, 1);
+    addParameter(FILTER_PARAM_DUPLICATE_THRESHOLD, &m_dDuplicateThreshold, 1.0);
+    addParameter(FILTER_PARAM_MAX_DUPLICATE_INTERVAL, &m_uiMaxDuplicateIntervalMs, 0);
+    addParameter(FILTER_PARAM_MAX_LATENESS, &m_uiMaxLatenessMs, 0);
+    addParameter(FILTER_PARAM_QUALITY_CONTROL, &m_uiQualityControl, 0);
+    addParameter(FILTER_PARAM_MIN_OUTPUT_RATE, &m_dMinOutputRate, 0.0);
+    addParameter(FILTER_PARAM_MAX_OUTPUT_RATE, &m_dMaxOutputRate, 0.0);
+    addParameter(FILTER_PARAM_REPACE, &m_uiRepace, 0);
+    addParameter(FILTER_PARAM_MAX_REPACE_OFFSET, &m_uiMaxRepaceOffsetMs, 0);
+    addParameter(FILTER_PARAM_TEMPORAL_LAYERS, &m_uiTemporalLayers, 4);
+    addParameter(FILTER_PARAM_MAX_TEMPORAL_LAYER, &m_uiMaxTemporalLayer, 3);
+    addParameter(FILTER_PARAM_BURST_DURATION, &m_uiBurstDurationMs, 0);
+    addParameter(FILTER_PARAM_MAX_BITRATE, &m_uiMaxBitrateKbps, 0);
+    addParameter(FILTER_PARAM_BITRATE_WINDOW, &m_uiBitrateWindowMs, 1000);
+    addParameter(FILTER_PARAM_LOOKAHEAD, &m_uiLookahead, 0);
+    addParameter(FILTER_PARAM_ANALYSIS_THREADS, &m_uiAnalysisThreads, 0);
+    addParameter(FILTER_PARAM_ANALYSIS_DEADLINE, &m_uiAnalysisDeadlineMs, 0);
+    addParameter(FILTER_PARAM_ESTIMATE_SOURCE_RATE, &m_uiEstimateSourceRate, 0);
+    addParameter(FILTER_PARAM_FRAMES_IN, &m_sFramesIn, "0");
+    addParameter(FILTER_PARAM_FRAMES_OUT, &m_sFramesOut, "0");
+    addParameter(FILTER_PARAM_FRAMES_DROPPED, &m_sFramesDropped, "0");
+    addParameter(FILTER_PARAM_ACHIEVED_FPS, &m_dAchievedFps, 0.0);
+    addParameter(FILTER_PARAM_ANALYSIS_MISSES, &m_sAnalysisMisses, "0");
   }
+  /// refreshes the statistics parameters before they are read
+  STDMETHODIMP GetParameter(const char* szParamName, int nBufferSize, char* szValue, int* pLength);
+  /// the statistics parameters are read-only. Returns E_INVALIDARG and keeps the previous value if a value is out of range.
   STDMETHODIMP SetParameter(const char* type, const char* value);
 
+  /// copies the statistics including the latency and output interval histograms
+  void getStatistics(FrameSkippingStatsSnapshot& stats) const;
+
+  // media type helpers shared with the FrameSkippingFanOutFilter
+
+  /// accepts raw RGB24, RGB32, I420, NV12, YUY2, UYVY and P010 video and H.264 and HEVC
+  static HRESULT checkVideoType(const CMediaType* pmt);
+  /// sets up the picture layout of raw video and the parser of compressed video for an input type
+  static void describeInput(const CMediaType* pmt, FramePicture& picture, NalParser& nalParser);
+  /// the FramePixelFormat of a raw subtype, FSKIP_PIXEL_FORMAT_UNKNOWN if it is not supported
+  static unsigned getPixelFormat(const GUID& subtype);
+  /// the FrameCodec of a compressed subtype, FSKIP_CODEC_NONE for raw video
+  static unsigned getCodec(const GUID& subtype);
+  /// the average frame duration of a VIDEOINFOHEADER or VIDEOINFOHEADER2 format. 0 = unknown
+  static REFERENCE_TIME getAverageTimePerFrame(const AM_MEDIA_TYPE *pmt);
+  /// sets the average frame duration and scales the bit rate with it. 0 marks the rate as unknown.
+  static void setAverageTimePerFrame(AM_MEDIA_TYPE *pmt, REFERENCE_TIME tAvgTimePerFrame);
+  /// returns the exact frame rate if set, otherwise the rational approximation of the floating point rate
+  static RationalFrameRate toRationalFrameRate(unsigned uiNum, unsigned uiDen, double dFrameRate);
+
 
 private:
 
-  bool lowestRatio(double SourceFrameRate, double targetFrameRate, int& iSkipFrame, int& tTotalFrames);
+  /// exposes the stream time of the filter graph to the engine
+  class StreamClock : public FrameSkippingClock
+  {
+  public:
+    StreamClock(FrameSkippingFilter* pFilter)
+      :m_pFilter(pFilter)
+    {
+
+    }
+
+    virtual bool getStreamTime(int64_t& tNow);
+
+  private:
+    FrameSkippingFilter* m_pFilter;
+  };
+
+  /**
+   * @brief makes the skipping decision for a media sample of the input. Only reads the sample.
+   * @param rbTagLayer set if the kept sample is to be tagged with its temporal layer
+   * @param bHold holds a reference to the sample in the lookahead window together with the decision
+   * @param bPending the sample is the pending one: its picture was analysed by the workers and its properties were
+   * read when it was received
+   * @return S_OK to keep the sample, S_FALSE to drop it
+   */
+  HRESULT decideSample(IMediaSample *pSample, bool& rbTagLayer, bool bHold = false, bool bPending = false);
+  /// passes a format change from upstream on with the next kept sample
+  void checkUpstreamType(const AM_SAMPLE2_PROPERTIES* pProps);
+  /// passes on a sample of another stream than the media stream, as a copy if the allocators differ
+  HRESULT deliverControl(IMediaSample *pSample);
+  /// signals that a sample was dropped as CTransInPlaceFilter::Receive does
+  void notifySampleSkipped();
+  /// holds the sample back until the lookahead window is full
+  HRESULT holdSample(IMediaSample *pSample);
+  /**
+   * @brief selects the kept frames of the lookahead window and releases the held samples
+   * @param bDeliver false discards the samples, e.g. when flushing
+   */
+  HRESULT deliverHeld(bool bDeliver);
+  /// prepares a kept sample or its copy if the allocators differ and delivers it
+  HRESULT deliverKept(IMediaSample *pSample, bool bTagLayer);
+  /// copies a sample into a buffer of the output allocator with the times, flags and media type of the sample itself
+  IMediaSample* copySample(IMediaSample *pSource);
+  /// applies a changed lookahead after delivering the frames held with the previous one
+  void updateLookahead();
+  /// submits the sample to the workers and decides and delivers the pending sample in the meantime
+  HRESULT analyseSample(IMediaSample *pSample);
+  /**
+   * @brief decides the pending sample once its analysis is done or missed its deadline
+   * @param bDeliver false releases the sample without a decision, e.g. when flushing
+   */
+  HRESULT deliverPending(bool bDeliver);
+  /// releases the samples whose pixels the workers do not read anymore. bWait waits for the workers first.
+  void releaseAnalysed(bool bWait);
+  /// true if the pictures are analysed by the workers: only the duplicate elimination mode reads them
+  bool isAnalysedByWorkers() const;
+  /// the samples held for the workers: the pending sample and those whose pixels the workers may still read
+  unsigned getAnalysingSamples() const;
+  /// restarts the workers if the number of threads changed after delivering the pending sample
+  void updateAnalysisThreads();
+  /// the input samples that may be held back for the workers or the lookahead: limited by the buffers of the input allocator
+  unsigned getHoldableSamples();
+  /// the frames of the lookahead window for the config: limited by the buffers of the input allocator
+  unsigned getLookahead(const FrameSkippingConfig& config);
+  /// announces format changes, tags and re-paces a kept sample or its copy
+  void prepareKeptSample(IMediaSample *pSample, bool bTagLayer);
+  /// takes over the estimated source rate for the announced output rate and the re-pacing grid
+  void followSourceFrameRate();
+  /// publishes the parameters to the streaming thread: they take effect on the next frame
+  void publishConfig();
+  /// the current parameters as a snapshot for the engine
+  FrameSkippingConfig makeConfig() const;
+  static bool isStatisticsParameter(const char* szParamName);
+  /// false if a parameter is out of range, e.g. an unknown mode or a negative or NaN frame rate
+  bool hasValidParameters() const;
+  /// stores the temporal layer in the type specific flags of the sample
+  static HRESULT setTemporalLayer(IMediaSample *pSample, unsigned uiLayer);
+  /// the average duration of an output frame for the source frame duration of the input type
+  REFERENCE_TIME getOutputTimePerFrame(const FrameSkippingConfig& config) const;
+  /// attaches the output type to a kept sample if the output rate or the upstream format changed
+  void updateOutputMediaType(IMediaSample *pSample);
 
   /// the total number of frames to be skipped
   unsigned m_uiSkipFrameNumber;
   /// the total number of frames per second
   unsigned m_uiTotalFrames;
-  // current frame
-  unsigned m_uiCurrentFrame;
   // current mode
   unsigned m_uiFrameSkippingMode;
-  // skip ratio
-  double m_dSkipRatio;
   // source fps
   double m_dSourceFrameRate;
   // target frame rate
   double m_dTargetFrameRate;
-  // vector to store which frames should be skipped: stores a 1 if a frame is to be skipped
-  std::vector<int> m_vFramesToBeSkipped;
-  // check if the time is initialized
-  bool m_bIsTimeSet;
-  // keep track of the time frame
-  double m_dTimeFrame, m_dTimeCurrent;
-  double m_dTargetTimeFrame;
-  REFERENCE_TIME m_tStart, m_tStop;
+  // exact source and target frame rates
+  unsigned m_uiSourceFrameRateNum;
+  unsigned m_uiSourceFrameRateDen;
+  unsigned m_uiTargetFrameRateNum;
+  unsigned m_uiTargetFrameRateDen;
+  // duplicate frame elimination
+  double m_dDuplicateThreshold;
+  unsigned m_uiMaxDuplicateIntervalMs;
+  // late frame detection
+  unsigned m_uiMaxLatenessMs;
+  StreamClock m_streamClock;
+  // quality control
+  unsigned m_uiQualityControl;
+  double m_dMinOutputRate;
+  double m_dMaxOutputRate;
+  // output re-pacing
+  unsigned m_uiRepace;
+  unsigned m_uiMaxRepaceOffsetMs;
+  // temporal layers
+  unsigned m_uiTemporalLayers;
+  unsigned m_uiMaxTemporalLayer;
+  // token bucket
+  unsigned m_uiBurstDurationMs;
+  // bitrate budget
+  unsigned m_uiMaxBitrateKbps;
+  unsigned m_uiBitrateWindowMs;
+  // lookahead
+  unsigned m_uiLookahead;
+  // picture analysis on worker threads
+  unsigned m_uiAnalysisThreads;
+  unsigned m_uiAnalysisDeadlineMs;
+  // source frame rate estimation
+  unsigned m_uiEstimateSourceRate;
+  // average frame duration of the input type and of the type last announced downstream
+  REFERENCE_TIME m_tSourceTimePerFrame;
+  REFERENCE_TIME m_tOutputTimePerFrame;
+  // streaming thread: a format change from upstream that has not been passed on yet
+  CMediaType m_mtUpstream;
+  bool m_bUpstreamTypeChanged;
+  // layout of the input pixel data: the data pointer is set per sample
+  FramePicture m_picture;
+  // finds the disposable frames of compressed input
+  NalParser m_nalParser;
+  // the parameters as published by SetParameter
+  ConfigSnapshot<FrameSkippingConfig> m_config;
+  // streaming thread: the snapshot applied to the engine and its generation
+  FrameSkippingConfig m_activeConfig;
+  uint64_t m_uiConfigGeneration;
+  // streaming thread: the estimate of the source rate last taken over from the engine
+  uint64_t m_uiSourceRateChanges;
+  // makes the skipping decisions
+  FrameSkippingEngine m_engine;
+  // rewrites the times of kept frames if re-pacing is enabled
+  OutputPacer m_pacer;
+  // streaming thread: the samples held back by the lookahead, their start times and decisions
+  LookaheadSelector m_lookahead;
+  IMediaSample* m_apHeld[FSKIP_MAX_LOOKAHEAD];
+  REFERENCE_TIME m_atHeldStart[FSKIP_MAX_LOOKAHEAD];
+  bool m_abHeldTimed[FSKIP_MAX_LOOKAHEAD];
+  bool m_abHeldTagLayer[FSKIP_MAX_LOOKAHEAD];
+  unsigned m_uiHeld;
+  // streaming thread: analyses the next frame while the pending frame is decided and delivered
+  FrameAnalysisPool m_analysisPool;
+  IMediaSample* m_pPending;
+  int m_iPendingSlot;
+  std::chrono::steady_clock::time_point m_tPendingDeadline;
+  DWORD m_dwPendingTypeSpecificFlags;
+  // the samples whose pixels may still be read by the workers per slot
+  IMediaSample* m_apAnalysing[FSKIP_ANALYSIS_SLOTS];
+  // the samples that may be held for the workers so that upstream always finds a free buffer
+  unsigned m_uiMaxAnalysing;
+  // recorded on the streaming thread
+  FrameSkippingStatistics m_statistics;
+  // copies of the statistics exposed as parameters: the counters as strings so that they do not wrap at 32 bits
+  std::string m_sFramesIn;
+  std::string m_sFramesOut;
+  std::string m_sFramesDropped;
+  double m_dAchievedFps;
+  std::string m_sAnalysisMisses;
 };
 
 class FrameSkippingOutputPin : public CTransInPlaceOutputPin
@@ -159,12 +413,16 @@ public:
     __inout HRESULT             *phr,
     __in_opt LPCWSTR              pName);
 
-  // Provide an enumerator for media types by getting one from downstream
+  /// offers the input type at the output frame rate
   STDMETHODIMP EnumMediaTypes(__deref_out IEnumMediaTypes **ppEnum);
-
+  HRESULT GetMediaType(int iPosition, __inout CMediaType *pMediaType);
+  /// asks upstream about the type at the input frame rate
+  HRESULT CheckMediaType(const CMediaType* pmtOut);
+  /// sets the output frame rate on the type
   HRESULT SetMediaType(const CMediaType* pmtOut);
-
-private:
-
-  void adjustAverageTimePerFrameInVideoInfoHeader(AM_MEDIA_TYPE *pmt);
+  /// changes the connection type while streaming without notifying the filter
+  void setStreamingMediaType(const CMediaType& mt)
+  {
+    CBasePin::SetMediaType(&mt);
+  }
 };
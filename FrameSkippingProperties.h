@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <climits>
 #include <sstream>
 #include <string>
+#include "FrameSkippingFilter.h"
 #include "resource.h"
 
 #define BUFFER_SIZE 256
@@ -97,6 +98,15 @@ public:
           SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_SELECTSTRING, 0, (LPARAM)FILTER_PARAM_TARGET_RATE_BASED);
           break;
         }
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+        {
+          SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_SETCURSEL, uiMode, 0);
+          break;
+        }
       }
     }
     else
@@ -111,6 +121,11 @@ public:
     setSpinBoxRange(IDC_SPIN1, lower, upper);
     setSpinBoxRange(IDC_SPIN2, lower, upper);
     setSpinBoxRange(IDC_SPIN3, lower, upper);
+    setSpinBoxRange(IDC_SPIN6, 1, static_cast<short>(FSKIP_MAX_TEMPORAL_LAYERS));
+    setSpinBoxRange(IDC_SPIN7, 0, static_cast<short>(FSKIP_MAX_TEMPORAL_LAYERS - 1));
+    setSpinBoxRange(IDC_SPIN8, lower, upper);
+    setSpinBoxRange(IDC_SPIN9, lower, upper);
+    setSpinBoxRange(IDC_SPIN10, lower, upper);
 
     hr = setEditTextFromIntFilterParameter(FILTER_PARAM_SKIP_FRAME, IDC_EDIT_SKIP_FRAME_NUMBER);
     if (FAILED(hr))
@@ -125,6 +140,37 @@ public:
     }
 
     hr = setEditTextFromIntFilterParameter(FILTER_PARAM_TARGET_FRAMERATE, IDC_EDIT_TARGET_FRAMERATE);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+
+    // temporal layer, token bucket and bitrate budget modes
+    hr = setEditTextFromIntFilterParameter(FILTER_PARAM_TEMPORAL_LAYERS, IDC_EDIT_TEMPORAL_LAYERS);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+
+    hr = setEditTextFromIntFilterParameter(FILTER_PARAM_MAX_TEMPORAL_LAYER, IDC_EDIT_MAX_TEMPORAL_LAYER);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+
+    hr = setEditTextFromIntFilterParameter(FILTER_PARAM_BURST_DURATION, IDC_EDIT_BURST_DURATION);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+
+    hr = setEditTextFromIntFilterParameter(FILTER_PARAM_MAX_BITRATE, IDC_EDIT_MAX_BITRATE);
+    if (FAILED(hr))
+    {
+      return hr;
+    }
+
+    hr = setEditTextFromIntFilterParameter(FILTER_PARAM_BITRATE_WINDOW, IDC_EDIT_BITRATE_WINDOW);
 
     return hr;
   }
@@ -135,11 +181,13 @@ public:
     int nLength = 0;
     char szBuffer[BUFFER_SIZE];
 
-    // mode of operation
+    // mode of operation: kept as it is if nothing is selected
     int index = ComboBox_GetCurSel(GetDlgItem(m_Dlg, IDC_CMB_MODE));
-    ASSERT(index != CB_ERR);
-    _itoa(index, szBuffer, 10);
-    m_pSettingsInterface->SetParameter(FILTER_PARAM_MODE, szBuffer);
+    if (index != CB_ERR)
+    {
+      _itoa(index, szBuffer, 10);
+      m_pSettingsInterface->SetParameter(FILTER_PARAM_MODE, szBuffer);
+    }
 
 
     HRESULT hr = setIntFilterParameterFromEditText(FILTER_PARAM_SKIP_FRAME, IDC_EDIT_SKIP_FRAME_NUMBER);
@@ -148,6 +196,17 @@ public:
     hr = setIntFilterParameterFromEditText(FILTER_PARAM_TOTAL_FRAMES, IDC_EDIT_SKIP_FRAME_TOTAL);
     if (FAILED(hr)) return hr;
     hr = setIntFilterParameterFromEditText(FILTER_PARAM_TARGET_FRAMERATE, IDC_EDIT_TARGET_FRAMERATE);
+    if (FAILED(hr)) return hr;
+
+    hr = setIntFilterParameterFromEditText(FILTER_PARAM_TEMPORAL_LAYERS, IDC_EDIT_TEMPORAL_LAYERS);
+    if (FAILED(hr)) return hr;
+    hr = setIntFilterParameterFromEditText(FILTER_PARAM_MAX_TEMPORAL_LAYER, IDC_EDIT_MAX_TEMPORAL_LAYER);
+    if (FAILED(hr)) return hr;
+    hr = setIntFilterParameterFromEditText(FILTER_PARAM_BURST_DURATION, IDC_EDIT_BURST_DURATION);
+    if (FAILED(hr)) return hr;
+    hr = setIntFilterParameterFromEditText(FILTER_PARAM_MAX_BITRATE, IDC_EDIT_MAX_BITRATE);
+    if (FAILED(hr)) return hr;
+    hr = setIntFilterParameterFromEditText(FILTER_PARAM_BITRATE_WINDOW, IDC_EDIT_BITRATE_WINDOW);
 
     return hr;
   }
@@ -163,6 +222,11 @@ public:
     SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_ADDSTRING, 0, (LPARAM)"Skip x every y");
     SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_SELECTSTRING, 0, (LPARAM)"Skip x every y");
     SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_INSERTSTRING, 1, (LPARAM)"Target Fps based");
+    SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_INSERTSTRING, 2, (LPARAM)"Exact rational");
+    SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_INSERTSTRING, 3, (LPARAM)"Drop duplicates");
+    SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_INSERTSTRING, 4, (LPARAM)"Temporal layers");
+    SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_INSERTSTRING, 5, (LPARAM)"Token bucket");
+    SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_INSERTSTRING, 6, (LPARAM)"Bitrate budget");
     SendMessage(GetDlgItem(m_Dlg, IDC_CMB_MODE), CB_SETMINVISIBLE, 9, 0);
 
     short lower = 0;
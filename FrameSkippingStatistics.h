@@ -0,0 +1,200 @@
+/** @file
+
+MODULE                : FrameSkippingStatistics
+
+FILE NAME             : FrameSkippingStatistics.h
+
+DESCRIPTION           : Collects runtime statistics on the streaming thread with relaxed atomics so that
+                        other threads can take snapshots at any time without slowing down the decisions.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "FrameSkippingStats.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Frame counters, a histogram of the decision latency and a histogram of the output frame interval.
+ *
+ * Only the streaming thread records: counters are updated with relaxed loads and stores rather than
+ * read-modify-write operations. Any thread may take a snapshot; the values of a snapshot may be a few
+ * frames apart from each other.
+ */
+class FrameSkippingStatistics
+{
+public:
+
+  /// uiLatencySamplingInterval must be a power of two: one decision out of this many is timed
+  explicit FrameSkippingStatistics(uint32_t uiLatencySamplingInterval = 64)
+    :m_uiLatencySamplingMask(uiLatencySamplingInterval - 1)
+  {
+    reset();
+  }
+
+  /// clears all statistics. Must not be called while frames are recorded.
+  void reset()
+  {
+    m_uiWriterFramesIn = m_uiWriterFramesOut = 0;
+    m_uiFramesIn.store(0, std::memory_order_relaxed);
+    m_uiFramesOut.store(0, std::memory_order_relaxed);
+    m_tFirstOut.store(NO_TIME, std::memory_order_relaxed);
+    m_tLastOut.store(NO_TIME, std::memory_order_relaxed);
+    m_uiAnalysisMisses.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < FSKIP_STATS_HISTOGRAM_BUCKETS; ++i)
+    {
+      m_aDecisionLatency[i].store(0, std::memory_order_relaxed);
+      m_aOutputInterval[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /// returns true if the decision on the next frame should be timed
+  bool isDecisionTimed() const
+  {
+    return (m_uiWriterFramesIn & m_uiLatencySamplingMask) == 0;
+  }
+
+  /// a cheap monotonic cycle counter: the CPU timestamp counter where available
+  static uint64_t readCycleCounter()
+  {
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+  }
+
+  /// records the duration of a timed decision in cycles
+  void recordDecisionLatency(uint64_t uiCycles)
+  {
+    increment(m_aDecisionLatency[getBucket(uiCycles)]);
+  }
+
+  /**
+   * @brief records the decision on a frame.
+   * @param bHasTime false if the start time of the frame is not known: the output interval is not recorded
+   */
+  void recordFrame(bool bKept, int64_t tStart, bool bHasTime)
+  {
+    m_uiFramesIn.store(++m_uiWriterFramesIn, std::memory_order_relaxed);
+    if (!bKept)
+      return;
+    m_uiFramesOut.store(++m_uiWriterFramesOut, std::memory_order_relaxed);
+    if (!bHasTime)
+      return;
+    int64_t tLastOut = m_tLastOut.load(std::memory_order_relaxed);
+    if (tLastOut == NO_TIME)
+    {
+      m_tFirstOut.store(tStart, std::memory_order_relaxed);
+    }
+    else
+    {
+      int64_t iInterval = tStart - tLastOut;
+      increment(m_aOutputInterval[getBucket(iInterval > 0 ? static_cast<uint64_t>(iInterval) : 0)]);
+    }
+    m_tLastOut.store(tStart, std::memory_order_relaxed);
+  }
+
+  /// records a frame that was decided without its analysis because the analysis missed its deadline
+  void recordAnalysisMiss()
+  {
+    increment(m_uiAnalysisMisses);
+  }
+
+  /// the number of frames decided without their analysis. May be called from any thread.
+  uint64_t getAnalysisMisses() const
+  {
+    return m_uiAnalysisMisses.load(std::memory_order_relaxed);
+  }
+
+  /// copies the current statistics. May be called from any thread.
+  void getSnapshot(FrameSkippingStatsSnapshot& snapshot) const
+  {
+    snapshot.FramesIn = m_uiFramesIn.load(std::memory_order_relaxed);
+    snapshot.FramesOut = m_uiFramesOut.load(std::memory_order_relaxed);
+    snapshot.FramesDropped = snapshot.FramesIn >= snapshot.FramesOut ? snapshot.FramesIn - snapshot.FramesOut : 0;
+    snapshot.LatencySamplingInterval = m_uiLatencySamplingMask + 1;
+    uint64_t uiIntervals = 0;
+    for (int i = 0; i < FSKIP_STATS_HISTOGRAM_BUCKETS; ++i)
+    {
+      snapshot.DecisionLatency[i] = m_aDecisionLatency[i].load(std::memory_order_relaxed);
+      snapshot.OutputInterval[i] = m_aOutputInterval[i].load(std::memory_order_relaxed);
+      uiIntervals += snapshot.OutputInterval[i];
+    }
+    int64_t tFirstOut = m_tFirstOut.load(std::memory_order_relaxed);
+    int64_t tLastOut = m_tLastOut.load(std::memory_order_relaxed);
+    snapshot.AchievedFps = (tFirstOut != NO_TIME && tLastOut > tFirstOut) ? uiIntervals * 10000000.0 / (tLastOut - tFirstOut) : 0.0;
+  }
+
+  /// the histogram bucket of a value: 0 for 0, otherwise the number of significant bits
+  static int getBucket(uint64_t uiValue)
+  {
+    if (uiValue == 0)
+      return 0;
+#if defined(_MSC_VER)
+    unsigned long ulIndex = 0;
+    int iBits = 0;
+    if (_BitScanReverse(&ulIndex, static_cast<unsigned long>(uiValue >> 32)))
+      iBits = static_cast<int>(ulIndex) + 33;
+    else if (_BitScanReverse(&ulIndex, static_cast<unsigned long>(uiValue)))
+      iBits = static_cast<int>(ulIndex) + 1;
+#else
+    int iBits = 64 - __builtin_clzll(uiValue);
+#endif
+    return iBits < FSKIP_STATS_HISTOGRAM_BUCKETS ? iBits : FSKIP_STATS_HISTOGRAM_BUCKETS - 1;
+  }
+
+private:
+
+  /// single writer: a relaxed load and store is enough and avoids a locked instruction
+  static void increment(std::atomic<uint64_t>& rCounter)
+  {
+    rCounter.store(rCounter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // marks that no kept frame had a start time yet
+  static const int64_t NO_TIME = INT64_MIN;
+
+  const uint32_t m_uiLatencySamplingMask;
+  // the writer's own copies of the frame counters: spares a load of the atomics per frame
+  uint64_t m_uiWriterFramesIn;
+  uint64_t m_uiWriterFramesOut;
+  std::atomic<uint64_t> m_uiFramesIn;
+  std::atomic<uint64_t> m_uiFramesOut;
+  // start times of the first and the last kept frame with a known start time
+  std::atomic<int64_t> m_tFirstOut;
+  std::atomic<int64_t> m_tLastOut;
+  std::atomic<uint64_t> m_uiAnalysisMisses;
+  std::atomic<uint64_t> m_aDecisionLatency[FSKIP_STATS_HISTOGRAM_BUCKETS];
+  std::atomic<uint64_t> m_aOutputInterval[FSKIP_STATS_HISTOGRAM_BUCKETS];
+};
@@ -0,0 +1,62 @@
+/** @file
+
+MODULE                : FrameSkippingStats
+
+FILE NAME             : FrameSkippingStats.h
+
+DESCRIPTION           : Plain C snapshot of the runtime statistics of a frame skipping filter or engine.
+                        The layout only uses fixed size types so that it can be read from C.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <stdint.h>
+
+/* number of buckets of the logarithmic histograms */
+#define FSKIP_STATS_HISTOGRAM_BUCKETS 32
+
+/**
+ * @brief Counters and histograms at the time of the snapshot.
+ * Histogram bucket 0 counts values of 0, bucket i counts values in [2^(i-1), 2^i).
+ * The last bucket also counts all larger values.
+ */
+typedef struct FrameSkippingStatsSnapshot
+{
+  /* frames passed to the decision */
+  uint64_t FramesIn;
+  /* frames that were kept */
+  uint64_t FramesOut;
+  /* frames that were dropped */
+  uint64_t FramesDropped;
+  /* kept frames per second of stream time between the first and the last kept frame, 0 if unknown */
+  double AchievedFps;
+  /* one decision out of this many is timed */
+  uint32_t LatencySamplingInterval;
+  /* duration of the timed decisions in CPU timestamp counter cycles */
+  uint64_t DecisionLatency[FSKIP_STATS_HISTOGRAM_BUCKETS];
+  /* interval between consecutive kept frames in 100 ns units */
+  uint64_t OutputInterval[FSKIP_STATS_HISTOGRAM_BUCKETS];
+} FrameSkippingStatsSnapshot;
@@ -0,0 +1,283 @@
+/** @file
+
+MODULE                : FrameTime
+
+FILE NAME             : FrameTime.h
+
+DESCRIPTION           : Exact frame rates, frame durations and time lines in 100 ns ticks.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+// timestamp unit is in 10^-7
+const double TIMESTAMP_FACTOR = 10000000.0;
+const int64_t TIMESTAMP_TICKS_PER_SECOND = 10000000;
+
+/**
+ * @brief A frame rate expressed as an exact integer ratio e.g. 30000/1001.
+ * A numerator of 0 denotes an unset frame rate.
+ */
+struct RationalFrameRate
+{
+  RationalFrameRate(uint32_t uiNum = 0, uint32_t uiDen = 1)
+    :Numerator(uiNum),
+    Denominator(uiDen == 0 ? 1 : uiDen)
+  {
+
+  }
+
+  bool isSet() const
+  {
+    return Numerator != 0;
+  }
+
+  bool operator==(const RationalFrameRate& rOther) const
+  {
+    return static_cast<uint64_t>(Numerator) * rOther.Denominator == static_cast<uint64_t>(rOther.Numerator) * Denominator;
+  }
+
+  bool operator!=(const RationalFrameRate& rOther) const
+  {
+    return !(*this == rOther);
+  }
+
+  double toDouble() const
+  {
+    return Numerator / static_cast<double>(Denominator);
+  }
+
+  /**
+   * @brief converts a floating point frame rate into a ratio.
+   * Rates that are within 0.01 fps of an NTSC rate (N * 1000/1001) map onto that exact rate,
+   * everything else is rounded to 1/1000 fps.
+   */
+  static RationalFrameRate fromDouble(double dFrameRate)
+  {
+    if (dFrameRate <= 0.0)
+      return RationalFrameRate();
+
+    double dNtsc = dFrameRate * 1001.0 / 1000.0;
+    double dNtscRounded = std::floor(dNtsc + 0.5);
+    if (std::fabs(dFrameRate - std::floor(dFrameRate + 0.5)) > 0.001 && std::fabs(dNtsc - dNtscRounded) * 1000.0 / 1001.0 < 0.01)
+    {
+      return RationalFrameRate(static_cast<uint32_t>(dNtscRounded) * 1000, 1001).reduced();
+    }
+    return RationalFrameRate(static_cast<uint32_t>(std::floor(dFrameRate * 1000.0 + 0.5)), 1000).reduced();
+  }
+
+  RationalFrameRate reduced() const
+  {
+    uint64_t uiGcd = gcd(Numerator, Denominator);
+    if (uiGcd == 0)
+      return *this;
+    return RationalFrameRate(static_cast<uint32_t>(Numerator / uiGcd), static_cast<uint32_t>(Denominator / uiGcd));
+  }
+
+  static uint64_t gcd(uint64_t uiA, uint64_t uiB)
+  {
+    while (uiB != 0)
+    {
+      uint64_t uiT = uiA % uiB;
+      uiA = uiB;
+      uiB = uiT;
+    }
+    return uiA;
+  }
+
+  uint32_t Numerator;
+  uint32_t Denominator;
+};
+
+/**
+ * @brief The exact duration of one frame in 100 ns ticks, stored as the reduced fraction Ticks/Divisor.
+ * A 29.97 fps frame lasts 1001000/3 ticks which cannot be represented by a whole number of ticks.
+ */
+class FrameDuration
+{
+public:
+
+  FrameDuration()
+    :m_iTicks(0),
+    m_iDivisor(1),
+    m_iWhole(0),
+    m_iRemainder(0)
+  {
+
+  }
+
+  explicit FrameDuration(const RationalFrameRate& frameRate)
+    :m_iTicks(0),
+    m_iDivisor(1),
+    m_iWhole(0),
+    m_iRemainder(0)
+  {
+    if (!frameRate.isSet())
+      return;
+
+    uint64_t uiTicks = static_cast<uint64_t>(TIMESTAMP_TICKS_PER_SECOND) * frameRate.Denominator;
+    uint64_t uiDivisor = frameRate.Numerator;
+    uint64_t uiGcd = RationalFrameRate::gcd(uiTicks, uiDivisor);
+    uiTicks /= uiGcd;
+    uiDivisor /= uiGcd;
+    // FrameTimeline needs Ticks * Divisor to fit into 63 bits: fall back to whole ticks for absurd rates
+    if (uiTicks > (static_cast<uint64_t>(INT64_MAX) >> 1) / uiDivisor)
+    {
+      uiTicks = (uiTicks + uiDivisor / 2) / uiDivisor;
+      uiDivisor = 1;
+    }
+    m_iTicks = static_cast<int64_t>(uiTicks);
+    m_iDivisor = static_cast<int64_t>(uiDivisor);
+    m_iWhole = m_iTicks / m_iDivisor;
+    m_iRemainder = m_iTicks % m_iDivisor;
+  }
+
+  bool isSet() const
+  {
+    return m_iTicks > 0;
+  }
+
+  /// numerator of the duration in ticks
+  int64_t getTicks() const { return m_iTicks; }
+  /// denominator of the duration in ticks
+  int64_t getDivisor() const { return m_iDivisor; }
+  /// whole ticks per frame
+  int64_t getWholeTicks() const { return m_iWhole; }
+  /// the fractional part of the duration in 1/Divisor ticks
+  int64_t getRemainder() const { return m_iRemainder; }
+
+private:
+
+  int64_t m_iTicks;
+  int64_t m_iDivisor;
+  int64_t m_iWhole;
+  int64_t m_iRemainder;
+};
+
+/**
+ * @brief A point on a time line that advances in exact frame durations.
+ * The time is kept as whole ticks plus a fraction in 1/Divisor ticks so that no error builds up
+ * however many frames the time line is advanced by.
+ */
+class FrameTimeline
+{
+public:
+
+  FrameTimeline()
+    :m_iWhole(0),
+    m_iFraction(0)
+  {
+
+  }
+
+  void set(int64_t tTime)
+  {
+    m_iWhole = tTime;
+    m_iFraction = 0;
+  }
+
+  /// sets the time to tTime + iFraction / Divisor ticks
+  void set(int64_t tTime, int64_t iFraction)
+  {
+    m_iWhole = tTime;
+    m_iFraction = iFraction;
+  }
+
+  /// the whole ticks of the current time: the exact time lies in [getTime(), getTime() + 1)
+  int64_t getTime() const
+  {
+    return m_iWhole;
+  }
+
+  /// the fractional part of the current time in 1/Divisor ticks
+  int64_t getFraction() const
+  {
+    return m_iFraction;
+  }
+
+  /// returns true if tTime lies strictly after the exact current time
+  bool isBefore(int64_t tTime) const
+  {
+    // with 0 <= fraction < 1 and whole ticks this reduces to a comparison of the whole part
+    return tTime > m_iWhole;
+  }
+
+  /// advances the time by iFrames frames of the given duration
+  void advance(const FrameDuration& duration, int64_t iFrames)
+  {
+    if (iFrames == 1)
+    {
+      m_iWhole += duration.getWholeTicks();
+      m_iFraction += duration.getRemainder();
+      if (m_iFraction >= duration.getDivisor())
+      {
+        m_iFraction -= duration.getDivisor();
+        ++m_iWhole;
+      }
+      return;
+    }
+    // split the multiplication so that only Ticks * Divisor needs to fit into 64 bits
+    int64_t iQuotient = iFrames / duration.getDivisor();
+    int64_t iRest = iFrames % duration.getDivisor();
+    m_iWhole += iQuotient * duration.getTicks();
+    int64_t iFraction = iRest * duration.getTicks() + m_iFraction;
+    m_iWhole += iFraction / duration.getDivisor();
+    m_iFraction = iFraction % duration.getDivisor();
+  }
+
+  /// the smallest number of frames that moves the time line to or past tTime
+  int64_t framesUntil(const FrameDuration& duration, int64_t tTime) const
+  {
+    int64_t iDelta = tTime - m_iWhole;
+    if (iDelta <= 0)
+      return 0;
+    // fast path: tTime lies within one frame duration
+    if (iDelta <= duration.getWholeTicks())
+      return 1;
+    // ceil((iDelta * Divisor - Fraction) / Ticks) without overflowing for long gaps
+    int64_t iQuotient = iDelta / duration.getTicks();
+    int64_t iRest = iDelta % duration.getTicks();
+    int64_t iScaled = iRest * duration.getDivisor() - m_iFraction;
+    int64_t iFrames = iQuotient * duration.getDivisor();
+    if (iScaled > 0)
+      iFrames += (iScaled + duration.getTicks() - 1) / duration.getTicks();
+    return iFrames;
+  }
+
+  /// rescales the fraction when the frame duration changes
+  void rescale(const FrameDuration& from, const FrameDuration& to)
+  {
+    if (from.getDivisor() != to.getDivisor())
+      m_iFraction = m_iFraction * to.getDivisor() / from.getDivisor();
+  }
+
+private:
+
+  int64_t m_iWhole;
+  int64_t m_iFraction;
+};
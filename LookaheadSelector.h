@@ -0,0 +1,278 @@
+/** @file
+
+MODULE                : LookaheadSelector
+
+FILE NAME             : LookaheadSelector.h
+
+DESCRIPTION           : Chooses which frames of a short window of held back frames are kept so that the
+                        dropped frames differ least from the frames shown in their place, at the output
+                        rate of the cadence.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include "FrameSignature.h"
+
+// the most frames that the lookahead selection may hold back
+const unsigned FSKIP_MAX_LOOKAHEAD = 16;
+// the fewest frames of a useful window: shorter windows leave too little choice and show more distortion than the cadence
+const unsigned FSKIP_MIN_LOOKAHEAD = 4;
+// the cost per frame of distance to the last kept frame: spreads the kept frames evenly where nothing moves
+const double FSKIP_LOOKAHEAD_SPACING_COST = 0.05;
+// the difference assumed between frames whose signatures cannot be compared, e.g. after a change of the frame size
+const double FSKIP_LOOKAHEAD_CUT_DIFFERENCE = 255.0;
+
+/**
+ * @brief Rearranges the frames kept by the cadence of a mode within a window of up to FSKIP_MAX_LOOKAHEAD frames.
+ *
+ * The caller holds back each frame together with the decision of the engine until the window is full. select then
+ * keeps as many frames of the window as the cadence did, including every protected frame, but chooses them so that
+ * the frames shown in place of the dropped ones differ least from them: dropping a frame costs the sum of the mean
+ * absolute signature differences between consecutive frames since the last kept frame. The choice is made by dynamic
+ * programming over the window in O(K^3) for K frames, with the cost of a gap from prefix sums in O(1). Windows with a frame without a signature, e.g. compressed
+ * frames, keep the cadence.
+ */
+class LookaheadSelector
+{
+public:
+
+  LookaheadSelector()
+    :m_uiLookahead(0)
+  {
+    reset();
+  }
+
+  /// sets the number of frames per window. Frames that are already held must be selected first.
+  void setLookahead(unsigned uiFrames)
+  {
+    m_uiLookahead = std::min(uiFrames, FSKIP_MAX_LOOKAHEAD);
+  }
+
+  unsigned getLookahead() const
+  {
+    return m_uiLookahead;
+  }
+
+  /// the number of frames held in the current window
+  unsigned getCount() const
+  {
+    return m_uiCount;
+  }
+
+  bool isFull() const
+  {
+    return m_uiCount >= std::max(m_uiLookahead, 1u);
+  }
+
+  /// forgets the held frames and the last kept frame
+  void reset()
+  {
+    m_uiCount = 0;
+    m_bHasPrevious = false;
+    m_dCarry = 0.0;
+    m_uiCarryGap = 0;
+  }
+
+  /**
+   * @brief adds the next frame to the window.
+   * @param pPicture the pixel data of the frame or NULL if it has none
+   * @param bProtected the frame must be kept, e.g. a compressed reference frame
+   * @param bCadenceKept the decision of the engine for the frame
+   */
+  void add(const FramePicture* pPicture, bool bProtected, bool bCadenceKept)
+  {
+    assert(!isFull());
+    const unsigned uiSlot = m_uiCount++;
+    FrameSignature& signature = m_aSignatures[uiSlot];
+    bool bSigned = pPicture != NULL && signature.compute(*pPicture);
+    if (!bSigned)
+      signature.clear();
+    const FrameSignature& previous = uiSlot > 0 ? m_aSignatures[uiSlot - 1] : m_previous;
+    double dDifference = -1.0;
+    if (bSigned && (uiSlot > 0 || m_bHasPrevious))
+      dDifference = signature.meanAbsoluteDifference(previous);
+    m_abSigned[uiSlot] = bSigned;
+    m_adDifference[uiSlot] = (bSigned && dDifference < 0.0) ? FSKIP_LOOKAHEAD_CUT_DIFFERENCE : dDifference;
+    m_abProtected[uiSlot] = bProtected;
+    m_abCadenceKept[uiSlot] = bCadenceKept;
+  }
+
+  /**
+   * @brief selects the kept frames of the window and starts the next one.
+   * @return bit i is set if frame i of the window is kept
+   */
+  uint32_t select()
+  {
+    const unsigned uiCount = m_uiCount;
+    uint32_t uiCadence = 0;
+    unsigned uiKeep = 0;
+    bool bSigned = true;
+    for (unsigned i = 0; i < uiCount; ++i)
+    {
+      if (m_abCadenceKept[i])
+      {
+        uiCadence |= 1u << i;
+        ++uiKeep;
+      }
+      bSigned = bSigned && m_abSigned[i];
+    }
+
+    // position 0 is the last kept frame before the window, position i + 1 is frame i of the window
+    m_adCumulative[0] = 0.0;
+    m_aiPosition[0] = -1 - static_cast<int>(m_uiCarryGap);
+    m_adCumulativeSum[0] = 0.0;
+    m_aiPositionSum[0] = 0;
+    m_auiProtectedSum[0] = 0;
+    double dCumulative = m_dCarry;
+    for (unsigned i = 0; i < uiCount; ++i)
+    {
+      // the first frame after a reset has nothing to be compared with
+      dCumulative += m_adDifference[i] < 0.0 ? 0.0 : m_adDifference[i];
+      m_adCumulative[i + 1] = dCumulative;
+      m_aiPosition[i + 1] = static_cast<int>(i);
+      m_adCumulativeSum[i + 1] = m_adCumulativeSum[i] + dCumulative;
+      m_aiPositionSum[i + 1] = m_aiPositionSum[i] + static_cast<int>(i);
+      m_auiProtectedSum[i + 1] = m_auiProtectedSum[i] + (m_abProtected[i] ? 1 : 0);
+    }
+
+    uint32_t uiKept = bSigned ? selectByCost(uiCount, uiKeep) : uiCadence;
+    if (bSigned && uiKept == 0 && uiKeep > 0)
+      uiKept = uiCadence;
+
+    // the last kept frame becomes the reference of the next window
+    unsigned uiLast = 0;
+    for (unsigned i = 0; i < uiCount; ++i)
+    {
+      if ((uiKept >> i) & 1)
+        uiLast = i + 1;
+    }
+    m_dCarry = m_adCumulative[uiCount] - m_adCumulative[uiLast];
+    m_uiCarryGap = (uiLast == 0) ? m_uiCarryGap + uiCount : uiCount - uiLast;
+    if (uiCount > 0)
+    {
+      m_previous.swap(m_aSignatures[uiCount - 1]);
+      m_bHasPrevious = m_abSigned[uiCount - 1];
+    }
+    m_uiCount = 0;
+    return uiKept;
+  }
+
+private:
+
+  /**
+   * @brief the cost of dropping the frames between the kept positions uiFrom and uiTo, exclusive.
+   * @return infinity if one of them is protected
+   */
+  double getGapCost(unsigned uiFrom, unsigned uiTo) const
+  {
+    // the sum over the dropped positions p of the differences and distances from uiFrom to p
+    const unsigned uiLast = uiTo - 1;
+    if (m_auiProtectedSum[uiLast] != m_auiProtectedSum[uiFrom])
+      return std::numeric_limits<double>::infinity();
+    const int iDropped = static_cast<int>(uiLast - uiFrom);
+    return m_adCumulativeSum[uiLast] - m_adCumulativeSum[uiFrom] - iDropped * m_adCumulative[uiFrom]
+      + FSKIP_LOOKAHEAD_SPACING_COST * (m_aiPositionSum[uiLast] - m_aiPositionSum[uiFrom] - iDropped * m_aiPosition[uiFrom]);
+  }
+
+  /// keeps uiKeep frames of the window at the lowest cost. Returns 0 if the protected frames do not allow it.
+  uint32_t selectByCost(unsigned uiCount, unsigned uiKeep)
+  {
+    const double INF = std::numeric_limits<double>::infinity();
+    // m_aadCost[k][p]: the lowest cost up to position p if p is the k-th kept frame of the window
+    for (unsigned k = 0; k <= uiKeep; ++k)
+    {
+      for (unsigned p = 0; p <= uiCount; ++p)
+        m_aadCost[k][p] = INF;
+    }
+    m_aadCost[0][0] = 0.0;
+    for (unsigned p = 1; p <= uiCount; ++p)
+    {
+      for (unsigned k = 1; k <= std::min(uiKeep, p); ++k)
+      {
+        for (unsigned uiFrom = k - 1; uiFrom < p; ++uiFrom)
+        {
+          if (m_aadCost[k - 1][uiFrom] == INF)
+            continue;
+          double dCost = m_aadCost[k - 1][uiFrom] + getGapCost(uiFrom, p);
+          if (dCost < m_aadCost[k][p])
+          {
+            m_aadCost[k][p] = dCost;
+            m_aauiFrom[k][p] = uiFrom;
+          }
+        }
+      }
+    }
+    // the frames after the last kept frame of the window are dropped as well
+    double dBest = INF;
+    unsigned uiBest = 0;
+    for (unsigned p = uiKeep; p <= uiCount; ++p)
+    {
+      if (m_aadCost[uiKeep][p] == INF)
+        continue;
+      double dCost = m_aadCost[uiKeep][p] + getGapCost(p, uiCount + 1);
+      if (dCost < dBest)
+      {
+        dBest = dCost;
+        uiBest = p;
+      }
+    }
+    if (dBest == INF)
+      return 0;
+    uint32_t uiKept = 0;
+    for (unsigned k = uiKeep, p = uiBest; k > 0; p = m_aauiFrom[k][p], --k)
+      uiKept |= 1u << (p - 1);
+    return uiKept;
+  }
+
+  unsigned m_uiLookahead;
+  unsigned m_uiCount;
+  // the frames of the window
+  FrameSignature m_aSignatures[FSKIP_MAX_LOOKAHEAD];
+  bool m_abSigned[FSKIP_MAX_LOOKAHEAD];
+  // to the previous frame: negative if there is none
+  double m_adDifference[FSKIP_MAX_LOOKAHEAD];
+  bool m_abProtected[FSKIP_MAX_LOOKAHEAD];
+  bool m_abCadenceKept[FSKIP_MAX_LOOKAHEAD];
+  // the last frame of the previous window
+  FrameSignature m_previous;
+  bool m_bHasPrevious;
+  // the summed differences and the number of frames from the last kept frame to the end of the previous window
+  double m_dCarry;
+  unsigned m_uiCarryGap;
+  // selection state by position in the window
+  double m_adCumulative[FSKIP_MAX_LOOKAHEAD + 2];
+  int m_aiPosition[FSKIP_MAX_LOOKAHEAD + 2];
+  // prefix sums over the positions for the cost of a gap
+  double m_adCumulativeSum[FSKIP_MAX_LOOKAHEAD + 2];
+  int m_aiPositionSum[FSKIP_MAX_LOOKAHEAD + 2];
+  unsigned m_auiProtectedSum[FSKIP_MAX_LOOKAHEAD + 2];
+  double m_aadCost[FSKIP_MAX_LOOKAHEAD + 1][FSKIP_MAX_LOOKAHEAD + 1];
+  unsigned m_aauiFrom[FSKIP_MAX_LOOKAHEAD + 1][FSKIP_MAX_LOOKAHEAD + 1];
+};
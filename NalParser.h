@@ -0,0 +1,229 @@
+/** @file
+
+MODULE                : NalParser
+
+FILE NAME             : NalParser.h
+
+DESCRIPTION           : Reads the NAL unit headers of H.264 and HEVC access units to find disposable pictures:
+                        pictures that no other picture uses as a reference and that can be dropped ahead
+                        of the decoder.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+enum FrameCodec
+{
+  FSKIP_CODEC_NONE = 0,
+  FSKIP_CODEC_H264 = 1,
+  FSKIP_CODEC_HEVC = 2
+};
+
+/**
+ * @brief Classifies compressed access units without decoding them. Only NAL unit headers and the first
+ * bytes of HEVC sequence parameter sets are read.
+ *
+ * H.264: a picture is disposable if every slice has nal_ref_idc 0. IDR pictures never are.
+ * HEVC: a sub-layer non-reference picture (TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and the reserved _N types)
+ * may still be referenced by pictures of higher sub-layers. It is only disposable in the highest sub-layer
+ * announced by the sequence parameter set, so HEVC pictures are never disposable before an SPS was seen.
+ */
+class NalParser
+{
+public:
+
+  NalParser()
+    :m_uiCodec(FSKIP_CODEC_NONE),
+    m_uiLengthSize(0),
+    m_iMaxTemporalId(-1)
+  {
+
+  }
+
+  /**
+   * @brief sets the bitstream format and forgets the parameter sets.
+   * @param uiLengthSize 0 for Annex B start codes, otherwise the size of the big endian NAL unit length prefix: 1, 2 or 4
+   */
+  void setFormat(unsigned uiCodec, unsigned uiLengthSize)
+  {
+    m_uiCodec = uiCodec;
+    m_uiLengthSize = (uiLengthSize == 1 || uiLengthSize == 2 || uiLengthSize == 4) ? uiLengthSize : 0;
+    m_iMaxTemporalId = -1;
+  }
+
+  unsigned getCodec() const
+  {
+    return m_uiCodec;
+  }
+
+  /// the highest HEVC TemporalId announced by the last SPS. -1 = no SPS seen
+  int getMaxTemporalId() const
+  {
+    return m_iMaxTemporalId;
+  }
+
+  /**
+   * @brief reads the parameter sets stored in the media type.
+   * @param uiLengthSize the NAL unit length prefix of the parameter sets: 2 in MPEG2VIDEOINFO, 0 for start codes
+   */
+  void parseParameterSets(const uint8_t* pData, size_t uiLength, unsigned uiLengthSize)
+  {
+    unsigned uiVclNals = 0;
+    bool bDisposable = true;
+    forEachNal(pData, uiLength, uiLengthSize, uiVclNals, bDisposable);
+  }
+
+  /**
+   * @brief returns true if no other picture refers to the picture in the access unit.
+   * Access units without slices or that cannot be parsed are treated as reference pictures.
+   * Parameter sets in the access unit are picked up.
+   */
+  bool isDisposable(const uint8_t* pData, size_t uiLength)
+  {
+    if (m_uiCodec == FSKIP_CODEC_NONE || pData == NULL)
+      return false;
+    unsigned uiVclNals = 0;
+    bool bDisposable = true;
+    if (!forEachNal(pData, uiLength, m_uiLengthSize, uiVclNals, bDisposable))
+      return false;
+    return bDisposable && uiVclNals > 0;
+  }
+
+private:
+
+  /// @return false if the data is truncated
+  bool forEachNal(const uint8_t* pData, size_t uiLength, unsigned uiLengthSize, unsigned& ruiVclNals, bool& rbDisposable)
+  {
+    if (uiLengthSize == 0)
+    {
+      size_t uiStart = findStartCode(pData, uiLength, 0);
+      while (uiStart < uiLength)
+      {
+        size_t uiNext = findStartCode(pData, uiLength, uiStart);
+        // the zero bytes of the next start code do not belong to the NAL unit
+        size_t uiEnd = uiNext;
+        if (uiEnd < uiLength)
+          uiEnd -= 3;
+        while (uiEnd > uiStart && pData[uiEnd - 1] == 0)
+          --uiEnd;
+        // a reference picture settles the question: the rest of the access unit is not read
+        if (!inspectNal(pData + uiStart, uiEnd - uiStart, ruiVclNals, rbDisposable))
+          return true;
+        uiStart = uiNext;
+      }
+      return true;
+    }
+
+    size_t uiPos = 0;
+    while (uiPos + uiLengthSize <= uiLength)
+    {
+      size_t uiNalLength = 0;
+      for (unsigned i = 0; i < uiLengthSize; ++i)
+        uiNalLength = (uiNalLength << 8) | pData[uiPos + i];
+      uiPos += uiLengthSize;
+      if (uiNalLength > uiLength - uiPos)
+        return false;
+      if (!inspectNal(pData + uiPos, uiNalLength, ruiVclNals, rbDisposable))
+        return true;
+      uiPos += uiNalLength;
+    }
+    return uiPos == uiLength;
+  }
+
+  /// @return the position after the next 00 00 01 at or after uiPos, or uiLength if there is none
+  static size_t findStartCode(const uint8_t* pData, size_t uiLength, size_t uiPos)
+  {
+    while (uiPos + 3 <= uiLength)
+    {
+      // the third byte of a start code is 1: skip ahead quickly while it cannot be one
+      if (pData[uiPos + 2] > 1)
+      {
+        uiPos += 3;
+      }
+      else if (pData[uiPos + 2] == 1 && pData[uiPos + 1] == 0 && pData[uiPos] == 0)
+      {
+        return uiPos + 3;
+      }
+      else
+      {
+        ++uiPos;
+      }
+    }
+    return uiLength;
+  }
+
+  /// updates the verdict with one NAL unit. @return false once a reference picture was found
+  bool inspectNal(const uint8_t* pNal, size_t uiLength, unsigned& ruiVclNals, bool& rbDisposable)
+  {
+    if (uiLength == 0)
+      return true;
+    if (m_uiCodec == FSKIP_CODEC_H264)
+    {
+      unsigned uiRefIdc = (pNal[0] >> 5) & 0x3;
+      unsigned uiType = pNal[0] & 0x1F;
+      // coded slices including data partitions and the SVC/MVC extensions
+      bool bVcl = (uiType >= 1 && uiType <= 5) || uiType == 20 || uiType == 21;
+      if (!bVcl)
+        return true;
+      ++ruiVclNals;
+      if (uiType == 5 || uiRefIdc != 0)
+        rbDisposable = false;
+      return rbDisposable;
+    }
+
+    if (m_uiCodec == FSKIP_CODEC_HEVC)
+    {
+      if (uiLength < 2)
+        return true;
+      unsigned uiType = (pNal[0] >> 1) & 0x3F;
+      int iTemporalId = static_cast<int>(pNal[1] & 0x7) - 1;
+      const unsigned NAL_SPS = 33;
+      if (uiType == NAL_SPS)
+      {
+        // sps_video_parameter_set_id u(4), sps_max_sub_layers_minus1 u(3)
+        if (uiLength >= 3)
+          m_iMaxTemporalId = (pNal[2] >> 1) & 0x7;
+        return true;
+      }
+      if (uiType > 31)
+        return true;
+      ++ruiVclNals;
+      // the sub-layer non-reference types are the even types up to RSV_VCL_N14
+      bool bSubLayerNonReference = uiType <= 14 && (uiType & 1) == 0;
+      if (!bSubLayerNonReference || m_iMaxTemporalId < 0 || iTemporalId != m_iMaxTemporalId)
+        rbDisposable = false;
+      return rbDisposable;
+    }
+    return true;
+  }
+
+  unsigned m_uiCodec;
+  unsigned m_uiLengthSize;
+  // highest TemporalId of the HEVC stream
+  int m_iMaxTemporalId;
+};
@@ -0,0 +1,139 @@
+/** @file
+
+MODULE                : OutputPacer
+
+FILE NAME             : OutputPacer.h
+
+DESCRIPTION           : Moves the timestamps of kept frames onto an exact grid at the output frame rate so that
+                        downstream sees a uniform cadence. The offset against the original times stays bounded.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <cstdint>
+#include "FrameTime.h"
+
+/**
+ * @brief Re-paces the kept frames onto the grid start + n * output frame duration.
+ *
+ * The grid is anchored at the first kept frame and advances by exactly one output frame per kept frame.
+ * If a frame would move by more than the maximum offset, e.g. after a gap in the source or when more or fewer
+ * frames are kept than the output rate implies, the grid is anchored at that frame again.
+ */
+class OutputPacer
+{
+public:
+
+  OutputPacer()
+    :m_iMaxOffset(0),
+    m_bIsAnchored(false),
+    m_iFrame(0),
+    m_uiReanchors(0)
+  {
+
+  }
+
+  /**
+   * @brief sets the output frame rate. The grid keeps its phase.
+   * @param iMaxOffset the largest distance in 100 ns units between a paced and an original start time.
+   * 0 uses one output frame: a kept frame lies at most one source frame away from the grid of a decimated stream
+   * so that only gaps and rate changes restart the grid.
+   */
+  void setFrameRate(const RationalFrameRate& frameRate, int64_t iMaxOffset)
+  {
+    FrameDuration duration(frameRate);
+    m_grid.rescale(m_duration, duration);
+    m_duration = duration;
+    m_iMaxOffset = (iMaxOffset > 0) ? iMaxOffset : duration.getWholeTicks();
+  }
+
+  bool isSet() const
+  {
+    return m_duration.isSet();
+  }
+
+  /// restarts the grid at the next frame and the media times at 0
+  void reset()
+  {
+    m_bIsAnchored = false;
+    m_iFrame = 0;
+    m_uiReanchors = 0;
+  }
+
+  /**
+   * @brief calculates the paced times of a kept frame.
+   * @param tStart the original start time
+   * @param rtStart rtStop the paced start and stop time
+   * @param riMediaStart riMediaStop the media time of the frame: the index of the output frame
+   * @return false if no output frame rate is set: the outputs are not changed
+   */
+  bool pace(int64_t tStart, int64_t& rtStart, int64_t& rtStop, int64_t& riMediaStart, int64_t& riMediaStop)
+  {
+    if (!m_duration.isSet())
+      return false;
+
+    if (m_bIsAnchored)
+    {
+      m_grid.advance(m_duration, 1);
+      int64_t iOffset = m_grid.getTime() - tStart;
+      if (iOffset > m_iMaxOffset || iOffset < -m_iMaxOffset)
+      {
+        m_grid.set(tStart);
+        ++m_uiReanchors;
+      }
+    }
+    else
+    {
+      m_grid.set(tStart);
+      m_bIsAnchored = true;
+    }
+
+    rtStart = m_grid.getTime();
+    FrameTimeline next = m_grid;
+    next.advance(m_duration, 1);
+    rtStop = next.getTime();
+    riMediaStart = m_iFrame++;
+    riMediaStop = m_iFrame;
+    return true;
+  }
+
+  /// the number of times the grid had to be anchored again since the last reset
+  uint64_t getReanchorCount() const
+  {
+    return m_uiReanchors;
+  }
+
+private:
+
+  FrameDuration m_duration;
+  int64_t m_iMaxOffset;
+  // the start time of the last paced frame
+  FrameTimeline m_grid;
+  bool m_bIsAnchored;
+  // index of the next output frame
+  int64_t m_iFrame;
+  uint64_t m_uiReanchors;
+};
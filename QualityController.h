@@ -0,0 +1,259 @@
+/** @file
+
+MODULE                : QualityController
+
+FILE NAME             : QualityController.h
+
+DESCRIPTION           : Adapts the output frame rate to quality messages from downstream: the rate is lowered
+                        in proportion to the reported proportion and lateness and raised gradually again.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include "FrameTime.h"
+
+/**
+ * @brief Limits the output frame rate according to quality messages from downstream.
+ *
+ * notify may be called from any thread. keepFrame and reset must only be called from the streaming thread:
+ * it reads the published limit with a single relaxed atomic load per frame.
+ */
+class QualityController
+{
+public:
+
+  /// a delay of this many ticks halves the output rate
+  static const int64_t LATENESS_SCALE = TIMESTAMP_TICKS_PER_SECOND;
+
+  QualityController()
+    :m_bEnabled(false),
+    m_dMinOutputRate(0.0),
+    m_dMaxOutputRate(0.0),
+    m_dHysteresis(0.05),
+    m_dMaxIncrease(0.1),
+    m_dOutputRate(0.0),
+    m_uiMilliFps(0),
+    m_iMeasuredInterval(0),
+    m_uiActiveMilliFps(0),
+    m_bIsTimeSet(false),
+    m_bHasLastKept(false),
+    m_tLastKept(0)
+  {
+
+  }
+
+  /// enables or disables quality control: disabling removes the current limit
+  void setEnabled(bool bEnabled)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bEnabled.store(bEnabled, std::memory_order_relaxed);
+    if (!bEnabled)
+      publish(0.0);
+  }
+
+  bool isEnabled() const
+  {
+    return m_bEnabled.load(std::memory_order_relaxed);
+  }
+
+  /// the output rate is never lowered below dMinOutputRate nor raised above dMaxOutputRate. 0 means no bound.
+  void setLimits(double dMinOutputRate, double dMaxOutputRate)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dMinOutputRate = dMinOutputRate;
+    m_dMaxOutputRate = dMaxOutputRate;
+    if (m_dOutputRate > 0.0)
+      publish(clamp(m_dOutputRate));
+  }
+
+  /**
+   * @brief changes to the rate smaller than this fraction of the current rate are ignored.
+   * Increases are limited to dMaxIncrease of the current rate per message so that the rate recovers gradually.
+   */
+  void setHysteresis(double dHysteresis, double dMaxIncrease)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dHysteresis = dHysteresis;
+    m_dMaxIncrease = dMaxIncrease;
+  }
+
+  /// the current output rate limit in fps. 0 if the output is not limited.
+  double getOutputRateLimit() const
+  {
+    return m_uiMilliFps.load(std::memory_order_relaxed) / 1000.0;
+  }
+
+  /**
+   * @brief processes a quality message.
+   * @param iLate how late downstream is in ticks, negative values mean early
+   * @param lProportion the rate downstream would like relative to the current rate in parts per thousand
+   * @return true if the output rate limit changed
+   */
+  bool notify(int64_t iLate, long lProportion)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!isEnabled() || lProportion <= 0)
+      return false;
+
+    double dCurrent = m_dOutputRate;
+    if (dCurrent == 0.0)
+    {
+      // start from the rate that is currently delivered
+      int64_t iInterval = m_iMeasuredInterval.load(std::memory_order_relaxed);
+      if (iInterval <= 0)
+        return false;
+      dCurrent = TIMESTAMP_FACTOR / iInterval;
+    }
+
+    double dDesired = dCurrent * lProportion / 1000.0;
+    if (iLate > 0)
+      dDesired *= LATENESS_SCALE / static_cast<double>(LATENESS_SCALE + iLate);
+
+    double dRate;
+    if (dDesired < dCurrent * (1.0 - m_dHysteresis))
+    {
+      // shed load at once
+      dRate = dDesired;
+    }
+    else if (dDesired > dCurrent * (1.0 + m_dHysteresis))
+    {
+      if (m_dOutputRate == 0.0)
+        return false;
+      dRate = std::min(dDesired, dCurrent * (1.0 + m_dMaxIncrease));
+    }
+    else
+    {
+      return false;
+    }
+
+    dRate = clamp(dRate);
+    // the limit is lifted once it reaches the maximum output rate
+    if (m_dMaxOutputRate > 0.0 && dRate >= m_dMaxOutputRate && dRate > dCurrent)
+      dRate = 0.0;
+    if (dRate == m_dOutputRate)
+      return false;
+    publish(dRate);
+    return true;
+  }
+
+  /// resets the streaming state. The rate limit is kept.
+  void reset()
+  {
+    m_bIsTimeSet = false;
+    m_bHasLastKept = false;
+  }
+
+  /**
+   * @brief decides whether a frame that the mode kept is delivered under the current rate limit.
+   * Only called on the streaming thread.
+   */
+  bool keepFrame(int64_t tStart)
+  {
+    uint32_t uiMilliFps = m_uiMilliFps.load(std::memory_order_relaxed);
+    if (uiMilliFps != m_uiActiveMilliFps)
+    {
+      FrameDuration duration(RationalFrameRate(uiMilliFps, 1000).reduced());
+      m_timeFrame.rescale(m_duration, duration);
+      m_duration = duration;
+      if (m_uiActiveMilliFps == 0)
+        m_bIsTimeSet = false;
+      m_uiActiveMilliFps = uiMilliFps;
+    }
+
+    if (uiMilliFps != 0)
+    {
+      if (!m_bIsTimeSet)
+      {
+        m_timeFrame.set(tStart);
+        m_timeFrame.advance(m_duration, 1);
+        m_bIsTimeSet = true;
+      }
+      else if (m_timeFrame.isBefore(tStart))
+      {
+        m_timeFrame.advance(m_duration, m_timeFrame.framesUntil(m_duration, tStart));
+      }
+      else
+      {
+        return false;
+      }
+    }
+
+    // moving average of the output frame interval
+    if (m_bHasLastKept && tStart > m_tLastKept)
+    {
+      int64_t iDelta = tStart - m_tLastKept;
+      int64_t iAverage = m_iMeasuredInterval.load(std::memory_order_relaxed);
+      iAverage = (iAverage == 0) ? iDelta : iAverage + (iDelta - iAverage) / 8;
+      m_iMeasuredInterval.store(iAverage, std::memory_order_relaxed);
+    }
+    m_tLastKept = tStart;
+    m_bHasLastKept = true;
+    return true;
+  }
+
+private:
+
+  double clamp(double dRate) const
+  {
+    if (m_dMinOutputRate > 0.0 && dRate < m_dMinOutputRate)
+      dRate = m_dMinOutputRate;
+    if (m_dMaxOutputRate > 0.0 && dRate > m_dMaxOutputRate)
+      dRate = m_dMaxOutputRate;
+    return dRate;
+  }
+
+  void publish(double dRate)
+  {
+    m_dOutputRate = dRate;
+    m_uiMilliFps.store(static_cast<uint32_t>(dRate * 1000.0 + 0.5), std::memory_order_relaxed);
+  }
+
+  // guards the controller state used by notify
+  std::mutex m_mutex;
+  std::atomic<bool> m_bEnabled;
+  double m_dMinOutputRate;
+  double m_dMaxOutputRate;
+  double m_dHysteresis;
+  double m_dMaxIncrease;
+  // the current limit in fps, 0 if unlimited
+  double m_dOutputRate;
+  // the limit published to the streaming thread in 1/1000 fps
+  std::atomic<uint32_t> m_uiMilliFps;
+  // moving average of the output frame interval in ticks, written by the streaming thread
+  std::atomic<int64_t> m_iMeasuredInterval;
+
+  // streaming thread state
+  uint32_t m_uiActiveMilliFps;
+  FrameDuration m_duration;
+  FrameTimeline m_timeFrame;
+  bool m_bIsTimeSet;
+  bool m_bHasLastKept;
+  int64_t m_tLastKept;
+};
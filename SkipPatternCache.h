@@ -0,0 +1,275 @@
+/** @file
+
+MODULE                : SkipPatternCache
+
+FILE NAME             : SkipPatternCache.h
+
+DESCRIPTION           : Bit-packed skip x frames every y patterns and a process wide cache that shares them
+                        between all engines that skip with the same pair of frame rates.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief An immutable skip x frames every y pattern with one bit per frame.
+ */
+class SkipPattern
+{
+public:
+
+  /// packs vFramesToBeSkipped as returned by build
+  SkipPattern(unsigned uiSkipFrameNumber, unsigned uiTotalFrames, const std::vector<int>& vFramesToBeSkipped)
+    :m_uiSkipFrameNumber(uiSkipFrameNumber),
+    m_uiTotalFrames(uiTotalFrames),
+    m_uiLength(static_cast<unsigned>(vFramesToBeSkipped.size())),
+    m_vBits((vFramesToBeSkipped.size() + 63) / 64, 0)
+  {
+    for (size_t i = 0; i < vFramesToBeSkipped.size(); ++i)
+    {
+      if (vFramesToBeSkipped[i] != 0)
+        m_vBits[i / 64] |= static_cast<uint64_t>(1) << (i % 64);
+    }
+  }
+
+  unsigned getSkipFrameNumber() const { return m_uiSkipFrameNumber; }
+  unsigned getTotalFrames() const { return m_uiTotalFrames; }
+  /// the number of frames in the pattern: 0 if no frames are skipped
+  unsigned getLength() const { return m_uiLength; }
+  /// the pattern with bit i % 64 of word i / 64 set if frame i is skipped
+  const uint64_t* getBits() const { return m_vBits.empty() ? NULL : &m_vBits[0]; }
+
+  bool isSkipped(unsigned uiFrame) const
+  {
+    return ((m_vBits[uiFrame / 64] >> (uiFrame % 64)) & 1) != 0;
+  }
+
+  /// bytes used by the pattern
+  size_t getMemoryUsage() const
+  {
+    return sizeof(*this) + m_vBits.capacity() * sizeof(uint64_t);
+  }
+
+  /// builds the pattern for a pair of frame rates. Returns NULL if no pattern can be calculated.
+  static std::shared_ptr<const SkipPattern> create(double dSourceFrameRate, double dTargetFrameRate)
+  {
+    unsigned uiSkip = 0, uiTotal = 0;
+    std::vector<int> vFramesToBeSkipped;
+    if (!build(dSourceFrameRate, dTargetFrameRate, uiSkip, uiTotal, vFramesToBeSkipped))
+      return std::shared_ptr<const SkipPattern>();
+    return std::make_shared<const SkipPattern>(uiSkip, uiTotal, vFramesToBeSkipped);
+  }
+
+  /**
+   * @brief calculates the skip x frames every y pattern for a pair of frame rates.
+   * @param vFramesToBeSkipped receives a 1 for every frame of the pattern that is skipped.
+   * It is left empty if no frames are skipped.
+   * @return false if no pattern could be calculated, the other outputs are unchanged
+   */
+  static bool build(double dSourceFrameRate, double dTargetFrameRate, unsigned& uiSkipFrameNumber, unsigned& uiTotalFrames, std::vector<int>& vFramesToBeSkipped)
+  {
+    int iSkip = 0, iTotal = 0;
+    bool res = lowestRatio(dSourceFrameRate, dTargetFrameRate, iSkip, iTotal);
+    if (!res)
+      return false;
+
+    uiSkipFrameNumber = iSkip;
+    uiTotalFrames = iTotal;
+    vFramesToBeSkipped.clear();
+    // calculate which frames should be dropped
+    if (uiSkipFrameNumber < uiTotalFrames && uiSkipFrameNumber > 0)
+    {
+      double dRatio = uiTotalFrames / static_cast<double>(uiSkipFrameNumber);
+      std::set<unsigned> toBeSkipped;
+      // populate to be skipped: note that this index is 1-indexed
+      for (unsigned uiCount = 1; uiCount <= uiSkipFrameNumber; ++uiCount)
+      {
+        unsigned uiToBeSkipped = static_cast<unsigned>(std::floor(uiCount * dRatio + 0.5));
+        toBeSkipped.insert(uiToBeSkipped);
+      }
+
+      for (unsigned uiCount = 1; uiCount <= uiTotalFrames; ++uiCount)
+      {
+        vFramesToBeSkipped.push_back(toBeSkipped.find(uiCount) == toBeSkipped.end() ? 0 : 1);
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief calculates the lowest ratio of frames to be skipped per total frames.
+   * Frame rates are limited to 1 decimal.
+   * @return false if the target frame rate exceeds the source frame rate
+   */
+  static bool lowestRatio(double SourceFrameRate, double targetFrameRate, int& iSkipFrame, int& tTotalFrames)
+  {
+    if (targetFrameRate > SourceFrameRate)
+    {
+      return false;
+    }
+    const double EPSILON = 0.0001;
+    if (SourceFrameRate - targetFrameRate < EPSILON)
+    {
+      iSkipFrame = 0;
+      tTotalFrames = 0;
+      return true;
+    }
+
+    //get rid of the floating point
+    //limited to 1 decimal for now
+    if (std::fmod(targetFrameRate, 1) != 0 || std::fmod(SourceFrameRate, 1) != 0)
+    {
+      targetFrameRate = targetFrameRate * 10;
+      SourceFrameRate = SourceFrameRate * 10;
+    }
+
+    // the ratio is taken from the rounded rates, e.g. 30000/1001 fps counts as 30.0 fps
+    targetFrameRate = std::round(targetFrameRate);
+    SourceFrameRate = std::round(SourceFrameRate);
+    double targetFrameRateTemp(targetFrameRate), SourceFrameRateTemp(SourceFrameRate);
+    //Logic to find the greatest common factor
+    while (true)
+    {
+      (targetFrameRateTemp > SourceFrameRateTemp) ? targetFrameRateTemp = std::remainder(targetFrameRateTemp, SourceFrameRateTemp) :
+        SourceFrameRateTemp = std::remainder(SourceFrameRateTemp, targetFrameRateTemp);
+      if (targetFrameRateTemp < 0)
+      {
+        targetFrameRateTemp += SourceFrameRateTemp;
+      }
+      else if (SourceFrameRateTemp < 0)
+      {
+        SourceFrameRateTemp += targetFrameRateTemp;
+      }
+      if (targetFrameRateTemp <= 0 || SourceFrameRateTemp <= 0)
+      {
+        break;
+      }
+    }
+    // Divide by the GCF to get the lowest ratio
+    if (targetFrameRateTemp == 0)
+    {
+      iSkipFrame = (unsigned int)((SourceFrameRate - targetFrameRate) / SourceFrameRateTemp);
+      tTotalFrames = (unsigned int)(SourceFrameRate / SourceFrameRateTemp);
+    }
+    else if (SourceFrameRateTemp == 0)
+    {
+      iSkipFrame = (unsigned int)((SourceFrameRate - targetFrameRate) / targetFrameRateTemp);
+      tTotalFrames = (unsigned int)(SourceFrameRate / targetFrameRateTemp);
+    }
+    else
+    {
+      //The previous loop prevent this from happening
+    }
+    return true;
+  }
+
+private:
+
+  unsigned m_uiSkipFrameNumber;
+  unsigned m_uiTotalFrames;
+  unsigned m_uiLength;
+  std::vector<uint64_t> m_vBits;
+};
+
+/**
+ * @brief A process wide cache of skip patterns keyed by the exact pair of frame rates.
+ * Patterns are shared by reference count and freed once no engine uses them any more.
+ * All methods are thread-safe.
+ */
+class SkipPatternCache
+{
+public:
+
+  static SkipPatternCache& getInstance()
+  {
+    static SkipPatternCache cache;
+    return cache;
+  }
+
+  /// returns the pattern for a pair of frame rates, building it on first use. Returns NULL if no pattern can be calculated.
+  std::shared_ptr<const SkipPattern> getPattern(double dSourceFrameRate, double dTargetFrameRate)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Key key(dSourceFrameRate, dTargetFrameRate);
+    std::map<Key, std::weak_ptr<const SkipPattern> >::iterator it = m_mPatterns.find(key);
+    if (it != m_mPatterns.end())
+    {
+      std::shared_ptr<const SkipPattern> pPattern = it->second.lock();
+      if (pPattern)
+        return pPattern;
+    }
+
+    std::shared_ptr<const SkipPattern> pPattern = SkipPattern::create(dSourceFrameRate, dTargetFrameRate);
+    if (!pPattern)
+      return pPattern;
+    removeExpired();
+    m_mPatterns[key] = pPattern;
+    return pPattern;
+  }
+
+  /// the number of patterns that are cached and still in use
+  size_t getPatternCount()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    removeExpired();
+    return m_mPatterns.size();
+  }
+
+private:
+
+  typedef std::pair<double, double> Key;
+
+  SkipPatternCache()
+  {
+
+  }
+
+  SkipPatternCache(const SkipPatternCache&);
+  SkipPatternCache& operator=(const SkipPatternCache&);
+
+  void removeExpired()
+  {
+    for (std::map<Key, std::weak_ptr<const SkipPattern> >::iterator it = m_mPatterns.begin(); it != m_mPatterns.end();)
+    {
+      if (it->second.expired())
+        it = m_mPatterns.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  std::mutex m_mutex;
+  std::map<Key, std::weak_ptr<const SkipPattern> > m_mPatterns;
+};
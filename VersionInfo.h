@@ -4,13 +4,34 @@
 #include <string>
 
 const unsigned MAJOR_VERSION = 1;
-const unsigned MINOR_VERSION = 0;
-const unsigned BUILD_VERSION = 1;
+const unsigned MINOR_VERSION = 19;
+const unsigned BUILD_VERSION = 0;
 
 /// 0.0.0: - Initial release of filter with version control
 /// 0.1.0: - Updating frame duration when skipping frames
 /// 1.0.0: - Added source and target frame rate concept rather than skip x out of y frames
 /// 1.0.1: - Bugfix in average duration per frame calculations
+/// 1.1.0: - Added exact rational decimation mode
+/// 1.1.1: - Target rate mode uses exact integer timestamps
+/// 1.2.0: - Added duplicate frame elimination mode
+/// 1.3.0: - Added dropping of late frames against the stream clock
+/// 1.4.0: - Added quality control: the output rate adapts to quality messages from downstream
+/// 1.5.0: - Parameter changes take effect on the next frame without restarting the graph
+/// 1.5.1: - Skip patterns are bit-packed and shared between filter instances
+/// 1.6.0: - Added runtime statistics: frame counters, achieved frame rate, latency and interval histograms
+/// 1.7.0: - Added re-pacing of kept frames onto an exact grid at the output rate
+/// 1.8.0: - The output type announces the true output rate in every mode
+/// 1.9.0: - Added skipping of compressed H.264 and HEVC frames that no other frame refers to
+/// 1.10.0: - Added the dyadic temporal layer mode that tags kept samples with their layer
+/// 1.11.0: - Added the fan-out filter with one output pin per rendition
+/// 1.12.0: - Frames are decided before they are copied between different allocators
+/// 1.13.0: - Added estimation of the source frame rate from the timestamps
+/// 1.14.0: - Added the token bucket mode with a configurable burst
+/// 1.15.0: - Added the bitrate budget mode driven by sample sizes
+/// 1.16.0: - Added a bounded lookahead that chooses which frames to keep
+/// 1.17.0: - Frames of the duplicate elimination mode are analysed stripe by stripe on worker threads
+/// 1.18.0: - Accepts NV12, YUY2, UYVY and P010 and the VIDEOINFOHEADER2 format
+/// 1.19.0: - Added libframeskipping, a shared library with a C interface for Linux
 struct VersionInfo
 {
   static std::string toString()
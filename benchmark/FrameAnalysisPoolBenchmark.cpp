@@ -0,0 +1,277 @@
+/** @file
+
+MODULE                : FrameAnalysisPoolBenchmark
+
+FILE NAME             : FrameAnalysisPoolBenchmark.cpp
+
+DESCRIPTION           : Verifies the stripe by stripe analysis of the FrameAnalysisPool against the synchronous
+                        analysis and measures its latency and the wait of a paced 4K stream for 1 to 16 worker threads.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameAnalysisPool.h"
+#include "FrameKernels.h"
+#include "FrameSignature.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const int FRAME_WIDTH = 3840;
+const int FRAME_HEIGHT = 2160;
+const unsigned THREAD_COUNTS[] = { 1, 2, 4, 8, 16 };
+// the pipelined stream: 4K at 240 fps and the time the streaming thread spends delivering a frame
+const double STREAM_FPS = 240.0;
+const double DELIVERY_MS = 0.5;
+const int STREAM_FRAMES = 240;
+
+typedef std::chrono::steady_clock Clock;
+
+/// deterministic pseudo random bytes: a gradient with noise so that the data is not trivially compressible
+std::vector<uint8_t> generateFrame(size_t uiSize, uint32_t uiSeed)
+{
+  std::vector<uint8_t> vData(uiSize);
+  uint32_t uiState = uiSeed;
+  for (size_t i = 0; i < uiSize; ++i)
+  {
+    uiState = uiState * 1664525u + 1013904223u;
+    vData[i] = static_cast<uint8_t>((i / 61) + (uiState >> 27));
+  }
+  return vData;
+}
+
+struct Format
+{
+  unsigned uiFormat;
+  const char* szName;
+  int iBytesPerPixel;
+};
+
+const Format FORMATS[] =
+{
+  { FSKIP_PIXEL_FORMAT_I420, "I420", 1 },
+  { FSKIP_PIXEL_FORMAT_RGB32, "RGB32", 4 },
+};
+
+FramePicture makePicture(const Format& format, const std::vector<uint8_t>& vData, int iWidth, int iHeight)
+{
+  FramePicture picture;
+  picture.Data = &vData[0];
+  picture.Width = iWidth;
+  picture.Height = iHeight;
+  picture.Stride = ((iWidth * format.iBytesPerPixel) + 3) & ~3;
+  picture.Format = format.uiFormat;
+  return picture;
+}
+
+std::vector<uint8_t> generatePicture(const Format& format, int iWidth, int iHeight, uint32_t uiSeed)
+{
+  return generateFrame(static_cast<size_t>(iHeight) * ((iWidth * format.iBytesPerPixel + 3) & ~3), uiSeed);
+}
+
+/// the signature, histogram and gradient of a picture computed on the calling thread with the scalar kernels
+void analyseSynchronously(const FramePicture& picture, FrameAnalysis& analysis)
+{
+  analysis.Signature.setKernels(getScalarFrameKernels());
+  analysis.Signature.compute(picture);
+  const FrameKernels& kernels = getScalarFrameKernels();
+  int iLumaWidth = analysis.Signature.getWidth() * FSKIP_SIGNATURE_BLOCK_SIZE;
+  int iLumaHeight = analysis.Signature.getHeight() * FSKIP_SIGNATURE_BLOCK_SIZE;
+  std::vector<uint8_t> vLuma(iLumaWidth);
+  for (int iRow = 0; iRow < iLumaHeight; ++iRow)
+  {
+    const uint8_t* pRow = picture.Data + static_cast<size_t>(iRow) * picture.Stride;
+    if (picture.Format == FSKIP_PIXEL_FORMAT_RGB32)
+    {
+      kernels.Rgb32ToLuma(pRow, iLumaWidth, &vLuma[0]);
+      pRow = &vLuma[0];
+    }
+    kernels.Histogram(pRow, iLumaWidth, analysis.Histogram);
+    analysis.Gradient += kernels.Sad(pRow, pRow + 1, iLumaWidth - 1);
+  }
+}
+
+/// compares the results of the pool with the synchronous analysis for frame sizes with partial stripes and blocks
+bool verify()
+{
+  const int SIZES[][2] = { { FRAME_WIDTH, FRAME_HEIGHT }, { 1918, 1078 }, { 64, 8 }, { 200, 300 } };
+  bool bExact = true;
+  FrameAnalysisPool pool;
+  pool.start(3, true);
+  for (const Format& format : FORMATS)
+  {
+    for (const auto& size : SIZES)
+    {
+      std::vector<uint8_t> vFrame = generatePicture(format, size[0], size[1], 7);
+      FramePicture picture = makePicture(format, vFrame, size[0], size[1]);
+      FrameAnalysis expected;
+      analyseSynchronously(picture, expected);
+      int iSlot = pool.submit(picture);
+      const FrameAnalysis* pActual = iSlot >= 0 ? pool.waitFor(iSlot, Clock::time_point::max()) : NULL;
+      bool bSame = pActual != NULL
+        && pActual->Signature.getBlocks() == expected.Signature.getBlocks()
+        && std::memcmp(pActual->Histogram, expected.Histogram, sizeof(expected.Histogram)) == 0
+        && pActual->Gradient == expected.Gradient;
+      if (iSlot >= 0)
+        pool.release(iSlot);
+      std::printf("%-6s %4dx%-4d bit-exact against the synchronous analysis: %s\n", format.szName, size[0], size[1], bSame ? "yes" : "NO");
+      bExact &= bSame;
+    }
+  }
+  return bExact;
+}
+
+/// runs the function repeatedly for about half a second and returns the mean duration in milliseconds
+template <typename Function>
+double measure(Function function)
+{
+  auto start = Clock::now();
+  int iRuns = 0;
+  do
+  {
+    function();
+    ++iRuns;
+  } while (std::chrono::duration<double>(Clock::now() - start).count() < 0.5);
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iRuns;
+}
+
+/// the mean duration of analysing frames one after the other in the pool
+double measurePool(const FramePicture& picture, unsigned uiThreads, bool bStatistics)
+{
+  FrameAnalysisPool pool;
+  pool.start(uiThreads, bStatistics);
+  return measure([&]()
+  {
+    int iSlot = pool.submit(picture);
+    pool.waitFor(iSlot, Clock::time_point::max());
+    pool.release(iSlot);
+  });
+}
+
+/// frames analysed one after the other: the latency of one analysis with and without the histogram and gradient
+void measureLatency(const Format& format, const FramePicture& picture)
+{
+  FrameSignature signature;
+  double dSignatureMs = measure([&]() { signature.compute(picture); });
+  std::vector<uint16_t> vSums(signature.getWidth());
+  std::vector<uint8_t> vLuma(static_cast<size_t>(signature.getWidth()) * FSKIP_SIGNATURE_BLOCK_SIZE);
+  FrameAnalysis analysis;
+  double dFullMs = measure([&]()
+  {
+    signature.computeBlockRows(picture, 0, signature.getHeight(), &vSums[0], &vLuma[0], analysis.Histogram, &analysis.Gradient);
+  });
+  std::printf("%-6s %-8s %13.2f %13.2f\n", format.szName, "inline", dSignatureMs, dFullMs);
+
+  for (unsigned uiThreads : THREAD_COUNTS)
+  {
+    char szThreads[16];
+    std::snprintf(szThreads, sizeof(szThreads), "%u", uiThreads);
+    std::printf("%-6s %-8s %13.2f %13.2f\n", format.szName, szThreads, measurePool(picture, uiThreads, false), measurePool(picture, uiThreads, true));
+  }
+}
+
+/**
+ * @brief a paced live stream as the filter handles it: on the arrival of frame N + 1 it is submitted, frame N is
+ * decided with the result of its analysis and delivered. A result that is not ready one frame interval after the
+ * arrival of the next frame is a miss.
+ */
+void measurePipeline(const Format& format, const FramePicture& picture)
+{
+  const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / STREAM_FPS));
+  const auto delivery = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(DELIVERY_MS));
+  for (unsigned uiThreads : THREAD_COUNTS)
+  {
+    FrameAnalysisPool pool;
+    // the filter only reads the signatures
+    pool.start(uiThreads);
+    int iPendingSlot = -1;
+    Clock::time_point tPendingDeadline;
+    int iMisses = 0;
+    double dWaitMs = 0.0;
+    double dMaxWaitMs = 0.0;
+    Clock::time_point tArrival = Clock::now();
+    for (int iFrame = 0; iFrame <= STREAM_FRAMES; ++iFrame)
+    {
+      std::this_thread::sleep_until(tArrival);
+      int iSlot = iFrame < STREAM_FRAMES ? pool.submit(picture) : -1;
+      if (iFrame > 0)
+      {
+        Clock::time_point tWait = Clock::now();
+        const FrameAnalysis* pAnalysis = iPendingSlot >= 0 ? pool.waitFor(iPendingSlot, tPendingDeadline) : NULL;
+        double dMs = std::chrono::duration<double, std::milli>(Clock::now() - tWait).count();
+        dWaitMs += dMs;
+        dMaxWaitMs = std::max(dMaxWaitMs, dMs);
+        if (pAnalysis == NULL)
+          ++iMisses;
+        if (iPendingSlot >= 0)
+          pool.release(iPendingSlot);
+        // delivering the pending frame
+        Clock::time_point tDelivered = Clock::now() + delivery;
+        while (Clock::now() < tDelivered)
+        {
+        }
+      }
+      iPendingSlot = iSlot;
+      tPendingDeadline = tArrival + 2 * interval;
+      tArrival += interval;
+    }
+    std::printf("%-6s %7u %12.3f %12.3f %8d/%d\n", format.szName, uiThreads, dWaitMs / STREAM_FRAMES, dMaxWaitMs, iMisses, STREAM_FRAMES);
+  }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  // --verify only checks the results of the pool, e.g. under ctest
+  bool bVerifyOnly = argc > 1 && std::strcmp(argv[1], "--verify") == 0;
+  std::printf("hardware threads: %u, kernels: %s\n\n", std::thread::hardware_concurrency(), getFrameKernels().Name);
+  bool bExact = verify();
+  if (bVerifyOnly)
+    return bExact ? 0 : 1;
+
+  std::printf("\n%dx%d frames analysed one after the other in ms per frame\n", FRAME_WIDTH, FRAME_HEIGHT);
+  std::printf("%-6s %-8s %13s %13s\n", "format", "threads", "signature", "+histogram");
+  for (const Format& format : FORMATS)
+  {
+    std::vector<uint8_t> vFrame = generatePicture(format, FRAME_WIDTH, FRAME_HEIGHT, 4);
+    measureLatency(format, makePicture(format, vFrame, FRAME_WIDTH, FRAME_HEIGHT));
+  }
+
+  std::printf("\n%dx%d at %.0f fps, %.1f ms delivery per frame: the streaming thread waits for the analysis of the previous frame\n",
+    FRAME_WIDTH, FRAME_HEIGHT, STREAM_FPS, DELIVERY_MS);
+  std::printf("%-6s %7s %12s %12s %10s\n", "format", "threads", "mean wait ms", "max wait ms", "misses");
+  for (const Format& format : FORMATS)
+  {
+    std::vector<uint8_t> vFrame = generatePicture(format, FRAME_WIDTH, FRAME_HEIGHT, 4);
+    measurePipeline(format, makePicture(format, vFrame, FRAME_WIDTH, FRAME_HEIGHT));
+  }
+  return bExact ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+/** @file
+
+MODULE                : FrameKernelsBenchmark
+
+FILE NAME             : FrameKernelsBenchmark.cpp
+
+DESCRIPTION           : Checks that every SIMD kernel is bit-exact against the scalar reference and reports the
+                        throughput of each kernel per pixel format on 4K frames.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameKernels.h"
+#include "FrameSignature.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace
+{
+
+const int FRAME_WIDTH = 3840;
+const int FRAME_HEIGHT = 2160;
+
+/// deterministic pseudo random bytes: a gradient with noise so that the data is not trivially compressible
+std::vector<uint8_t> generateFrame(size_t uiSize, uint32_t uiSeed)
+{
+  std::vector<uint8_t> vData(uiSize);
+  uint32_t uiState = uiSeed;
+  for (size_t i = 0; i < uiSize; ++i)
+  {
+    uiState = uiState * 1664525u + 1013904223u;
+    vData[i] = static_cast<uint8_t>((i / 61) + (uiState >> 27));
+  }
+  return vData;
+}
+
+struct Format
+{
+  unsigned uiFormat;
+  const char* szName;
+  int iBytesPerPixel;
+};
+
+const Format FORMATS[] =
+{
+  { FSKIP_PIXEL_FORMAT_I420, "I420", 1 },
+  { FSKIP_PIXEL_FORMAT_RGB24, "RGB24", 3 },
+  { FSKIP_PIXEL_FORMAT_RGB32, "RGB32", 4 },
+  { FSKIP_PIXEL_FORMAT_NV12, "NV12", 1 },
+  { FSKIP_PIXEL_FORMAT_YUY2, "YUY2", 2 },
+  { FSKIP_PIXEL_FORMAT_UYVY, "UYVY", 2 },
+  { FSKIP_PIXEL_FORMAT_P010, "P010", 2 },
+};
+
+FramePicture makePicture(const Format& format, const std::vector<uint8_t>& vData)
+{
+  FramePicture picture;
+  picture.Data = &vData[0];
+  picture.Width = FRAME_WIDTH;
+  picture.Height = FRAME_HEIGHT;
+  picture.Stride = ((FRAME_WIDTH * format.iBytesPerPixel) + 3) & ~3;
+  picture.Format = format.uiFormat;
+  return picture;
+}
+
+/// compares every kernel of a variant with the scalar reference on random lengths and offsets
+bool verify(const FrameKernels& kernels)
+{
+  const FrameKernels& reference = getScalarFrameKernels();
+  std::vector<uint8_t> vA = generateFrame(1 << 16, 1);
+  std::vector<uint8_t> vB = generateFrame(1 << 16, 2);
+  uint32_t uiState = 12345;
+  bool bExact = true;
+  for (int iTrial = 0; iTrial < 2000 && bExact; ++iTrial)
+  {
+    uiState = uiState * 1664525u + 1013904223u;
+    size_t uiOffset = (uiState >> 8) % 61;
+    uiState = uiState * 1664525u + 1013904223u;
+    int iWidth = static_cast<int>((uiState >> 8) % 4000);
+    const uint8_t* pA = &vA[uiOffset];
+    const uint8_t* pB = &vB[uiOffset];
+
+    std::vector<uint8_t> vExpected(iWidth + 1), vActual(iWidth + 1);
+    reference.Rgb24ToLuma(pA, iWidth, &vExpected[0]);
+    kernels.Rgb24ToLuma(pA, iWidth, &vActual[0]);
+    bExact &= (vExpected == vActual);
+    reference.Rgb32ToLuma(pA, iWidth, &vExpected[0]);
+    kernels.Rgb32ToLuma(pA, iWidth, &vActual[0]);
+    bExact &= (vExpected == vActual);
+    reference.Yuy2ToLuma(pA, iWidth, &vExpected[0]);
+    kernels.Yuy2ToLuma(pA, iWidth, &vActual[0]);
+    bExact &= (vExpected == vActual);
+
+    int iBlocks = iWidth / FSKIP_KERNEL_BLOCK_WIDTH;
+    std::vector<uint16_t> vExpectedSums(iBlocks + 1, 7), vActualSums(iBlocks + 1, 7);
+    for (int iRow = 0; iRow < FSKIP_KERNEL_BLOCK_WIDTH; ++iRow)
+    {
+      reference.SumBlocks(pA + iRow * 97, iBlocks, &vExpectedSums[0]);
+      kernels.SumBlocks(pA + iRow * 97, iBlocks, &vActualSums[0]);
+    }
+    bExact &= (vExpectedSums == vActualSums);
+
+    bExact &= (reference.Sad(pA, pB, iWidth * 4) == kernels.Sad(pA, pB, iWidth * 4));
+
+    std::vector<uint32_t> vExpectedHistogram(256, 3), vActualHistogram(256, 3);
+    reference.Histogram(pA, iWidth * 4, &vExpectedHistogram[0]);
+    kernels.Histogram(pA, iWidth * 4, &vActualHistogram[0]);
+    bExact &= (vExpectedHistogram == vActualHistogram);
+  }
+
+  // full frame signatures of every format
+  for (const Format& format : FORMATS)
+  {
+    std::vector<uint8_t> vFrame = generateFrame(static_cast<size_t>(FRAME_HEIGHT) * FRAME_WIDTH * format.iBytesPerPixel, 3);
+    FramePicture picture = makePicture(format, vFrame);
+    FrameSignature expected, actual;
+    expected.setKernels(reference);
+    actual.setKernels(kernels);
+    expected.compute(picture);
+    actual.compute(picture);
+    bExact &= (expected.getBlocks() == actual.getBlocks());
+  }
+  return bExact;
+}
+
+/**
+ * @brief builds a picture in the layout of a format around a luma plane with a padded stride. The chroma bytes and the
+ * 2 least significant bits of 10-bit luma are noise that must not change the signature.
+ */
+std::vector<uint8_t> buildLayout(const Format& format, const std::vector<uint8_t>& vLuma, int iWidth, int iHeight, FramePicture& picture)
+{
+  const int PADDING = 64;
+  picture.Width = iWidth;
+  picture.Height = iHeight;
+  picture.Format = format.uiFormat;
+  picture.Stride = iWidth * format.iBytesPerPixel + PADDING;
+  // the chroma planes of NV12 and P010 follow with half the rows
+  int iRows = (format.uiFormat == FSKIP_PIXEL_FORMAT_NV12 || format.uiFormat == FSKIP_PIXEL_FORMAT_P010) ? iHeight + iHeight / 2 : iHeight;
+  std::vector<uint8_t> vData = generateFrame(static_cast<size_t>(iRows) * picture.Stride, 9);
+  for (int iRow = 0; iRow < iHeight; ++iRow)
+  {
+    uint8_t* pRow = &vData[static_cast<size_t>(iRow) * picture.Stride];
+    const uint8_t* pLuma = &vLuma[static_cast<size_t>(iRow) * iWidth];
+    for (int i = 0; i < iWidth; ++i)
+    {
+      switch (format.uiFormat)
+      {
+      case FSKIP_PIXEL_FORMAT_NV12:
+        pRow[i] = pLuma[i];
+        break;
+      case FSKIP_PIXEL_FORMAT_YUY2:
+        pRow[2 * i] = pLuma[i];
+        break;
+      case FSKIP_PIXEL_FORMAT_UYVY:
+        pRow[2 * i + 1] = pLuma[i];
+        break;
+      case FSKIP_PIXEL_FORMAT_P010:
+      {
+        // little endian with the 10-bit value in the most significant bits
+        unsigned uiSample = ((pLuma[i] << 2) | (pRow[2 * i] & 3)) << 6;
+        pRow[2 * i] = static_cast<uint8_t>(uiSample);
+        pRow[2 * i + 1] = static_cast<uint8_t>(uiSample >> 8);
+        break;
+      }
+      }
+    }
+  }
+  picture.Data = &vData[0];
+  return vData;
+}
+
+/// the signature of synthetic pictures in each YUV layout must equal the signature of their luma plane as I420
+bool verifyLayouts(const FrameKernels& kernels)
+{
+  const int SIZES[][2] = { { FRAME_WIDTH, FRAME_HEIGHT }, { 1918, 1080 }, { 722, 482 } };
+  bool bExact = true;
+  for (const auto& size : SIZES)
+  {
+    int iWidth = size[0], iHeight = size[1];
+    std::vector<uint8_t> vLuma = generateFrame(static_cast<size_t>(iWidth) * iHeight, 8);
+    FramePicture luma;
+    luma.Data = &vLuma[0];
+    luma.Width = iWidth;
+    luma.Height = iHeight;
+    luma.Stride = iWidth;
+    luma.Format = FSKIP_PIXEL_FORMAT_I420;
+    FrameSignature expected;
+    expected.setKernels(getScalarFrameKernels());
+    expected.compute(luma);
+    for (const Format& format : FORMATS)
+    {
+      if (format.uiFormat == FSKIP_PIXEL_FORMAT_I420 || format.uiFormat == FSKIP_PIXEL_FORMAT_RGB24 || format.uiFormat == FSKIP_PIXEL_FORMAT_RGB32)
+        continue;
+      FramePicture picture;
+      std::vector<uint8_t> vData = buildLayout(format, vLuma, iWidth, iHeight, picture);
+      FrameSignature actual;
+      actual.setKernels(kernels);
+      bExact &= actual.compute(picture) && actual.getBlocks() == expected.getBlocks();
+    }
+  }
+  return bExact;
+}
+
+/// runs the function repeatedly for about half a second and returns the best throughput in GB/s
+double measure(const std::function<void()>& function, double dBytes)
+{
+  double dBest = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  do
+  {
+    auto before = std::chrono::steady_clock::now();
+    function();
+    auto after = std::chrono::steady_clock::now();
+    double dSeconds = std::chrono::duration<double>(after - before).count();
+    if (dBest == 0.0 || dSeconds < dBest)
+      dBest = dSeconds;
+  } while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < 0.5);
+  return dBytes / dBest / 1e9;
+}
+
+void report(const char* szKernel, const char* szFormat, const FrameKernels& kernels, double dGbPerSecond, double dFrameBytes)
+{
+  std::printf("%-12s %-6s %-7s %10.2f %12.1f\n", szKernel, szFormat, kernels.Name, dGbPerSecond, dGbPerSecond * 1e9 / dFrameBytes);
+}
+
+void benchmark(const FrameKernels& kernels)
+{
+  volatile uint64_t uiSink = 0;
+  for (const Format& format : FORMATS)
+  {
+    size_t uiBytes = static_cast<size_t>(FRAME_HEIGHT) * (((FRAME_WIDTH * format.iBytesPerPixel) + 3) & ~3);
+    std::vector<uint8_t> vFrame = generateFrame(uiBytes, 4);
+    FramePicture picture = makePicture(format, vFrame);
+    FrameSignature signature;
+    signature.setKernels(kernels);
+    double dGbps = measure([&]() { signature.compute(picture); uiSink += signature.getBlocks()[0]; }, static_cast<double>(uiBytes));
+    report("signature", format.szName, kernels, dGbps, static_cast<double>(uiBytes));
+
+    if (!FrameSignature::hasLumaPlane(format.uiFormat))
+    {
+      std::vector<uint8_t> vLuma(FRAME_WIDTH);
+      dGbps = measure([&]()
+      {
+        for (int iRow = 0; iRow < FRAME_HEIGHT; ++iRow)
+        {
+          const uint8_t* pRow = &vFrame[static_cast<size_t>(iRow) * picture.Stride];
+          if (format.uiFormat == FSKIP_PIXEL_FORMAT_RGB24)
+            kernels.Rgb24ToLuma(pRow, FRAME_WIDTH, &vLuma[0]);
+          else if (format.uiFormat == FSKIP_PIXEL_FORMAT_RGB32)
+            kernels.Rgb32ToLuma(pRow, FRAME_WIDTH, &vLuma[0]);
+          else
+            kernels.Yuy2ToLuma(pRow, FRAME_WIDTH, &vLuma[0]);
+        }
+        uiSink += vLuma[0];
+      }, static_cast<double>(uiBytes));
+      report("luma", format.szName, kernels, dGbps, static_cast<double>(uiBytes));
+    }
+  }
+
+  // SAD and histogram work on the luma plane
+  size_t uiLumaBytes = static_cast<size_t>(FRAME_WIDTH) * FRAME_HEIGHT;
+  std::vector<uint8_t> vA = generateFrame(uiLumaBytes, 5);
+  std::vector<uint8_t> vB = generateFrame(uiLumaBytes, 6);
+  double dGbps = measure([&]() { uiSink += kernels.Sad(&vA[0], &vB[0], uiLumaBytes); }, 2.0 * uiLumaBytes);
+  report("sad", "Y", kernels, dGbps, 2.0 * uiLumaBytes);
+
+  std::vector<uint32_t> vHistogram(256);
+  dGbps = measure([&]() { kernels.Histogram(&vA[0], uiLumaBytes, &vHistogram[0]); uiSink += vHistogram[0]; }, static_cast<double>(uiLumaBytes));
+  report("histogram", "Y", kernels, dGbps, static_cast<double>(uiLumaBytes));
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  // --verify only checks the kernels, e.g. under ctest
+  bool bVerifyOnly = argc > 1 && std::strcmp(argv[1], "--verify") == 0;
+  std::vector<const FrameKernels*> vKernels;
+  vKernels.push_back(&getScalarFrameKernels());
+  if (getSse2FrameKernels()) vKernels.push_back(getSse2FrameKernels());
+  if (getAvx2FrameKernels()) vKernels.push_back(getAvx2FrameKernels());
+
+  std::printf("selected kernels: %s\n", getFrameKernels().Name);
+  bool bExact = true;
+  for (const FrameKernels* pKernels : vKernels)
+  {
+    bool bVariantExact = verify(*pKernels);
+    std::printf("%-7s bit-exact against scalar: %s\n", pKernels->Name, bVariantExact ? "yes" : "NO");
+    bExact &= bVariantExact;
+    bool bLayoutsExact = verifyLayouts(*pKernels);
+    std::printf("%-7s NV12, YUY2, UYVY and P010 with padded strides match their luma plane: %s\n", pKernels->Name, bLayoutsExact ? "yes" : "NO");
+    bExact &= bLayoutsExact;
+  }
+  if (bVerifyOnly)
+    return bExact ? 0 : 1;
+
+  std::printf("\n%dx%d frames\n", FRAME_WIDTH, FRAME_HEIGHT);
+  std::printf("%-12s %-6s %-7s %10s %12s\n", "kernel", "format", "isa", "GB/s", "frames/s");
+  for (const FrameKernels* pKernels : vKernels)
+  {
+    benchmark(*pKernels);
+  }
+  return bExact ? 0 : 1;
+}
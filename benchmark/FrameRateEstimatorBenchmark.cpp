@@ -0,0 +1,264 @@
+/** @file
+
+MODULE                : FrameRateEstimatorBenchmark
+
+FILE NAME             : FrameRateEstimatorBenchmark.cpp
+
+DESCRIPTION           : Replays synthetic timestamp traces with jitter, dropped frames, rate switches and gaps
+                        through FrameRateEstimator and checks the estimates, how often they change and how fast
+                        they settle. Also checks that an engine with a wrong source rate follows the estimate.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingEngine.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+
+/// a deterministic generator so that every run replays the same traces
+class TraceRandom
+{
+public:
+
+  explicit TraceRandom(uint32_t uiSeed)
+    :m_uiState(uiSeed)
+  {
+
+  }
+
+  /// uniform in [0, 1)
+  double next()
+  {
+    m_uiState = m_uiState * 1664525u + 1013904223u;
+    return (m_uiState >> 8) / 16777216.0;
+  }
+
+private:
+
+  uint32_t m_uiState;
+};
+
+/// one segment of a trace: a nominal rate with uniform timestamp jitter and randomly dropped frames
+struct TraceSegment
+{
+  RationalFrameRate FrameRate;
+  unsigned Frames;
+  int64_t Jitter;
+  double DropProbability;
+  /// a pause before the segment, e.g. a seek
+  int64_t Gap;
+};
+
+/// the start times of the frames that were not dropped
+std::vector<int64_t> makeTrace(const std::vector<TraceSegment>& vSegments, uint32_t uiSeed)
+{
+  TraceRandom random(uiSeed);
+  std::vector<int64_t> vTimes;
+  int64_t tSegment = 0;
+  for (const TraceSegment& segment : vSegments)
+  {
+    tSegment += segment.Gap;
+    int64_t tNext = tSegment;
+    for (unsigned i = 0; i < segment.Frames; ++i)
+    {
+      tNext = tSegment + static_cast<int64_t>(i) * TIMESTAMP_TICKS_PER_SECOND * segment.FrameRate.Denominator / segment.FrameRate.Numerator;
+      double dJitter = (2.0 * random.next() - 1.0) * segment.Jitter;
+      bool bDropped = random.next() < segment.DropProbability;
+      if (!bDropped)
+        vTimes.push_back(tNext + static_cast<int64_t>(std::llround(dJitter)));
+    }
+    tSegment = tNext + TIMESTAMP_TICKS_PER_SECOND * segment.FrameRate.Denominator / segment.FrameRate.Numerator;
+  }
+  return vTimes;
+}
+
+struct EstimateResult
+{
+  EstimateResult()
+    :Changes(0),
+    LastChange(0),
+    Ns(0.0)
+  {
+
+  }
+
+  RationalFrameRate FrameRate;
+  unsigned Changes;
+  /// index of the frame at which the estimate last changed
+  size_t LastChange;
+  double Ns;
+};
+
+EstimateResult estimate(const std::vector<int64_t>& vTimes)
+{
+  FrameRateEstimator estimator;
+  EstimateResult result;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < vTimes.size(); ++i)
+  {
+    if (estimator.addTimestamp(vTimes[i]))
+    {
+      ++result.Changes;
+      result.LastChange = i;
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+  result.FrameRate = estimator.getFrameRate();
+  result.Ns = std::chrono::duration<double, std::nano>(stop - start).count() / vTimes.size();
+  return result;
+}
+
+/**
+ * @brief estimates the rate of the trace and checks the final estimate.
+ * @param uiMaxChanges the estimate may change this often including the first estimate
+ * @param uiSettleFrames the estimate must be final this many frames after uiFrom
+ */
+bool reportEstimate(const char* szName, const std::vector<TraceSegment>& vSegments, const RationalFrameRate& expected,
+  unsigned uiMaxChanges, size_t uiFrom, size_t uiSettleFrames)
+{
+  std::vector<int64_t> vTimes = makeTrace(vSegments, 12345);
+  EstimateResult result = estimate(vTimes);
+  bool bOk = result.FrameRate == expected && result.Changes <= uiMaxChanges && result.LastChange <= uiFrom + uiSettleFrames;
+  std::printf("%-36s %11u/%-5u %11u/%-5u %8u %8zu %8.1f %s\n", szName, expected.Numerator, expected.Denominator,
+    result.FrameRate.Numerator, result.FrameRate.Denominator, result.Changes, result.LastChange, result.Ns, bOk ? "ok" : "FAILED");
+  return bOk;
+}
+
+/**
+ * @brief runs an engine whose configured source rate is wrong with estimation enabled.
+ * @return false if the kept rate after the last change of the source rate is off the target
+ */
+bool reportEngine(const char* szName, unsigned uiMode, const std::vector<TraceSegment>& vSegments, size_t uiSettleFrames)
+{
+  const double TARGET = 15.0;
+  FrameSkippingConfig config;
+  config.Mode = uiMode;
+  config.EstimateSourceRate = true;
+  config.TargetFrameRate = TARGET;
+  config.RationalTargetFrameRate = RationalFrameRate(15);
+  // deliberately wrong: the estimate replaces it
+  FrameSkippingEngine::setConfigSourceFrameRate(config, RationalFrameRate(50));
+  FrameSkippingEngine engine;
+  engine.applyConfig(config);
+
+  std::vector<int64_t> vTimes = makeTrace(vSegments, 54321);
+  // the kept frames are counted over the last segment after the estimate settled
+  size_t uiFrom = vTimes.size() - (vSegments.back().Frames * 9 / 10) + uiSettleFrames;
+  size_t uiKept = 0;
+  for (size_t i = 0; i < vTimes.size(); ++i)
+  {
+    if (engine.keepFrame(vTimes[i]) && i >= uiFrom)
+      ++uiKept;
+  }
+  double dSeconds = (vTimes.back() - vTimes[uiFrom]) / TIMESTAMP_FACTOR;
+  double dFps = uiKept / dSeconds;
+  const RationalFrameRate& source = engine.getEstimatedSourceFrameRate();
+  bool bOk = source == vSegments.back().FrameRate && std::fabs(dFps - TARGET) <= 0.02 * TARGET;
+  std::printf("%-36s %11u/%-5u %8llu %10.3f %s\n", szName, source.Numerator, source.Denominator,
+    static_cast<unsigned long long>(engine.getSourceRateChanges()), dFps, bOk ? "ok" : "FAILED");
+  return bOk;
+}
+
+TraceSegment segment(const RationalFrameRate& frameRate, unsigned uiFrames, int64_t iJitter, double dDropProbability, int64_t iGap = 0)
+{
+  TraceSegment result;
+  result.FrameRate = frameRate;
+  result.Frames = uiFrames;
+  result.Jitter = iJitter;
+  result.DropProbability = dDropProbability;
+  result.Gap = iGap;
+  return result;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  unsigned uiFrames = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], NULL, 10)) : 3000;
+  // 2 ms of jitter either way, more than the 33 us between the intervals of 30 and 30000/1001 fps
+  const int64_t JITTER = 20000;
+  const double DROPS = 0.02;
+  // the first estimate may be refined once as the long run mean separates the NTSC rates
+  const unsigned MAX_CHANGES = 2;
+  const size_t SETTLE = 600;
+
+  std::printf("%-36s %17s %17s %8s %8s %8s\n", "trace", "expected", "estimate", "changes", "settled", "ns/frame");
+  bool bOk = true;
+  const RationalFrameRate RATES[] =
+  {
+    RationalFrameRate(24000, 1001), RationalFrameRate(24), RationalFrameRate(25), RationalFrameRate(30000, 1001),
+    RationalFrameRate(30), RationalFrameRate(50), RationalFrameRate(60000, 1001), RationalFrameRate(60)
+  };
+  for (const RationalFrameRate& frameRate : RATES)
+  {
+    char szName[64];
+    std::snprintf(szName, sizeof(szName), "steady %.3f fps, jitter, drops", frameRate.toDouble());
+    std::vector<TraceSegment> vSegments(1, segment(frameRate, uiFrames, JITTER, DROPS));
+    bOk &= reportEstimate(szName, vSegments, frameRate, MAX_CHANGES, 0, SETTLE);
+  }
+
+  // the source switches from 30 to 25 fps halfway through: the new estimate needs a window of intervals
+  std::vector<TraceSegment> vSwitch;
+  vSwitch.push_back(segment(RationalFrameRate(30), uiFrames / 2, JITTER, DROPS));
+  vSwitch.push_back(segment(RationalFrameRate(25), uiFrames / 2, JITTER, DROPS));
+  size_t uiSwitch = makeTrace(std::vector<TraceSegment>(1, vSwitch[0]), 12345).size();
+  bOk &= reportEstimate("30 then 25 fps", vSwitch, RationalFrameRate(25), MAX_CHANGES + 1, uiSwitch, 2 * FSKIP_RATE_WINDOW);
+
+  // pauses longer than FSKIP_RATE_MAX_INTERVAL, e.g. seeks, do not disturb the estimate
+  std::vector<TraceSegment> vGaps;
+  for (int i = 0; i < 4; ++i)
+    vGaps.push_back(segment(RationalFrameRate(25), uiFrames / 4, JITTER, DROPS, i > 0 ? 3 * TIMESTAMP_TICKS_PER_SECOND : 0));
+  bOk &= reportEstimate("25 fps with 3 s gaps", vGaps, RationalFrameRate(25), MAX_CHANGES, 0, SETTLE);
+
+  // a variable rate source where half of the frames are missing in bursts settles on the rate of the regular frames
+  std::vector<TraceSegment> vBursts;
+  for (int i = 0; i < 20; ++i)
+    vBursts.push_back(segment(RationalFrameRate(60), uiFrames / 20, JITTER / 4, i % 2 == 0 ? 0.0 : 0.5));
+  bOk &= reportEstimate("60 fps with bursts of drops", vBursts, RationalFrameRate(60), MAX_CHANGES, 0, SETTLE);
+
+  // the engine rebuilds its cadence for the estimated rate while the configured source rate is wrong
+  std::printf("\n%-36s %17s %8s %10s\n", "engine, target 15 fps", "source", "changes", "kept fps");
+  std::vector<TraceSegment> vSteady(1, segment(RationalFrameRate(30000, 1001), uiFrames, JITTER, 0.0));
+  bOk &= reportEngine("skip, 29.97 fps", FSKIP_SKIP_X_FRAMES_EVERY_Y, vSteady, SETTLE);
+  bOk &= reportEngine("rational, 29.97 fps", FSKIP_RATIONAL_DECIMATION, vSteady, SETTLE);
+  std::vector<TraceSegment> vEngineSwitch;
+  vEngineSwitch.push_back(segment(RationalFrameRate(60), uiFrames / 2, JITTER / 4, 0.0));
+  vEngineSwitch.push_back(segment(RationalFrameRate(30), uiFrames / 2, JITTER, 0.0));
+  bOk &= reportEngine("skip, 60 then 30 fps", FSKIP_SKIP_X_FRAMES_EVERY_Y, vEngineSwitch, 2 * FSKIP_RATE_WINDOW);
+  bOk &= reportEngine("rational, 60 then 30 fps", FSKIP_RATIONAL_DECIMATION, vEngineSwitch, 2 * FSKIP_RATE_WINDOW);
+
+  if (!bOk)
+  {
+    std::printf("FAILED: an estimate is wrong, changed too often or settled too late\n");
+    return 1;
+  }
+  return 0;
+}
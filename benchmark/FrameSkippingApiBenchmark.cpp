@@ -0,0 +1,385 @@
+/** @file
+
+MODULE                : FrameSkippingApiBenchmark
+
+FILE NAME             : FrameSkippingApiBenchmark.cpp
+
+DESCRIPTION           : Checks that the C interface of libframeskipping decides like the engine, that deciding does not
+                        allocate memory and measures the decision rate of several streams on separate threads.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingApi.h"
+#include "FrameSkippingEngine.h"
+#include "VersionInfo.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+// counts the allocations of the whole process: the library resolves operator new to this replacement
+static std::atomic<uint64_t> g_uiAllocations(0);
+
+void* operator new(size_t uiSize)
+{
+  g_uiAllocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(uiSize > 0 ? uiSize : 1);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+// FrameSkippingApiC.c
+extern "C" int runCApiSmokeTest(void);
+
+namespace
+{
+
+const int64_t TICKS_PER_SECOND = 10000000;
+const int WIDTH = 320, HEIGHT = 180;
+
+/// one mode of the C interface and the engine settings it is expected to map to
+struct ModeCase
+{
+  const char* Name;
+  FrameSkippingSettings Settings;
+  FrameSkippingConfig Config;
+};
+
+ModeCase makeCase(const char* szName, unsigned uiMode, double dSourceFrameRate, double dTargetFrameRate)
+{
+  ModeCase modeCase;
+  modeCase.Name = szName;
+  fskip_init_settings(&modeCase.Settings);
+  modeCase.Settings.Mode = uiMode;
+  modeCase.Settings.SourceFrameRate = dSourceFrameRate;
+  modeCase.Settings.TargetFrameRate = dTargetFrameRate;
+  modeCase.Config.Mode = uiMode;
+  modeCase.Config.SourceFrameRate = dSourceFrameRate;
+  modeCase.Config.TargetFrameRate = dTargetFrameRate;
+  modeCase.Config.RationalSourceFrameRate = RationalFrameRate::fromDouble(dSourceFrameRate);
+  modeCase.Config.RationalTargetFrameRate = RationalFrameRate::fromDouble(dTargetFrameRate);
+  return modeCase;
+}
+
+std::vector<ModeCase> makeCases()
+{
+  std::vector<ModeCase> vCases;
+  vCases.push_back(makeCase("skip", FSKIP_MODE_SKIP_X_FRAMES_EVERY_Y, 60.0, 20.0));
+  vCases.push_back(makeCase("target", FSKIP_MODE_ACHIEVE_TARGET_RATE, 60.0, 24.0));
+
+  ModeCase rational = makeCase("rational", FSKIP_MODE_RATIONAL_DECIMATION, 0.0, 0.0);
+  rational.Settings.SourceFrameRateNum = 60000;
+  rational.Settings.SourceFrameRateDen = 1001;
+  rational.Settings.TargetFrameRateNum = 24000;
+  rational.Settings.TargetFrameRateDen = 1001;
+  rational.Config.RationalSourceFrameRate = RationalFrameRate(60000, 1001);
+  rational.Config.RationalTargetFrameRate = RationalFrameRate(24000, 1001);
+  vCases.push_back(rational);
+
+  ModeCase duplicates = makeCase("duplicates", FSKIP_MODE_DROP_DUPLICATES, 60.0, 0.0);
+  duplicates.Settings.MaxDuplicateInterval = TICKS_PER_SECOND / 10;
+  duplicates.Config.MaxDuplicateInterval = TICKS_PER_SECOND / 10;
+  vCases.push_back(duplicates);
+
+  ModeCase layers = makeCase("layers", FSKIP_MODE_TEMPORAL_LAYERS, 60.0, 0.0);
+  layers.Settings.TemporalLayers = layers.Config.TemporalLayers = 4;
+  layers.Settings.MaxTemporalLayer = layers.Config.MaxTemporalLayer = 1;
+  vCases.push_back(layers);
+
+  ModeCase bucket = makeCase("bucket", FSKIP_MODE_TOKEN_BUCKET, 60.0, 25.0);
+  bucket.Settings.BurstDuration = bucket.Config.BurstDuration = TICKS_PER_SECOND / 2;
+  vCases.push_back(bucket);
+
+  ModeCase bitrate = makeCase("bitrate", FSKIP_MODE_BITRATE_BUDGET, 60.0, 0.0);
+  bitrate.Settings.MaxBitrate = bitrate.Config.MaxBitrate = 2000000;
+  vCases.push_back(bitrate);
+
+  ModeCase estimated = makeCase("estimated", FSKIP_MODE_ACHIEVE_TARGET_RATE, 30.0, 24.0);
+  estimated.Settings.EstimateSourceRate = 1;
+  estimated.Config.EstimateSourceRate = true;
+  vCases.push_back(estimated);
+  return vCases;
+}
+
+/// the start time of a frame at 60 fps with up to 2 ms of jitter and a stall every 1000 frames
+int64_t frameTime(uint64_t uiFrame)
+{
+  uint32_t uiHash = static_cast<uint32_t>(uiFrame * 2654435761u);
+  int64_t iJitter = static_cast<int64_t>(uiHash % 40000) - 20000;
+  int64_t tStart = static_cast<int64_t>(uiFrame * TICKS_PER_SECOND / 60) + (uiFrame > 0 ? iJitter : 0);
+  return tStart + static_cast<int64_t>(uiFrame / 1000) * TICKS_PER_SECOND / 4;
+}
+
+/// a payload size between 2 and 10 KB with a large frame every 30 frames
+uint32_t frameBytes(uint64_t uiFrame)
+{
+  return uiFrame % 30 == 0 ? 40000 : 2000 + static_cast<uint32_t>((uiFrame * 7919) % 8000);
+}
+
+/// an I420 luma plane that changes every third frame
+void fillFrame(std::vector<uint8_t>& vFrame, uint64_t uiFrame)
+{
+  uint8_t uiShift = static_cast<uint8_t>((uiFrame / 3) * 11);
+  for (int y = 0; y < HEIGHT; ++y)
+  {
+    for (int x = 0; x < WIDTH; ++x)
+      vFrame[static_cast<size_t>(y) * WIDTH + x] = static_cast<uint8_t>((x * 2 + y) + uiShift);
+  }
+}
+
+/**
+ * @brief runs the same frames through the C interface and through an engine configured directly.
+ * @return false if a decision, a temporal layer or the statistics differ or deciding allocates memory
+ */
+bool checkMode(const ModeCase& modeCase, size_t uiFrames)
+{
+  FrameSkipper* pSkipper = fskip_create();
+  if (pSkipper == NULL || fskip_configure(pSkipper, &modeCase.Settings) != FSKIP_OK)
+  {
+    std::printf("%-12s could not be configured\n", modeCase.Name);
+    fskip_destroy(pSkipper);
+    return false;
+  }
+  FrameSkippingEngine engine;
+  engine.applyConfig(modeCase.Config);
+
+  std::vector<uint8_t> vFrame(static_cast<size_t>(WIDTH) * HEIGHT * 3 / 2);
+  FrameSkippingPicture picture = { &vFrame[0], WIDTH, HEIGHT, WIDTH, FSKIP_FORMAT_I420 };
+  FramePicture enginePicture;
+  enginePicture.Data = &vFrame[0];
+  enginePicture.Width = WIDTH;
+  enginePicture.Height = HEIGHT;
+  enginePicture.Stride = WIDTH;
+  enginePicture.Format = FSKIP_PIXEL_FORMAT_I420;
+
+  size_t uiMismatches = 0, uiKept = 0;
+  uint64_t uiAllocations = 0;
+  for (size_t uiFrame = 0; uiFrame < uiFrames; ++uiFrame)
+  {
+    int64_t tStart = frameTime(uiFrame);
+    uint32_t uiBytes = frameBytes(uiFrame);
+    fillFrame(vFrame, uiFrame);
+    // the first decision applies the settings and the first two size the signatures of the current and the kept frame
+    uint64_t uiBefore = g_uiAllocations.load(std::memory_order_relaxed);
+    int iKeep = fskip_decide(pSkipper, tStart, &picture, uiBytes, 0);
+    if (uiFrame > 1)
+      uiAllocations += g_uiAllocations.load(std::memory_order_relaxed) - uiBefore;
+    bool bExpected = engine.keepFrame(tStart, &enginePicture, true, uiBytes);
+    uiMismatches += (iKeep == 1) != bExpected || (bExpected && fskip_get_temporal_layer(pSkipper) != engine.getLastTemporalLayer()) ? 1 : 0;
+    uiKept += iKeep == 1 ? 1 : 0;
+  }
+
+  FrameSkippingStatsSnapshot stats;
+  bool bStats = fskip_get_stats(pSkipper, &stats) == FSKIP_OK && stats.FramesIn == uiFrames && stats.FramesOut == uiKept;
+  fskip_reset(pSkipper);
+  bStats &= fskip_get_stats(pSkipper, &stats) == FSKIP_OK && stats.FramesIn == 0;
+  fskip_destroy(pSkipper);
+
+  std::printf("%-12s %10zu %10zu %12zu %12llu %8s\n", modeCase.Name, uiFrames, uiKept, uiMismatches,
+    static_cast<unsigned long long>(uiAllocations), bStats ? "ok" : "wrong");
+  return uiMismatches == 0 && uiAllocations == 0 && bStats;
+}
+
+/// the settings that fskip_configure must refuse
+bool checkInvalidSettings()
+{
+  FrameSkipper* pSkipper = fskip_create();
+  FrameSkippingSettings settings;
+  bool bOk = fskip_configure(NULL, NULL) == FSKIP_E_INVALID_ARGUMENT && fskip_configure(pSkipper, NULL) == FSKIP_E_INVALID_ARGUMENT;
+
+  fskip_init_settings(&settings);
+  settings.Mode = FSKIP_MODE_BITRATE_BUDGET + 1;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_init_settings(&settings);
+  settings.TargetFrameRateNum = 30;
+  settings.TargetFrameRateDen = 0;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_init_settings(&settings);
+  settings.TemporalLayers = FSKIP_MAX_TEMPORAL_LAYERS + 1;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_init_settings(&settings);
+  settings.TargetFrameRate = std::nan("");
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_init_settings(&settings);
+  settings.BurstDuration = -1;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_init_settings(&settings);
+  settings.BitrateWindow = -1;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_init_settings(&settings);
+  settings.MaxDuplicateInterval = -1;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_init_settings(&settings);
+  settings.Size = 4;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_E_INVALID_ARGUMENT;
+
+  // a caller built against an older header that ends before the exact rates: the rest keeps the defaults
+  fskip_init_settings(&settings);
+  settings.Size = offsetof(FrameSkippingSettings, SourceFrameRateNum);
+  settings.SourceFrameRate = 30.0;
+  settings.TargetFrameRate = 15.0;
+  settings.TemporalLayers = 0;
+  bOk &= fskip_configure(pSkipper, &settings) == FSKIP_OK;
+  int iKept = 0;
+  for (int i = 0; i < 30; ++i)
+    iKept += fskip_decide(pSkipper, i * TICKS_PER_SECOND / 30, NULL, 0, 0);
+  bOk &= iKept == 15;
+
+  // reference frames are never dropped
+  iKept = 0;
+  for (int i = 30; i < 60; ++i)
+    iKept += fskip_decide(pSkipper, i * TICKS_PER_SECOND / 30, NULL, 0, FSKIP_FRAME_REFERENCE);
+  bOk &= iKept == 30;
+  bOk &= fskip_decide(NULL, 0, NULL, 0, 0) == FSKIP_E_INVALID_ARGUMENT;
+  fskip_destroy(pSkipper);
+  std::printf("invalid settings and older callers: %s\n", bOk ? "ok" : "wrong");
+  return bOk;
+}
+
+/**
+ * @brief decides uiFrames frames on each of uiThreads streams, each on its own thread, while the settings of the
+ * first stream are changed from another thread.
+ * @return the decisions per second of all threads together, a negative value if a stream decided wrongly
+ */
+double measureThreads(unsigned uiThreads, size_t uiFrames)
+{
+  std::vector<FrameSkipper*> vSkippers(uiThreads);
+  FrameSkippingSettings settings;
+  fskip_init_settings(&settings);
+  settings.Mode = FSKIP_MODE_ACHIEVE_TARGET_RATE;
+  settings.SourceFrameRate = 60.0;
+  settings.TargetFrameRate = 30.0;
+  for (unsigned i = 0; i < uiThreads; ++i)
+  {
+    vSkippers[i] = fskip_create();
+    fskip_configure(vSkippers[i], &settings);
+  }
+
+  std::atomic<bool> bStop(false);
+  std::thread configurator([&]()
+  {
+    FrameSkippingSettings alternate = settings;
+    for (unsigned uiRound = 0; !bStop.load(std::memory_order_relaxed); ++uiRound)
+    {
+      alternate.TargetFrameRate = uiRound % 2 == 0 ? 20.0 : 30.0;
+      fskip_configure(vSkippers[0], &alternate);
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+
+  std::vector<size_t> vKept(uiThreads);
+  std::vector<std::thread> vThreads;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < uiThreads; ++i)
+  {
+    vThreads.push_back(std::thread([&, i]()
+    {
+      size_t uiKept = 0;
+      for (size_t uiFrame = 0; uiFrame < uiFrames; ++uiFrame)
+        uiKept += fskip_decide(vSkippers[i], static_cast<int64_t>(uiFrame * TICKS_PER_SECOND / 60), NULL, 0, 0) == 1 ? 1 : 0;
+      vKept[i] = uiKept;
+    }));
+  }
+  for (size_t i = 0; i < vThreads.size(); ++i)
+    vThreads[i].join();
+  auto stop = std::chrono::steady_clock::now();
+  bStop.store(true);
+  configurator.join();
+
+  // the streams that were not reconfigured keep every second frame
+  bool bOk = true;
+  for (unsigned i = 1; i < uiThreads; ++i)
+    bOk &= vKept[i] == uiFrames / 2;
+  bOk &= vKept[0] >= uiFrames / 3 - 2 && vKept[0] <= uiFrames / 2 + 2;
+  for (unsigned i = 0; i < uiThreads; ++i)
+    fskip_destroy(vSkippers[i]);
+
+  double dSeconds = std::chrono::duration<double>(stop - start).count();
+  return bOk ? uiThreads * uiFrames / dSeconds : -1.0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t uiFrames = argc > 1 ? static_cast<size_t>(std::strtoul(argv[1], NULL, 10)) : 1000000;
+
+  uint32_t uiMajor = 0, uiMinor = 0, uiBuild = 0;
+  fskip_get_version(&uiMajor, &uiMinor, &uiBuild);
+  std::printf("libframeskipping %u.%u.%u\n", uiMajor, uiMinor, uiBuild);
+  bool bOk = uiMajor == MAJOR_VERSION && uiMinor == MINOR_VERSION;
+
+  std::printf("\n%-12s %10s %10s %12s %12s %8s\n", "mode", "frames", "kept", "mismatches", "allocations", "stats");
+  std::vector<ModeCase> vCases = makeCases();
+  for (size_t i = 0; i < vCases.size(); ++i)
+  {
+    // the pictures dominate the duplicate elimination mode
+    bOk &= checkMode(vCases[i], vCases[i].Settings.Mode == FSKIP_MODE_DROP_DUPLICATES ? uiFrames / 100 : uiFrames / 10);
+  }
+  std::printf("\n");
+  bOk &= checkInvalidSettings();
+  bool bC = runCApiSmokeTest() == 0;
+  std::printf("C caller: %s\n", bC ? "ok" : "wrong");
+  bOk &= bC;
+
+  std::printf("\n%8s %16s %20s\n", "threads", "decisions/s", "per thread");
+  unsigned uiMaxThreads = std::max(4u, std::thread::hardware_concurrency());
+  for (unsigned uiThreads = 1; uiThreads <= uiMaxThreads; uiThreads *= 2)
+  {
+    double dRate = measureThreads(uiThreads, uiFrames);
+    if (dRate < 0.0)
+    {
+      std::printf("%8u wrong decisions\n", uiThreads);
+      bOk = false;
+      continue;
+    }
+    std::printf("%8u %16.0f %20.0f\n", uiThreads, dRate, dRate / uiThreads);
+  }
+
+  if (!bOk)
+  {
+    std::printf("FAILED: the C interface differs from the engine, allocates while deciding or accepts invalid settings\n");
+    return 1;
+  }
+  return 0;
+}
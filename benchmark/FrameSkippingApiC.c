@@ -0,0 +1,61 @@
+/** @file
+
+MODULE                : FrameSkippingApiBenchmark
+
+FILE NAME             : FrameSkippingApiC.c
+
+DESCRIPTION           : Compiles the C interface of libframeskipping as C and runs one stream through it.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingApi.h"
+#include <stddef.h>
+
+/* halves a 30 fps stream and checks the statistics: returns 0 on success */
+int runCApiSmokeTest(void)
+{
+  FrameSkippingSettings settings;
+  FrameSkippingStatsSnapshot stats;
+  FrameSkipper* pSkipper = fskip_create();
+  int iKept = 0;
+  int i;
+  int iResult = 0;
+
+  if (pSkipper == NULL)
+    return 1;
+  fskip_init_settings(&settings);
+  settings.Mode = FSKIP_MODE_SKIP_X_FRAMES_EVERY_Y;
+  settings.SourceFrameRate = 30.0;
+  settings.TargetFrameRate = 15.0;
+  if (fskip_configure(pSkipper, &settings) != FSKIP_OK)
+    iResult = 1;
+  for (i = 0; i < 30 && iResult == 0; ++i)
+    iKept += fskip_decide(pSkipper, (int64_t)i * 10000000 / 30, NULL, 0, 0);
+  if (iKept != 15 || fskip_get_stats(pSkipper, &stats) != FSKIP_OK || stats.FramesIn != 30 || stats.FramesOut != 15)
+    iResult = 1;
+  fskip_destroy(pSkipper);
+  return iResult;
+}
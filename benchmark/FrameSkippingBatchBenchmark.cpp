@@ -0,0 +1,323 @@
+/** @file
+
+MODULE                : FrameSkippingBatchBenchmark
+
+FILE NAME             : FrameSkippingBatchBenchmark.cpp
+
+DESCRIPTION           : Compares the batch engine with one FrameSkippingEngine per stream for thousands of
+                        streams. Verifies that both make the same decisions and reports decisions per second
+                        and, where the kernel allows it, hardware cache misses.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingBatchEngine.h"
+#include "FrameSkippingEngine.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+struct StreamConfig
+{
+  unsigned uiMode;
+  RationalFrameRate source;
+  RationalFrameRate target;
+};
+
+const StreamConfig CONFIGS[] =
+{
+  { FSKIP_SKIP_X_FRAMES_EVERY_Y, RationalFrameRate(30, 1), RationalFrameRate(10, 1) },
+  { FSKIP_RATIONAL_DECIMATION, RationalFrameRate(30000, 1001), RationalFrameRate(15, 1) },
+  { FSKIP_ACHIEVE_TARGET_RATE, RationalFrameRate(25, 1), RationalFrameRate(10, 1) },
+  { FSKIP_RATIONAL_DECIMATION, RationalFrameRate(60, 1), RationalFrameRate(24, 1) },
+  { FSKIP_SKIP_X_FRAMES_EVERY_Y, RationalFrameRate(25, 1), RationalFrameRate(15, 1) },
+  { FSKIP_RATIONAL_DECIMATION, RationalFrameRate(25, 1), RationalFrameRate(5, 1) },
+  { FSKIP_ACHIEVE_TARGET_RATE, RationalFrameRate(60000, 1001), RationalFrameRate(24000, 1001) },
+  { FSKIP_RATIONAL_DECIMATION, RationalFrameRate(30, 1), RationalFrameRate(29, 1) },
+};
+const size_t CONFIG_COUNT = sizeof(CONFIGS) / sizeof(CONFIGS[0]);
+
+/// counts hardware cache misses of the calling thread. Reports nothing if perf events are not available.
+class CacheMissCounter
+{
+public:
+
+  CacheMissCounter()
+  {
+#if defined(__linux__)
+    m_aFds[0] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    m_aFds[1] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+  }
+
+  ~CacheMissCounter()
+  {
+#if defined(__linux__)
+    for (int i = 0; i < 2; ++i)
+      if (m_aFds[i] >= 0)
+        close(m_aFds[i]);
+#endif
+  }
+
+  bool isAvailable() const
+  {
+#if defined(__linux__)
+    return m_aFds[0] >= 0 || m_aFds[1] >= 0;
+#else
+    return false;
+#endif
+  }
+
+  void start()
+  {
+#if defined(__linux__)
+    for (int i = 0; i < 2; ++i)
+    {
+      if (m_aFds[i] < 0)
+        continue;
+      ioctl(m_aFds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(m_aFds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  /// stops counting and returns the last level and L1 data cache misses, -1 if a counter is not available
+  void stop(long long& llLastLevel, long long& llL1)
+  {
+    llLastLevel = llL1 = -1;
+#if defined(__linux__)
+    long long* aResults[2] = { &llLastLevel, &llL1 };
+    for (int i = 0; i < 2; ++i)
+    {
+      if (m_aFds[i] < 0)
+        continue;
+      ioctl(m_aFds[i], PERF_EVENT_IOC_DISABLE, 0);
+      long long llValue = 0;
+      if (read(m_aFds[i], &llValue, sizeof(llValue)) == sizeof(llValue))
+        *aResults[i] = llValue;
+    }
+#endif
+  }
+
+private:
+
+#if defined(__linux__)
+  static int open(uint32_t uiType, uint64_t uiConfig)
+  {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = uiType;
+    attr.config = uiConfig;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+  int m_aFds[2];
+#endif
+};
+
+/// start times of every frame of every stream: index round * streams + stream
+std::vector<int64_t> generateTimestamps(size_t uiStreams, size_t uiRounds)
+{
+  std::vector<int64_t> vStarts(uiStreams * uiRounds);
+  for (size_t uiStream = 0; uiStream < uiStreams; ++uiStream)
+  {
+    FrameDuration duration(CONFIGS[uiStream % CONFIG_COUNT].source);
+    FrameTimeline time;
+    // streams do not start in phase
+    time.set(static_cast<int64_t>(uiStream) * 997);
+    for (size_t uiRound = 0; uiRound < uiRounds; ++uiRound)
+    {
+      vStarts[uiRound * uiStreams + uiStream] = time.getTime();
+      time.advance(duration, 1);
+    }
+  }
+  return vStarts;
+}
+
+/// one round in which every stream delivers one frame, in random order
+std::vector<FrameBatchEntry> generateArrivalOrder(size_t uiStreams, size_t uiRounds, const std::vector<int64_t>& vStarts)
+{
+  std::vector<FrameBatchEntry> vEntries(uiStreams * uiRounds);
+  uint32_t uiState = 12345;
+  for (size_t uiRound = 0; uiRound < uiRounds; ++uiRound)
+  {
+    FrameBatchEntry* pRound = &vEntries[uiRound * uiStreams];
+    for (size_t i = 0; i < uiStreams; ++i)
+      pRound[i].StreamId = static_cast<uint32_t>(i);
+    for (size_t i = uiStreams - 1; i > 0; --i)
+    {
+      uiState = uiState * 1664525u + 1013904223u;
+      std::swap(pRound[i], pRound[(uiState >> 8) % (i + 1)]);
+    }
+    for (size_t i = 0; i < uiStreams; ++i)
+      pRound[i].Start = vStarts[uiRound * uiStreams + pRound[i].StreamId];
+  }
+  return vEntries;
+}
+
+void report(const char* szName, size_t uiDecisions, unsigned uiRepetitions, const std::function<void()>& run, CacheMissCounter& counter)
+{
+  double dBest = 0.0;
+  long long llLastLevel = -1, llL1 = -1;
+  for (unsigned uiRep = 0; uiRep < uiRepetitions; ++uiRep)
+  {
+    counter.start();
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto stop = std::chrono::steady_clock::now();
+    long long llRunLastLevel = -1, llRunL1 = -1;
+    counter.stop(llRunLastLevel, llRunL1);
+    double dSeconds = std::chrono::duration<double>(stop - start).count();
+    if (uiRep == 0 || dSeconds < dBest)
+    {
+      dBest = dSeconds;
+      llLastLevel = llRunLastLevel;
+      llL1 = llRunL1;
+    }
+  }
+  std::printf("%-28s %10.3f %14.0f", szName, dBest * 1e9 / uiDecisions, uiDecisions / dBest);
+  if (llL1 >= 0)
+    std::printf(" %12.4f", llL1 / static_cast<double>(uiDecisions));
+  else
+    std::printf(" %12s", "n/a");
+  if (llLastLevel >= 0)
+    std::printf(" %12.4f", llLastLevel / static_cast<double>(uiDecisions));
+  else
+    std::printf(" %12s", "n/a");
+  std::printf("\n");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t uiStreams = 10000;
+  size_t uiRounds = 300;
+  unsigned uiRepetitions = 5;
+  if (argc > 1) uiStreams = std::strtoul(argv[1], NULL, 10);
+  if (argc > 2) uiRounds = std::strtoul(argv[2], NULL, 10);
+  if (argc > 3) uiRepetitions = std::strtoul(argv[3], NULL, 10);
+  if (uiStreams == 0 || uiRounds == 0 || uiRepetitions == 0)
+  {
+    std::fprintf(stderr, "Usage: %s [streams] [frames per stream] [repetitions]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<int64_t> vStarts = generateTimestamps(uiStreams, uiRounds);
+  std::vector<FrameBatchEntry> vEntries = generateArrivalOrder(uiStreams, uiRounds, vStarts);
+  const size_t uiDecisions = uiStreams * uiRounds;
+
+  // one heap allocated engine per stream as with one filter instance per stream
+  std::vector<std::unique_ptr<FrameSkippingEngine> > vEngines(uiStreams);
+  FrameSkippingBatchEngine batch(uiStreams);
+  for (size_t i = 0; i < uiStreams; ++i)
+  {
+    const StreamConfig& config = CONFIGS[i % CONFIG_COUNT];
+    vEngines[i].reset(new FrameSkippingEngine());
+    vEngines[i]->setMode(config.uiMode);
+    vEngines[i]->setSourceFrameRate(config.source.toDouble());
+    vEngines[i]->setTargetFrameRate(config.target.toDouble());
+    vEngines[i]->setRationalFrameRates(config.source, config.target);
+    vEngines[i]->buildPattern();
+    batch.configureStream(static_cast<uint32_t>(i), config.uiMode, config.source, config.target);
+  }
+
+  // both engines must make the same decisions
+  std::vector<uint8_t> vExpected(uiDecisions), vKeep(uiDecisions), vKeepArrival(uiDecisions);
+  for (size_t uiRound = 0; uiRound < uiRounds; ++uiRound)
+  {
+    for (size_t i = 0; i < uiStreams; ++i)
+      vExpected[uiRound * uiStreams + i] = vEngines[i]->keepFrame(vStarts[uiRound * uiStreams + i]) ? 1 : 0;
+    batch.decideAll(&vStarts[uiRound * uiStreams], &vKeep[uiRound * uiStreams]);
+  }
+  batch.reset();
+  batch.decide(&vEntries[0], uiDecisions, &vKeepArrival[0]);
+  size_t uiMismatches = 0;
+  for (size_t i = 0; i < uiDecisions; ++i)
+  {
+    size_t uiRound = i / uiStreams;
+    size_t uiExpected = uiRound * uiStreams + vEntries[i].StreamId;
+    if (vKeep[i] != vExpected[i] || vKeepArrival[i] != vExpected[uiExpected])
+      ++uiMismatches;
+  }
+  if (uiMismatches > 0)
+  {
+    std::printf("MISMATCH: %zu of %zu decisions differ from FrameSkippingEngine\n", uiMismatches, uiDecisions);
+    return 1;
+  }
+
+  CacheMissCounter counter;
+  std::printf("%zu streams, %zu frames per stream, best of %u runs\n", uiStreams, uiRounds, uiRepetitions);
+  std::printf("state per stream: %zu bytes per engine object\n", sizeof(FrameSkippingEngine));
+  if (!counter.isAvailable())
+    std::printf("hardware cache counters are not available (perf_event_open failed), cache misses are not reported\n");
+  std::printf("%-28s %10s %14s %12s %12s\n", "engine", "ns/dec", "decisions/s", "L1D miss/dec", "LLC miss/dec");
+
+  report("object per stream", uiDecisions, uiRepetitions, [&]()
+  {
+    for (size_t i = 0; i < uiStreams; ++i)
+      vEngines[i]->reset();
+    for (size_t uiRound = 0; uiRound < uiRounds; ++uiRound)
+    {
+      const int64_t* pStarts = &vStarts[uiRound * uiStreams];
+      uint8_t* pKeep = &vKeep[uiRound * uiStreams];
+      for (size_t i = 0; i < uiStreams; ++i)
+        pKeep[i] = vEngines[i]->keepFrame(pStarts[i]) ? 1 : 0;
+    }
+  }, counter);
+
+  report("batch, all streams", uiDecisions, uiRepetitions, [&]()
+  {
+    batch.reset();
+    for (size_t uiRound = 0; uiRound < uiRounds; ++uiRound)
+      batch.decideAll(&vStarts[uiRound * uiStreams], &vKeep[uiRound * uiStreams]);
+  }, counter);
+
+  report("batch, arrival order", uiDecisions, uiRepetitions, [&]()
+  {
+    batch.reset();
+    batch.decide(&vEntries[0], uiDecisions, &vKeep[0]);
+  }, counter);
+  return 0;
+}
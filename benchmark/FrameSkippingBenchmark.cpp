@@ -0,0 +1,1018 @@
+/** @file
+
+MODULE                : FrameSkippingBenchmark
+
+FILE NAME             : FrameSkippingBenchmark.cpp
+
+DESCRIPTION           : Micro-benchmarks for the frame skipping decision hot path. Reports the cost per
+                        decision for every mode and for a set of source/target frame rate pairs.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "ConfigSnapshot.h"
+#include "FrameSkippingEngine.h"
+#include "FrameSkippingStatistics.h"
+#include "OutputPacer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct RatePair
+{
+  double dSourceFrameRate;
+  double dTargetFrameRate;
+};
+
+const RatePair RATE_PAIRS[] =
+{
+  { 30.0, 15.0 },
+  { 30.0, 10.0 },
+  { 25.0, 10.0 },
+  { 60.0, 24.0 },
+  { 30.0, 29.0 },
+  { 29.97, 15.0 },
+  { 59.94, 23.976 },
+};
+
+struct Mode
+{
+  unsigned uiMode;
+  const char* szName;
+};
+
+const Mode MODES[] =
+{
+  { FSKIP_SKIP_X_FRAMES_EVERY_Y, "skip-x-every-y" },
+  { FSKIP_ACHIEVE_TARGET_RATE, "target-rate" },
+  { FSKIP_RATIONAL_DECIMATION, "rational" },
+  { FSKIP_TOKEN_BUCKET, "token-bucket" },
+};
+
+/// generates uniformly spaced start times at the source frame rate
+std::vector<int64_t> generateTimestamps(double dSourceFrameRate, size_t uiFrames)
+{
+  std::vector<int64_t> vTimestamps(uiFrames);
+  for (size_t i = 0; i < uiFrames; ++i)
+  {
+    vTimestamps[i] = static_cast<int64_t>(i * TIMESTAMP_FACTOR / dSourceFrameRate);
+  }
+  return vTimestamps;
+}
+
+void runBenchmark(const Mode& mode, const RatePair& rates, const std::vector<int64_t>& vTimestamps, unsigned uiRepetitions)
+{
+  FrameSkippingEngine engine;
+  engine.setMode(mode.uiMode);
+  engine.setSourceFrameRate(rates.dSourceFrameRate);
+  engine.setTargetFrameRate(rates.dTargetFrameRate);
+  engine.setRationalFrameRates(RationalFrameRate::fromDouble(rates.dSourceFrameRate), RationalFrameRate::fromDouble(rates.dTargetFrameRate));
+
+  uint64_t uiKept = 0;
+  double dBest = 0.0;
+  for (unsigned uiRep = 0; uiRep < uiRepetitions; ++uiRep)
+  {
+    engine.buildPattern();
+    engine.reset();
+    uint64_t uiKeptThisRun = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < vTimestamps.size(); ++i)
+    {
+      uiKeptThisRun += engine.keepFrame(vTimestamps[i]) ? 1 : 0;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double dSeconds = std::chrono::duration<double>(stop - start).count();
+    if (uiRep == 0 || dSeconds < dBest)
+      dBest = dSeconds;
+    uiKept = uiKeptThisRun;
+  }
+
+  // the rate announced in the output media type for an input type at the source rate
+  FrameSkippingConfig config;
+  config.Mode = mode.uiMode;
+  config.SourceFrameRate = rates.dSourceFrameRate;
+  config.TargetFrameRate = rates.dTargetFrameRate;
+  config.RationalSourceFrameRate = RationalFrameRate::fromDouble(rates.dSourceFrameRate);
+  config.RationalTargetFrameRate = RationalFrameRate::fromDouble(rates.dTargetFrameRate);
+  config.Pattern = SkipPatternCache::getInstance().getPattern(rates.dSourceFrameRate, rates.dTargetFrameRate);
+  int64_t iSourceDuration = static_cast<int64_t>(TIMESTAMP_FACTOR / rates.dSourceFrameRate + 0.5);
+  int64_t iOutputDuration = FrameSkippingEngine::getOutputFrameDuration(config, iSourceDuration);
+
+  double dNsPerDecision = dBest * 1e9 / vTimestamps.size();
+  double dDecisionsPerSecond = vTimestamps.size() / dBest;
+  double dStreamSeconds = vTimestamps.size() / rates.dSourceFrameRate;
+  std::printf("%-16s %8.3f -> %-8.3f %10.3f %14.0f %12.3f %10.3f\n",
+    mode.szName, rates.dSourceFrameRate, rates.dTargetFrameRate,
+    dNsPerDecision, dDecisionsPerSecond, uiKept / dStreamSeconds, TIMESTAMP_FACTOR / iOutputDuration);
+}
+
+/// a stream clock that runs behind or ahead of the frames by a programmable offset
+class FakeClock : public FrameSkippingClock
+{
+public:
+
+  FakeClock()
+    :m_tNow(0)
+  {
+
+  }
+
+  void setStreamTime(int64_t tNow)
+  {
+    m_tNow = tNow;
+  }
+
+  virtual bool getStreamTime(int64_t& tNow)
+  {
+    tNow = m_tNow;
+    return true;
+  }
+
+private:
+
+  int64_t m_tNow;
+};
+
+/**
+ * @brief measures the cost of the lateness check. The fake clock simulates a pipeline that falls
+ * behind by up to 200 ms and catches up again in a saw-tooth pattern.
+ */
+void runLatenessBenchmark(const std::vector<int64_t>& vTimestamps, int64_t iMaxLatenessTicks)
+{
+  FakeClock clock;
+  FrameSkippingEngine engine;
+  engine.setMode(FSKIP_RATIONAL_DECIMATION);
+  engine.setRationalFrameRates(RationalFrameRate(30, 1), RationalFrameRate(15, 1));
+  engine.setClock(&clock);
+  engine.setMaxLateness(iMaxLatenessTicks);
+
+  const int64_t iMaxLag = 2000000;
+  uint64_t uiKept = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < vTimestamps.size(); ++i)
+  {
+    clock.setStreamTime(vTimestamps[i] + static_cast<int64_t>(i % 64) * (iMaxLag / 64));
+    uiKept += engine.keepFrame(vTimestamps[i]) ? 1 : 0;
+  }
+  auto stop = std::chrono::steady_clock::now();
+  double dSeconds = std::chrono::duration<double>(stop - start).count();
+  std::printf("max lateness %6.1f ms: %8.3f ns/dec, kept %5.2f%% of frames\n",
+    iMaxLatenessTicks / 10000.0, dSeconds * 1e9 / vTimestamps.size(), 100.0 * uiKept / vTimestamps.size());
+}
+
+/**
+ * @brief a renderer that can only present a limited number of frames per second. Frames queue up behind
+ * each other and the renderer reports its lateness and the rate it can sustain like a DirectShow renderer.
+ */
+class SimulatedRenderer
+{
+public:
+
+  SimulatedRenderer()
+    :m_dCapacity(0.0),
+    m_tBusyUntil(0),
+    m_iLate(0),
+    m_uiWindowFrames(0),
+    m_tWindowStart(-1)
+  {
+
+  }
+
+  void setCapacity(double dFramesPerSecond)
+  {
+    m_dCapacity = dFramesPerSecond;
+  }
+
+  void render(int64_t tStart)
+  {
+    if (m_tWindowStart < 0)
+      m_tWindowStart = tStart;
+    int64_t tPresent = std::max(tStart, m_tBusyUntil);
+    m_tBusyUntil = tPresent + static_cast<int64_t>(TIMESTAMP_FACTOR / m_dCapacity);
+    m_iLate = tPresent - tStart;
+    ++m_uiWindowFrames;
+  }
+
+  /// returns true and a quality message every iInterval ticks
+  bool getQuality(int64_t tNow, int64_t iInterval, int64_t& iLate, long& lProportion)
+  {
+    if (m_uiWindowFrames == 0 || m_tWindowStart < 0 || tNow - m_tWindowStart < iInterval)
+      return false;
+    double dRate = m_uiWindowFrames * TIMESTAMP_FACTOR / (tNow - m_tWindowStart);
+    lProportion = static_cast<long>(1000.0 * m_dCapacity / dRate);
+    iLate = m_iLate;
+    m_uiWindowFrames = 0;
+    m_tWindowStart = tNow;
+    return true;
+  }
+
+  int64_t getLate() const
+  {
+    return m_iLate;
+  }
+
+private:
+
+  double m_dCapacity;
+  int64_t m_tBusyUntil;
+  int64_t m_iLate;
+  unsigned m_uiWindowFrames;
+  int64_t m_tWindowStart;
+};
+
+/**
+ * @brief replays the quality messages of a renderer whose capacity drops and recovers and prints how the
+ * output rate chosen by quality control follows it.
+ */
+void runQualityControlSimulation()
+{
+  const RationalFrameRate source(60, 1);
+  FrameSkippingEngine engine;
+  engine.setMode(FSKIP_RATIONAL_DECIMATION);
+  engine.setRationalFrameRates(source, source);
+  engine.setQualityControl(true);
+  engine.setQualityLimits(5.0, 60.0);
+
+  SimulatedRenderer renderer;
+  FrameDuration duration(source);
+  FrameTimeline time;
+  const int64_t iSecond = TIMESTAMP_TICKS_PER_SECOND;
+  const int64_t iQualityInterval = iSecond / 4;
+  unsigned uiKept = 0;
+  unsigned uiMessages = 0;
+  std::printf("%6s %10s %10s %10s %10s\n", "second", "capacity", "limit", "output", "late ms");
+  for (int iSecondIndex = 0; iSecondIndex < 30; ++iSecondIndex)
+  {
+    double dCapacity = (iSecondIndex < 10) ? 60.0 : ((iSecondIndex < 20) ? 22.0 : 45.0);
+    renderer.setCapacity(dCapacity);
+    uiKept = 0;
+    while (time.getTime() < (iSecondIndex + 1) * iSecond)
+    {
+      int64_t tStart = time.getTime();
+      if (engine.keepFrame(tStart))
+      {
+        renderer.render(tStart);
+        ++uiKept;
+      }
+      int64_t iLate = 0;
+      long lProportion = 0;
+      if (renderer.getQuality(tStart, iQualityInterval, iLate, lProportion))
+      {
+        engine.notifyQuality(iLate, lProportion);
+        ++uiMessages;
+      }
+      time.advance(duration, 1);
+    }
+    std::printf("%6d %10.1f %10.2f %10u %10.1f\n", iSecondIndex, dCapacity, engine.getQualityOutputRate(), uiKept, renderer.getLate() / 10000.0);
+  }
+  std::printf("%u quality messages\n", uiMessages);
+}
+
+/**
+ * @brief streams frames while another thread keeps publishing new modes and target rates, the way SetParameter
+ * does while the graph runs. Every snapshot carries the target rate twice so that a torn copy would be detected.
+ * @return false if a torn snapshot was seen or the cadence broke
+ */
+bool runReconfigurationStress(size_t uiFrames)
+{
+  const unsigned MODES_CYCLED[] = { FSKIP_SKIP_X_FRAMES_EVERY_Y, FSKIP_ACHIEVE_TARGET_RATE, FSKIP_RATIONAL_DECIMATION };
+  const double TARGET_RATES[] = { 30.0, 20.0, 15.0 };
+  const double dSourceFrameRate = 60.0;
+  // at 15 fps out of 60 fps 3 frames in a row are dropped. The target rate mode drops one more when a
+  // truncated source timestamp falls just short of the exact boundary. A switch must not add to that.
+  const size_t uiMaxGap = 4;
+
+  ConfigSnapshot<FrameSkippingConfig> config;
+  std::atomic<bool> bDone(false);
+  std::atomic<uint64_t> uiPublished(0);
+  std::thread writer([&]()
+  {
+    uint64_t uiSequence = 0;
+    while (!bDone.load(std::memory_order_relaxed))
+    {
+      ++uiSequence;
+      FrameSkippingConfig next;
+      next.Mode = MODES_CYCLED[uiSequence % 3];
+      next.SourceFrameRate = dSourceFrameRate;
+      next.TargetFrameRate = TARGET_RATES[(uiSequence / 3) % 3];
+      next.RationalSourceFrameRate = RationalFrameRate::fromDouble(next.SourceFrameRate);
+      next.RationalTargetFrameRate = RationalFrameRate::fromDouble(next.TargetFrameRate);
+      // not used while quality control is off: copies of the target rate and the sequence number
+      next.MinOutputRate = next.TargetFrameRate;
+      next.MaxOutputRate = static_cast<double>(uiSequence);
+      config.publish(next);
+      uiPublished.store(uiSequence, std::memory_order_relaxed);
+    }
+  });
+
+  FrameSkippingEngine engine;
+  FrameSkippingConfig active;
+  uint64_t uiGeneration = UINT64_MAX;
+  FrameDuration duration(RationalFrameRate(60, 1));
+  FrameTimeline time;
+  size_t uiKept = 0, uiApplied = 0, uiTorn = 0, uiGap = 0, uiLongestGap = 0;
+  double dLastSequence = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < uiFrames; ++i)
+  {
+    if (config.update(active, uiGeneration))
+    {
+      ++uiApplied;
+      if (active.MinOutputRate != active.TargetFrameRate || active.RationalTargetFrameRate != RationalFrameRate::fromDouble(active.TargetFrameRate)
+        || active.MaxOutputRate < dLastSequence)
+        ++uiTorn;
+      dLastSequence = active.MaxOutputRate;
+      engine.applyConfig(active);
+    }
+    if (engine.keepFrame(time.getTime()))
+    {
+      ++uiKept;
+      uiGap = 0;
+    }
+    else
+    {
+      uiLongestGap = std::max(uiLongestGap, ++uiGap);
+    }
+    time.advance(duration, 1);
+  }
+  auto stop = std::chrono::steady_clock::now();
+  bDone.store(true);
+  writer.join();
+
+  double dSeconds = std::chrono::duration<double>(stop - start).count();
+  std::printf("%zu frames, %llu snapshots published, %zu applied, %8.3f ns/frame\n", uiFrames,
+    static_cast<unsigned long long>(uiPublished.load()), uiApplied, dSeconds * 1e9 / uiFrames);
+  std::printf("kept %5.2f%% of frames, longest run of dropped frames %zu, torn snapshots %zu\n",
+    100.0 * uiKept / uiFrames, uiLongestGap, uiTorn);
+  return uiTorn == 0 && uiLongestGap <= uiMaxGap;
+}
+
+/**
+ * @brief measures how long it takes to set up the skip patterns of many filter instances that start together,
+ * once with every instance building its own pattern and once with the patterns shared through the cache.
+ */
+void runPatternStartupBenchmark(unsigned uiInstances, unsigned uiStartups)
+{
+  const RatePair STARTUP_PAIRS[] = { { 30.0, 10.0 }, { 29.97, 15.0 }, { 59.94, 23.976 }, { 25.0, 15.0 } };
+  const unsigned uiPairs = sizeof(STARTUP_PAIRS) / sizeof(STARTUP_PAIRS[0]);
+
+  // every instance builds its own pattern with one int per frame as before the cache
+  size_t uiPrivateBytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned uiStartup = 0; uiStartup < uiStartups; ++uiStartup)
+  {
+    std::vector<std::vector<int> > vPatterns(uiInstances);
+    uiPrivateBytes = 0;
+    for (unsigned i = 0; i < uiInstances; ++i)
+    {
+      const RatePair& rates = STARTUP_PAIRS[i % uiPairs];
+      unsigned uiSkip = 0, uiTotal = 0;
+      SkipPattern::build(rates.dSourceFrameRate, rates.dTargetFrameRate, uiSkip, uiTotal, vPatterns[i]);
+      uiPrivateBytes += vPatterns[i].capacity() * sizeof(int);
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+  double dPrivate = std::chrono::duration<double>(stop - start).count() / uiStartups;
+
+  // engines look the pattern up in the cache: all patterns expire between startups
+  size_t uiSharedBytes = 0;
+  size_t uiCached = 0;
+  start = std::chrono::steady_clock::now();
+  for (unsigned uiStartup = 0; uiStartup < uiStartups; ++uiStartup)
+  {
+    std::vector<std::unique_ptr<FrameSkippingEngine> > vEngines(uiInstances);
+    for (unsigned i = 0; i < uiInstances; ++i)
+    {
+      const RatePair& rates = STARTUP_PAIRS[i % uiPairs];
+      vEngines[i].reset(new FrameSkippingEngine());
+      vEngines[i]->setSourceFrameRate(rates.dSourceFrameRate);
+      vEngines[i]->setTargetFrameRate(rates.dTargetFrameRate);
+      vEngines[i]->buildPattern();
+    }
+    if (uiStartup == 0)
+    {
+      uiCached = SkipPatternCache::getInstance().getPatternCount();
+      for (unsigned i = 0; i < uiPairs; ++i)
+        uiSharedBytes += SkipPatternCache::getInstance().getPattern(STARTUP_PAIRS[i].dSourceFrameRate, STARTUP_PAIRS[i].dTargetFrameRate)->getMemoryUsage();
+    }
+  }
+  stop = std::chrono::steady_clock::now();
+  double dShared = std::chrono::duration<double>(stop - start).count() / uiStartups;
+
+  // instances starting on several threads at once must end up sharing the same patterns
+  const unsigned uiThreads = 8;
+  std::vector<std::shared_ptr<const SkipPattern> > vShared(uiInstances);
+  std::vector<std::thread> vThreads;
+  for (unsigned uiThread = 0; uiThread < uiThreads; ++uiThread)
+  {
+    vThreads.push_back(std::thread([&, uiThread]()
+    {
+      for (unsigned i = uiThread; i < uiInstances; i += uiThreads)
+      {
+        const RatePair& rates = STARTUP_PAIRS[i % uiPairs];
+        vShared[i] = SkipPatternCache::getInstance().getPattern(rates.dSourceFrameRate, rates.dTargetFrameRate);
+      }
+    }));
+  }
+  for (size_t i = 0; i < vThreads.size(); ++i)
+    vThreads[i].join();
+  size_t uiDistinct = 0;
+  for (unsigned i = 0; i < uiInstances; ++i)
+  {
+    if (vShared[i] != vShared[i % uiPairs])
+      ++uiDistinct;
+  }
+
+  std::printf("own pattern per instance: %10.1f us per startup, %8zu bytes of patterns\n", dPrivate * 1e6, uiPrivateBytes);
+  std::printf("shared through the cache: %10.1f us per startup, %8zu bytes of patterns in %zu cache entries\n", dShared * 1e6, uiSharedBytes, uiCached);
+  std::printf("%u threads starting together: %zu instances did not share their pattern\n", uiThreads, uiDistinct);
+}
+
+/// prints the non-empty buckets of a histogram
+void printHistogram(const char* szName, const uint64_t* pBuckets)
+{
+  std::printf("%s:", szName);
+  for (int i = 0; i < FSKIP_STATS_HISTOGRAM_BUCKETS; ++i)
+  {
+    if (pBuckets[i] != 0)
+      std::printf(" [%llu,%llu) %llu", i == 0 ? 0ULL : 1ULL << (i - 1), 1ULL << i, static_cast<unsigned long long>(pBuckets[i]));
+  }
+  std::printf("\n");
+}
+
+/**
+ * @brief measures what recording the statistics adds to each decision, in the same way as the filter does it:
+ * a sampled cycle counter around the decision and the frame counters and output interval histogram after it.
+ */
+void runStatisticsOverhead(const std::vector<int64_t>& vTimestamps, unsigned uiRepetitions)
+{
+  FrameSkippingEngine engine;
+  engine.setMode(FSKIP_RATIONAL_DECIMATION);
+  engine.setRationalFrameRates(RationalFrameRate(30, 1), RationalFrameRate(15, 1));
+  FrameSkippingStatistics statistics;
+
+  double dBestPlain = 0.0, dBestRecorded = 0.0;
+  uint64_t uiKept = 0;
+  for (unsigned uiRep = 0; uiRep < uiRepetitions; ++uiRep)
+  {
+    engine.reset();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < vTimestamps.size(); ++i)
+      uiKept += engine.keepFrame(vTimestamps[i]) ? 1 : 0;
+    auto stop = std::chrono::steady_clock::now();
+    double dPlain = std::chrono::duration<double>(stop - start).count();
+
+    engine.reset();
+    statistics.reset();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < vTimestamps.size(); ++i)
+    {
+      bool bTimed = statistics.isDecisionTimed();
+      uint64_t uiCycles = bTimed ? FrameSkippingStatistics::readCycleCounter() : 0;
+      bool bKeep = engine.keepFrame(vTimestamps[i]);
+      if (bTimed)
+        statistics.recordDecisionLatency(FrameSkippingStatistics::readCycleCounter() - uiCycles);
+      statistics.recordFrame(bKeep, vTimestamps[i], true);
+    }
+    stop = std::chrono::steady_clock::now();
+    double dRecorded = std::chrono::duration<double>(stop - start).count();
+    if (uiRep == 0 || dPlain < dBestPlain)
+      dBestPlain = dPlain;
+    if (uiRep == 0 || dRecorded < dBestRecorded)
+      dBestRecorded = dRecorded;
+  }
+
+  // reading the timestamp counter may trap into the hypervisor on virtual machines
+  auto start = std::chrono::steady_clock::now();
+  uint64_t uiSum = 0;
+  for (size_t i = 0; i < vTimestamps.size(); ++i)
+    uiSum += FrameSkippingStatistics::readCycleCounter();
+  auto stop = std::chrono::steady_clock::now();
+  std::printf("reading the cycle counter takes %.3f ns%s\n",
+    std::chrono::duration<double>(stop - start).count() * 1e9 / vTimestamps.size(), uiSum == 0 ? " " : "");
+
+  FrameSkippingStatsSnapshot stats;
+  statistics.getSnapshot(stats);
+  std::printf("without statistics %8.3f ns/dec, with statistics %8.3f ns/dec: %+.3f ns per frame\n",
+    dBestPlain * 1e9 / vTimestamps.size(), dBestRecorded * 1e9 / vTimestamps.size(), (dBestRecorded - dBestPlain) * 1e9 / vTimestamps.size());
+  std::printf("in %llu, out %llu, dropped %llu, achieved %.3f fps, 1 in %u decisions timed\n",
+    static_cast<unsigned long long>(stats.FramesIn), static_cast<unsigned long long>(stats.FramesOut),
+    static_cast<unsigned long long>(stats.FramesDropped), stats.AchievedFps, stats.LatencySamplingInterval);
+  printHistogram("decision latency in cycles", stats.DecisionLatency);
+  printHistogram("output interval in 100 ns", stats.OutputInterval);
+  (void)uiKept;
+}
+
+/**
+ * @brief replays weeks of exact source timestamps through the target rate mode and reports how far the
+ * time frame ends up from the exact output grid. A floating point time line is run alongside for comparison.
+ */
+void runDriftCheck(const RationalFrameRate& source, const RationalFrameRate& target, unsigned uiWeeks)
+{
+  FrameSkippingEngine engine;
+  engine.setMode(FSKIP_ACHIEVE_TARGET_RATE);
+  engine.setRationalFrameRates(source, target);
+
+  FrameDuration sourceDuration(source);
+  FrameDuration targetDuration(target);
+  const int64_t tEnd = static_cast<int64_t>(uiWeeks) * 7 * 24 * 3600 * TIMESTAMP_TICKS_PER_SECOND;
+  // floating point time line as used before timestamps were kept in integer ticks
+  const double dTargetTimeFrame = target.Denominator / static_cast<double>(target.Numerator);
+  double dTimeFrame = 0.0;
+
+  uint64_t uiKept = 0;
+  FrameTimeline sourceTime;
+  while (sourceTime.getTime() < tEnd)
+  {
+    int64_t tStart = sourceTime.getTime();
+    if (engine.keepFrame(tStart))
+      ++uiKept;
+
+    double dTimeCurrent = tStart / TIMESTAMP_FACTOR;
+    if (tStart == 0)
+    {
+      dTimeFrame = dTimeCurrent + dTargetTimeFrame;
+    }
+    else if (dTimeCurrent > dTimeFrame)
+    {
+      int multiplier = static_cast<int>(std::ceil((dTimeCurrent - dTimeFrame) / dTargetTimeFrame));
+      if (multiplier == 0) { multiplier = 1; }
+      dTimeFrame += dTargetTimeFrame * multiplier;
+    }
+    sourceTime.advance(sourceDuration, 1);
+  }
+
+  // distance of the integer time frame from the nearest exact multiple of the target frame duration
+  FrameTimeline timeFrame = engine.getTimeFrame();
+  int64_t iScaled = timeFrame.getTime() * targetDuration.getDivisor() + timeFrame.getFraction();
+  int64_t iFrames = (iScaled + targetDuration.getTicks() / 2) / targetDuration.getTicks();
+  int64_t iError = iScaled - iFrames * targetDuration.getTicks();
+  double dIntegerError = iError / static_cast<double>(targetDuration.getDivisor());
+  double dDoubleError = dTimeFrame * TIMESTAMP_FACTOR - iFrames * (targetDuration.getTicks() / static_cast<double>(targetDuration.getDivisor()));
+
+  double dIdeal = tEnd / TIMESTAMP_FACTOR * target.toDouble();
+  std::printf("%6u/%-5u -> %6u/%-5u %3u weeks %12llu kept %+10.0f vs ideal, grid error %g ticks (double: %g ticks)\n",
+    source.Numerator, source.Denominator, target.Numerator, target.Denominator, uiWeeks,
+    static_cast<unsigned long long>(uiKept), uiKept - dIdeal, dIntegerError, dDoubleError);
+}
+
+}
+
+/// spread of the intervals between consecutive start times
+struct IntervalJitter
+{
+  IntervalJitter()
+    :Count(0),
+    Sum(0.0),
+    SumOfSquares(0.0),
+    Min(INT64_MAX),
+    Max(INT64_MIN)
+  {
+
+  }
+
+  void add(int64_t iInterval)
+  {
+    ++Count;
+    Sum += iInterval;
+    SumOfSquares += static_cast<double>(iInterval) * iInterval;
+    Min = std::min(Min, iInterval);
+    Max = std::max(Max, iInterval);
+  }
+
+  /// standard deviation in milliseconds
+  double getDeviationMs() const
+  {
+    if (Count == 0)
+      return 0.0;
+    double dMean = Sum / Count;
+    return std::sqrt(std::max(SumOfSquares / Count - dMean * dMean, 0.0)) * 1000.0 / TIMESTAMP_FACTOR;
+  }
+
+  /// largest minus smallest interval in milliseconds
+  double getRangeMs() const
+  {
+    return Count == 0 ? 0.0 : (Max - Min) * 1000.0 / TIMESTAMP_FACTOR;
+  }
+
+  uint64_t Count;
+  double Sum;
+  double SumOfSquares;
+  int64_t Min;
+  int64_t Max;
+};
+
+/**
+ * @brief measures the output interval jitter of the kept frames before and after re-pacing.
+ * @param iNoise the source timestamps are moved by up to this many ticks in either direction
+ * @param uiGapFrame the source skips one second of frames here to force the grid to restart. 0 = no gap
+ * @return false if the paced intervals are not uniform to within one tick or a frame moved further than allowed
+ */
+bool runRepacingJitter(const Mode& mode, const RatePair& rates, size_t uiFrames, int64_t iNoise, size_t uiGapFrame)
+{
+  FrameSkippingEngine engine;
+  engine.setMode(mode.uiMode);
+  engine.setSourceFrameRate(rates.dSourceFrameRate);
+  engine.setTargetFrameRate(rates.dTargetFrameRate);
+  engine.setRationalFrameRates(RationalFrameRate::fromDouble(rates.dSourceFrameRate), RationalFrameRate::fromDouble(rates.dTargetFrameRate));
+  engine.buildPattern();
+  engine.reset();
+
+  OutputPacer pacer;
+  pacer.setFrameRate(engine.getOutputFrameRate(), 0);
+  const int64_t iMaxOffset = FrameDuration(engine.getOutputFrameRate()).getWholeTicks();
+
+  std::srand(1);
+  IntervalJitter before, after;
+  int64_t tLastOriginal = 0, tLastPaced = 0, iMaxMoved = 0, iLastMediaStop = 0;
+  bool bHasLast = false, bMediaTimeValid = true;
+  int64_t iGapTicks = 0;
+  for (size_t i = 0; i < uiFrames; ++i)
+  {
+    if (uiGapFrame != 0 && i == uiGapFrame)
+      iGapTicks = TIMESTAMP_TICKS_PER_SECOND;
+    int64_t tStart = static_cast<int64_t>(i * TIMESTAMP_FACTOR / rates.dSourceFrameRate) + iGapTicks;
+    if (iNoise > 0)
+      tStart += std::rand() % (2 * iNoise + 1) - iNoise;
+    if (!engine.keepFrame(tStart))
+      continue;
+
+    int64_t tPacedStart = 0, tPacedStop = 0, iMediaStart = 0, iMediaStop = 0;
+    pacer.pace(tStart, tPacedStart, tPacedStop, iMediaStart, iMediaStop);
+    iMaxMoved = std::max(iMaxMoved, std::abs(tPacedStart - tStart));
+    if (iMediaStart != iLastMediaStop || iMediaStop != iMediaStart + 1)
+      bMediaTimeValid = false;
+    iLastMediaStop = iMediaStop;
+    // the interval across the gap belongs to neither cadence
+    bool bAcrossGap = uiGapFrame != 0 && tStart - tLastOriginal > TIMESTAMP_TICKS_PER_SECOND / 2;
+    if (bHasLast && !bAcrossGap)
+    {
+      before.add(tStart - tLastOriginal);
+      after.add(tPacedStart - tLastPaced);
+    }
+    tLastOriginal = tStart;
+    tLastPaced = tPacedStart;
+    bHasLast = true;
+  }
+
+  std::printf("%-16s %8.3f -> %-8.3f %6.2f %7.3f %7.3f %7.3f %7.3f %8.3f %6llu\n",
+    mode.szName, rates.dSourceFrameRate, rates.dTargetFrameRate, iNoise / 10000.0,
+    before.getDeviationMs(), before.getRangeMs(), after.getDeviationMs(), after.getRangeMs(),
+    iMaxMoved / 10000.0, static_cast<unsigned long long>(pacer.getReanchorCount()));
+  return bMediaTimeValid && after.Max - after.Min <= 1 && iMaxMoved <= iMaxOffset;
+}
+
+/**
+ * @brief checks the dyadic temporal layer mode: every layer limit gives an evenly spaced cadence, lower limits keep
+ * subsets of the frames of higher ones and a relay that compares the tags of the samples thins the stream in the
+ * same way as a filter that counts frames.
+ * @return false if any of this does not hold
+ */
+bool runTemporalLayerCheck(unsigned uiLayers, double dSourceFrameRate, size_t uiFrames)
+{
+  // the frames and tags of the stream with every layer kept as a relay would receive them
+  std::vector<uint32_t> vTagged(uiFrames);
+  {
+    FrameSkippingEngine engine;
+    engine.setMode(FSKIP_TEMPORAL_LAYERS);
+    engine.setTemporalLayers(uiLayers, uiLayers - 1);
+    for (size_t i = 0; i < uiFrames; ++i)
+    {
+      engine.keepFrame(0);
+      vTagged[i] = FrameSkippingEngine::setTemporalLayerFlags(0, engine.getLastTemporalLayer());
+    }
+  }
+
+  bool bOk = true;
+  std::vector<bool> vPrevious;
+  for (unsigned uiMaxLayer = 0; uiMaxLayer < uiLayers; ++uiMaxLayer)
+  {
+    FrameSkippingEngine engine;
+    engine.setMode(FSKIP_TEMPORAL_LAYERS);
+    engine.setRationalFrameRates(RationalFrameRate::fromDouble(dSourceFrameRate), RationalFrameRate());
+    engine.setTemporalLayers(uiLayers, uiMaxLayer);
+    std::vector<bool> vKept(uiFrames);
+    size_t uiKept = 0, uiLastKept = 0, uiMaxGap = 0, uiNotSubset = 0, uiRelayMismatches = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < uiFrames; ++i)
+    {
+      vKept[i] = engine.keepFrame(0);
+      unsigned uiLayer = 0;
+      bool bRelayKeeps = FrameSkippingEngine::getTemporalLayerFlags(vTagged[i], uiLayer) && uiLayer <= uiMaxLayer;
+      uiRelayMismatches += (bRelayKeeps != vKept[i]) ? 1 : 0;
+      if (!vKept[i])
+        continue;
+      if (uiKept++ > 0)
+        uiMaxGap = std::max(uiMaxGap, i - uiLastKept);
+      uiLastKept = i;
+    }
+    double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // every frame kept with a lower limit is also kept with this one
+    for (size_t i = 0; i < vPrevious.size(); ++i)
+      uiNotSubset += (vPrevious[i] && !vKept[i]) ? 1 : 0;
+    size_t uiSpacing = static_cast<size_t>(1) << (uiLayers - 1 - uiMaxLayer);
+    double dAnnounced = engine.getOutputFrameRate().toDouble();
+    std::printf("%6u %9u %10.3f %10.3f %8zu %10zu %10zu %8.3f\n", uiLayers, uiMaxLayer, uiKept * dSourceFrameRate / uiFrames,
+      dAnnounced, uiMaxGap, uiNotSubset, uiRelayMismatches, dSeconds * 1e9 / uiFrames);
+    bOk &= uiMaxGap == uiSpacing && uiNotSubset == 0 && uiRelayMismatches == 0 && dAnnounced * uiSpacing == dSourceFrameRate;
+    vPrevious.swap(vKept);
+  }
+  return bOk;
+}
+
+/**
+ * @brief a synthetic trace at 30 fps. Every uiPeriod frames uiStalled frames do not arrive in time: with bClumped
+ * they follow the stall 1 ms apart, like a source that stamps frames when they arrive, otherwise they are lost.
+ */
+std::vector<int64_t> generateStallTrace(size_t uiFrames, size_t uiPeriod, size_t uiStalled, bool bClumped)
+{
+  const int64_t FRAME = TIMESTAMP_TICKS_PER_SECOND / 30;
+  std::vector<int64_t> vTimestamps;
+  vTimestamps.reserve(uiFrames);
+  for (size_t i = 0; i < uiFrames; ++i)
+  {
+    size_t uiPhase = uiPeriod > 0 ? i % uiPeriod : uiPeriod;
+    int64_t tStart = static_cast<int64_t>(i) * FRAME;
+    if (uiPhase < uiStalled)
+    {
+      if (!bClumped)
+        continue;
+      // the stalled frames arrive together with the first frame after the stall
+      tStart = static_cast<int64_t>(i - uiPhase + uiStalled) * FRAME + static_cast<int64_t>(uiPhase) * 10000;
+    }
+    vTimestamps.push_back(tStart);
+  }
+  return vTimestamps;
+}
+
+/**
+ * @brief the most frames kept within any window of iWindow ticks minus the bound of the token bucket:
+ * fewer than (window + burst) * rate + 2 frames, so the result must be negative
+ */
+double getBucketExcess(const std::vector<int64_t>& vKept, int64_t iWindow, int64_t iBurst, const RationalFrameRate& target)
+{
+  double dExcess = -1e300;
+  size_t uiFirst = 0;
+  for (size_t i = 0; i < vKept.size(); ++i)
+  {
+    while (vKept[i] - vKept[uiFirst] > iWindow)
+      ++uiFirst;
+    double dAllowed = (iWindow + iBurst) * target.toDouble() / TIMESTAMP_FACTOR + 2.0;
+    dExcess = std::max(dExcess, (i - uiFirst + 1) - dAllowed);
+  }
+  return dExcess;
+}
+
+/**
+ * @brief replays a trace through the target rate mode and the token bucket mode at the same target rate.
+ * @return false if the token bucket keeps more than its burst allows, fewer frames than the target rate mode
+ * or, without stalls, a different number of frames
+ */
+bool runTokenBucketCheck(const char* szName, const std::vector<int64_t>& vTimestamps, const RationalFrameRate& target,
+  int64_t iBurst, bool bSteady)
+{
+  FrameSkippingConfig config;
+  config.Mode = FSKIP_ACHIEVE_TARGET_RATE;
+  config.RationalSourceFrameRate = RationalFrameRate(30);
+  config.RationalTargetFrameRate = target;
+  config.BurstDuration = iBurst;
+  FrameSkippingEngine targetRate;
+  targetRate.applyConfig(config);
+  config.Mode = FSKIP_TOKEN_BUCKET;
+  FrameSkippingEngine tokenBucket;
+  tokenBucket.applyConfig(config);
+
+  std::vector<int64_t> vTargetKept, vBucketKept;
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t tStart : vTimestamps)
+  {
+    if (tokenBucket.keepFrame(tStart))
+      vBucketKept.push_back(tStart);
+  }
+  double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for (int64_t tStart : vTimestamps)
+  {
+    if (targetRate.keepFrame(tStart))
+      vTargetKept.push_back(tStart);
+  }
+
+  double dDuration = (vTimestamps.back() - vTimestamps.front()) / TIMESTAMP_FACTOR;
+  double dExcess = getBucketExcess(vBucketKept, TIMESTAMP_TICKS_PER_SECOND, iBurst, target);
+  std::printf("%-24s %8.0f %10zu %10.3f %10zu %10.3f %+8.2f %8.3f\n", szName, iBurst / 10000.0,
+    vTargetKept.size(), vTargetKept.size() / dDuration, vBucketKept.size(), vBucketKept.size() / dDuration,
+    dExcess, dSeconds * 1e9 / vTimestamps.size());
+  bool bOk = dExcess < 0.0 && vBucketKept.size() >= vTargetKept.size();
+  if (bSteady)
+    bOk &= vBucketKept.size() == vTargetKept.size();
+  return bOk;
+}
+
+// read after every copy so that the copies are not optimised away
+volatile uint8_t g_uiCopySink = 0;
+
+/**
+ * @brief models CTransInPlaceFilter::Receive between different allocators: every input frame is copied before
+ * the decision, against deciding first and copying only the kept frames.
+ * @return false if the two orders keep different frames or the second copies more than the kept frames
+ */
+bool runCopyPath(int iWidth, int iHeight, double dSourceFrameRate, double dTargetFrameRate, size_t uiFrames)
+{
+  const size_t uiFrameBytes = static_cast<size_t>(iWidth) * iHeight * 3 / 2;
+  // two input buffers so that consecutive copies do not come from the cache
+  std::vector<uint8_t> vInput[2] = { std::vector<uint8_t>(uiFrameBytes, 16), std::vector<uint8_t>(uiFrameBytes, 128) };
+  std::vector<uint8_t> vOutput(uiFrameBytes);
+  RationalFrameRate sourceRate = RationalFrameRate::fromDouble(dSourceFrameRate);
+  RationalFrameRate targetRate = RationalFrameRate::fromDouble(dTargetFrameRate);
+
+  bool bOk = true;
+  uint64_t aBytes[2] = { 0, 0 };
+  double aSeconds[2] = { 0.0, 0.0 };
+  std::vector<bool> vKept[2];
+  for (int iPath = 0; iPath < 2; ++iPath)
+  {
+    FrameSkippingEngine engine;
+    engine.setMode(FSKIP_RATIONAL_DECIMATION);
+    engine.setRationalFrameRates(sourceRate, targetRate);
+    vKept[iPath].resize(uiFrames);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < uiFrames; ++i)
+    {
+      const std::vector<uint8_t>& vFrame = vInput[i & 1];
+      bool bKeep = false;
+      if (iPath == 0)
+      {
+        std::memcpy(&vOutput[0], &vFrame[0], uiFrameBytes);
+        g_uiCopySink = vOutput[i % uiFrameBytes];
+        aBytes[0] += uiFrameBytes;
+        bKeep = engine.keepFrame(0);
+      }
+      else
+      {
+        bKeep = engine.keepFrame(0);
+        if (bKeep)
+        {
+          std::memcpy(&vOutput[0], &vFrame[0], uiFrameBytes);
+          g_uiCopySink = vOutput[i % uiFrameBytes];
+          aBytes[1] += uiFrameBytes;
+        }
+      }
+      vKept[iPath][i] = bKeep;
+    }
+    aSeconds[iPath] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  size_t uiKept = 0;
+  for (size_t i = 0; i < uiFrames; ++i)
+    uiKept += vKept[1][i] ? 1 : 0;
+  bOk = vKept[0] == vKept[1] && aBytes[1] == uiKept * uiFrameBytes;
+
+  // bytes copied per second of the stream
+  double dStreamSeconds = uiFrames / dSourceFrameRate;
+  const char* aNames[] = { "copy, decide", "decide, copy" };
+  for (int iPath = 0; iPath < 2; ++iPath)
+  {
+    std::printf("%-14s %5dx%-5d %6.2f -> %-6.2f %8zu %14.1f %14.2f\n", aNames[iPath], iWidth, iHeight, dSourceFrameRate,
+      dTargetFrameRate, static_cast<size_t>(aBytes[iPath] / uiFrameBytes), aBytes[iPath] / dStreamSeconds / 1e6,
+      aSeconds[iPath] * 1e3 / uiFrames);
+  }
+  return bOk;
+}
+
+int main(int argc, char** argv)
+{
+  size_t uiFrames = 10000000;
+  unsigned uiRepetitions = 5;
+  if (argc > 1) uiFrames = std::strtoul(argv[1], NULL, 10);
+  if (argc > 2) uiRepetitions = std::strtoul(argv[2], NULL, 10);
+  if (uiFrames == 0 || uiRepetitions == 0)
+  {
+    std::fprintf(stderr, "Usage: %s [frames] [repetitions]\n", argv[0]);
+    return 1;
+  }
+
+  std::printf("%zu decisions per run, best of %u runs\n", uiFrames, uiRepetitions);
+  std::printf("%-16s %21s %10s %14s %12s %10s\n", "mode", "source -> target", "ns/dec", "decisions/s", "output fps", "announced");
+  for (const Mode& mode : MODES)
+  {
+    for (const RatePair& rates : RATE_PAIRS)
+    {
+      std::vector<int64_t> vTimestamps = generateTimestamps(rates.dSourceFrameRate, uiFrames);
+      runBenchmark(mode, rates, vTimestamps, uiRepetitions);
+    }
+  }
+
+  std::printf("\nlate frame dropping against a fake stream clock, rational 30 -> 15\n");
+  std::vector<int64_t> vTimestamps = generateTimestamps(30.0, uiFrames);
+  runLatenessBenchmark(vTimestamps, 0);
+  runLatenessBenchmark(vTimestamps, 1000000);
+  runLatenessBenchmark(vTimestamps, 500000);
+
+  std::printf("\nquality control against a renderer with limited capacity, 60 fps source\n");
+  runQualityControlSimulation();
+
+  std::printf("\nstatistics overhead, rational 30 -> 15\n");
+  runStatisticsOverhead(vTimestamps, uiRepetitions);
+
+  std::printf("\nlive reconfiguration while another thread publishes new settings\n");
+  if (!runReconfigurationStress(uiFrames))
+  {
+    std::printf("FAILED: reconfiguration was not glitch free\n");
+    return 1;
+  }
+
+  std::printf("\noutput interval jitter before and after re-pacing onto the output grid\n");
+  std::printf("%-16s %21s %6s %15s %15s %8s %6s\n", "mode", "source -> target", "noise", "before sd/range", "after sd/range", "moved", "resync");
+  const RatePair REPACED_RATES[] = { { 60.0, 24.0 }, { 59.94, 23.976 }, { 30.0, 20.0 }, { 50.0, 30.0 } };
+  bool bUniform = true;
+  for (const Mode& mode : MODES)
+  {
+    for (const RatePair& rates : REPACED_RATES)
+    {
+      bUniform &= runRepacingJitter(mode, rates, 100000, 0, 0);
+      bUniform &= runRepacingJitter(mode, rates, 100000, 20000, 50000);
+    }
+  }
+  if (!bUniform)
+  {
+    std::printf("FAILED: re-paced output was not uniform\n");
+    return 1;
+  }
+
+  std::printf("\ncopying between different allocators before and after deciding on the input sample\n");
+  std::printf("%-14s %11s %16s %8s %14s %14s\n", "order", "size", "source -> target", "copies", "MB copied/s", "ms per frame");
+  bool bCopies = runCopyPath(3840, 2160, 60.0, 15.0, 240);
+  bCopies &= runCopyPath(1920, 1080, 59.94, 29.97, 480);
+  if (!bCopies)
+  {
+    std::printf("FAILED: deciding before the copy changed the decisions or copied dropped frames\n");
+    return 1;
+  }
+
+  std::printf("\ndyadic temporal layers at 60 fps\n");
+  std::printf("%6s %9s %10s %10s %8s %10s %10s %8s\n", "layers", "max layer", "fps", "announced", "spacing", "not subset", "relay diff", "ns/dec");
+  if (!runTemporalLayerCheck(4, 60.0, uiFrames) || !runTemporalLayerCheck(FSKIP_MAX_TEMPORAL_LAYERS, 60.0, uiFrames))
+  {
+    std::printf("FAILED: temporal layers are not consistent\n");
+    return 1;
+  }
+
+  std::printf("\ntoken bucket against the target rate mode, 30 -> 15 fps\n");
+  std::printf("%-24s %8s %10s %10s %10s %10s %8s %8s\n", "trace", "burst ms", "target", "fps", "bucket", "fps", "excess", "ns/dec");
+  const size_t TRACE_FRAMES = 30 * 600;
+  std::vector<int64_t> vSteady = generateStallTrace(TRACE_FRAMES, 0, 0, false);
+  std::vector<int64_t> vStalls = generateStallTrace(TRACE_FRAMES, 60, 8, false);
+  std::vector<int64_t> vClumps = generateStallTrace(TRACE_FRAMES, 60, 8, true);
+  // without a burst the token bucket keeps the frames of the target rate mode
+  bool bBucket = runTokenBucketCheck("steady", vSteady, RationalFrameRate(15), 0, true);
+  bBucket &= runTokenBucketCheck("steady", vSteady, RationalFrameRate(15), 5000000, true);
+  bBucket &= runTokenBucketCheck("267 ms lost every 2 s", vStalls, RationalFrameRate(15), 0, false);
+  bBucket &= runTokenBucketCheck("267 ms lost every 2 s", vStalls, RationalFrameRate(15), 5000000, false);
+  bBucket &= runTokenBucketCheck("267 ms late every 2 s", vClumps, RationalFrameRate(15), 0, false);
+  bBucket &= runTokenBucketCheck("267 ms late every 2 s", vClumps, RationalFrameRate(15), 5000000, false);
+  bBucket &= runTokenBucketCheck("267 ms late, 29.97 fps", vClumps, RationalFrameRate(30000, 2002), 5000000, false);
+  if (!bBucket)
+  {
+    std::printf("FAILED: the token bucket exceeded its burst or dropped more than the target rate mode\n");
+    return 1;
+  }
+
+  std::printf("\nskip pattern setup for 256 instances starting together\n");
+  runPatternStartupBenchmark(256, 100);
+
+  std::printf("\nlong horizon drift of the target rate mode\n");
+  runDriftCheck(RationalFrameRate(30000, 1001), RationalFrameRate(15, 1), 4);
+  runDriftCheck(RationalFrameRate(60000, 1001), RationalFrameRate(24000, 1001), 4);
+  runDriftCheck(RationalFrameRate(25, 1), RationalFrameRate(10, 1), 4);
+  return 0;
+}
@@ -0,0 +1,457 @@
+/** @file
+
+MODULE                : FrameSkippingCompressedBenchmark
+
+FILE NAME             : FrameSkippingCompressedBenchmark.cpp
+
+DESCRIPTION           : Parses sample H.264 and HEVC bitstreams and checks which access units are found to be
+                        disposable. Skips the streams ahead of a decoder and reports the share of frames that
+                        no longer need decoding and the parsing throughput.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingEngine.h"
+#include "NalParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+
+/// an access unit and whether a decoder may skip it
+struct AccessUnit
+{
+  std::vector<uint8_t> Data;
+  bool IsSyncPoint;
+  bool IsDisposable;
+};
+
+/// payload without 00 00 sequences so that no start code is emulated
+void appendPayload(std::vector<uint8_t>& vData, size_t uiBytes)
+{
+  for (size_t i = 0; i < uiBytes; ++i)
+    vData.push_back(static_cast<uint8_t>(1 + std::rand() % 255));
+}
+
+void appendNal(std::vector<uint8_t>& vData, const std::vector<uint8_t>& vHeader, size_t uiPayload, unsigned uiLengthSize)
+{
+  size_t uiNalLength = vHeader.size() + uiPayload;
+  if (uiLengthSize == 0)
+  {
+    // a 4 byte start code as at the start of an access unit
+    const uint8_t START_CODE[] = { 0, 0, 0, 1 };
+    vData.insert(vData.end(), START_CODE, START_CODE + 4);
+  }
+  else
+  {
+    for (unsigned i = uiLengthSize; i > 0; --i)
+      vData.push_back(static_cast<uint8_t>(uiNalLength >> (8 * (i - 1))));
+  }
+  vData.insert(vData.end(), vHeader.begin(), vHeader.end());
+  appendPayload(vData, uiPayload);
+}
+
+std::vector<uint8_t> h264Header(unsigned uiRefIdc, unsigned uiType)
+{
+  return std::vector<uint8_t>(1, static_cast<uint8_t>((uiRefIdc << 5) | uiType));
+}
+
+std::vector<uint8_t> hevcHeader(unsigned uiType, unsigned uiTemporalId)
+{
+  std::vector<uint8_t> vHeader;
+  vHeader.push_back(static_cast<uint8_t>(uiType << 1));
+  vHeader.push_back(static_cast<uint8_t>(uiTemporalId + 1));
+  return vHeader;
+}
+
+/**
+ * @brief an H.264 stream with the GOP structure I B B P B B P ... of 30 frames. Every third GOP uses a
+ * B pyramid in which the middle B frame is a reference. Frames have two slices.
+ */
+std::vector<AccessUnit> makeH264Stream(size_t uiFrames, size_t uiSliceBytes, unsigned uiLengthSize)
+{
+  std::vector<AccessUnit> vUnits(uiFrames);
+  const size_t GOP = 30;
+  for (size_t i = 0; i < uiFrames; ++i)
+  {
+    AccessUnit& unit = vUnits[i];
+    size_t uiPosition = i % GOP;
+    bool bPyramid = (i / GOP) % 3 == 2;
+    // access unit delimiter
+    appendNal(unit.Data, h264Header(0, 9), 1, uiLengthSize);
+    unsigned uiRefIdc = 0, uiType = 1;
+    if (uiPosition == 0)
+    {
+      appendNal(unit.Data, h264Header(3, 7), 12, uiLengthSize);
+      appendNal(unit.Data, h264Header(3, 8), 4, uiLengthSize);
+      uiRefIdc = 3;
+      uiType = 5;
+    }
+    else if (uiPosition % 3 == 0)
+    {
+      uiRefIdc = 2;
+    }
+    else if (bPyramid && uiPosition % 3 == 1)
+    {
+      uiRefIdc = 1;
+    }
+    // SEI
+    appendNal(unit.Data, h264Header(0, 6), 8, uiLengthSize);
+    appendNal(unit.Data, h264Header(uiRefIdc, uiType), uiSliceBytes, uiLengthSize);
+    appendNal(unit.Data, h264Header(uiRefIdc, uiType), uiSliceBytes, uiLengthSize);
+    unit.IsSyncPoint = uiPosition == 0;
+    unit.IsDisposable = uiRefIdc == 0;
+  }
+  return vUnits;
+}
+
+/**
+ * @brief an HEVC stream with dyadic temporal layers 0, 1 and 2 in a GOP of 4. Only the TRAIL_N pictures in the
+ * highest layer are disposable. Layer 1 pictures alternate between TSA_N and TRAIL_R: a TSA_N picture is
+ * a sub-layer non-reference picture but layer 2 pictures may still refer to it.
+ */
+std::vector<AccessUnit> makeHevcStream(size_t uiFrames, size_t uiSliceBytes, unsigned uiLengthSize)
+{
+  const unsigned TRAIL_N = 0, TRAIL_R = 1, TSA_N = 2, IDR_W_RADL = 19, VPS = 32, SPS = 33, PPS = 34, AUD = 35;
+  std::vector<AccessUnit> vUnits(uiFrames);
+  for (size_t i = 0; i < uiFrames; ++i)
+  {
+    AccessUnit& unit = vUnits[i];
+    appendNal(unit.Data, hevcHeader(AUD, 0), 1, uiLengthSize);
+    unsigned uiType = TRAIL_N, uiTemporalId = 2;
+    if (i % 64 == 0)
+    {
+      appendNal(unit.Data, hevcHeader(VPS, 0), 20, uiLengthSize);
+      // sps_video_parameter_set_id 0, sps_max_sub_layers_minus1 2, sps_temporal_id_nesting_flag 1
+      std::vector<uint8_t> vSps = hevcHeader(SPS, 0);
+      vSps.push_back((2 << 1) | 1);
+      appendNal(unit.Data, vSps, 30, uiLengthSize);
+      appendNal(unit.Data, hevcHeader(PPS, 0), 6, uiLengthSize);
+      uiType = IDR_W_RADL;
+      uiTemporalId = 0;
+    }
+    else if (i % 4 == 0)
+    {
+      uiType = TRAIL_R;
+      uiTemporalId = 0;
+    }
+    else if (i % 2 == 0)
+    {
+      uiType = ((i / 4) % 2 == 0) ? TSA_N : TRAIL_R;
+      uiTemporalId = 1;
+    }
+    appendNal(unit.Data, hevcHeader(uiType, uiTemporalId), uiSliceBytes, uiLengthSize);
+    unit.IsSyncPoint = uiType == IDR_W_RADL;
+    unit.IsDisposable = uiType == TRAIL_N && uiTemporalId == 2;
+  }
+  return vUnits;
+}
+
+/// @return false if an access unit was classified differently than expected
+bool checkClassification(const char* szName, unsigned uiCodec, unsigned uiLengthSize, const std::vector<AccessUnit>& vUnits)
+{
+  NalParser parser;
+  parser.setFormat(uiCodec, uiLengthSize);
+  size_t uiErrors = 0, uiDisposable = 0, uiBytes = 0;
+  for (const AccessUnit& unit : vUnits)
+  {
+    bool bDisposable = parser.isDisposable(&unit.Data[0], unit.Data.size());
+    uiErrors += (bDisposable != unit.IsDisposable) ? 1 : 0;
+    uiDisposable += bDisposable ? 1 : 0;
+    uiBytes += unit.Data.size();
+  }
+
+  // parsing throughput over the whole stream
+  const unsigned REPETITIONS = 20;
+  size_t uiCount = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned uiRep = 0; uiRep < REPETITIONS; ++uiRep)
+  {
+    for (const AccessUnit& unit : vUnits)
+      uiCount += parser.isDisposable(&unit.Data[0], unit.Data.size()) ? 1 : 0;
+  }
+  double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::printf("%-22s %8zu %11zu %8zu %10.0f %10.1f\n", szName, vUnits.size(), uiDisposable, uiErrors,
+    REPETITIONS * uiBytes / dSeconds / 1e6, dSeconds * 1e9 / (REPETITIONS * vUnits.size()));
+  return uiErrors == 0 && uiCount == REPETITIONS * uiDisposable;
+}
+
+/// @return false if a malformed or incomplete access unit was found to be disposable
+bool checkEdgeCases()
+{
+  NalParser hevc;
+  hevc.setFormat(FSKIP_CODEC_HEVC, 0);
+  std::vector<uint8_t> vTrailN;
+  appendNal(vTrailN, hevcHeader(0, 0), 16, 0);
+  // the highest sub-layer is unknown before the SPS
+  bool bOk = !hevc.isDisposable(&vTrailN[0], vTrailN.size());
+
+  NalParser avc;
+  avc.setFormat(FSKIP_CODEC_H264, 4);
+  std::vector<uint8_t> vNonReference;
+  appendNal(vNonReference, h264Header(0, 1), 64, 4);
+  bOk &= avc.isDisposable(&vNonReference[0], vNonReference.size());
+  // a length prefix that runs past the end
+  bOk &= !avc.isDisposable(&vNonReference[0], vNonReference.size() - 1);
+  // no slices at all
+  std::vector<uint8_t> vSei;
+  appendNal(vSei, h264Header(0, 6), 8, 4);
+  bOk &= !avc.isDisposable(&vSei[0], vSei.size());
+  bOk &= !avc.isDisposable(NULL, 0);
+
+  // parameter sets in the format block of the media type with 2 byte length prefixes
+  NalParser hvc1;
+  hvc1.setFormat(FSKIP_CODEC_HEVC, 4);
+  std::vector<uint8_t> vSequenceHeader;
+  std::vector<uint8_t> vSps = hevcHeader(33, 0);
+  vSps.push_back(0);
+  appendNal(vSequenceHeader, vSps, 10, 2);
+  hvc1.parseParameterSets(&vSequenceHeader[0], vSequenceHeader.size(), 2);
+  std::vector<uint8_t> vTrailN4;
+  appendNal(vTrailN4, hevcHeader(0, 0), 16, 4);
+  bOk &= hvc1.getMaxTemporalId() == 0 && hvc1.isDisposable(&vTrailN4[0], vTrailN4.size());
+  return bOk;
+}
+
+/**
+ * @brief skips the stream ahead of the decoder the way Transform does.
+ * @return false if a reference frame was dropped
+ */
+bool runDecimation(const char* szName, unsigned uiCodec, const std::vector<AccessUnit>& vUnits,
+  const RationalFrameRate& source, const RationalFrameRate& target)
+{
+  FrameSkippingEngine engine;
+  engine.setMode(FSKIP_RATIONAL_DECIMATION);
+  engine.setRationalFrameRates(source, target);
+  NalParser parser;
+  parser.setFormat(uiCodec, 0);
+
+  FrameDuration duration(source);
+  FrameTimeline time;
+  size_t uiKept = 0, uiReferenceDropped = 0, uiGap = 0, uiLongestGap = 0;
+  for (const AccessUnit& unit : vUnits)
+  {
+    bool bDisposable = parser.isDisposable(&unit.Data[0], unit.Data.size()) && !unit.IsSyncPoint;
+    if (engine.keepFrame(time.getTime(), NULL, bDisposable))
+    {
+      ++uiKept;
+      uiGap = 0;
+    }
+    else
+    {
+      uiReferenceDropped += unit.IsDisposable ? 0 : 1;
+      uiLongestGap = std::max(uiLongestGap, ++uiGap);
+    }
+    time.advance(duration, 1);
+  }
+  double dOutputRate = uiKept * source.toDouble() / vUnits.size();
+  std::printf("%-22s %8.3f -> %-8.3f %10.3f %13.1f%% %9zu %10zu\n", szName, source.toDouble(), target.toDouble(),
+    dOutputRate, 100.0 * (vUnits.size() - uiKept) / vUnits.size(), uiLongestGap, uiReferenceDropped);
+  return uiReferenceDropped == 0;
+}
+
+/// the payload size of a frame and whether it may be dropped
+struct SizedFrame
+{
+  uint32_t Bytes;
+  bool IsProtected;
+};
+
+/// a random size within +-uiJitter percent of uiBytes
+uint32_t jitterSize(uint32_t uiBytes, unsigned uiJitter)
+{
+  if (uiJitter == 0)
+    return uiBytes;
+  int iPercent = static_cast<int>(std::rand() % (2 * uiJitter + 1)) - static_cast<int>(uiJitter);
+  return static_cast<uint32_t>(uiBytes + static_cast<int64_t>(uiBytes) * iPercent / 100);
+}
+
+/**
+ * @brief the sizes of a stream with the GOP structure I B B P B B P ... The I and P frames are protected.
+ * A GOP of 1 gives frames of equal type as for raw video: uiIntra is then the size of every frame and none is protected.
+ */
+std::vector<SizedFrame> makeSizeTrace(size_t uiFrames, size_t uiGop, uint32_t uiIntra, uint32_t uiPredicted,
+  uint32_t uiBidirectional, unsigned uiJitter)
+{
+  std::vector<SizedFrame> vFrames(uiFrames);
+  for (size_t i = 0; i < uiFrames; ++i)
+  {
+    size_t uiPosition = i % uiGop;
+    SizedFrame& frame = vFrames[i];
+    if (uiGop == 1)
+    {
+      frame.Bytes = jitterSize(uiIntra, uiJitter);
+      frame.IsProtected = false;
+    }
+    else if (uiPosition == 0)
+    {
+      frame.Bytes = jitterSize(uiIntra, uiJitter);
+      frame.IsProtected = true;
+    }
+    else
+    {
+      frame.IsProtected = uiPosition % 3 == 0;
+      frame.Bytes = jitterSize(frame.IsProtected ? uiPredicted : uiBidirectional, uiJitter);
+    }
+  }
+  return vFrames;
+}
+
+/**
+ * @brief runs the bitrate budget mode over a size trace at 30 fps and checks the kept frames with a second pass.
+ * Disposable frames may never take the kept bytes of a window over the cap. Protected frames are always kept
+ * and may exceed it on their own: such windows are counted.
+ * @return false if a protected frame was dropped or a kept disposable frame exceeded the cap
+ */
+bool runBitrateBudget(const char* szName, const std::vector<SizedFrame>& vFrames, uint64_t uiMaxBitrate, int64_t iWindow)
+{
+  FrameSkippingEngine engine;
+  engine.setMode(FSKIP_BITRATE_BUDGET);
+  engine.setBitrateBudget(uiMaxBitrate, iWindow);
+
+  const RationalFrameRate frameRate(30, 1);
+  FrameDuration duration(frameRate);
+  std::vector<int64_t> vStart(vFrames.size());
+  FrameTimeline time;
+  for (size_t i = 0; i < vFrames.size(); ++i)
+  {
+    vStart[i] = time.getTime();
+    time.advance(duration, 1);
+  }
+
+  std::vector<bool> vKept(vFrames.size());
+  std::chrono::steady_clock::time_point tBegin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < vFrames.size(); ++i)
+  {
+    vKept[i] = engine.keepFrame(vStart[i], NULL, !vFrames[i].IsProtected, vFrames[i].Bytes);
+  }
+  double dNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - tBegin).count();
+
+  // the kept bytes in (start - window, start] at every kept frame
+  const double dBudgetBytes = uiMaxBitrate / 8.0 * iWindow / TIMESTAMP_TICKS_PER_SECOND;
+  uint64_t uiWindowBytes = 0, uiMaxWindowBytes = 0, uiInBytes = 0, uiOutBytes = 0;
+  size_t uiOldest = 0, uiKept = 0, uiProtectedDropped = 0, uiDisposableOver = 0, uiProtectedOver = 0;
+  for (size_t i = 0; i < vFrames.size(); ++i)
+  {
+    uiInBytes += vFrames[i].Bytes;
+    if (!vKept[i])
+    {
+      uiProtectedDropped += vFrames[i].IsProtected ? 1 : 0;
+      continue;
+    }
+    for (; vStart[uiOldest] <= vStart[i] - iWindow; ++uiOldest)
+      uiWindowBytes -= vKept[uiOldest] ? vFrames[uiOldest].Bytes : 0;
+    uiWindowBytes += vFrames[i].Bytes;
+    uiOutBytes += vFrames[i].Bytes;
+    ++uiKept;
+    uiMaxWindowBytes = std::max(uiMaxWindowBytes, uiWindowBytes);
+    if (uiWindowBytes > dBudgetBytes)
+      ++(vFrames[i].IsProtected ? uiProtectedOver : uiDisposableOver);
+  }
+  double dSeconds = vFrames.size() / frameRate.toDouble();
+  double dWindowSeconds = iWindow / static_cast<double>(TIMESTAMP_TICKS_PER_SECOND);
+  std::printf("%-26s %6.2f %5.1f %9.2f %9.2f %9.2f %7.1f%% %6zu %6zu %8.1f\n", szName, uiMaxBitrate / 1e6, dWindowSeconds,
+    uiInBytes * 8 / dSeconds / 1e6, uiOutBytes * 8 / dSeconds / 1e6, uiMaxWindowBytes * 8 / dWindowSeconds / 1e6,
+    100.0 * uiKept / vFrames.size(), uiProtectedOver, uiDisposableOver + uiProtectedDropped, dNs / vFrames.size());
+  return uiProtectedDropped == 0 && uiDisposableOver == 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t uiFrames = 6000;
+  size_t uiSliceBytes = 4000;
+  if (argc > 1) uiFrames = std::strtoul(argv[1], NULL, 10);
+  if (argc > 2) uiSliceBytes = std::strtoul(argv[2], NULL, 10);
+  if (uiFrames == 0)
+  {
+    std::fprintf(stderr, "Usage: %s [frames] [slice bytes]\n", argv[0]);
+    return 1;
+  }
+
+  std::srand(1);
+  std::vector<AccessUnit> vH264 = makeH264Stream(uiFrames, uiSliceBytes, 0);
+  std::vector<AccessUnit> vAvc1 = makeH264Stream(uiFrames, uiSliceBytes, 4);
+  std::vector<AccessUnit> vHevc = makeHevcStream(uiFrames, uiSliceBytes, 0);
+  std::vector<AccessUnit> vHvc1 = makeHevcStream(uiFrames, uiSliceBytes, 4);
+
+  std::printf("disposable access units, %zu byte slices\n", uiSliceBytes);
+  std::printf("%-22s %8s %11s %8s %10s %10s\n", "stream", "frames", "disposable", "errors", "MB/s", "ns/frame");
+  bool bOk = checkClassification("h264 annex b", FSKIP_CODEC_H264, 0, vH264);
+  bOk &= checkClassification("h264 avc1", FSKIP_CODEC_H264, 4, vAvc1);
+  bOk &= checkClassification("hevc annex b", FSKIP_CODEC_HEVC, 0, vHevc);
+  bOk &= checkClassification("hevc hvc1", FSKIP_CODEC_HEVC, 4, vHvc1);
+  bOk &= checkEdgeCases();
+  if (!bOk)
+  {
+    std::printf("FAILED: access units were classified incorrectly\n");
+    return 1;
+  }
+
+  std::printf("\nrational decimation ahead of the decoder: only disposable frames are dropped\n");
+  std::printf("%-22s %21s %10s %14s %9s %10s\n", "stream", "source -> target", "output fps", "not decoded", "max run", "refs lost");
+  const RationalFrameRate TARGETS[] = { RationalFrameRate(30, 1), RationalFrameRate(20, 1), RationalFrameRate(15, 1) };
+  for (const RationalFrameRate& target : TARGETS)
+  {
+    bOk &= runDecimation("h264 annex b", FSKIP_CODEC_H264, vH264, RationalFrameRate(60, 1), target);
+    bOk &= runDecimation("hevc annex b", FSKIP_CODEC_HEVC, vHevc, RationalFrameRate(60, 1), target);
+  }
+  if (!bOk)
+  {
+    std::printf("FAILED: a reference frame was dropped\n");
+    return 1;
+  }
+
+  // 30 fps GOPs of 120 KB I, 30 KB P and 12 KB B frames average about 5 Mbit/s
+  std::printf("\nbitrate budget: disposable frames are dropped to keep the kept payload of every window under the cap\n");
+  std::printf("%-26s %6s %5s %9s %9s %9s %8s %6s %6s %8s\n", "sizes", "Mbit/s", "win s", "in Mbit/s", "out", "max win",
+    "kept", "I/P >", "errors", "ns/frame");
+  const size_t BUDGET_FRAMES = std::max<size_t>(uiFrames, 3000);
+  const int64_t SECOND = TIMESTAMP_TICKS_PER_SECOND;
+  std::vector<SizedFrame> vGop30 = makeSizeTrace(BUDGET_FRAMES, 30, 120000, 30000, 12000, 30);
+  std::vector<SizedFrame> vGop90 = makeSizeTrace(BUDGET_FRAMES, 90, 120000, 30000, 12000, 30);
+  std::vector<SizedFrame> vExact = makeSizeTrace(BUDGET_FRAMES, 30, 120000, 30000, 12000, 0);
+  std::vector<SizedFrame> vRaw = makeSizeTrace(BUDGET_FRAMES, 1, 1000000, 0, 0, 0);
+  bOk &= runBitrateBudget("gop 30 +-30%", vGop30, 4000000, SECOND);
+  bOk &= runBitrateBudget("gop 30 +-30%", vGop30, 3500000, SECOND);
+  bOk &= runBitrateBudget("gop 30 +-30%", vGop30, 4000000, 10 * SECOND);
+  bOk &= runBitrateBudget("gop 30 exact", vExact, 4000000, SECOND);
+  bOk &= runBitrateBudget("gop 90 +-30%, I > window", vGop90, 4000000, SECOND);
+  bOk &= runBitrateBudget("gop 30, cap below I/P", vGop30, 2000000, SECOND);
+  bOk &= runBitrateBudget("raw 1 MB frames", vRaw, 80000000, SECOND);
+  bOk &= runBitrateBudget("raw 1 MB frames", vRaw, 80000000, 10 * SECOND);
+  if (!bOk)
+  {
+    std::printf("FAILED: a protected frame was dropped or a disposable frame exceeded the cap\n");
+    return 1;
+  }
+  return 0;
+}
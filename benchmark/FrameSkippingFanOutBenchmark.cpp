@@ -0,0 +1,223 @@
+/** @file
+
+MODULE                : FrameSkippingFanOutBenchmark
+
+FILE NAME             : FrameSkippingFanOutBenchmark.cpp
+
+DESCRIPTION           : Compares one FrameSkippingFanOut with one FrameSkippingEngine per output for a
+                        rate ladder. Verifies that both make the same decisions and that every output
+                        announces the rate it delivers, and reports the time per input frame.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingFanOut.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+
+const int64_t TICKS_PER_SECOND = 10000000;
+
+/// the settings of one output of the ladder
+FrameSkippingConfig makeOutput(unsigned uiMode, double dSourceFrameRate, double dTargetFrameRate)
+{
+  FrameSkippingConfig config;
+  config.Mode = uiMode;
+  config.SourceFrameRate = dSourceFrameRate;
+  config.TargetFrameRate = dTargetFrameRate;
+  config.RationalSourceFrameRate = RationalFrameRate::fromDouble(dSourceFrameRate);
+  config.RationalTargetFrameRate = RationalFrameRate::fromDouble(dTargetFrameRate);
+  if (uiMode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+    config.Pattern = SkipPatternCache::getInstance().getPattern(dSourceFrameRate, dTargetFrameRate);
+  if (uiMode == FSKIP_TEMPORAL_LAYERS)
+  {
+    // the dyadic layer closest to the target rate from below
+    config.TemporalLayers = 4;
+    config.MaxTemporalLayer = 3;
+    while (config.MaxTemporalLayer > 0 && dSourceFrameRate / (1 << (3 - config.MaxTemporalLayer)) > dTargetFrameRate)
+      --config.MaxTemporalLayer;
+  }
+  return config;
+}
+
+/// an I420 luma plane that changes every uiRepeat frames
+void fillFrame(std::vector<uint8_t>& vFrame, int iWidth, int iHeight, size_t uiFrame, size_t uiRepeat)
+{
+  uint8_t uiShift = static_cast<uint8_t>((uiFrame / uiRepeat) * 7);
+  for (int y = 0; y < iHeight; ++y)
+  {
+    for (int x = 0; x < iWidth; ++x)
+      vFrame[static_cast<size_t>(y) * iWidth + x] = static_cast<uint8_t>((x + y) * 3 + uiShift);
+  }
+}
+
+struct LadderResult
+{
+  LadderResult()
+    :Mismatches(0),
+    FanOutNs(0.0),
+    EnginesNs(0.0)
+  {
+
+  }
+
+  std::vector<size_t> Kept;
+  size_t Mismatches;
+  double FanOutNs;
+  double EnginesNs;
+};
+
+/**
+ * @brief runs the ladder through the fan-out and through independent engines.
+ * @param uiRepeat if not 0 every frame has an I420 picture that changes every uiRepeat frames
+ */
+LadderResult runLadder(const FrameSkippingFanOutConfig& config, double dSourceFrameRate, size_t uiFrames, size_t uiRepeat)
+{
+  const int WIDTH = 640, HEIGHT = 360;
+  std::vector<uint8_t> vFrame(uiRepeat > 0 ? static_cast<size_t>(WIDTH) * HEIGHT * 3 / 2 : 0);
+  FramePicture picture;
+  picture.Data = uiRepeat > 0 ? &vFrame[0] : NULL;
+  picture.Width = WIDTH;
+  picture.Height = HEIGHT;
+  picture.Stride = WIDTH;
+  picture.Format = FSKIP_PIXEL_FORMAT_I420;
+  const FramePicture* pPicture = uiRepeat > 0 ? &picture : NULL;
+
+  FrameSkippingFanOut fanOut;
+  fanOut.applyConfig(config);
+  std::vector<FrameSkippingEngine> vEngines(config.OutputCount);
+  for (unsigned i = 0; i < config.OutputCount; ++i)
+    vEngines[i].applyConfig(config.Outputs[i]);
+
+  LadderResult result;
+  result.Kept.resize(config.OutputCount);
+  std::vector<uint32_t> vMasks(uiFrames);
+  std::chrono::steady_clock::duration fanOutTime(0), enginesTime(0);
+  for (size_t uiFrame = 0; uiFrame < uiFrames; ++uiFrame)
+  {
+    int64_t tStart = static_cast<int64_t>(std::llround(uiFrame * TICKS_PER_SECOND / dSourceFrameRate));
+    if (uiRepeat > 0)
+      fillFrame(vFrame, WIDTH, HEIGHT, uiFrame, uiRepeat);
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t uiMask = fanOut.keepFrame(tStart, pPicture);
+    auto middle = std::chrono::steady_clock::now();
+    uint32_t uiExpected = 0;
+    for (unsigned i = 0; i < config.OutputCount; ++i)
+    {
+      if (vEngines[i].keepFrame(tStart, pPicture))
+        uiExpected |= 1u << i;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    fanOutTime += middle - start;
+    enginesTime += stop - middle;
+
+    result.Mismatches += uiMask != uiExpected ? 1 : 0;
+    for (unsigned i = 0; i < config.OutputCount; ++i)
+      result.Kept[i] += (uiMask >> i) & 1;
+  }
+  result.FanOutNs = std::chrono::duration<double, std::nano>(fanOutTime).count() / uiFrames;
+  result.EnginesNs = std::chrono::duration<double, std::nano>(enginesTime).count() / uiFrames;
+  return result;
+}
+
+const char* modeName(unsigned uiMode)
+{
+  switch (uiMode)
+  {
+  case FSKIP_SKIP_X_FRAMES_EVERY_Y: return "skip";
+  case FSKIP_ACHIEVE_TARGET_RATE: return "target";
+  case FSKIP_RATIONAL_DECIMATION: return "rational";
+  case FSKIP_DROP_DUPLICATES: return "duplicates";
+  case FSKIP_TEMPORAL_LAYERS: return "layers";
+  default: return "?";
+  }
+}
+
+/**
+ * @brief prints the rate of each output and checks it against the rate the output announces.
+ * @return false if the decisions differ from independent engines or an announced rate is off
+ */
+bool reportLadder(const char* szName, const FrameSkippingFanOutConfig& config, double dSourceFrameRate, size_t uiFrames,
+  size_t uiRepeat, bool bCheckRates)
+{
+  LadderResult result = runLadder(config, dSourceFrameRate, uiFrames, uiRepeat);
+  const int64_t iSourceDuration = static_cast<int64_t>(std::llround(TICKS_PER_SECOND / dSourceFrameRate));
+  std::printf("\n%s: %u outputs at %.3f fps\n", szName, config.OutputCount, dSourceFrameRate);
+  std::printf("%6s %10s %10s %10s %10s\n", "output", "mode", "target", "fps", "announced");
+  bool bOk = result.Mismatches == 0;
+  for (unsigned i = 0; i < config.OutputCount; ++i)
+  {
+    const FrameSkippingConfig& output = config.Outputs[i];
+    double dFps = result.Kept[i] * dSourceFrameRate / uiFrames;
+    int64_t iDuration = FrameSkippingEngine::getOutputFrameDuration(output, iSourceDuration);
+    double dAnnounced = iDuration > 0 ? TICKS_PER_SECOND / static_cast<double>(iDuration) : 0.0;
+    std::printf("%6u %10s %10.3f %10.3f %10.3f\n", i, modeName(output.Mode), output.TargetFrameRate, dFps, dAnnounced);
+    if (bCheckRates)
+      bOk &= std::fabs(dFps - dAnnounced) <= 0.01 * dAnnounced;
+  }
+  std::printf("decision mismatches %zu, fan-out %.1f ns/frame, independent engines %.1f ns/frame (%.2fx)\n",
+    result.Mismatches, result.FanOutNs, result.EnginesNs, result.EnginesNs / result.FanOutNs);
+  return bOk;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t uiFrames = argc > 1 ? static_cast<size_t>(std::strtoul(argv[1], NULL, 10)) : 600000;
+  const double SOURCE = 60.0;
+
+  // a rate ladder with one output per mode that follows a fixed cadence
+  FrameSkippingFanOutConfig ladder;
+  ladder.OutputCount = 5;
+  ladder.Outputs[0] = makeOutput(FSKIP_RATIONAL_DECIMATION, SOURCE, 60.0);
+  ladder.Outputs[1] = makeOutput(FSKIP_RATIONAL_DECIMATION, SOURCE, 30.0);
+  ladder.Outputs[2] = makeOutput(FSKIP_ACHIEVE_TARGET_RATE, SOURCE, 24.0);
+  ladder.Outputs[3] = makeOutput(FSKIP_SKIP_X_FRAMES_EVERY_Y, SOURCE, 20.0);
+  ladder.Outputs[4] = makeOutput(FSKIP_TEMPORAL_LAYERS, SOURCE, 15.0);
+  bool bOk = reportLadder("rate ladder", ladder, SOURCE, uiFrames, 0, true);
+
+  // duplicate elimination on every output: the fan-out computes the signature once per frame
+  FrameSkippingFanOutConfig duplicates;
+  duplicates.OutputCount = 4;
+  duplicates.Outputs[0] = makeOutput(FSKIP_DROP_DUPLICATES, SOURCE, 0.0);
+  duplicates.Outputs[1] = makeOutput(FSKIP_DROP_DUPLICATES, SOURCE, 20.0);
+  duplicates.Outputs[2] = makeOutput(FSKIP_DROP_DUPLICATES, SOURCE, 10.0);
+  duplicates.Outputs[3] = makeOutput(FSKIP_DROP_DUPLICATES, SOURCE, 5.0);
+  bOk &= reportLadder("duplicate ladder, each picture shown twice", duplicates, SOURCE, uiFrames / 100, 2, false);
+
+  if (!bOk)
+  {
+    std::printf("FAILED: the fan-out differs from independent engines or an output misreports its rate\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,370 @@
+/** @file
+
+MODULE                : LookaheadSelectorBenchmark
+
+FILE NAME             : LookaheadSelectorBenchmark.cpp
+
+DESCRIPTION           : Compares the distortion of the frames shown in place of dropped frames for the
+                        cadence of the rational decimation mode and lookahead windows of 4 to 16 frames
+                        on synthetic Y4M clips or a Y4M file.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingEngine.h"
+#include "LookaheadSelector.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/// a deterministic generator so that every run renders the same clips
+class ClipRandom
+{
+public:
+
+  explicit ClipRandom(uint32_t uiSeed)
+    :m_uiState(uiSeed)
+  {
+
+  }
+
+  uint32_t next()
+  {
+    m_uiState = m_uiState * 1664525u + 1013904223u;
+    return m_uiState >> 8;
+  }
+
+private:
+
+  uint32_t m_uiState;
+};
+
+/// the luma planes of a 4:2:0 Y4M clip
+struct Clip
+{
+  Clip()
+    :Width(0),
+    Height(0)
+  {
+
+  }
+
+  int Width;
+  int Height;
+  RationalFrameRate FrameRate;
+  std::vector<std::vector<uint8_t> > Frames;
+};
+
+/// how the content of a synthetic clip moves
+enum ClipMotion
+{
+  // a square stands still for 20 frames and then crosses 6 frames quickly
+  CLIP_BURSTS = 0,
+  // 24 fps motion repeated in a 3:2 cadence to 60 fps
+  CLIP_PULLDOWN = 1,
+  // steady motion with a flash every 25 frames
+  CLIP_FLASHES = 2
+};
+
+/**
+ * @brief renders a clip as a Y4M stream: a textured square over a textured background.
+ * The chroma planes are flat.
+ */
+std::string makeY4mClip(unsigned uiMotion, int iWidth, int iHeight, unsigned uiFrames)
+{
+  char szHeader[128];
+  std::snprintf(szHeader, sizeof(szHeader), "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", iWidth, iHeight);
+  std::string sClip(szHeader);
+  const size_t uiLuma = static_cast<size_t>(iWidth) * iHeight;
+  const size_t uiChroma = static_cast<size_t>((iWidth + 1) / 2) * ((iHeight + 1) / 2);
+  std::vector<uint8_t> vBackground(uiLuma);
+  ClipRandom random(7);
+  for (int y = 0; y < iHeight; ++y)
+  {
+    for (int x = 0; x < iWidth; ++x)
+      vBackground[static_cast<size_t>(y) * iWidth + x] = static_cast<uint8_t>(40 + (x + 2 * y) % 64 + random.next() % 24);
+  }
+  const int iSize = iHeight / 3;
+  std::vector<uint8_t> vFrame(uiLuma);
+  double dPosition = 0.0;
+  for (unsigned uiFrame = 0; uiFrame < uiFrames; ++uiFrame)
+  {
+    uint8_t uiFlash = 0;
+    switch (uiMotion)
+    {
+    case CLIP_BURSTS:
+      if (uiFrame % 26 >= 20)
+        dPosition += (iWidth - iSize) / 6.0;
+      break;
+    case CLIP_PULLDOWN:
+      // frames 0, 0, 0, 1, 1, 2, 2, 2, 3, 3 ... of the 24 fps source
+      dPosition = ((uiFrame / 5) * 2 + ((uiFrame % 5) >= 3 ? 1 : 0)) * 6.0;
+      break;
+    case CLIP_FLASHES:
+      dPosition += 3.0;
+      uiFlash = (uiFrame % 25 == 12) ? 100 : 0;
+      break;
+    }
+    int iLeft = static_cast<int>(std::fmod(dPosition, static_cast<double>(iWidth - iSize)));
+    int iTop = (iHeight - iSize) / 2;
+    for (int y = 0; y < iHeight; ++y)
+    {
+      for (int x = 0; x < iWidth; ++x)
+      {
+        size_t uiIndex = static_cast<size_t>(y) * iWidth + x;
+        bool bSquare = x >= iLeft && x < iLeft + iSize && y >= iTop && y < iTop + iSize;
+        uint8_t uiValue = bSquare ? static_cast<uint8_t>((((x - iLeft) / 4 + (y - iTop) / 4) & 1) ? 220 : 150) : vBackground[uiIndex];
+        vFrame[uiIndex] = static_cast<uint8_t>(std::min(255, uiValue + uiFlash));
+      }
+    }
+    sClip += "FRAME\n";
+    sClip.append(reinterpret_cast<const char*>(&vFrame[0]), uiLuma);
+    sClip.append(2 * uiChroma, static_cast<char>(128));
+  }
+  return sClip;
+}
+
+/// reads the luma planes of a Y4M stream with 4:2:0 chroma. Frame parameters are skipped.
+bool readY4mClip(const std::string& sData, Clip& clip)
+{
+  size_t uiEnd = sData.find('\n');
+  if (sData.compare(0, 10, "YUV4MPEG2 ") != 0 || uiEnd == std::string::npos)
+    return false;
+  std::string sHeader = sData.substr(10, uiEnd - 10);
+  clip.FrameRate = RationalFrameRate(30, 1);
+  size_t uiPos = 0;
+  while (uiPos < sHeader.size())
+  {
+    size_t uiNext = sHeader.find(' ', uiPos);
+    if (uiNext == std::string::npos)
+      uiNext = sHeader.size();
+    std::string sToken = sHeader.substr(uiPos, uiNext - uiPos);
+    unsigned uiNum = 0, uiDen = 0;
+    if (!sToken.empty() && sToken[0] == 'W')
+      clip.Width = std::atoi(sToken.c_str() + 1);
+    else if (!sToken.empty() && sToken[0] == 'H')
+      clip.Height = std::atoi(sToken.c_str() + 1);
+    else if (std::sscanf(sToken.c_str(), "F%u:%u", &uiNum, &uiDen) == 2 && uiNum > 0 && uiDen > 0)
+      clip.FrameRate = RationalFrameRate(uiNum, uiDen);
+    else if (!sToken.empty() && sToken[0] == 'C' && sToken.compare(0, 4, "C420") != 0)
+      return false;
+    uiPos = uiNext + 1;
+  }
+  if (clip.Width <= 0 || clip.Height <= 0)
+    return false;
+  const size_t uiLuma = static_cast<size_t>(clip.Width) * clip.Height;
+  const size_t uiChroma = static_cast<size_t>((clip.Width + 1) / 2) * ((clip.Height + 1) / 2);
+  uiPos = uiEnd + 1;
+  while (uiPos < sData.size())
+  {
+    uiEnd = sData.find('\n', uiPos);
+    if (sData.compare(uiPos, 5, "FRAME") != 0 || uiEnd == std::string::npos || uiEnd + 1 + uiLuma + 2 * uiChroma > sData.size())
+      break;
+    const uint8_t* pLuma = reinterpret_cast<const uint8_t*>(sData.data() + uiEnd + 1);
+    clip.Frames.push_back(std::vector<uint8_t>(pLuma, pLuma + uiLuma));
+    uiPos = uiEnd + 1 + uiLuma + 2 * uiChroma;
+  }
+  return !clip.Frames.empty();
+}
+
+/// the result of skipping a clip with a lookahead of some frames
+struct LookaheadResult
+{
+  size_t Kept;
+  size_t CadenceKept;
+  size_t ProtectedDropped;
+  // the mean absolute luma difference per pixel between each source frame and the frame shown in its place
+  double MeanDistortion;
+  double MaxDistortion;
+  double NsPerFrame;
+};
+
+/**
+ * @brief skips a clip to the target rate with the rational decimation mode and rearranges its decisions within
+ * windows of uiLookahead frames. A lookahead of 1 keeps the cadence.
+ * @param uiProtectedInterval every this many frames is protected. 0 = none
+ */
+LookaheadResult runLookahead(const Clip& clip, const RationalFrameRate& target, unsigned uiLookahead, unsigned uiProtectedInterval)
+{
+  FrameSkippingEngine engine;
+  engine.setMode(FSKIP_RATIONAL_DECIMATION);
+  engine.setRationalFrameRates(clip.FrameRate, target);
+  LookaheadSelector selector;
+  selector.setLookahead(uiLookahead);
+
+  FramePicture picture;
+  picture.Width = clip.Width;
+  picture.Height = clip.Height;
+  picture.Stride = clip.Width;
+  picture.Format = FSKIP_PIXEL_FORMAT_I420;
+
+  LookaheadResult result = LookaheadResult();
+  std::vector<bool> vKept(clip.Frames.size());
+  FrameDuration duration(clip.FrameRate);
+  FrameTimeline time;
+  size_t uiFirst = 0;
+  std::chrono::steady_clock::time_point tBegin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < clip.Frames.size(); ++i)
+  {
+    bool bProtected = uiProtectedInterval != 0 && i % uiProtectedInterval == 0;
+    bool bCadenceKept = engine.keepFrame(time.getTime(), NULL, !bProtected);
+    time.advance(duration, 1);
+    result.CadenceKept += bCadenceKept ? 1 : 0;
+    if (uiLookahead <= 1)
+    {
+      vKept[i] = bCadenceKept;
+      continue;
+    }
+    picture.Data = &clip.Frames[i][0];
+    selector.add(&picture, bProtected, bCadenceKept);
+    if (selector.isFull() || i + 1 == clip.Frames.size())
+    {
+      uint32_t uiKept = selector.select();
+      for (size_t j = uiFirst; j <= i; ++j)
+        vKept[j] = ((uiKept >> (j - uiFirst)) & 1) != 0;
+      uiFirst = i + 1;
+    }
+  }
+  result.NsPerFrame = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - tBegin).count() / clip.Frames.size();
+
+  const FrameKernels& kernels = getFrameKernels();
+  const size_t uiLuma = clip.Frames[0].size();
+  const std::vector<uint8_t>* pShown = NULL;
+  size_t uiMeasured = 0;
+  double dTotal = 0.0;
+  for (size_t i = 0; i < clip.Frames.size(); ++i)
+  {
+    if (vKept[i])
+    {
+      pShown = &clip.Frames[i];
+      ++result.Kept;
+    }
+    else if (uiProtectedInterval != 0 && i % uiProtectedInterval == 0)
+    {
+      ++result.ProtectedDropped;
+    }
+    if (pShown == NULL)
+      continue;
+    double dDistortion = kernels.Sad(&clip.Frames[i][0], &(*pShown)[0], uiLuma) / static_cast<double>(uiLuma);
+    dTotal += dDistortion;
+    result.MaxDistortion = std::max(result.MaxDistortion, dDistortion);
+    ++uiMeasured;
+  }
+  result.MeanDistortion = uiMeasured > 0 ? dTotal / uiMeasured : 0.0;
+  return result;
+}
+
+/**
+ * @brief compares the cadence with lookaheads of FSKIP_MIN_LOOKAHEAD to 16 frames.
+ * @return false if a lookahead changed the number of kept frames, dropped a protected frame or showed more
+ * distortion than the cadence
+ */
+bool runClip(const char* szName, const Clip& clip, const RationalFrameRate& target, unsigned uiProtectedInterval)
+{
+  const unsigned LOOKAHEADS[] = { 1, FSKIP_MIN_LOOKAHEAD, 8, 16 };
+  bool bOk = true;
+  double dCadence = 0.0;
+  for (unsigned uiLookahead : LOOKAHEADS)
+  {
+    LookaheadResult result = runLookahead(clip, target, uiLookahead, uiProtectedInterval);
+    if (uiLookahead == 1)
+      dCadence = result.MeanDistortion;
+    double dLatencyMs = (uiLookahead - 1) * 1000.0 / clip.FrameRate.toDouble();
+    std::printf("%-24s %7.2f %5u %10.1f %8zu %10.3f %8.1f%% %9.2f %9.1f\n", szName, target.toDouble(), uiLookahead, dLatencyMs,
+      result.Kept, result.MeanDistortion, dCadence > 0.0 ? 100.0 * (dCadence - result.MeanDistortion) / dCadence : 0.0,
+      result.MaxDistortion, result.NsPerFrame);
+    bOk &= result.Kept == result.CadenceKept && result.ProtectedDropped == 0;
+    bOk &= result.MeanDistortion <= dCadence;
+  }
+  return bOk;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::pair<std::string, Clip> > vClips;
+  if (argc > 1)
+  {
+    // a Y4M file in place of the synthetic clips
+    FILE* pFile = std::fopen(argv[1], "rb");
+    std::string sData;
+    if (pFile != NULL)
+    {
+      char aBuffer[65536];
+      size_t uiRead = 0;
+      while ((uiRead = std::fread(aBuffer, 1, sizeof(aBuffer), pFile)) > 0)
+        sData.append(aBuffer, uiRead);
+      std::fclose(pFile);
+    }
+    Clip clip;
+    if (!readY4mClip(sData, clip))
+    {
+      std::fprintf(stderr, "Usage: %s [4:2:0 y4m file]\n", argv[0]);
+      return 1;
+    }
+    vClips.push_back(std::make_pair(std::string(argv[1]), clip));
+  }
+  else
+  {
+    const char* NAMES[] = { "bursts", "3:2 pulldown", "flashes" };
+    for (unsigned uiMotion = CLIP_BURSTS; uiMotion <= CLIP_FLASHES; ++uiMotion)
+    {
+      Clip clip;
+      readY4mClip(makeY4mClip(uiMotion, 320, 180, 600), clip);
+      vClips.push_back(std::make_pair(std::string(NAMES[uiMotion]), clip));
+    }
+  }
+
+  std::printf("lookahead selection against the cadence of the rational decimation mode\n");
+  std::printf("%-24s %7s %5s %10s %8s %10s %9s %9s %9s\n", "clip", "target", "K", "latency ms", "kept", "distortion",
+    "better", "max", "ns/frame");
+  bool bOk = true;
+  for (size_t i = 0; i < vClips.size(); ++i)
+  {
+    const Clip& clip = vClips[i].second;
+    RationalFrameRate source = clip.FrameRate;
+    const RationalFrameRate TARGETS[] = { RationalFrameRate(source.Numerator, source.Denominator * 2).reduced(),
+      RationalFrameRate(source.Numerator * 2, source.Denominator * 5).reduced() };
+    for (const RationalFrameRate& target : TARGETS)
+      bOk &= runClip(vClips[i].first.c_str(), clip, target, 0);
+  }
+  // every 12th frame is a protected reference frame
+  bOk &= runClip("bursts, protected 1/12", vClips[0].second, RationalFrameRate(vClips[0].second.FrameRate.Numerator,
+    vClips[0].second.FrameRate.Denominator * 2).reduced(), 12);
+  if (!bOk)
+  {
+    std::printf("FAILED: the lookahead changed the output rate, dropped a protected frame or increased the distortion\n");
+    return 1;
+  }
+  return 0;
+}
@@ -14,6 +14,16 @@
 #define IDC_CMB_MODE                     1007
 #define IDC_SPIN4                        1008
 #define IDC_SPIN5                        1009
+#define IDC_EDIT_TEMPORAL_LAYERS         1010
+#define IDC_SPIN6                        1011
+#define IDC_EDIT_MAX_TEMPORAL_LAYER      1012
+#define IDC_SPIN7                        1013
+#define IDC_EDIT_BURST_DURATION          1014
+#define IDC_SPIN8                        1015
+#define IDC_EDIT_MAX_BITRATE             1016
+#define IDC_SPIN9                        1017
+#define IDC_EDIT_BITRATE_WINDOW          1018
+#define IDC_SPIN10                       1019
 
 // Next default values for new objects
 // 
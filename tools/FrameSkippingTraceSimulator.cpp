@@ -0,0 +1,984 @@
+/** @file
+
+MODULE                : FrameSkippingTraceSimulator
+
+FILE NAME             : FrameSkippingTraceSimulator.cpp
+
+DESCRIPTION           : Replays recorded timestamp traces through the FrameSkippingEngine with the settings of the
+                        filter. Binary and CSV traces of (stream id, start, stop, size, reference) are memory mapped. Prints the
+                        kept and dropped frame indices and per stream statistics such as the achieved rate,
+                        the longest gap and the jitter of the output intervals.
+
+LICENSE: Software License Agreement (BSD License)
+
+Copyright (c) 2014, CSIR
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+* Neither the name of the CSIR nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+===========================================================================
+*/
+#include "FrameSkippingEngine.h"
+#include "OutputPacer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+/**
+ * Binary traces start with a 16 byte header followed by fixed size little endian records.
+ * Stream ids and times are those of the media samples: times are in 100 ns units.
+ * Version 1 records end before the flags: their frames are all disposable.
+ */
+const char TRACE_MAGIC[8] = { 'F', 'S', 'K', 'T', 'R', 'A', 'C', 'E' };
+const uint32_t TRACE_VERSION = 2;
+// the size of a version 1 record
+const uint32_t TRACE_V1_RECORD_SIZE = 24;
+// other frames depend on the frame, e.g. a compressed reference frame: the engine never drops it
+const uint32_t TRACE_FLAG_REFERENCE = 1;
+
+struct TraceHeader
+{
+  char Magic[8];
+  uint32_t Version;
+  /// size of a record in bytes: later versions may append fields
+  uint32_t RecordSize;
+};
+
+struct TraceRecord
+{
+  uint32_t StreamId;
+  /// payload size of the sample in bytes, 0 if unknown. Was reserved and written as 0 before sizes were recorded.
+  uint32_t Bytes;
+  int64_t Start;
+  int64_t Stop;
+  /// TRACE_FLAG_* since version 2
+  uint32_t Flags;
+  uint32_t Reserved;
+};
+
+/// a read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+
+  MappedFile()
+    :m_pData(NULL),
+    m_uiSize(0)
+  {
+
+  }
+
+  ~MappedFile()
+  {
+    if (m_pData != NULL)
+      munmap(const_cast<char*>(m_pData), m_uiSize);
+  }
+
+  bool open(const char* szFileName)
+  {
+    int iFd = ::open(szFileName, O_RDONLY);
+    if (iFd < 0)
+      return false;
+    struct stat info;
+    if (fstat(iFd, &info) != 0)
+    {
+      close(iFd);
+      return false;
+    }
+    m_uiSize = static_cast<size_t>(info.st_size);
+    if (m_uiSize > 0)
+    {
+      void* pData = mmap(NULL, m_uiSize, PROT_READ, MAP_PRIVATE, iFd, 0);
+      if (pData == MAP_FAILED)
+      {
+        close(iFd);
+        return false;
+      }
+      // the trace is read once from front to back
+      madvise(pData, m_uiSize, MADV_SEQUENTIAL);
+      m_pData = static_cast<const char*>(pData);
+    }
+    close(iFd);
+    return true;
+  }
+
+  const char* getData() const { return m_pData; }
+  size_t getSize() const { return m_uiSize; }
+
+private:
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* m_pData;
+  size_t m_uiSize;
+};
+
+/// buffered text output without the formatting cost of printf per line
+class OutputBuffer
+{
+public:
+
+  explicit OutputBuffer(FILE* pFile)
+    :m_pFile(pFile),
+    m_uiUsed(0)
+  {
+
+  }
+
+  ~OutputBuffer()
+  {
+    flush();
+  }
+
+  void flush()
+  {
+    if (m_uiUsed > 0)
+      fwrite(m_aBuffer, 1, m_uiUsed, m_pFile);
+    m_uiUsed = 0;
+  }
+
+  void put(char c)
+  {
+    reserve(1);
+    m_aBuffer[m_uiUsed++] = c;
+  }
+
+  void put(int64_t iValue)
+  {
+    reserve(21);
+    uint64_t uiValue = static_cast<uint64_t>(iValue);
+    if (iValue < 0)
+    {
+      m_aBuffer[m_uiUsed++] = '-';
+      uiValue = 0 - uiValue;
+    }
+    char aDigits[20];
+    int iDigits = 0;
+    do
+    {
+      aDigits[iDigits++] = static_cast<char>('0' + uiValue % 10);
+      uiValue /= 10;
+    } while (uiValue != 0);
+    while (iDigits > 0)
+      m_aBuffer[m_uiUsed++] = aDigits[--iDigits];
+  }
+
+private:
+
+  void reserve(size_t uiBytes)
+  {
+    if (m_uiUsed + uiBytes > sizeof(m_aBuffer))
+      flush();
+  }
+
+  FILE* m_pFile;
+  size_t m_uiUsed;
+  char m_aBuffer[1 << 20];
+};
+
+/**
+ * @brief parses the lines "stream id, start, stop, size" of a CSV trace. Blank lines and lines that start with text such as
+ * headers are skipped. Lines that start with a number but are not a valid record are skipped and counted.
+ */
+class CsvTraceReader
+{
+public:
+
+  CsvTraceReader(const char* pData, size_t uiSize)
+    :m_pPos(pData),
+    m_pEnd(pData + uiSize),
+    m_uiLine(0),
+    m_uiRejected(0),
+    m_uiFirstRejected(0)
+  {
+
+  }
+
+  bool next(TraceRecord& record)
+  {
+    while (m_pPos < m_pEnd)
+    {
+      ++m_uiLine;
+      int64_t aFields[5];
+      int iFields = 0;
+      bool bValid = true;
+      while (m_pPos < m_pEnd && (*m_pPos == ' ' || *m_pPos == '\t'))
+        ++m_pPos;
+      if (m_pPos < m_pEnd && *m_pPos != '-' && static_cast<unsigned>(*m_pPos - '0') >= 10)
+      {
+        skipLine();
+        continue;
+      }
+      while (m_pPos < m_pEnd && *m_pPos != '\n')
+      {
+        while (m_pPos < m_pEnd && (*m_pPos == ' ' || *m_pPos == '\t'))
+          ++m_pPos;
+        if (m_pPos == m_pEnd || *m_pPos == '\n' || *m_pPos == '\r')
+          break;
+        int64_t iValue = 0;
+        if (iFields == 5 || !parseInteger(iValue))
+        {
+          bValid = false;
+          break;
+        }
+        aFields[iFields++] = iValue;
+        while (m_pPos < m_pEnd && (*m_pPos == ' ' || *m_pPos == '\t' || *m_pPos == '\r'))
+          ++m_pPos;
+        if (m_pPos < m_pEnd && *m_pPos == ',')
+          ++m_pPos;
+      }
+      skipLine();
+      if (iFields == 0 && bValid)
+        continue;
+      // the stop time, the size and the reference flag are optional
+      if (bValid && iFields >= 2 && aFields[0] >= 0 && aFields[0] <= UINT32_MAX
+        && (iFields < 4 || (aFields[3] >= 0 && aFields[3] <= UINT32_MAX))
+        && (iFields < 5 || aFields[4] == 0 || aFields[4] == 1))
+      {
+        record.StreamId = static_cast<uint32_t>(aFields[0]);
+        record.Bytes = (iFields >= 4) ? static_cast<uint32_t>(aFields[3]) : 0;
+        record.Start = aFields[1];
+        record.Stop = (iFields >= 3) ? aFields[2] : aFields[1];
+        record.Flags = (iFields == 5 && aFields[4] == 1) ? TRACE_FLAG_REFERENCE : 0;
+        record.Reserved = 0;
+        return true;
+      }
+      if (m_uiRejected++ == 0)
+        m_uiFirstRejected = m_uiLine;
+    }
+    return false;
+  }
+
+  /// the number of lines that started with a number but were not a valid record
+  uint64_t getRejectedLines() const { return m_uiRejected; }
+  uint64_t getFirstRejectedLine() const { return m_uiFirstRejected; }
+
+private:
+
+  /// parses a decimal integer that must be followed by a separator or the end of the line
+  bool parseInteger(int64_t& iValue)
+  {
+    bool bNegative = false;
+    if (*m_pPos == '-')
+    {
+      bNegative = true;
+      ++m_pPos;
+    }
+    const char* pStart = m_pPos;
+    uint64_t uiValue = 0;
+    while (m_pPos < m_pEnd && static_cast<unsigned>(*m_pPos - '0') < 10)
+    {
+      unsigned uiDigit = static_cast<unsigned>(*m_pPos - '0');
+      if (uiValue > (static_cast<uint64_t>(INT64_MAX) - uiDigit) / 10)
+        return false;
+      uiValue = uiValue * 10 + uiDigit;
+      ++m_pPos;
+    }
+    if (m_pPos == pStart)
+      return false;
+    if (m_pPos < m_pEnd && *m_pPos != ',' && *m_pPos != ' ' && *m_pPos != '\t' && *m_pPos != '\r' && *m_pPos != '\n')
+      return false;
+    iValue = bNegative ? -static_cast<int64_t>(uiValue) : static_cast<int64_t>(uiValue);
+    return true;
+  }
+
+  void skipLine()
+  {
+    const char* pNewline = static_cast<const char*>(memchr(m_pPos, '\n', m_pEnd - m_pPos));
+    m_pPos = (pNewline != NULL) ? pNewline + 1 : m_pEnd;
+  }
+
+  const char* m_pPos;
+  const char* m_pEnd;
+  uint64_t m_uiLine;
+  uint64_t m_uiRejected;
+  uint64_t m_uiFirstRejected;
+};
+
+/// spread of the intervals between consecutive kept frames
+struct IntervalStatistics
+{
+  IntervalStatistics()
+    :Count(0),
+    Sum(0.0),
+    SumOfSquares(0.0),
+    Max(0)
+  {
+
+  }
+
+  void add(int64_t iInterval)
+  {
+    ++Count;
+    Sum += iInterval;
+    SumOfSquares += static_cast<double>(iInterval) * iInterval;
+    Max = std::max(Max, iInterval);
+  }
+
+  /// standard deviation in milliseconds
+  double getDeviationMs() const
+  {
+    if (Count == 0)
+      return 0.0;
+    double dMean = Sum / Count;
+    return std::sqrt(std::max(SumOfSquares / Count - dMean * dMean, 0.0)) * 1000.0 / TIMESTAMP_FACTOR;
+  }
+
+  uint64_t Count;
+  double Sum;
+  double SumOfSquares;
+  int64_t Max;
+};
+
+struct StreamState
+{
+  StreamState(uint32_t uiStreamId)
+    :StreamId(uiStreamId),
+    Engine(new FrameSkippingEngine()),
+    FramesIn(0),
+    FramesOut(0),
+    DroppedRun(0),
+    MaxDroppedRun(0),
+    FirstKept(0),
+    LastKept(0),
+    LastPaced(0),
+    KeptBytes(0),
+    SourceRateChanges(0)
+  {
+
+  }
+
+  uint32_t StreamId;
+  std::unique_ptr<FrameSkippingEngine> Engine;
+  OutputPacer Pacer;
+  uint64_t FramesIn;
+  uint64_t FramesOut;
+  uint64_t DroppedRun;
+  uint64_t MaxDroppedRun;
+  int64_t FirstKept;
+  int64_t LastKept;
+  int64_t LastPaced;
+  // payload of the kept frames
+  uint64_t KeptBytes;
+  // the estimate of the source rate the pacer follows
+  uint64_t SourceRateChanges;
+  IntervalStatistics Intervals;
+  IntervalStatistics PacedIntervals;
+};
+
+enum PrintMode
+{
+  PRINT_NONE,
+  PRINT_KEPT,
+  PRINT_DROPPED,
+  PRINT_ALL
+};
+
+struct Options
+{
+  Options()
+    :TraceFile(NULL),
+    GenerateFile(NULL),
+    Print(PRINT_NONE),
+    MaxStreamsShown(32),
+    GenerateStreams(1),
+    GenerateFrames(1000),
+    GenerateFrameRate(30.0),
+    GenerateNoise(0),
+    GenerateBytes(0)
+  {
+
+  }
+
+  const char* TraceFile;
+  const char* GenerateFile;
+  FrameSkippingConfig Config;
+  PrintMode Print;
+  size_t MaxStreamsShown;
+  unsigned GenerateStreams;
+  uint64_t GenerateFrames;
+  double GenerateFrameRate;
+  int64_t GenerateNoise;
+  uint32_t GenerateBytes;
+};
+
+/**
+ * @brief replays the trace one frame at a time in file order, the way Transform sees the samples of each stream.
+ */
+class TraceSimulator
+{
+public:
+
+  TraceSimulator(const Options& options)
+    :m_options(options),
+    m_output(stdout),
+    m_uiFrames(0)
+  {
+
+  }
+
+  void process(const TraceRecord& record)
+  {
+    StreamState& stream = getStream(record.StreamId);
+    uint64_t uiIndex = m_uiFrames++;
+    ++stream.FramesIn;
+    bool bKeep = stream.Engine->keepFrame(record.Start, NULL, (record.Flags & TRACE_FLAG_REFERENCE) == 0, record.Bytes);
+    if (stream.Engine->getSourceRateChanges() != stream.SourceRateChanges)
+    {
+      stream.SourceRateChanges = stream.Engine->getSourceRateChanges();
+      stream.Pacer.setFrameRate(stream.Engine->getOutputFrameRate(), m_options.Config.MaxRepaceOffset);
+    }
+    int64_t tPacedStart = record.Start, tPacedStop = record.Stop;
+    if (bKeep)
+    {
+      if (stream.FramesOut > 0)
+        stream.Intervals.add(record.Start - stream.LastKept);
+      else
+        stream.FirstKept = record.Start;
+      stream.LastKept = record.Start;
+      stream.KeptBytes += record.Bytes;
+      if (m_options.Config.Repace)
+      {
+        int64_t iMediaStart = 0, iMediaStop = 0;
+        stream.Pacer.pace(record.Start, tPacedStart, tPacedStop, iMediaStart, iMediaStop);
+        if (stream.FramesOut > 0)
+          stream.PacedIntervals.add(tPacedStart - stream.LastPaced);
+        stream.LastPaced = tPacedStart;
+      }
+      ++stream.FramesOut;
+      stream.DroppedRun = 0;
+    }
+    else
+    {
+      stream.MaxDroppedRun = std::max(stream.MaxDroppedRun, ++stream.DroppedRun);
+    }
+
+    if (m_options.Print == PRINT_ALL || (bKeep ? m_options.Print == PRINT_KEPT : m_options.Print == PRINT_DROPPED))
+    {
+      // index,stream,start,stop,kept with the paced times of kept frames
+      m_output.put(static_cast<int64_t>(uiIndex));
+      m_output.put(',');
+      m_output.put(static_cast<int64_t>(record.StreamId));
+      m_output.put(',');
+      m_output.put(tPacedStart);
+      m_output.put(',');
+      m_output.put(tPacedStop);
+      m_output.put(',');
+      m_output.put(bKeep ? '1' : '0');
+      m_output.put('\n');
+    }
+  }
+
+  void finish()
+  {
+    m_output.flush();
+  }
+
+  uint64_t getFrameCount() const
+  {
+    return m_uiFrames;
+  }
+
+  void printSummary() const
+  {
+    std::vector<const StreamState*> vStreams;
+    for (const std::unique_ptr<StreamState>& pStream : m_vStreams)
+      vStreams.push_back(pStream.get());
+    std::sort(vStreams.begin(), vStreams.end(), [](const StreamState* pA, const StreamState* pB) { return pA->StreamId < pB->StreamId; });
+
+    FILE* pOut = (m_options.Print == PRINT_NONE) ? stdout : stderr;
+    bool bRepace = m_options.Config.Repace;
+    bool bEstimate = m_options.Config.EstimateSourceRate;
+    bool bBitrate = m_options.Config.Mode == FSKIP_BITRATE_BUDGET;
+    std::fprintf(pOut, "%10s %12s %12s %12s %10s %9s %10s %10s%s%s%s\n", "stream", "frames in", "kept", "dropped",
+      "fps", "max run", "max gap ms", "jitter ms", bRepace ? "  paced ms" : "", bEstimate ? " source fps  changes" : "",
+      bBitrate ? "     kbit/s" : "");
+    uint64_t uiIn = 0, uiOut = 0, uiMaxRun = 0;
+    int64_t iMaxGap = 0;
+    double dWorstJitter = 0.0;
+    size_t uiShown = 0;
+    for (const StreamState* pStream : vStreams)
+    {
+      const StreamState& stream = *pStream;
+      uiIn += stream.FramesIn;
+      uiOut += stream.FramesOut;
+      uiMaxRun = std::max(uiMaxRun, stream.MaxDroppedRun);
+      iMaxGap = std::max(iMaxGap, stream.Intervals.Max);
+      dWorstJitter = std::max(dWorstJitter, stream.Intervals.getDeviationMs());
+      if (uiShown++ >= m_options.MaxStreamsShown)
+        continue;
+      double dFps = (stream.FramesOut > 1 && stream.LastKept > stream.FirstKept)
+        ? (stream.FramesOut - 1) * TIMESTAMP_FACTOR / (stream.LastKept - stream.FirstKept) : 0.0;
+      std::fprintf(pOut, "%10u %12llu %12llu %12llu %10.3f %9llu %10.3f %10.3f", stream.StreamId,
+        static_cast<unsigned long long>(stream.FramesIn), static_cast<unsigned long long>(stream.FramesOut),
+        static_cast<unsigned long long>(stream.FramesIn - stream.FramesOut), dFps,
+        static_cast<unsigned long long>(stream.MaxDroppedRun), stream.Intervals.Max * 1000.0 / TIMESTAMP_FACTOR,
+        stream.Intervals.getDeviationMs());
+      if (bRepace)
+        std::fprintf(pOut, " %10.3f", stream.PacedIntervals.getDeviationMs());
+      if (bEstimate)
+      {
+        const RationalFrameRate& sourceFrameRate = stream.Engine->getEstimatedSourceFrameRate();
+        std::fprintf(pOut, " %6u/%-4u %8llu", sourceFrameRate.Numerator, sourceFrameRate.Denominator,
+          static_cast<unsigned long long>(stream.SourceRateChanges));
+      }
+      if (bBitrate)
+      {
+        // the payload of the kept frames over the span of their start times
+        double dKbps = stream.LastKept > stream.FirstKept
+          ? stream.KeptBytes * 8.0 * TIMESTAMP_FACTOR / (stream.LastKept - stream.FirstKept) / 1000.0 : 0.0;
+        std::fprintf(pOut, " %11.1f", dKbps);
+      }
+      std::fprintf(pOut, "\n");
+    }
+    if (vStreams.size() > m_options.MaxStreamsShown)
+      std::fprintf(pOut, "... %zu more streams\n", vStreams.size() - m_options.MaxStreamsShown);
+    std::fprintf(pOut, "%zu streams, %llu frames in, %llu kept, %llu dropped, longest dropped run %llu, "
+      "longest gap %.3f ms, worst jitter %.3f ms\n", vStreams.size(),
+      static_cast<unsigned long long>(uiIn), static_cast<unsigned long long>(uiOut),
+      static_cast<unsigned long long>(uiIn - uiOut), static_cast<unsigned long long>(uiMaxRun),
+      iMaxGap * 1000.0 / TIMESTAMP_FACTOR, dWorstJitter);
+  }
+
+private:
+
+  StreamState& getStream(uint32_t uiStreamId)
+  {
+    // most traces use small consecutive stream ids: larger ids go through the hash map
+    const uint32_t DENSE_IDS = 1 << 16;
+    int32_t iIndex = -1;
+    if (uiStreamId < DENSE_IDS)
+    {
+      if (uiStreamId < m_vDenseIndex.size())
+        iIndex = m_vDenseIndex[uiStreamId];
+    }
+    else
+    {
+      std::unordered_map<uint32_t, int32_t>::const_iterator it = m_sparseIndex.find(uiStreamId);
+      if (it != m_sparseIndex.end())
+        iIndex = it->second;
+    }
+    if (iIndex >= 0)
+      return *m_vStreams[iIndex];
+
+    iIndex = static_cast<int32_t>(m_vStreams.size());
+    if (uiStreamId < DENSE_IDS)
+    {
+      if (uiStreamId >= m_vDenseIndex.size())
+        m_vDenseIndex.resize(uiStreamId + 1, -1);
+      m_vDenseIndex[uiStreamId] = iIndex;
+    }
+    else
+    {
+      m_sparseIndex[uiStreamId] = iIndex;
+    }
+    m_vStreams.push_back(std::unique_ptr<StreamState>(new StreamState(uiStreamId)));
+    StreamState& stream = *m_vStreams.back();
+    // the same path as a filter that picks up a new snapshot
+    stream.Engine->applyConfig(m_options.Config);
+    stream.Engine->reset();
+    stream.Pacer.setFrameRate(stream.Engine->getOutputFrameRate(), m_options.Config.MaxRepaceOffset);
+    return stream;
+  }
+
+  const Options& m_options;
+  OutputBuffer m_output;
+  std::vector<std::unique_ptr<StreamState>> m_vStreams;
+  std::vector<int32_t> m_vDenseIndex;
+  std::unordered_map<uint32_t, int32_t> m_sparseIndex;
+  uint64_t m_uiFrames;
+};
+
+bool isBinaryTrace(const MappedFile& file)
+{
+  return file.getSize() >= sizeof(TraceHeader) && std::memcmp(file.getData(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0;
+}
+
+bool replayBinaryTrace(const MappedFile& file, TraceSimulator& simulator)
+{
+  TraceHeader header;
+  std::memcpy(&header, file.getData(), sizeof(header));
+  if (header.Version < 1 || header.Version > TRACE_VERSION
+    || header.RecordSize < (header.Version == 1 ? TRACE_V1_RECORD_SIZE : sizeof(TraceRecord)))
+  {
+    std::fprintf(stderr, "unsupported trace version %u with %u byte records\n", header.Version, header.RecordSize);
+    return false;
+  }
+  const char* pRecord = file.getData() + sizeof(TraceHeader);
+  size_t uiRecords = (file.getSize() - sizeof(TraceHeader)) / header.RecordSize;
+  for (size_t i = 0; i < uiRecords; ++i, pRecord += header.RecordSize)
+  {
+    TraceRecord record = TraceRecord();
+    std::memcpy(&record, pRecord, std::min<size_t>(header.RecordSize, sizeof(record)));
+    simulator.process(record);
+  }
+  return true;
+}
+
+/// returns false if lines of the trace had to be skipped
+bool replayCsvTrace(const MappedFile& file, TraceSimulator& simulator)
+{
+  CsvTraceReader reader(file.getData(), file.getSize());
+  TraceRecord record;
+  while (reader.next(record))
+    simulator.process(record);
+  if (reader.getRejectedLines() > 0)
+  {
+    std::fprintf(stderr, "skipped %llu malformed lines, the first is line %llu\n",
+      static_cast<unsigned long long>(reader.getRejectedLines()), static_cast<unsigned long long>(reader.getFirstRejectedLine()));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief writes a trace of interleaved streams at a constant frame rate with random timestamp noise.
+ * Files ending in .csv are written as CSV, all others in the binary format.
+ */
+bool generateTrace(const Options& options)
+{
+  FILE* pFile = std::fopen(options.GenerateFile, "wb");
+  if (pFile == NULL)
+  {
+    std::fprintf(stderr, "cannot create %s\n", options.GenerateFile);
+    return false;
+  }
+  size_t uiLength = std::strlen(options.GenerateFile);
+  bool bCsv = uiLength > 4 && std::strcmp(options.GenerateFile + uiLength - 4, ".csv") == 0;
+  OutputBuffer output(pFile);
+  if (bCsv)
+  {
+    std::fprintf(pFile, "stream,start,stop,size,reference\n");
+  }
+  else
+  {
+    TraceHeader header;
+    std::memcpy(header.Magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.Version = TRACE_VERSION;
+    header.RecordSize = sizeof(TraceRecord);
+    std::fwrite(&header, sizeof(header), 1, pFile);
+  }
+
+  std::vector<TraceRecord> vRecords(options.GenerateStreams);
+  FrameDuration duration(RationalFrameRate::fromDouble(options.GenerateFrameRate));
+  FrameTimeline time;
+  std::srand(1);
+  for (uint64_t uiFrame = 0; uiFrame < options.GenerateFrames; ++uiFrame)
+  {
+    FrameTimeline next = time;
+    next.advance(duration, 1);
+    for (unsigned uiStream = 0; uiStream < options.GenerateStreams; ++uiStream)
+    {
+      int64_t iNoise = 0;
+      if (options.GenerateNoise > 0)
+        iNoise = std::rand() % (2 * options.GenerateNoise + 1) - options.GenerateNoise;
+      TraceRecord& record = vRecords[uiStream];
+      record.StreamId = uiStream;
+      // sizes vary between half and one and a half times the mean
+      record.Bytes = options.GenerateBytes > 0
+        ? options.GenerateBytes / 2 + static_cast<uint32_t>(std::rand() % (options.GenerateBytes + 1)) : 0;
+      record.Start = time.getTime() + iNoise;
+      record.Stop = next.getTime() + iNoise;
+      record.Flags = 0;
+      record.Reserved = 0;
+      if (bCsv)
+      {
+        output.put(static_cast<int64_t>(record.StreamId));
+        output.put(',');
+        output.put(record.Start);
+        output.put(',');
+        output.put(record.Stop);
+        output.put(',');
+        output.put(static_cast<int64_t>(record.Bytes));
+        output.put(',');
+        output.put(static_cast<int64_t>(record.Flags & TRACE_FLAG_REFERENCE));
+        output.put('\n');
+      }
+    }
+    if (!bCsv)
+    {
+      output.flush();
+      std::fwrite(&vRecords[0], sizeof(TraceRecord), vRecords.size(), pFile);
+    }
+    time = next;
+  }
+  output.flush();
+  return std::fclose(pFile) == 0;
+}
+
+/// parses the whole value as a non-negative integer
+bool parseUnsigned(const char* szValue, uint64_t& uiValue)
+{
+  if (*szValue < '0' || *szValue > '9')
+    return false;
+  char* pEnd = NULL;
+  errno = 0;
+  unsigned long long uiParsed = std::strtoull(szValue, &pEnd, 10);
+  if (errno != 0 || *pEnd != '\0')
+    return false;
+  uiValue = uiParsed;
+  return true;
+}
+
+bool parseUnsigned(const char* szValue, unsigned& uiValue)
+{
+  uint64_t uiParsed = 0;
+  if (!parseUnsigned(szValue, uiParsed) || uiParsed > UINT_MAX)
+    return false;
+  uiValue = static_cast<unsigned>(uiParsed);
+  return true;
+}
+
+/// parses the whole value as a finite non-negative number
+bool parseNumber(const char* szValue, double& dValue)
+{
+  char* pEnd = NULL;
+  errno = 0;
+  double dParsed = std::strtod(szValue, &pEnd);
+  if (pEnd == szValue || *pEnd != '\0' || errno != 0 || !std::isfinite(dParsed) || dParsed < 0.0)
+    return false;
+  dValue = dParsed;
+  return true;
+}
+
+/// parses a duration in milliseconds into 100 ns units
+bool parseMilliseconds(const char* szValue, int64_t& iTicks)
+{
+  double dMs = 0.0;
+  if (!parseNumber(szValue, dMs) || dMs > 1e12)
+    return false;
+  iTicks = static_cast<int64_t>(dMs * TIMESTAMP_FACTOR / 1000.0);
+  return true;
+}
+
+bool parseRational(const char* szValue, RationalFrameRate& frameRate)
+{
+  unsigned uiNum = 0, uiDen = 1;
+  int iFields = std::sscanf(szValue, "%u/%u", &uiNum, &uiDen);
+  if (iFields < 1 || uiDen == 0)
+    return false;
+  frameRate = RationalFrameRate(uiNum, uiDen).reduced();
+  return true;
+}
+
+void printUsage(const char* szProgram)
+{
+  std::fprintf(stderr,
+    "Usage: %s [options] trace\n"
+    "       %s --generate file [--streams n] [--frames n] [--fps rate] [--noise ticks] [--bytes n]\n"
+    "Replays a binary or CSV trace of (stream id, start, stop, size, reference) through the frame skipping\n"
+    "engine. The stop time, the payload size in bytes and the reference flag are optional. Reference 1\n"
+    "marks a frame that other frames depend on, e.g. a compressed reference frame: it is never dropped.\n"
+    "Traces carry no pixels: in the drop duplicates mode every frame differs from the previous one.\n"
+    "  --mode n                 0 skip x of every y, 1 target rate, 2 rational, 3 drop duplicates,\n"
+    "                           4 temporal layers, 5 token bucket, 6 bitrate budget\n"
+    "  --source fps             source frame rate\n"
+    "  --target fps             target frame rate\n"
+    "  --source-rational n/d    exact source frame rate\n"
+    "  --target-rational n/d    exact target frame rate\n"
+    "  --max-duplicate-interval ms\n"
+    "  --temporal-layers n      number of dyadic temporal layers, default 4\n"
+    "  --max-temporal-layer n   highest layer kept, default 3\n"
+    "  --burst-duration ms      token bucket: missing frames caught up on after a stall\n"
+    "  --max-bitrate kbps       bitrate budget: cap on the payload of the kept frames, 0 = no limit\n"
+    "  --bitrate-window ms      bitrate budget: sliding window of the cap, default 1000\n"
+    "  --estimate-source-rate   estimate the source rate from the timestamps\n"
+    "  --repace                 re-pace kept frames onto the output grid\n"
+    "  --max-repace-offset ms\n"
+    "  --print kept|dropped|all print index,stream,start,stop,kept per frame to stdout\n"
+    "  --streams-shown n        number of streams in the summary, default 32\n"
+    "  --bytes n                generated traces: mean payload size per frame, default 0\n",
+    szProgram, szProgram);
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+  FrameSkippingConfig& config = options.Config;
+  bool bSourceRational = false, bTargetRational = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string sOption = argv[i];
+    if (sOption.compare(0, 2, "--") != 0)
+    {
+      if (options.TraceFile != NULL)
+        return false;
+      options.TraceFile = argv[i];
+      continue;
+    }
+    if (sOption == "--repace")
+    {
+      config.Repace = true;
+      continue;
+    }
+    if (sOption == "--estimate-source-rate")
+    {
+      config.EstimateSourceRate = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      return false;
+    const char* szValue = argv[++i];
+    bool bValid = true;
+    if (sOption == "--mode")
+      bValid = parseUnsigned(szValue, config.Mode) && config.Mode <= FSKIP_BITRATE_BUDGET;
+    else if (sOption == "--source")
+      bValid = parseNumber(szValue, config.SourceFrameRate);
+    else if (sOption == "--target")
+      bValid = parseNumber(szValue, config.TargetFrameRate);
+    else if (sOption == "--source-rational")
+      bValid = bSourceRational = parseRational(szValue, config.RationalSourceFrameRate);
+    else if (sOption == "--target-rational")
+      bValid = bTargetRational = parseRational(szValue, config.RationalTargetFrameRate);
+    else if (sOption == "--max-duplicate-interval")
+      bValid = parseMilliseconds(szValue, config.MaxDuplicateInterval);
+    else if (sOption == "--temporal-layers")
+      bValid = parseUnsigned(szValue, config.TemporalLayers) && config.TemporalLayers > 0 && config.TemporalLayers <= FSKIP_MAX_TEMPORAL_LAYERS;
+    else if (sOption == "--max-temporal-layer")
+      bValid = parseUnsigned(szValue, config.MaxTemporalLayer);
+    else if (sOption == "--burst-duration")
+      bValid = parseMilliseconds(szValue, config.BurstDuration);
+    else if (sOption == "--max-bitrate")
+    {
+      double dKbps = 0.0;
+      bValid = parseNumber(szValue, dKbps) && dKbps < 1e12;
+      config.MaxBitrate = static_cast<uint64_t>(dKbps * 1000.0);
+    }
+    else if (sOption == "--bitrate-window")
+      bValid = parseMilliseconds(szValue, config.BitrateWindow) && config.BitrateWindow > 0;
+    else if (sOption == "--max-repace-offset")
+      bValid = parseMilliseconds(szValue, config.MaxRepaceOffset);
+    else if (sOption == "--print")
+    {
+      std::string sValue = szValue;
+      if (sValue == "kept")
+        options.Print = PRINT_KEPT;
+      else if (sValue == "dropped")
+        options.Print = PRINT_DROPPED;
+      else if (sValue == "all")
+        options.Print = PRINT_ALL;
+      else
+        return false;
+    }
+    else if (sOption == "--streams-shown")
+    {
+      uint64_t uiShown = 0;
+      bValid = parseUnsigned(szValue, uiShown);
+      options.MaxStreamsShown = static_cast<size_t>(uiShown);
+    }
+    else if (sOption == "--generate")
+      options.GenerateFile = szValue;
+    else if (sOption == "--streams")
+      bValid = parseUnsigned(szValue, options.GenerateStreams);
+    else if (sOption == "--frames")
+      bValid = parseUnsigned(szValue, options.GenerateFrames);
+    else if (sOption == "--fps")
+      bValid = parseNumber(szValue, options.GenerateFrameRate);
+    else if (sOption == "--noise")
+    {
+      uint64_t uiNoise = 0;
+      bValid = parseUnsigned(szValue, uiNoise) && uiNoise <= INT32_MAX;
+      options.GenerateNoise = static_cast<int64_t>(uiNoise);
+    }
+    else if (sOption == "--bytes")
+    {
+      unsigned uiBytes = 0;
+      bValid = parseUnsigned(szValue, uiBytes) && uiBytes <= INT32_MAX;
+      options.GenerateBytes = uiBytes;
+    }
+    else
+      return false;
+    if (!bValid)
+    {
+      std::fprintf(stderr, "invalid value %s for %s\n", szValue, sOption.c_str());
+      return false;
+    }
+  }
+  // as in the filter the exact rates default to the floating point rates
+  if (!bSourceRational)
+    config.RationalSourceFrameRate = RationalFrameRate::fromDouble(config.SourceFrameRate);
+  if (!bTargetRational)
+    config.RationalTargetFrameRate = RationalFrameRate::fromDouble(config.TargetFrameRate);
+  if (config.Mode == FSKIP_SKIP_X_FRAMES_EVERY_Y)
+    config.Pattern = SkipPatternCache::getInstance().getPattern(config.SourceFrameRate, config.TargetFrameRate);
+  if (options.GenerateFile != NULL)
+    return options.GenerateStreams > 0 && options.GenerateFrameRate > 0.0;
+  return options.TraceFile != NULL;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  if (options.GenerateFile != NULL)
+    return generateTrace(options) ? 0 : 1;
+
+  MappedFile file;
+  if (!file.open(options.TraceFile))
+  {
+    std::fprintf(stderr, "cannot map %s\n", options.TraceFile);
+    return 1;
+  }
+
+  TraceSimulator simulator(options);
+  bool bOk = true;
+  auto start = std::chrono::steady_clock::now();
+  if (isBinaryTrace(file))
+  {
+    if (!replayBinaryTrace(file, simulator))
+      return 1;
+  }
+  else
+  {
+    bOk = replayCsvTrace(file, simulator);
+  }
+  simulator.finish();
+  auto stop = std::chrono::steady_clock::now();
+
+  simulator.printSummary();
+  double dSeconds = std::chrono::duration<double>(stop - start).count();
+  FILE* pOut = (options.Print == PRINT_NONE) ? stdout : stderr;
+  std::fprintf(pOut, "replayed %llu frames (%.1f MB) in %.3f s: %.1f million frames/s\n",
+    static_cast<unsigned long long>(simulator.getFrameCount()), file.getSize() / 1e6, dSeconds,
+    dSeconds > 0.0 ? simulator.getFrameCount() / dSeconds / 1e6 : 0.0);
+  return bOk ? 0 : 1;
+}